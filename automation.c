@@ -0,0 +1,464 @@
+/* -*- Mode: C ; c-basic-offset: 2 -*- */
+/*****************************************************************************
+ *
+ *   This file is part of jack_mixer
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <jack/ringbuffer.h>
+
+#include <glib.h>
+
+//#define LOG_LEVEL LOG_LEVEL_DEBUG
+#include "log.h"
+#include "automation.h"
+
+/*
+ * File format is text, one event per line, ordered by frame:
+ *
+ *   frame <TAB> type <TAB> in|out <TAB> channel name <TAB> input name or - <TAB> value
+ */
+
+#define AUTOMATION_DISK_PERIOD_US 50000
+#define AUTOMATION_LINE_MAX 1024
+
+static const char * automation_type_names[] =
+{
+  [AUTOMATION_VOLUME] = "volume",
+  [AUTOMATION_BALANCE] = "balance",
+  [AUTOMATION_OUT_MUTE] = "out_mute",
+  [AUTOMATION_SEND_MUTE] = "send_mute",
+};
+
+#define AUTOMATION_TYPES (sizeof(automation_type_names) / sizeof(automation_type_names[0]))
+
+struct automation
+{
+  bool record;
+  FILE * file;
+  struct automation_callbacks callbacks;
+  jack_ringbuffer_t * ring;
+  pthread_t thread;
+  bool stop;
+
+  /* relocation, written by the process callback */
+  uint32_t generation;
+  uint32_t relocate_frame;
+
+  /* disk thread only */
+  uint32_t fill_generation;     /* generation of events being produced */
+  GSList * chase_list;          /* last events before relocation frame */
+  struct automation_event pending; /* first event after relocation frame */
+  bool have_pending;
+  struct automation_event next; /* did not fit in the ring */
+  bool have_next;
+};
+
+static void
+automation_flush(
+  struct automation * automation_ptr)
+{
+  struct automation_event event;
+  char name[AUTOMATION_LINE_MAX];
+  char input_name[AUTOMATION_LINE_MAX];
+  bool output;
+  bool input_output;
+
+  while (jack_ringbuffer_read(automation_ptr->ring, (char *)&event, sizeof(event)) == sizeof(event))
+  {
+    if (event.type >= AUTOMATION_TYPES ||
+        !automation_ptr->callbacks.get_slot_name(automation_ptr->callbacks.context, event.slot, name, sizeof(name), &output))
+    {
+      continue;
+    }
+
+    strcpy(input_name, "-");
+    if (event.type == AUTOMATION_SEND_MUTE &&
+        !automation_ptr->callbacks.get_slot_name(automation_ptr->callbacks.context, event.input_slot, input_name, sizeof(input_name), &input_output))
+    {
+      continue;
+    }
+
+    fprintf(
+      automation_ptr->file,
+      "%" PRIu32 "\t%s\t%s\t%s\t%s\t%g\n",
+      event.frame,
+      automation_type_names[event.type],
+      output ? "out" : "in",
+      name,
+      input_name,
+      event.value);
+  }
+
+  fflush(automation_ptr->file);
+}
+
+/* read next line with channels that exist, key identifies the parameter */
+static bool
+automation_read_line(
+  struct automation * automation_ptr,
+  struct automation_event * event_ptr,
+  char * key,
+  size_t key_size)
+{
+  char line[AUTOMATION_LINE_MAX];
+  char * fields[6];
+  char * save_ptr;
+  unsigned int i;
+  int slot;
+  int input_slot;
+
+  while (fgets(line, sizeof(line), automation_ptr->file) != NULL)
+  {
+    line[strcspn(line, "\n")] = 0;
+
+    fields[0] = strtok_r(line, "\t", &save_ptr);
+    for (i = 1 ; i < 6 && fields[i - 1] != NULL ; i++)
+    {
+      fields[i] = strtok_r(NULL, "\t", &save_ptr);
+    }
+    if (i < 6 || fields[5] == NULL)
+    {
+      continue;
+    }
+
+    for (i = 0 ; i < AUTOMATION_TYPES ; i++)
+    {
+      if (strcmp(fields[1], automation_type_names[i]) == 0)
+      {
+        break;
+      }
+    }
+    if (i == AUTOMATION_TYPES)
+    {
+      continue;
+    }
+
+    slot = automation_ptr->callbacks.find_slot(automation_ptr->callbacks.context, fields[3], strcmp(fields[2], "out") == 0);
+    if (slot < 0)
+    {
+      continue;
+    }
+
+    input_slot = AUTOMATION_NO_SLOT;
+    if (i == AUTOMATION_SEND_MUTE)
+    {
+      input_slot = automation_ptr->callbacks.find_slot(automation_ptr->callbacks.context, fields[4], false);
+      if (input_slot < 0)
+      {
+        continue;
+      }
+    }
+
+    event_ptr->frame = strtoul(fields[0], NULL, 10);
+    event_ptr->generation = 0;
+    event_ptr->slot = slot;
+    event_ptr->input_slot = input_slot;
+    event_ptr->type = i;
+    event_ptr->value = strtof(fields[5], NULL);
+    event_ptr->node_ptr = NULL;
+
+    snprintf(key, key_size, "%u\t%d\t%d", i, slot, input_slot);
+
+    return true;
+  }
+
+  return false;
+}
+
+/* restart from frame, chasing the parameter values it had there */
+static void
+automation_seek(
+  struct automation * automation_ptr,
+  uint32_t frame)
+{
+  GHashTable * chase_table;
+  gpointer event_ptr;
+  struct automation_event event;
+  char key[64];
+
+  LOG_DEBUG("Automation playback from frame %" PRIu32, frame);
+
+  g_slist_free_full(automation_ptr->chase_list, g_free);
+  automation_ptr->chase_list = NULL;
+  automation_ptr->have_pending = false;
+  automation_ptr->have_next = false;
+
+  rewind(automation_ptr->file);
+
+  chase_table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+  while (automation_read_line(automation_ptr, &event, key, sizeof(key)))
+  {
+    if (event.frame >= frame)
+    {
+      automation_ptr->pending = event;
+      automation_ptr->have_pending = true;
+      break;
+    }
+
+    event.frame = frame;
+    event_ptr = g_hash_table_lookup(chase_table, key);
+    if (event_ptr != NULL)
+    {
+      *(struct automation_event *)event_ptr = event;
+    }
+    else
+    {
+      event_ptr = g_new(struct automation_event, 1);
+      *(struct automation_event *)event_ptr = event;
+      g_hash_table_insert(chase_table, g_strdup(key), event_ptr);
+      automation_ptr->chase_list = g_slist_prepend(automation_ptr->chase_list, event_ptr);
+    }
+  }
+
+  g_hash_table_destroy(chase_table);
+}
+
+static bool
+automation_next_event(
+  struct automation * automation_ptr,
+  struct automation_event * event_ptr)
+{
+  char key[64];
+  GSList * node_ptr;
+
+  if (automation_ptr->chase_list != NULL)
+  {
+    node_ptr = automation_ptr->chase_list;
+    *event_ptr = *(struct automation_event *)node_ptr->data;
+    g_free(node_ptr->data);
+    automation_ptr->chase_list = g_slist_delete_link(node_ptr, node_ptr);
+    return true;
+  }
+
+  if (automation_ptr->have_pending)
+  {
+    *event_ptr = automation_ptr->pending;
+    automation_ptr->have_pending = false;
+    return true;
+  }
+
+  return automation_read_line(automation_ptr, event_ptr, key, sizeof(key));
+}
+
+static void
+automation_fill(
+  struct automation * automation_ptr)
+{
+  uint32_t generation;
+
+  generation = __atomic_load_n(&automation_ptr->generation, __ATOMIC_ACQUIRE);
+  if (generation != automation_ptr->fill_generation)
+  {
+    automation_ptr->fill_generation = generation;
+    automation_seek(automation_ptr, __atomic_load_n(&automation_ptr->relocate_frame, __ATOMIC_RELAXED));
+  }
+
+  /* process callback did not tell transport position yet */
+  if (automation_ptr->fill_generation == 0)
+  {
+    return;
+  }
+
+  while (jack_ringbuffer_write_space(automation_ptr->ring) >= sizeof(struct automation_event))
+  {
+    if (!automation_ptr->have_next)
+    {
+      if (!automation_next_event(automation_ptr, &automation_ptr->next))
+      {
+        break;
+      }
+      automation_ptr->have_next = true;
+    }
+
+    automation_ptr->next.generation = automation_ptr->fill_generation;
+    automation_ptr->next.node_ptr = NULL;
+    if (automation_ptr->next.type == AUTOMATION_SEND_MUTE && automation_ptr->next.value != 0.0)
+    {
+      automation_ptr->next.node_ptr = g_slist_alloc();
+    }
+
+    jack_ringbuffer_write(automation_ptr->ring, (const char *)&automation_ptr->next, sizeof(struct automation_event));
+    automation_ptr->have_next = false;
+  }
+}
+
+static void *
+automation_thread(
+  void * arg)
+{
+  struct automation * automation_ptr = arg;
+
+  while (!__atomic_load_n(&automation_ptr->stop, __ATOMIC_ACQUIRE))
+  {
+    if (automation_ptr->record)
+    {
+      automation_flush(automation_ptr);
+    }
+    else
+    {
+      automation_fill(automation_ptr);
+    }
+
+    automation_ptr->callbacks.collect(automation_ptr->callbacks.context);
+
+    usleep(AUTOMATION_DISK_PERIOD_US);
+  }
+
+  if (automation_ptr->record)
+  {
+    automation_flush(automation_ptr);
+  }
+
+  return NULL;
+}
+
+struct automation *
+automation_start(
+  const char * path,
+  bool record,
+  const struct automation_callbacks * callbacks_ptr)
+{
+  struct automation * automation_ptr;
+
+  automation_ptr = calloc(1, sizeof(struct automation));
+  if (automation_ptr == NULL)
+  {
+    goto fail;
+  }
+
+  automation_ptr->record = record;
+  automation_ptr->callbacks = *callbacks_ptr;
+
+  automation_ptr->file = fopen(path, record ? "w" : "r");
+  if (automation_ptr->file == NULL)
+  {
+    LOG_ERROR("Cannot open automation file \"%s\"", path);
+    goto fail_free;
+  }
+
+  automation_ptr->ring = jack_ringbuffer_create(AUTOMATION_RING_EVENTS * sizeof(struct automation_event));
+  if (automation_ptr->ring == NULL)
+  {
+    goto fail_close;
+  }
+  jack_ringbuffer_mlock(automation_ptr->ring);
+
+  if (pthread_create(&automation_ptr->thread, NULL, automation_thread, automation_ptr) != 0)
+  {
+    LOG_ERROR("Cannot start automation disk thread");
+    goto fail_free_ring;
+  }
+
+  return automation_ptr;
+
+fail_free_ring:
+  jack_ringbuffer_free(automation_ptr->ring);
+
+fail_close:
+  fclose(automation_ptr->file);
+
+fail_free:
+  free(automation_ptr);
+
+fail:
+  return NULL;
+}
+
+void
+automation_stop(
+  struct automation * automation_ptr)
+{
+  struct automation_event event;
+
+  __atomic_store_n(&automation_ptr->stop, true, __ATOMIC_RELEASE);
+  pthread_join(automation_ptr->thread, NULL);
+
+  /* playback events the process callback did not consume */
+  while (jack_ringbuffer_read(automation_ptr->ring, (char *)&event, sizeof(event)) == sizeof(event))
+  {
+    if (event.node_ptr != NULL)
+    {
+      g_slist_free_1(event.node_ptr);
+    }
+  }
+
+  g_slist_free_full(automation_ptr->chase_list, g_free);
+  jack_ringbuffer_free(automation_ptr->ring);
+  fclose(automation_ptr->file);
+  free(automation_ptr);
+}
+
+bool
+automation_is_recording(
+  struct automation * automation_ptr)
+{
+  return automation_ptr->record;
+}
+
+bool
+automation_record(
+  struct automation * automation_ptr,
+  const struct automation_event * event_ptr)
+{
+  if (jack_ringbuffer_write_space(automation_ptr->ring) < sizeof(struct automation_event))
+  {
+    return false;
+  }
+
+  jack_ringbuffer_write(automation_ptr->ring, (const char *)event_ptr, sizeof(struct automation_event));
+  return true;
+}
+
+bool
+automation_peek(
+  struct automation * automation_ptr,
+  struct automation_event * event_ptr)
+{
+  return jack_ringbuffer_peek(automation_ptr->ring, (char *)event_ptr, sizeof(struct automation_event)) == sizeof(struct automation_event);
+}
+
+void
+automation_advance(
+  struct automation * automation_ptr)
+{
+  jack_ringbuffer_read_advance(automation_ptr->ring, sizeof(struct automation_event));
+}
+
+void
+automation_relocate(
+  struct automation * automation_ptr,
+  uint32_t frame)
+{
+  __atomic_store_n(&automation_ptr->relocate_frame, frame, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&automation_ptr->generation, 1, __ATOMIC_RELEASE);
+}
+
+uint32_t
+automation_generation(
+  struct automation * automation_ptr)
+{
+  return __atomic_load_n(&automation_ptr->generation, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,116 @@
+/* -*- Mode: C ; c-basic-offset: 2 -*- */
+/*****************************************************************************
+ *
+ *   This file is part of jack_mixer
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ *****************************************************************************/
+
+#ifndef AUTOMATION_H__0E6A3F2C_91B7_4D58_A4C2_6B8D1E7F3A95__INCLUDED
+#define AUTOMATION_H__0E6A3F2C_91B7_4D58_A4C2_6B8D1E7F3A95__INCLUDED
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Automation lane, recorded from or played back into the engine, keyed to
+ * JACK transport frames. The process callback exchanges events with a disk
+ * thread through a lock free ring; only the disk thread touches the file.
+ *
+ * Channels are referred to by slot, a small index the engine assigns to
+ * each channel. On disk they are referred to by name, the disk thread maps
+ * between the two through the callbacks.
+ */
+
+#define AUTOMATION_VOLUME    0 /* value is in dBFS */
+#define AUTOMATION_BALANCE   1
+#define AUTOMATION_OUT_MUTE  2
+#define AUTOMATION_SEND_MUTE 3 /* input_slot muted in output channel slot */
+
+#define AUTOMATION_SLOTS   512
+#define AUTOMATION_NO_SLOT 0xFFFF
+
+#define AUTOMATION_RING_EVENTS 4096 /* buffered between disk thread and process callback */
+
+struct automation_event
+{
+  uint32_t frame;               /* JACK transport frame */
+  uint32_t generation;          /* playback, see automation_relocate() */
+  uint16_t slot;
+  uint16_t input_slot;          /* AUTOMATION_SEND_MUTE */
+  uint32_t type;
+  float value;
+  void * node_ptr;              /* playback AUTOMATION_SEND_MUTE set, preallocated GSList node */
+};
+
+/* called from the disk thread */
+struct automation_callbacks
+{
+  void * context;
+  bool (* get_slot_name)(void * context, unsigned int slot, char * name, size_t size, bool * output_ptr);
+  int (* find_slot)(void * context, const char * name, bool output);
+  void (* collect)(void * context); /* free GSList nodes handed back by the process callback */
+};
+
+struct automation;
+
+/* will sleep */
+struct automation *
+automation_start(
+  const char * path,
+  bool record,
+  const struct automation_callbacks * callbacks_ptr);
+
+/* will sleep, process callback must not use automation anymore, unapplied
+ * playback list nodes are freed */
+void
+automation_stop(
+  struct automation * automation_ptr);
+
+/* will not sleep, to be called from the process callback only */
+
+bool
+automation_is_recording(
+  struct automation * automation_ptr);
+
+/* false if ring is full and event was dropped */
+bool
+automation_record(
+  struct automation * automation_ptr,
+  const struct automation_event * event_ptr);
+
+/* next playback event, false if none is buffered */
+bool
+automation_peek(
+  struct automation * automation_ptr,
+  struct automation_event * event_ptr);
+
+void
+automation_advance(
+  struct automation * automation_ptr);
+
+/* transport jumped, disk thread will refill from frame; buffered events
+ * of older generation are to be dropped */
+void
+automation_relocate(
+  struct automation * automation_ptr,
+  uint32_t frame);
+
+uint32_t
+automation_generation(
+  struct automation * automation_ptr);
+
+#endif /* #ifndef AUTOMATION_H__0E6A3F2C_91B7_4D58_A4C2_6B8D1E7F3A95__INCLUDED */
@@ -0,0 +1,306 @@
+/* -*- Mode: C ; c-basic-offset: 2 -*- */
+/*****************************************************************************
+ *
+ *   This file is part of jack_mixer
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <jack/ringbuffer.h>
+
+//#define LOG_LEVEL LOG_LEVEL_DEBUG
+#include "log.h"
+#include "capture.h"
+
+#define CAPTURE_DISK_PERIOD_US 10000
+#define CAPTURE_NAME_MAX 1024
+
+struct capture
+{
+  FILE * file;
+  struct capture_callbacks callbacks;
+  jack_ringbuffer_t * ring;
+  pthread_t thread;
+  bool stop;
+  bool failed;                  /* set by the process callback */
+
+  /* writer thread only */
+  char * payload;
+  size_t payload_size;
+  bool write_error;
+};
+
+static void
+capture_put(
+  struct capture * capture_ptr,
+  uint32_t type,
+  const void * payload_ptr,
+  size_t size)
+{
+  struct capture_record record;
+
+  record.type = type;
+  record.size = size;
+
+  if (capture_ptr->write_error)
+  {
+    return;
+  }
+
+  if (fwrite(&record, sizeof(record), 1, capture_ptr->file) != 1 ||
+      (size > 0 && fwrite(payload_ptr, size, 1, capture_ptr->file) != 1))
+  {
+    LOG_ERROR("Cannot write capture file");
+    capture_ptr->write_error = true;
+  }
+}
+
+/* follow channel appearance with its name, channel may be gone already */
+static void
+capture_put_name(
+  struct capture * capture_ptr,
+  const struct capture_channel * channel_ptr)
+{
+  struct
+  {
+    struct capture_name header;
+    char name[CAPTURE_NAME_MAX];
+  } record;
+  bool output;
+
+  if (!capture_ptr->callbacks.get_slot_name(capture_ptr->callbacks.context, channel_ptr->slot, record.name, sizeof(record.name), &output) ||
+      output != (channel_ptr->output != 0))
+  {
+    return;
+  }
+
+  record.header.slot = channel_ptr->slot;
+  capture_put(capture_ptr, CAPTURE_NAME, &record, sizeof(record.header) + strlen(record.name));
+}
+
+static void
+capture_flush(
+  struct capture * capture_ptr)
+{
+  struct capture_record record;
+  char * payload;
+
+  while (jack_ringbuffer_peek(capture_ptr->ring, (char *)&record, sizeof(record)) == sizeof(record) &&
+         jack_ringbuffer_read_space(capture_ptr->ring) >= sizeof(record) + record.size)
+  {
+    if (record.size > capture_ptr->payload_size)
+    {
+      payload = realloc(capture_ptr->payload, record.size);
+      if (payload == NULL)
+      {
+        LOG_ERROR("Cannot allocate %" PRIu32 " bytes for capture record", record.size);
+        jack_ringbuffer_read_advance(capture_ptr->ring, sizeof(record) + record.size);
+        capture_ptr->write_error = true;
+        continue;
+      }
+      capture_ptr->payload = payload;
+      capture_ptr->payload_size = record.size;
+    }
+
+    jack_ringbuffer_read_advance(capture_ptr->ring, sizeof(record));
+    jack_ringbuffer_read(capture_ptr->ring, capture_ptr->payload, record.size);
+
+    capture_put(capture_ptr, record.type, capture_ptr->payload, record.size);
+
+    if (record.type == CAPTURE_CHANNEL && record.size >= sizeof(struct capture_channel))
+    {
+      capture_put_name(capture_ptr, (const struct capture_channel *)capture_ptr->payload);
+    }
+  }
+
+  fflush(capture_ptr->file);
+}
+
+static void *
+capture_thread(
+  void * arg)
+{
+  struct capture * capture_ptr = arg;
+
+  while (!__atomic_load_n(&capture_ptr->stop, __ATOMIC_ACQUIRE))
+  {
+    capture_flush(capture_ptr);
+    usleep(CAPTURE_DISK_PERIOD_US);
+  }
+
+  capture_flush(capture_ptr);
+
+  if (__atomic_load_n(&capture_ptr->failed, __ATOMIC_ACQUIRE))
+  {
+    LOG_ERROR("Capture stopped early, writer thread could not keep up");
+    capture_put(capture_ptr, CAPTURE_OVERRUN, NULL, 0);
+  }
+
+  return NULL;
+}
+
+struct capture *
+capture_start(
+  const char * path,
+  const struct capture_callbacks * callbacks_ptr)
+{
+  struct capture * capture_ptr;
+
+  capture_ptr = calloc(1, sizeof(struct capture));
+  if (capture_ptr == NULL)
+  {
+    goto fail;
+  }
+
+  capture_ptr->callbacks = *callbacks_ptr;
+
+  capture_ptr->file = fopen(path, "wb");
+  if (capture_ptr->file == NULL)
+  {
+    LOG_ERROR("Cannot open capture file \"%s\"", path);
+    goto fail_free;
+  }
+
+  if (fwrite(CAPTURE_MAGIC, strlen(CAPTURE_MAGIC), 1, capture_ptr->file) != 1)
+  {
+    LOG_ERROR("Cannot write capture file \"%s\"", path);
+    goto fail_close;
+  }
+
+  capture_ptr->ring = jack_ringbuffer_create(CAPTURE_RING_SIZE);
+  if (capture_ptr->ring == NULL)
+  {
+    goto fail_close;
+  }
+  jack_ringbuffer_mlock(capture_ptr->ring);
+
+  if (pthread_create(&capture_ptr->thread, NULL, capture_thread, capture_ptr) != 0)
+  {
+    LOG_ERROR("Cannot start capture writer thread");
+    goto fail_free_ring;
+  }
+
+  return capture_ptr;
+
+fail_free_ring:
+  jack_ringbuffer_free(capture_ptr->ring);
+
+fail_close:
+  fclose(capture_ptr->file);
+
+fail_free:
+  free(capture_ptr);
+
+fail:
+  return NULL;
+}
+
+void
+capture_stop(
+  struct capture * capture_ptr)
+{
+  __atomic_store_n(&capture_ptr->stop, true, __ATOMIC_RELEASE);
+  pthread_join(capture_ptr->thread, NULL);
+
+  if (fclose(capture_ptr->file) != 0)
+  {
+    LOG_ERROR("Cannot write capture file");
+  }
+
+  jack_ringbuffer_free(capture_ptr->ring);
+  free(capture_ptr->payload);
+  free(capture_ptr);
+}
+
+bool
+capture_reserve(
+  struct capture * capture_ptr,
+  size_t size)
+{
+  if (capture_ptr->failed)
+  {
+    return false;
+  }
+
+  if (jack_ringbuffer_write_space(capture_ptr->ring) < size)
+  {
+    __atomic_store_n(&capture_ptr->failed, true, __ATOMIC_RELEASE);
+    return false;
+  }
+
+  return true;
+}
+
+bool
+capture_failed(
+  struct capture * capture_ptr)
+{
+  return capture_ptr->failed;
+}
+
+void
+capture_write(
+  struct capture * capture_ptr,
+  uint32_t type,
+  const void * payload_ptr,
+  size_t size)
+{
+  struct capture_record record;
+
+  if (!capture_reserve(capture_ptr, sizeof(record) + size))
+  {
+    return;
+  }
+
+  record.type = type;
+  record.size = size;
+  jack_ringbuffer_write(capture_ptr->ring, (const char *)&record, sizeof(record));
+  jack_ringbuffer_write(capture_ptr->ring, payload_ptr, size);
+}
+
+void
+capture_write_samples(
+  struct capture * capture_ptr,
+  uint32_t type,
+  unsigned int slot,
+  bool right,
+  const float * samples,
+  uint32_t nframes)
+{
+  struct capture_record record;
+  struct capture_buffer buffer;
+
+  record.type = type;
+  record.size = sizeof(buffer) + nframes * sizeof(float);
+
+  if (!capture_reserve(capture_ptr, sizeof(record) + record.size))
+  {
+    return;
+  }
+
+  buffer.slot = slot;
+  buffer.right = right;
+  jack_ringbuffer_write(capture_ptr->ring, (const char *)&record, sizeof(record));
+  jack_ringbuffer_write(capture_ptr->ring, (const char *)&buffer, sizeof(buffer));
+  jack_ringbuffer_write(capture_ptr->ring, (const char *)samples, nframes * sizeof(float));
+}
@@ -0,0 +1,209 @@
+/* -*- Mode: C ; c-basic-offset: 2 -*- */
+/*****************************************************************************
+ *
+ *   This file is part of jack_mixer
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ *****************************************************************************/
+
+#ifndef CAPTURE_H__7B2E4D91_C38A_4F06_9E15_A6D0F2B83C47__INCLUDED
+#define CAPTURE_H__7B2E4D91_C38A_4F06_9E15_A6D0F2B83C47__INCLUDED
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Capture of everything the process callback consumes and produces, for
+ * replaying it offline and comparing the output bit for bit. The process
+ * callback writes records into a lock free ring, a writer thread moves
+ * them into the file.
+ *
+ * The file is CAPTURE_MAGIC followed by records in native byte order, each
+ * a struct capture_record header followed by size bytes of payload. A
+ * cycle starts with CAPTURE_CYCLE, then come channel changes, input
+ * buffers and MIDI, parameter changes applied during the cycle and output
+ * buffers. Channels are referred to by automation slot.
+ */
+
+#define CAPTURE_MAGIC "JMCAPT01"
+
+#define CAPTURE_CYCLE    0  /* struct capture_cycle */
+#define CAPTURE_CHANNEL  1  /* struct capture_channel, channel appeared */
+#define CAPTURE_NAME     2  /* struct capture_name, added by writer thread after CAPTURE_CHANNEL */
+#define CAPTURE_REMOVE   3  /* struct capture_slot, channel disappeared */
+#define CAPTURE_STATE    4  /* struct capture_state, channel parameters changed */
+#define CAPTURE_ROUTING  5  /* struct capture_routing, input mute or solo in output changed */
+#define CAPTURE_INPUT    6  /* struct capture_buffer, input port samples */
+#define CAPTURE_MIDI     7  /* struct capture_midi, MIDI input event */
+#define CAPTURE_EVENT    8  /* struct capture_event, parameter change applied during cycle */
+#define CAPTURE_OUTPUT   9  /* struct capture_buffer, output port samples */
+#define CAPTURE_OVERRUN 10  /* no payload, writer lagged, capture ends with an incomplete cycle */
+
+#define CAPTURE_RING_SIZE (16 * 1024 * 1024)
+
+struct capture_record
+{
+  uint32_t type;
+  uint32_t size;
+};
+
+struct capture_cycle
+{
+  uint32_t nframes;
+  uint32_t sample_rate;
+  uint32_t frame_time;          /* jack_last_frame_time() */
+  uint32_t transport_rolling;
+  uint32_t transport_frame;
+};
+
+struct capture_channel
+{
+  uint32_t slot;
+  uint32_t output;
+  uint32_t stereo;
+  uint32_t system;
+};
+
+struct capture_slot
+{
+  uint32_t slot;
+};
+
+struct capture_name
+{
+  uint32_t slot;
+  char name[];                  /* up to end of record, not terminated */
+};
+
+/* parameters set from outside of the mix, a change in any of them is
+ * recorded with the whole channel state */
+struct capture_controls
+{
+  float volume;
+  float volume_new;
+  float balance;
+  float balance_new;
+  uint32_t out_mute;
+  uint32_t solo;
+  uint32_t prefader;
+  uint32_t double_precision;
+  uint32_t monitor_slot;        /* monitor source, AUTOMATION_NO_SLOT if none */
+  uint32_t monitor_prefader;
+  uint32_t agc_enabled;
+  float agc_target_db;
+  float agc_max_gain_db;
+  float agc_gate_db;
+};
+
+struct capture_state
+{
+  uint32_t slot;
+  struct capture_controls controls;
+  uint32_t volume_idx;
+  uint32_t balance_idx;
+  double agc_energy;
+  uint32_t agc_frames;
+  float agc_level;
+  float agc_gain;
+  float agc_gain_new;
+  uint32_t agc_gain_idx;
+};
+
+struct capture_routing
+{
+  uint32_t slot;                /* output channel */
+  uint32_t input_slot;
+  uint32_t muted;
+  uint32_t soloed;
+};
+
+struct capture_buffer
+{
+  uint32_t slot;
+  uint32_t right;
+  float samples[];              /* nframes of the cycle */
+};
+
+struct capture_midi
+{
+  uint32_t time;
+  uint32_t size;
+  uint8_t data[4];              /* first bytes of event */
+};
+
+struct capture_event
+{
+  uint32_t offset;              /* frame in cycle */
+  uint32_t type;                /* AUTOMATION_* */
+  uint32_t slot;
+  uint32_t input_slot;          /* AUTOMATION_SEND_MUTE */
+  float value;                  /* as in struct automation_event */
+};
+
+/* called from the writer thread */
+struct capture_callbacks
+{
+  void * context;
+  bool (* get_slot_name)(void * context, unsigned int slot, char * name, size_t size, bool * output_ptr);
+};
+
+struct capture;
+
+/* will sleep */
+struct capture *
+capture_start(
+  const char * path,
+  const struct capture_callbacks * callbacks_ptr);
+
+/* will sleep, process callback must not use capture anymore */
+void
+capture_stop(
+  struct capture * capture_ptr);
+
+/* will not sleep, to be called from the process callback only */
+
+/* false if there is no room for size bytes of records; capture is failed
+ * then and writes nothing more */
+bool
+capture_reserve(
+  struct capture * capture_ptr,
+  size_t size);
+
+bool
+capture_failed(
+  struct capture * capture_ptr);
+
+void
+capture_write(
+  struct capture * capture_ptr,
+  uint32_t type,
+  const void * payload_ptr,
+  size_t size);
+
+void
+capture_write_samples(
+  struct capture * capture_ptr,
+  uint32_t type,
+  unsigned int slot,
+  bool right,
+  const float * samples,
+  uint32_t nframes);
+
+/* bytes capture_write() and capture_write_samples() need */
+#define CAPTURE_RECORD_SIZE(payload_size) (sizeof(struct capture_record) + (payload_size))
+#define CAPTURE_SAMPLES_SIZE(nframes) CAPTURE_RECORD_SIZE(sizeof(struct capture_buffer) + (nframes) * sizeof(float))
+
+#endif /* #ifndef CAPTURE_H__7B2E4D91_C38A_4F06_9E15_A6D0F2B83C47__INCLUDED */
@@ -15,11 +15,13 @@
 # along with this program; if not, write to the Free Software
 # Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
 
+import os
 import gtk
 import gobject
 import slider
 import meter
 import abspeak
+import jack_mixer_c
 from serialization import SerializedObject
 
 try:
@@ -32,6 +34,8 @@ class Channel(gtk.VBox, SerializedObject):
     '''Widget with slider and meter used as base class for more specific
        channel widgets'''
     monitor_button = None
+    visible = True # inside the viewport, meters are polled only then
+    metered = False # subscribed to engine meters
 
     def __init__(self, app, name, stereo):
         gtk.VBox.__init__(self)
@@ -57,7 +61,7 @@ class Channel(gtk.VBox, SerializedObject):
     channel = None
     post_fader_output_channel = None
     def set_channel_name(self, name):
-        self.app.on_channel_rename(self._channel_name, name);
+        self.app.on_channel_rename(self._channel_name, name, self);
         self._channel_name = name
         if self.label_name:
             self.label_name.set_text(name)
@@ -69,6 +73,16 @@ class Channel(gtk.VBox, SerializedObject):
 
     def realize(self):
         #print "Realizing channel \"%s\"" % self.channel_name
+        if self.channel.restored:
+            # engine state survived a restart, it is newer than the session
+            self.future_out_mute = None
+            self.future_volume_midi_cc = None
+            self.future_balance_midi_cc = None
+            self.future_mute_midi_cc = None
+            self.future_solo_midi_cc = None
+            self.slider_adjustment.set_value_db(self.channel.volume)
+            self.balance_adjustment.set_value(self.channel.balance)
+
         if self.future_out_mute != None:
             self.channel.out_mute = self.future_out_mute
 
@@ -103,9 +117,21 @@ class Channel(gtk.VBox, SerializedObject):
         self.connect("key-press-event", self.on_key_pressed)
         self.connect("scroll-event", self.on_scroll)
 
+        self.set_metered(self.visible)
+
     def unrealize(self):
         #print "Unrealizing channel \"%s\"" % self.channel_name
-        pass
+        self.set_metered(False)
+
+    def set_metered(self, metered):
+        '''Engine meters the channel only while we subscribe'''
+        if metered == self.metered or not self.channel:
+            return
+        self.metered = metered
+        if metered:
+            self.channel.meter_subscribe(jack_mixer_c.METER_PEAK)
+        else:
+            self.channel.meter_unsubscribe(jack_mixer_c.METER_PEAK)
 
     def create_balance_widget(self):
         if self.gui_factory.use_custom_widgets and phat:
@@ -185,14 +211,13 @@ class Channel(gtk.VBox, SerializedObject):
         #print "volume digits focus out detected"
         self.update_volume(False)
 
-    def read_meter(self):
-        if not self.channel:
+    def read_meter(self, pixels=None):
+        if not self.channel or not self.visible:
             return
-        if self.stereo:
-            meter_left, meter_right = self.channel.meter
-            self.meter.set_values(meter_left, meter_right)
-        else:
-            self.meter.set_value(self.channel.meter[0])
+        if pixels is None:
+            pixels = jack_mixer_c.meters_to_pixels(self.meter.scale.scale,
+                            int(self.meter.height), [self.channel])[0]
+        self.meter.set_pixels(pixels)
 
         self.abspeak.set_peak(self.channel.abspeak)
 
@@ -211,7 +236,6 @@ class Channel(gtk.VBox, SerializedObject):
 
         if update_engine:
             self.channel.volume = db
-            self.app.update_monitor(self)
 
     def on_volume_changed(self, adjustment):
         self.update_volume(True)
@@ -220,7 +244,6 @@ class Channel(gtk.VBox, SerializedObject):
         balance = self.balance_adjustment.get_value()
         #print "%s balance: %f" % (self.channel_name, balance)
         self.channel.balance = balance
-        self.app.update_monitor(self)
 
     def on_key_pressed(self, widget, event):
         if (event.keyval == gtk.keysyms.Up):
@@ -274,6 +297,41 @@ class Channel(gtk.VBox, SerializedObject):
             return True
         return False
 
+    def reload_from(self, channel, frame_time):
+        '''Take settings of channel, unserialized from a session and not
+           realized, keeping our ports and connections. Gain changes are
+           scheduled at frame_time, for all strips to change in one cycle.'''
+        if channel.channel_name != self.channel_name:
+            self.channel_name = channel.channel_name
+
+        db = channel.slider_adjustment.get_value_db()
+        if db != self.slider_adjustment.get_value_db():
+            self.channel.volume_write_at(db, frame_time)
+            self.slider_adjustment.handler_block_by_func(self.on_volume_changed)
+            self.slider_adjustment.set_value_db(db)
+            self.slider_adjustment.handler_unblock_by_func(self.on_volume_changed)
+            self.update_volume(False)
+
+        balance = channel.balance_adjustment.get_value()
+        if balance != self.balance_adjustment.get_value():
+            self.channel.balance_write_at(balance, frame_time)
+            self.balance_adjustment.handler_block_by_func(self.on_balance_changed)
+            self.balance_adjustment.set_value(balance)
+            self.balance_adjustment.handler_unblock_by_func(self.on_balance_changed)
+
+        if channel.future_out_mute != None and channel.future_out_mute != self.channel.out_mute:
+            self.channel.out_mute_write_at(channel.future_out_mute, frame_time)
+            self.mute.handler_block_by_func(self.on_mute_toggled)
+            self.mute.set_active(channel.future_out_mute)
+            self.mute.handler_unblock_by_func(self.on_mute_toggled)
+
+        if channel.future_volume_midi_cc != None:
+            self.channel.volume_midi_cc = channel.future_volume_midi_cc
+        if channel.future_balance_midi_cc != None:
+            self.channel.balance_midi_cc = channel.future_balance_midi_cc
+        if channel.future_mute_midi_cc != None:
+            self.channel.mute_midi_cc = channel.future_mute_midi_cc
+
     def on_midi_event_received(self, *args):
         self.slider_adjustment.set_value_db(self.channel.volume)
         self.balance_adjustment.set_value(self.channel.balance)
@@ -296,12 +354,20 @@ class Channel(gtk.VBox, SerializedObject):
 
 class InputChannel(Channel):
     post_fader_output_channel = None
+    future_agc = None # (target, max gain, gate), from session
+    future_delay = None # ms, or 'auto' to follow port latencies, from session
+    player_file = None # audio file played instead of having ports
+    play_seen = False # player was seen playing since play was pressed
 
     def __init__(self, app, name, stereo):
         Channel.__init__(self, app, name, stereo)
 
     def realize(self):
-        self.channel = self.mixer.add_channel(self.channel_name, self.stereo)
+        if self.player_file != None:
+            self.channel = self.mixer.add_player_channel(self.channel_name, self.player_file)
+            self.stereo = self.channel.is_stereo
+        else:
+            self.channel = self.mixer.add_channel(self.channel_name, self.stereo)
         if self.channel == None:
             raise Exception,"Cannot create a channel"
         Channel.realize(self)
@@ -315,6 +381,10 @@ class InputChannel(Channel):
             self.channel.solo_midi_cc = self.future_solo_midi_cc
         if self.app._init_solo_channels and self.channel_name in self.app._init_solo_channels:
             self.channel.solo = True
+        if self.future_agc != None:
+            self.set_agc(*self.future_agc)
+        if self.future_delay != None:
+            self.set_delay(self.future_delay)
 
         self.channel.midi_scale = self.slider_scale.scale
 
@@ -353,6 +423,13 @@ class InputChannel(Channel):
         self.solo.connect("toggled", self.on_solo_toggled)
         self.hbox_mutesolo.pack_start(self.solo, True)
 
+        if self.channel.is_player:
+            self.play = gtk.ToggleButton()
+            self.play.set_label("P")
+            self.play.set_tooltip_text('Play %s from its start' % os.path.basename(self.player_file))
+            self.play.connect("toggled", self.on_play_toggled)
+            self.hbox_mutesolo.pack_start(self.play, True)
+
         self.vbox.pack_start(self.hbox_mutesolo, False)
 
         frame = gtk.Frame()
@@ -430,6 +507,50 @@ class InputChannel(Channel):
     def on_solo_toggled(self, button):
         self.channel.solo = self.solo.get_active()
 
+    def on_play_toggled(self, button):
+        if self.play.get_active():
+            self.play_seen = False
+            self.channel.play_at(self.mixer.frame_time)
+        elif self.channel.playing:
+            self.channel.stop_at(self.mixer.frame_time)
+
+    def read_meter(self, pixels=None):
+        Channel.read_meter(self, pixels)
+        # release play button once the end of file is played
+        if self.channel and self.channel.is_player and self.play.get_active():
+            if self.channel.playing:
+                self.play_seen = True
+            elif self.play_seen:
+                self.play.set_active(False)
+
+    def set_agc(self, target, max_gain, gate):
+        self.channel.agc_target = target
+        self.channel.agc_max_gain = max_gain
+        self.channel.agc_gate = gate
+        self.channel.agc = True
+
+    def set_delay(self, delay):
+        if delay == 'auto':
+            self.channel.delay_auto = True
+        else:
+            self.channel.delay_auto = False
+            self.channel.delay = delay
+
+    def reload_from(self, channel, frame_time):
+        Channel.reload_from(self, channel, frame_time)
+        if channel.future_agc != None:
+            self.set_agc(*channel.future_agc)
+        else:
+            self.channel.agc = False
+        if channel.future_delay != None:
+            self.set_delay(channel.future_delay)
+        else:
+            self.set_delay(0.0)
+        if channel.future_solo_midi_cc != None:
+            self.channel.solo_midi_cc = channel.future_solo_midi_cc
+        solo = bool(self.app._init_solo_channels) and self.channel_name in self.app._init_solo_channels
+        self.solo.set_active(solo)
+
     def midi_events_check(self):
         if self.channel.midi_in_got_events:
             self.mute.set_active(self.channel.out_mute)
@@ -469,6 +590,15 @@ class InputChannel(Channel):
             object_backend.add_property("type", "stereo")
         else:
             object_backend.add_property("type", "mono")
+        if self.channel.agc:
+            object_backend.add_property("agc", "%f|%f|%f" % (self.channel.agc_target,
+                            self.channel.agc_max_gain, self.channel.agc_gate))
+        if self.channel.delay_auto:
+            object_backend.add_property("delay", "auto")
+        elif self.channel.delay > 0:
+            object_backend.add_property("delay", "%f" % self.channel.delay)
+        if self.player_file != None:
+            object_backend.add_property("player", self.player_file)
         Channel.serialize(self, object_backend)
 
     def unserialize_property(self, name, value):
@@ -482,6 +612,18 @@ class InputChannel(Channel):
             if value == "mono":
                 self.stereo = False
                 return True
+        if name == "agc":
+            self.future_agc = tuple([float(x) for x in value.split('|')])
+            return True
+        if name == "delay":
+            if value == "auto":
+                self.future_delay = 'auto'
+            else:
+                self.future_delay = float(value)
+            return True
+        if name == "player":
+            self.player_file = str(value)
+            return True
         return Channel.unserialize_property(self, name, value)
 
 
@@ -498,6 +640,7 @@ available_colours = [
 class OutputChannel(Channel):
     colours = available_colours[:]
     _display_solo_buttons = False
+    future_double_precision = None
 
     _init_muted_channels = None
     _init_solo_channels = None
@@ -527,6 +670,9 @@ class OutputChannel(Channel):
             self.channel.balance_midi_cc = self.future_balance_midi_cc
         if self.future_mute_midi_cc != None:
             self.channel.mute_midi_cc = self.future_mute_midi_cc
+        if self.future_double_precision != None and not self.channel.restored:
+            self.channel.double_precision = self.future_double_precision
+        self.future_double_precision = None
         self.channel.midi_scale = self.slider_scale.scale
 
         self.on_volume_changed(self.slider_adjustment)
@@ -585,6 +731,8 @@ class OutputChannel(Channel):
         # appropriately
         for input_channel in self.app.channels:
             ctlgroup = input_channel.add_control_group(self)
+            if self.channel.restored:
+                continue
             if self._init_muted_channels and input_channel.channel.name in self._init_muted_channels:
                 ctlgroup.mute.set_active(True)
             if self._init_solo_channels and input_channel.channel.name in self._init_solo_channels:
@@ -633,6 +781,8 @@ class OutputChannel(Channel):
             object_backend.add_property("type", "mono")
         if self.display_solo_buttons:
             object_backend.add_property("solo_buttons", "true")
+        if self.channel.double_precision:
+            object_backend.add_property("double_precision", "true")
         muted_channels = []
         solo_channels = []
         for input_channel in self.app.channels:
@@ -661,6 +811,9 @@ class OutputChannel(Channel):
             if value == "true":
                 self.display_solo_buttons = True
                 return True
+        if name == "double_precision":
+            self.future_double_precision = value == "true"
+            return True
         if name == 'muted_channels':
             self._init_muted_channels = value.split('|')
             return True
@@ -669,6 +822,18 @@ class OutputChannel(Channel):
             return True
         return Channel.unserialize_property(self, name, value)
 
+    def reload_from(self, channel, frame_time):
+        Channel.reload_from(self, channel, frame_time)
+        if channel.display_solo_buttons != self.display_solo_buttons:
+            self.display_solo_buttons = channel.display_solo_buttons
+        self.channel.double_precision = bool(channel.future_double_precision)
+        muted_channels = channel._init_muted_channels or []
+        solo_channels = channel._init_solo_channels or []
+        for input_channel in self.app.channels:
+            ctlgroup = input_channel.get_control_group(self)
+            ctlgroup.mute.set_active(input_channel.channel_name in muted_channels)
+            ctlgroup.solo.set_active(input_channel.channel_name in solo_channels)
+
 class ChannelPropertiesDialog(gtk.Dialog):
     channel = None
 
@@ -777,6 +942,38 @@ class ChannelPropertiesDialog(gtk.Dialog):
                             self.on_sense_midi_solo_clicked)
             table.attach(self.button_sense_midi_solo, 2, 3, 3, 4)
 
+        if self.channel and isinstance(self.channel, InputChannel):
+            table = gtk.Table(2, 4, False)
+            vbox.pack_start(self.create_frame('Automatic Gain', table))
+            table.set_row_spacings(5)
+            table.set_col_spacings(5)
+
+            self.agc = gtk.CheckButton('Level input automatically')
+            table.attach(self.agc, 0, 2, 0, 1)
+            table.attach(gtk.Label('Target (dBFS)'), 0, 1, 1, 2)
+            self.agc_target = gtk.SpinButton(gtk.Adjustment(-20, -60, 0, 1, 6), digits=1)
+            table.attach(self.agc_target, 1, 2, 1, 2)
+            table.attach(gtk.Label('Maximum gain (dB)'), 0, 1, 2, 3)
+            self.agc_max_gain = gtk.SpinButton(gtk.Adjustment(12, 0, 40, 1, 6), digits=1)
+            table.attach(self.agc_max_gain, 1, 2, 2, 3)
+            table.attach(gtk.Label('Gate (dBFS)'), 0, 1, 3, 4)
+            self.agc_gate = gtk.SpinButton(gtk.Adjustment(-50, -90, 0, 1, 6), digits=1)
+            table.attach(self.agc_gate, 1, 2, 3, 4)
+
+        # players are not delayed
+        if self.channel and isinstance(self.channel, InputChannel) and not self.channel.channel.is_player:
+            table = gtk.Table(2, 2, False)
+            vbox.pack_start(self.create_frame('Delay', table))
+            table.set_row_spacings(5)
+            table.set_col_spacings(5)
+
+            table.attach(gtk.Label('Delay (ms)'), 0, 1, 0, 1)
+            self.delay = gtk.SpinButton(gtk.Adjustment(0, 0, jack_mixer_c.DELAY_MAX_MS, 0.1, 1), digits=2)
+            table.attach(self.delay, 1, 2, 0, 1)
+            self.delay_auto = gtk.CheckButton('Align with other inputs by port latency')
+            self.delay_auto.connect('toggled', self.on_delay_auto_toggled)
+            table.attach(self.delay_auto, 0, 2, 1, 2)
+
         self.vbox.show_all()
 
     def fill_ui(self):
@@ -791,6 +988,13 @@ class ChannelPropertiesDialog(gtk.Dialog):
         self.entry_mute_cc.set_text('%s' % self.channel.channel.mute_midi_cc)
         if (self.channel and isinstance(self.channel, InputChannel)):
             self.entry_solo_cc.set_text('%s' % self.channel.channel.solo_midi_cc)
+            self.agc.set_active(self.channel.channel.agc)
+            self.agc_target.set_value(self.channel.channel.agc_target)
+            self.agc_max_gain.set_value(self.channel.channel.agc_max_gain)
+            self.agc_gate.set_value(self.channel.channel.agc_gate)
+        if hasattr(self, 'delay_auto'):
+            self.delay.set_value(self.channel.channel.delay)
+            self.delay_auto.set_active(self.channel.channel.delay_auto)
 
     def sense_popup_dialog(self, entry):
         window = gtk.Window(gtk.WINDOW_TOPLEVEL)
@@ -859,8 +1063,23 @@ class ChannelPropertiesDialog(gtk.Dialog):
                     self.channel.channel.solo_midi_cc = int(self.entry_solo_cc.get_text())
             except ValueError:
                 pass
+            if hasattr(self, 'agc'):
+                if self.agc.get_active():
+                    self.channel.set_agc(self.agc_target.get_value(),
+                                    self.agc_max_gain.get_value(),
+                                    self.agc_gate.get_value())
+                else:
+                    self.channel.channel.agc = False
+            if hasattr(self, 'delay_auto'):
+                if self.delay_auto.get_active():
+                    self.channel.set_delay('auto')
+                else:
+                    self.channel.set_delay(self.delay.get_value())
         self.destroy()
 
+    def on_delay_auto_toggled(self, button):
+        self.delay.set_sensitive(not button.get_active())
+
     def on_entry_name_changed(self, entry):
         sensitive = False
         if len(entry.get_text()):
@@ -887,6 +1106,15 @@ class NewChannelDialog(ChannelPropertiesDialog):
         self.ok_button.set_sensitive(False)
         self.set_default_response(gtk.RESPONSE_OK);
 
+    def create_ui(self):
+        ChannelPropertiesDialog.create_ui(self)
+
+        self.player_file = gtk.FileChooserButton('Audio File')
+        self.player_file.set_tooltip_text('Play a WAV, W64 or FLAC file instead of having ports, stereo if the file is')
+        self.vbox.pack_start(self.create_frame('Player', self.player_file))
+
+        self.vbox.show_all()
+
     def fill_ui(self):
         self.entry_volume_cc.set_text('-1')
         self.entry_balance_cc.set_text('-1')
@@ -899,7 +1127,8 @@ class NewChannelDialog(ChannelPropertiesDialog):
                 'volume_cc': self.entry_volume_cc.get_text(),
                 'balance_cc': self.entry_balance_cc.get_text(),
                 'mute_cc': self.entry_mute_cc.get_text(),
-                'solo_cc': self.entry_solo_cc.get_text()
+                'solo_cc': self.entry_solo_cc.get_text(),
+                'player_file': self.player_file.get_filename()
                }
 
 class OutputChannelPropertiesDialog(ChannelPropertiesDialog):
@@ -912,15 +1141,21 @@ class OutputChannelPropertiesDialog(ChannelPropertiesDialog):
         self.display_solo_buttons = gtk.CheckButton('Display solo buttons')
         vbox.pack_start(self.display_solo_buttons)
 
+        self.double_precision = gtk.CheckButton('Sum inputs in double precision')
+        self.double_precision.set_tooltip_text('Output does not depend on the order of inputs, unless their levels are extremely far apart, at some processing cost')
+        vbox.pack_start(self.double_precision)
+
         self.vbox.show_all()
 
     def fill_ui(self):
         ChannelPropertiesDialog.fill_ui(self)
         self.display_solo_buttons.set_active(self.channel.display_solo_buttons)
+        self.double_precision.set_active(self.channel.channel.double_precision)
 
     def on_response_cb(self, dlg, response_id, *args):
         if response_id == gtk.RESPONSE_APPLY:
             self.channel.display_solo_buttons = self.display_solo_buttons.get_active()
+            self.channel.channel.double_precision = self.double_precision.get_active()
         ChannelPropertiesDialog.on_response_cb(self, dlg, response_id, *args)
 
 
@@ -954,6 +1189,7 @@ class NewOutputChannelDialog(OutputChannelPropertiesDialog):
                 'balance_cc': self.entry_balance_cc.get_text(),
                 'mute_cc': self.entry_mute_cc.get_text(),
                 'display_solo_buttons': self.display_solo_buttons.get_active(),
+                'double_precision': self.double_precision.get_active(),
                }
 
 
@@ -971,12 +1207,15 @@ class ControlGroup(gtk.Alignment):
         mute = gtk.ToggleButton()
         self.mute = mute
         mute.set_label("M")
+        # reflect routing already in the engine (restored from state file)
+        mute.set_active(output_channel.channel.is_muted(input_channel.channel))
         mute.connect("toggled", self.on_mute_toggled)
         hbox.pack_start(mute, False)
 
         solo = gtk.ToggleButton()
         self.solo = solo
         solo.set_label("S")
+        solo.set_active(output_channel.channel.is_solo(input_channel.channel))
         solo.connect("toggled", self.on_solo_toggled)
         if self.output_channel.display_solo_buttons:
             hbox.pack_start(solo, True)
@@ -999,9 +1238,7 @@ class ControlGroup(gtk.Alignment):
 
     def on_mute_toggled(self, button):
         self.output_channel.channel.set_muted(self.input_channel.channel, button.get_active())
-        self.app.update_monitor(self)
 
     def on_solo_toggled(self, button):
         self.output_channel.channel.set_solo(self.input_channel.channel, button.get_active())
-        self.app.update_monitor(self)
 
@@ -0,0 +1,279 @@
+/* -*- Mode: C ; c-basic-offset: 2 -*- */
+/*****************************************************************************
+ *
+ *   This file is part of jack_mixer
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ *****************************************************************************/
+
+/*
+ * Process callback benchmark on top of the JACK stub. Stereo input
+ * channels, all routed to one stereo output channel, are fed with noise;
+ * the time process() takes is measured for several channel counts, with
+ * planar and interleaved frame layout, with the output channel summing in
+ * float and in double precision. Summing kernels alone are measured too.
+ *
+ *   ./bench [cycles [buffer-size]]
+ */
+
+/* engine is built into the benchmark, to reach its kernels and channels */
+#include "jack_mixer.c"
+
+#include "jack_stub.h"
+
+#define BENCH_CYCLES_DEFAULT 20000
+#define BENCH_BUFFER_SIZE_DEFAULT 256
+#define BENCH_SAMPLE_RATE 48000
+#define BENCH_ROUNDS 5          /* best one is reported, layouts alternate */
+
+static double
+bench_now(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void
+bench_noise(
+  float * buffer_ptr,
+  unsigned int count,
+  unsigned int * seed_ptr)
+{
+  unsigned int i;
+
+  for (i = 0; i < count; i++)
+  {
+    *seed_ptr = *seed_ptr * 1103515245 + 12345;
+    buffer_ptr[i] = (int)((*seed_ptr >> 8) % 20001 - 10000) / 20000.0f;
+  }
+}
+
+/* seconds spent in process callback for cycles */
+static double
+bench_process(
+  struct jack_mixer * mixer_ptr,
+  float * noise_ptr,
+  unsigned int cycles)
+{
+  jack_nframes_t buffer_size = mixer_ptr->buffers_size;
+  GSList * list_ptr;
+  struct channel * channel_ptr;
+  unsigned int offset;
+  double start;
+  double total;
+
+  total = 0.0;
+  for (offset = 0; cycles > 0; cycles--, offset = (offset + 1) % buffer_size)
+  {
+    stub_cycle_begin(mixer_ptr->jack_client);
+
+    for (list_ptr = mixer_ptr->input_channels_list; list_ptr; list_ptr = g_slist_next(list_ptr))
+    {
+      channel_ptr = list_ptr->data;
+      memcpy(jack_port_get_buffer(channel_ptr->port_left, buffer_size), noise_ptr + offset, buffer_size * sizeof(float));
+      memcpy(jack_port_get_buffer(channel_ptr->port_right, buffer_size), noise_ptr + offset + 1, buffer_size * sizeof(float));
+    }
+
+    start = bench_now();
+    stub_cycle_process(mixer_ptr->jack_client);
+    total += bench_now() - start;
+
+    stub_cycle_end(mixer_ptr->jack_client);
+  }
+
+  return total;
+}
+
+/* seconds spent summing inputs into a bus, for cycles */
+static double
+bench_kernels(
+  unsigned int inputs,
+  unsigned int cycles,
+  unsigned int buffer_size,
+  float * noise_ptr,
+  bool precise)
+{
+  float * sum_ptr;
+  double * sum_double_ptr;
+  unsigned int i;
+  unsigned int j;
+  double start;
+
+  sum_ptr = calloc(buffer_size, sizeof(float));
+  sum_double_ptr = calloc(buffer_size, sizeof(double));
+
+  start = bench_now();
+  for (i = 0; i < cycles; i++)
+  {
+    /* both channels of the bus */
+    for (j = 0; j < 2 * inputs; j++)
+    {
+      if (precise)
+      {
+        kernel_accumulate_double(sum_double_ptr, noise_ptr + j % buffer_size, buffer_size);
+      }
+      else
+      {
+        kernel_accumulate(sum_ptr, noise_ptr + j % buffer_size, buffer_size);
+      }
+    }
+
+    if (precise)
+    {
+      kernel_round_double(sum_ptr, sum_double_ptr, buffer_size);
+      memset(sum_double_ptr, 0, buffer_size * sizeof(double));
+    }
+  }
+  start = bench_now() - start;
+
+  free(sum_ptr);
+  free(sum_double_ptr);
+
+  return start;
+}
+
+static void
+bench_report(
+  unsigned int inputs,
+  const char * what,
+  double float_time,
+  double double_time,
+  unsigned int cycles)
+{
+  printf(
+    "%6u  %-12s %10.2f %10.2f %+7.1f%%\n",
+    inputs,
+    what,
+    float_time * 1e6 / cycles,
+    double_time * 1e6 / cycles,
+    (double_time / float_time - 1.0) * 100.0);
+}
+
+static struct jack_mixer *
+bench_create(
+  unsigned int inputs,
+  unsigned int layout,
+  struct output_channel ** bus_ptr_ptr)
+{
+  struct jack_mixer * mixer_ptr;
+  struct channel * channel_ptr;
+  unsigned int i;
+  char name[32];
+
+  mixer_ptr = create("bench", false);
+  if (mixer_ptr == NULL)
+  {
+    fprintf(stderr, "bench: cannot create mixer\n");
+    exit(2);
+  }
+
+  /* before channels fill their buffers */
+  mixer_ptr->layout = layout;
+
+  *bus_ptr_ptr = add_output_channel(mixer_ptr, "bus", true, false);
+  channel_volume_write(*bus_ptr_ptr, 0.0);
+  for (i = 0; i < inputs; i++)
+  {
+    snprintf(name, sizeof(name), "in %u", i);
+    channel_ptr = add_channel(mixer_ptr, name, true);
+    channel_volume_write(channel_ptr, 0.0);
+  }
+
+  return mixer_ptr;
+}
+
+int
+main(
+  int argc,
+  char ** argv)
+{
+  static const unsigned int inputs_counts[] = {8, 32, 128};
+  static const char * layout_names[] = {"planar", "interleaved"};
+  unsigned int cycles = argc > 1 ? strtoul(argv[1], NULL, 10) : BENCH_CYCLES_DEFAULT;
+  unsigned int buffer_size = argc > 2 ? strtoul(argv[2], NULL, 10) : BENCH_BUFFER_SIZE_DEFAULT;
+  unsigned int inputs_max = inputs_counts[sizeof(inputs_counts) / sizeof(inputs_counts[0]) - 1];
+  struct jack_mixer * mixers[2];
+  struct output_channel * buses[2];
+  double float_times[2];
+  double double_times[2];
+  float * noise_ptr;
+  unsigned int seed;
+  unsigned int i;
+  unsigned int round;
+  unsigned int layout;
+  unsigned int inputs;
+  double float_time;
+  double double_time;
+
+  if (argc > 3 || cycles == 0 || buffer_size == 0 || buffer_size > STUB_MAX_BUFFER_SIZE)
+  {
+    fprintf(stderr, "usage: %s [cycles [buffer-size]]\n", argv[0]);
+    return 2;
+  }
+
+  /* room for the per cycle offset, and for inputs in bench_kernels() */
+  noise_ptr = malloc((2 * buffer_size + 2 * inputs_max) * sizeof(float));
+  seed = 1;
+  bench_noise(noise_ptr, 2 * buffer_size + 2 * inputs_max, &seed);
+
+  stub_configure(BENCH_SAMPLE_RATE, buffer_size);
+  kernels_init();
+
+  printf("%u frames, %s kernels, time per cycle in us\n", buffer_size, kernels_name());
+  printf("%6s  %-12s %10s %10s %8s\n", "inputs", "", "float", "double", "");
+
+  for (i = 0; i < sizeof(inputs_counts) / sizeof(inputs_counts[0]); i++)
+  {
+    inputs = inputs_counts[i];
+
+    for (layout = KERNELS_LAYOUT_PLANAR; layout <= KERNELS_LAYOUT_INTERLEAVED; layout++)
+    {
+      mixers[layout] = bench_create(inputs, layout, &buses[layout]);
+      /* warm up, and let volume ramps finish */
+      bench_process(mixers[layout], noise_ptr, 100);
+      float_times[layout] = double_times[layout] = HUGE_VAL;
+    }
+
+    for (round = 0; round < BENCH_ROUNDS; round++)
+    {
+      for (layout = KERNELS_LAYOUT_PLANAR; layout <= KERNELS_LAYOUT_INTERLEAVED; layout++)
+      {
+        output_channel_set_double_precision(buses[layout], false);
+        float_time = bench_process(mixers[layout], noise_ptr, cycles);
+        output_channel_set_double_precision(buses[layout], true);
+        double_time = bench_process(mixers[layout], noise_ptr, cycles);
+
+        float_times[layout] = fmin(float_times[layout], float_time);
+        double_times[layout] = fmin(double_times[layout], double_time);
+      }
+    }
+
+    for (layout = KERNELS_LAYOUT_PLANAR; layout <= KERNELS_LAYOUT_INTERLEAVED; layout++)
+    {
+      bench_report(inputs, layout_names[layout], float_times[layout], double_times[layout], cycles);
+      destroy(mixers[layout]);
+    }
+
+    float_time = bench_kernels(inputs, cycles, buffer_size, noise_ptr, false);
+    double_time = bench_kernels(inputs, cycles, buffer_size, noise_ptr, true);
+    bench_report(inputs, "sum only", float_time, double_time, cycles);
+  }
+
+  free(noise_ptr);
+
+  return 0;
+}
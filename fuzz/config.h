@@ -0,0 +1,4 @@
+/* configuration of the JACK stub build, see Makefile */
+
+#define HAVE_JACK_MIDI 1
+#define HAVE_JACK_LATENCY 1
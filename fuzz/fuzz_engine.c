@@ -0,0 +1,1361 @@
+/* -*- Mode: C ; c-basic-offset: 2 -*- */
+/*****************************************************************************
+ *
+ *   This file is part of jack_mixer
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ *****************************************************************************/
+
+/*
+ * Fuzz harness for the mixing engine, running on top of the JACK stub.
+ *
+ * Input is decoded into a sequence of engine API calls, process cycles with
+ * arbitrary audio (NaN, infinities and denormals included) and MIDI input
+ * (malformed events included), buffer size and sample rate changes. After
+ * each step engine invariants are checked and any violation aborts:
+ *
+ *  - port buffers are allocated exactly buffer size long, out of bounds
+ *    accesses are reported by AddressSanitizer;
+ *  - MIDI CC map and channels MIDI CC indices agree, and the map only
+ *    points to live channels;
+ *  - soloed channels are live channels;
+ *  - no ports are leaked;
+ *  - process callback does not allocate, free or lock, in the harness
+ *    thread or in worker threads; for this the engine allocation functions
+ *    are wrapped at link time, see Makefile;
+ *  - a mixer split into shard clients outputs the same as one that is not,
+ *    with scheduled and automation events splitting cycles.
+ *
+ * Built with libFuzzer, LLVMFuzzerTestOneInput() is the entry point. Other
+ * builds get a main() that runs the files given on command line, or
+ * standard input, once each, which is what AFL and crash reproduction need.
+ */
+
+/* engine is built into the harness, so its internals can be checked */
+#include "jack_mixer.c"
+
+#include <errno.h>
+#include <float.h>
+
+#include "jack_stub.h"
+
+#define FUZZ_CHANNELS_MAX 16
+#define FUZZ_MIDI_EVENTS_MAX 8
+#define FUZZ_COMPARE_CHANNELS_MAX 4
+#define FUZZ_COMPARE_CYCLES_MAX 4
+#define FUZZ_COMPARE_EVENTS_MAX 8   /* per cycle, and automation ones over all cycles */
+#define FUZZ_AUTOMATION_WAIT_MS 2000
+#define FUZZ_CHECK(condition, message)                                        \
+  do                                                                          \
+  {                                                                           \
+    if (!(condition))                                                         \
+    {                                                                         \
+      fprintf(stderr, "fuzz: %s (%s:%d)\n", message, __FILE__, __LINE__);     \
+      abort();                                                                \
+    }                                                                         \
+  } while (0)
+
+struct fuzz_input
+{
+  const uint8_t * data;
+  size_t size;
+};
+
+struct fuzz_state
+{
+  struct jack_mixer * mixer_ptr;
+  jack_client_t * client_ptr;
+  jack_mixer_scale_t scale;
+  struct channel * inputs[FUZZ_CHANNELS_MAX];
+  unsigned int inputs_count;
+  struct channel * outputs[FUZZ_CHANNELS_MAX];
+  unsigned int outputs_count;
+  unsigned int names;
+};
+
+/* same channels in a mixer not split and in a split one */
+struct fuzz_compare
+{
+  struct jack_mixer * mixers[2];
+  struct channel * inputs[2][FUZZ_COMPARE_CHANNELS_MAX];
+  unsigned int inputs_count;
+  struct channel * outputs[2][FUZZ_COMPARE_CHANNELS_MAX];
+  unsigned int outputs_count;
+};
+
+struct fuzz_thread
+{
+  void * (* start_routine)(void *);
+  void * arg;
+  bool realtime;
+};
+
+/* allocation check, see link flags in Makefile; disk threads of the engine
+ * may run during the process callback, they are not checked */
+
+static __thread bool fuzz_realtime_thread;
+static bool fuzz_creating_realtime; /* threads being created run process callback work */
+
+/* mutex whose locks are counted, see fuzz_wait_automation() */
+static pthread_mutex_t * fuzz_watched_mutex;
+static unsigned int fuzz_watched_locks;
+
+static void
+fuzz_check_realtime(
+  const char * function)
+{
+  if (stub_in_process && fuzz_realtime_thread)
+  {
+    fprintf(stderr, "fuzz: %s() called from the process callback\n", function);
+    abort();
+  }
+}
+
+#define FUZZ_WRAP(type, name, params, args)                                   \
+  type __real_ ## name params;                                                \
+  type __wrap_ ## name params                                                 \
+  {                                                                           \
+    fuzz_check_realtime(#name);                                               \
+    return __real_ ## name args;                                              \
+  }
+
+#define FUZZ_WRAP_VOID(name, params, args)                                    \
+  void __real_ ## name params;                                                \
+  void __wrap_ ## name params                                                 \
+  {                                                                           \
+    fuzz_check_realtime(#name);                                               \
+    __real_ ## name args;                                                     \
+  }
+
+FUZZ_WRAP(void *, malloc, (size_t size), (size))
+FUZZ_WRAP(void *, calloc, (size_t nmemb, size_t size), (nmemb, size))
+FUZZ_WRAP(void *, realloc, (void * ptr, size_t size), (ptr, size))
+FUZZ_WRAP_VOID(free, (void * ptr), (ptr))
+FUZZ_WRAP(gpointer, g_malloc, (gsize n_bytes), (n_bytes))
+FUZZ_WRAP_VOID(g_free, (gpointer mem), (mem))
+FUZZ_WRAP(gchar *, g_strdup, (const gchar * str), (str))
+FUZZ_WRAP(GSList *, g_slist_alloc, (void), ())
+FUZZ_WRAP(GSList *, g_slist_prepend, (GSList * list, gpointer data), (list, data))
+FUZZ_WRAP(GSList *, g_slist_append, (GSList * list, gpointer data), (list, data))
+FUZZ_WRAP(GSList *, g_slist_remove, (GSList * list, gconstpointer data), (list, data))
+FUZZ_WRAP_VOID(g_slist_free, (GSList * list), (list))
+FUZZ_WRAP_VOID(g_slist_free_1, (GSList * list), (list))
+
+int __real_pthread_mutex_lock(pthread_mutex_t * mutex);
+int
+__wrap_pthread_mutex_lock(
+  pthread_mutex_t * mutex)
+{
+  fuzz_check_realtime("pthread_mutex_lock");
+
+  if (mutex == __atomic_load_n(&fuzz_watched_mutex, __ATOMIC_ACQUIRE))
+  {
+    __atomic_fetch_add(&fuzz_watched_locks, 1, __ATOMIC_RELEASE);
+  }
+
+  return __real_pthread_mutex_lock(mutex);
+}
+
+static void *
+fuzz_thread_start(
+  void * arg)
+{
+  struct fuzz_thread thread;
+
+  thread = *(struct fuzz_thread *)arg;
+  free(arg);
+
+  fuzz_realtime_thread = thread.realtime;
+
+  return thread.start_routine(thread.arg);
+}
+
+int __real_pthread_create(pthread_t * thread, const pthread_attr_t * attr, void * (* start_routine)(void *), void * arg);
+int
+__wrap_pthread_create(
+  pthread_t * thread,
+  const pthread_attr_t * attr,
+  void * (* start_routine)(void *),
+  void * arg)
+{
+  struct fuzz_thread * thread_ptr;
+  int ret;
+
+  thread_ptr = malloc(sizeof(struct fuzz_thread));
+  if (thread_ptr == NULL)
+  {
+    return EAGAIN;
+  }
+
+  thread_ptr->start_routine = start_routine;
+  thread_ptr->arg = arg;
+  thread_ptr->realtime = fuzz_creating_realtime;
+
+  ret = __real_pthread_create(thread, attr, fuzz_thread_start, thread_ptr);
+  if (ret != 0)
+  {
+    free(thread_ptr);
+  }
+
+  return ret;
+}
+
+/* input decoding, zeros once input is exhausted */
+
+static uint8_t
+fuzz_byte(
+  struct fuzz_input * input_ptr)
+{
+  uint8_t byte;
+
+  if (input_ptr->size == 0)
+  {
+    return 0;
+  }
+
+  byte = input_ptr->data[0];
+  input_ptr->data++;
+  input_ptr->size--;
+
+  return byte;
+}
+
+static uint16_t
+fuzz_u16(
+  struct fuzz_input * input_ptr)
+{
+  return fuzz_byte(input_ptr) | (fuzz_byte(input_ptr) << 8);
+}
+
+static float
+fuzz_sample(
+  struct fuzz_input * input_ptr)
+{
+  uint8_t byte;
+
+  byte = fuzz_byte(input_ptr);
+  switch (byte)
+  {
+  case 0x80:
+    return NAN;
+  case 0x81:
+    return INFINITY;
+  case 0x82:
+    return -INFINITY;
+  case 0x83:
+    return 1e-40f;              /* denormal */
+  case 0x84:
+    return FLT_MAX;
+  case 0x85:
+    return -0.0f;
+  }
+
+  return (int8_t)byte / 64.0f;
+}
+
+/* in dBFS, or out of range values */
+static double
+fuzz_db(
+  struct fuzz_input * input_ptr)
+{
+  uint8_t byte;
+
+  byte = fuzz_byte(input_ptr);
+  switch (byte)
+  {
+  case 0x80:
+    return NAN;
+  case 0x81:
+    return INFINITY;
+  case 0x82:
+    return -INFINITY;
+  case 0x83:
+    return 1e30;
+  }
+
+  return (int8_t)byte / 2.0;
+}
+
+static struct channel *
+fuzz_input_channel(
+  struct fuzz_state * state_ptr,
+  struct fuzz_input * input_ptr)
+{
+  uint8_t byte;
+
+  byte = fuzz_byte(input_ptr);
+  if (state_ptr->inputs_count == 0)
+  {
+    return NULL;
+  }
+
+  return state_ptr->inputs[byte % state_ptr->inputs_count];
+}
+
+static struct channel *
+fuzz_output_channel(
+  struct fuzz_state * state_ptr,
+  struct fuzz_input * input_ptr)
+{
+  uint8_t byte;
+
+  byte = fuzz_byte(input_ptr);
+  if (state_ptr->outputs_count == 0)
+  {
+    return NULL;
+  }
+
+  return state_ptr->outputs[byte % state_ptr->outputs_count];
+}
+
+/* any channel, input or output */
+static struct channel *
+fuzz_channel(
+  struct fuzz_state * state_ptr,
+  struct fuzz_input * input_ptr)
+{
+  if (fuzz_byte(input_ptr) & 1)
+  {
+    return fuzz_output_channel(state_ptr, input_ptr);
+  }
+
+  return fuzz_input_channel(state_ptr, input_ptr);
+}
+
+static const char *
+fuzz_name(
+  struct fuzz_state * state_ptr,
+  struct fuzz_input * input_ptr,
+  char * buffer,
+  size_t size)
+{
+  uint8_t byte;
+
+  byte = fuzz_byte(input_ptr);
+  switch (byte % 4)
+  {
+  case 0:
+    /* unique */
+    snprintf(buffer, size, "channel %u", state_ptr->names++);
+    break;
+  case 1:
+    /* likely to clash */
+    snprintf(buffer, size, "clash %u", (unsigned int)(byte >> 6));
+    break;
+  case 2:
+    /* too long for JACK port name */
+    memset(buffer, 'n', size - 1);
+    buffer[size - 1] = 0;
+    break;
+  case 3:
+    buffer[0] = 0;
+    break;
+  }
+
+  return buffer;
+}
+
+/* invariants */
+
+static bool
+fuzz_is_live(
+  struct fuzz_state * state_ptr,
+  struct channel * channel_ptr)
+{
+  return g_slist_find(state_ptr->mixer_ptr->input_channels_list, channel_ptr) != NULL ||
+    g_slist_find(state_ptr->mixer_ptr->output_channels_list, channel_ptr) != NULL;
+}
+
+static void
+fuzz_check_channel_cc(
+  struct fuzz_state * state_ptr,
+  struct channel * channel_ptr,
+  int cc)
+{
+  if (cc == -1)
+  {
+    return;
+  }
+
+  FUZZ_CHECK(cc >= 0 && cc < 128, "channel MIDI CC out of range");
+  FUZZ_CHECK(state_ptr->mixer_ptr->midi_cc_map[cc] == channel_ptr, "channel MIDI CC not in map");
+}
+
+static void
+fuzz_check_channel(
+  struct fuzz_state * state_ptr,
+  struct channel * channel_ptr)
+{
+  fuzz_check_channel_cc(state_ptr, channel_ptr, channel_ptr->midi_cc_volume_index);
+  fuzz_check_channel_cc(state_ptr, channel_ptr, channel_ptr->midi_cc_balance_index);
+  fuzz_check_channel_cc(state_ptr, channel_ptr, channel_ptr->midi_cc_mute_index);
+  fuzz_check_channel_cc(state_ptr, channel_ptr, channel_ptr->midi_cc_solo_index);
+}
+
+static void
+fuzz_check(
+  struct fuzz_state * state_ptr)
+{
+  struct channel * channel_ptr;
+  GSList * node_ptr;
+  unsigned int ports;
+  unsigned int clients_ports;
+  unsigned int i;
+  int cc;
+
+  for (cc = 0 ; cc < 128 ; cc++)
+  {
+    channel_ptr = state_ptr->mixer_ptr->midi_cc_map[cc];
+    if (channel_ptr == NULL)
+    {
+      continue;
+    }
+
+    FUZZ_CHECK(fuzz_is_live(state_ptr, channel_ptr), "MIDI CC map points to removed channel");
+    FUZZ_CHECK(channel_ptr->midi_cc_volume_index == cc ||
+               channel_ptr->midi_cc_balance_index == cc ||
+               channel_ptr->midi_cc_mute_index == cc ||
+               channel_ptr->midi_cc_solo_index == cc,
+               "MIDI CC map points to channel not using the CC");
+  }
+
+#if defined(HAVE_JACK_MIDI)
+  ports = 2;
+#else
+  ports = 0;
+#endif
+
+  for (node_ptr = state_ptr->mixer_ptr->input_channels_list; node_ptr; node_ptr = g_slist_next(node_ptr))
+  {
+    channel_ptr = node_ptr->data;
+    fuzz_check_channel(state_ptr, channel_ptr);
+    ports += channel_ptr->stereo ? 2 : 1;
+  }
+
+  for (node_ptr = state_ptr->mixer_ptr->output_channels_list; node_ptr; node_ptr = g_slist_next(node_ptr))
+  {
+    channel_ptr = node_ptr->data;
+    fuzz_check_channel(state_ptr, channel_ptr);
+    ports += channel_ptr->stereo ? 2 : 1;
+  }
+
+  for (node_ptr = state_ptr->mixer_ptr->soloed_channels; node_ptr; node_ptr = g_slist_next(node_ptr))
+  {
+    FUZZ_CHECK(fuzz_is_live(state_ptr, node_ptr->data), "removed channel is soloed");
+  }
+
+  /* sync ports of shards */
+  clients_ports = stub_port_count(state_ptr->client_ptr);
+  for (i = 0 ; i < state_ptr->mixer_ptr->shards_count ; i++)
+  {
+    clients_ports += stub_port_count(state_ptr->mixer_ptr->shards[i].jack_client);
+    ports += i == 0 ? 2 : 1;
+  }
+
+  FUZZ_CHECK(clients_ports == ports, "JACK ports leaked");
+}
+
+/* steps */
+
+static void
+fuzz_add_channel(
+  struct fuzz_state * state_ptr,
+  struct fuzz_input * input_ptr,
+  bool output)
+{
+  char name[300];
+  bool stereo;
+  struct channel * channel_ptr;
+
+  stereo = fuzz_byte(input_ptr) & 1;
+  fuzz_name(state_ptr, input_ptr, name, sizeof(name));
+
+  if (output)
+  {
+    if (state_ptr->outputs_count == FUZZ_CHANNELS_MAX)
+    {
+      return;
+    }
+    channel_ptr = add_output_channel(state_ptr->mixer_ptr, name, stereo, fuzz_byte(input_ptr) & 1);
+    if (channel_ptr != NULL)
+    {
+      state_ptr->outputs[state_ptr->outputs_count++] = channel_ptr;
+    }
+  }
+  else
+  {
+    if (state_ptr->inputs_count == FUZZ_CHANNELS_MAX)
+    {
+      return;
+    }
+    channel_ptr = add_channel(state_ptr->mixer_ptr, name, stereo);
+    if (channel_ptr != NULL)
+    {
+      state_ptr->inputs[state_ptr->inputs_count++] = channel_ptr;
+    }
+  }
+}
+
+static void
+fuzz_remove_channel(
+  struct fuzz_state * state_ptr,
+  struct fuzz_input * input_ptr,
+  bool output)
+{
+  uint8_t byte;
+  unsigned int index;
+
+  byte = fuzz_byte(input_ptr);
+
+  if (output)
+  {
+    if (state_ptr->outputs_count == 0)
+    {
+      return;
+    }
+    index = byte % state_ptr->outputs_count;
+    remove_output_channel(state_ptr->outputs[index]);
+    state_ptr->outputs[index] = state_ptr->outputs[--state_ptr->outputs_count];
+  }
+  else
+  {
+    if (state_ptr->inputs_count == 0)
+    {
+      return;
+    }
+    index = byte % state_ptr->inputs_count;
+    remove_channel(state_ptr->inputs[index]);
+    state_ptr->inputs[index] = state_ptr->inputs[--state_ptr->inputs_count];
+  }
+}
+
+static void
+fuzz_set_midi_cc(
+  struct fuzz_state * state_ptr,
+  struct fuzz_input * input_ptr)
+{
+  struct channel * channel_ptr;
+  uint8_t which;
+  int cc;
+
+  channel_ptr = fuzz_channel(state_ptr, input_ptr);
+  which = fuzz_byte(input_ptr);
+  cc = (int8_t)fuzz_byte(input_ptr) + 64; /* -64 - 191, out of range too */
+  if (channel_ptr == NULL)
+  {
+    return;
+  }
+
+  switch (which % 5)
+  {
+  case 0:
+    channel_set_volume_midi_cc(channel_ptr, cc);
+    break;
+  case 1:
+    channel_set_balance_midi_cc(channel_ptr, cc);
+    break;
+  case 2:
+    channel_set_mute_midi_cc(channel_ptr, cc);
+    break;
+  case 3:
+    channel_set_solo_midi_cc(channel_ptr, cc);
+    break;
+  case 4:
+    channel_autoset_midi_cc(channel_ptr);
+    break;
+  }
+}
+
+static void
+fuzz_fill_audio(
+  struct fuzz_input * input_ptr,
+  jack_port_t * port_ptr,
+  jack_nframes_t nframes)
+{
+  jack_default_audio_sample_t * buffer_ptr;
+  jack_default_audio_sample_t value;
+  jack_nframes_t i;
+
+  buffer_ptr = jack_port_get_buffer(port_ptr, nframes);
+
+  switch (fuzz_byte(input_ptr) % 4)
+  {
+  case 0:
+    /* silence */
+    break;
+  case 1:
+    value = fuzz_sample(input_ptr);
+    for (i = 0 ; i < nframes ; i++)
+    {
+      buffer_ptr[i] = value;
+    }
+    break;
+  case 2:
+    for (i = 0 ; i < nframes && input_ptr->size > 0 ; i++)
+    {
+      buffer_ptr[i] = fuzz_sample(input_ptr);
+    }
+    break;
+  case 3:
+    for (i = 0 ; i < nframes ; i++)
+    {
+      buffer_ptr[i] = sinf(i * 0.1f);
+    }
+    break;
+  }
+}
+
+static void
+fuzz_cycle(
+  struct fuzz_state * state_ptr,
+  struct fuzz_input * input_ptr)
+{
+  jack_nframes_t nframes;
+  unsigned int i;
+  unsigned int events;
+  unsigned char midi[4];
+  size_t size;
+
+  nframes = jack_get_buffer_size(state_ptr->client_ptr);
+  stub_cycle_begin(state_ptr->client_ptr);
+
+  for (i = 0 ; i < state_ptr->inputs_count ; i++)
+  {
+    fuzz_fill_audio(input_ptr, state_ptr->inputs[i]->port_left, nframes);
+    if (state_ptr->inputs[i]->stereo)
+    {
+      fuzz_fill_audio(input_ptr, state_ptr->inputs[i]->port_right, nframes);
+    }
+  }
+
+#if defined(HAVE_JACK_MIDI)
+  events = fuzz_byte(input_ptr) % (FUZZ_MIDI_EVENTS_MAX + 1);
+  for (i = 0 ; i < events ; i++)
+  {
+    size = fuzz_byte(input_ptr);
+    midi[0] = fuzz_byte(input_ptr);
+    midi[1] = fuzz_byte(input_ptr);
+    midi[2] = fuzz_byte(input_ptr);
+    midi[3] = fuzz_byte(input_ptr);
+    if (size & 0x80)
+    {
+      /* mostly control changes, to get past the status check */
+      midi[0] = 0xB0 | (midi[0] & 0x0F);
+      midi[1] &= 0x7F;
+      midi[2] = (size & 0x40) ? 127 : (midi[2] & 0x7F);
+      size = 3;
+    }
+    else
+    {
+      size %= sizeof(midi) + 1;
+    }
+
+    stub_midi_write(state_ptr->mixer_ptr->port_midi_in, fuzz_u16(input_ptr), midi, size);
+  }
+#endif
+
+  stub_cycle_run(state_ptr->client_ptr);
+}
+
+/* split against unsplit mixer */
+
+static void
+fuzz_compare_create(
+  struct fuzz_compare * compare_ptr,
+  struct fuzz_input * input_ptr,
+  unsigned int layout)
+{
+  struct jack_mixer * mixer_ptr;
+  struct channel * channel_ptr;
+  char name[32];
+  uint8_t byte;
+  double volume;
+  double balance;
+  unsigned int source;
+  unsigned int i;
+  unsigned int k;
+
+  byte = fuzz_byte(input_ptr);
+  compare_ptr->inputs_count = 1 + byte % FUZZ_COMPARE_CHANNELS_MAX;
+  compare_ptr->outputs_count = 1 + (byte >> 2) % FUZZ_COMPARE_CHANNELS_MAX;
+
+  for (k = 0 ; k < 2 ; k++)
+  {
+    mixer_ptr = create_split(k == 0 ? "fuzz unsplit" : "fuzz split", false, k == 0 ? 0 : 1 + (byte >> 4) % 2);
+    FUZZ_CHECK(mixer_ptr != NULL, "cannot create mixer");
+    mixer_ptr->layout = layout;
+    if ((byte & 0x40) && mixer_ptr->workers_slot_ptr != NULL)
+    {
+      workers_detach(mixer_ptr->workers_slot_ptr);
+      mixer_ptr->workers_slot_ptr = NULL;
+    }
+    compare_ptr->mixers[k] = mixer_ptr;
+  }
+
+  for (i = 0 ; i < compare_ptr->inputs_count ; i++)
+  {
+    byte = fuzz_byte(input_ptr);
+    volume = fuzz_db(input_ptr);
+    balance = (int8_t)fuzz_byte(input_ptr) / 128.0;
+    snprintf(name, sizeof(name), "in %u", i);
+    for (k = 0 ; k < 2 ; k++)
+    {
+      channel_ptr = add_channel(compare_ptr->mixers[k], name, byte & 1);
+      FUZZ_CHECK(channel_ptr != NULL, "cannot add input channel");
+      channel_volume_write(channel_ptr, volume);
+      channel_balance_write(channel_ptr, balance);
+      if (byte & 2)
+      {
+        channel_out_mute(channel_ptr);
+      }
+      compare_ptr->inputs[k][i] = channel_ptr;
+    }
+  }
+
+  /* not system ones, those are left to the mixer client */
+  for (i = 0 ; i < compare_ptr->outputs_count ; i++)
+  {
+    byte = fuzz_byte(input_ptr);
+    volume = fuzz_db(input_ptr);
+    source = fuzz_byte(input_ptr) % compare_ptr->inputs_count;
+    snprintf(name, sizeof(name), "out %u", i);
+    for (k = 0 ; k < 2 ; k++)
+    {
+      channel_ptr = add_output_channel(compare_ptr->mixers[k], name, byte & 1, false);
+      FUZZ_CHECK(channel_ptr != NULL, "cannot add output channel");
+      channel_volume_write(channel_ptr, volume);
+      output_channel_set_prefader(channel_ptr, byte & 2);
+      output_channel_set_double_precision(channel_ptr, byte & 4);
+      if (byte & 8)
+      {
+        output_channel_set_muted(channel_ptr, compare_ptr->inputs[k][source], true);
+      }
+      if (byte & 0x10)
+      {
+        output_channel_set_solo(channel_ptr, compare_ptr->inputs[k][source], true);
+      }
+      if (byte & 0x20)
+      {
+        output_channel_set_monitor_source(channel_ptr, compare_ptr->inputs[k][source], byte & 0x40);
+      }
+      compare_ptr->outputs[k][i] = channel_ptr;
+    }
+  }
+}
+
+/* volume, balance and out mute changes of input channels, output channel
+ * ones take effect at cycle start in shard clients */
+static void
+fuzz_compare_schedule(
+  struct fuzz_compare * compare_ptr,
+  struct fuzz_input * input_ptr,
+  jack_nframes_t nframes)
+{
+  unsigned int events;
+  unsigned int type;
+  unsigned int channel;
+  int32_t offset;
+  double value;
+  uint32_t frame_time;
+  unsigned int i;
+  unsigned int k;
+
+  events = fuzz_byte(input_ptr) % (FUZZ_COMPARE_EVENTS_MAX + 1);
+  for (i = 0 ; i < events ; i++)
+  {
+    type = fuzz_byte(input_ptr) % 3;
+    channel = fuzz_byte(input_ptr) % compare_ptr->inputs_count;
+    /* late and next cycle ones too */
+    offset = (int32_t)(fuzz_u16(input_ptr) % (nframes + 16)) - 8;
+    value = type == 1 ? (int8_t)fuzz_byte(input_ptr) / 128.0 : fuzz_db(input_ptr);
+
+    for (k = 0 ; k < 2 ; k++)
+    {
+      frame_time = mixer_get_frame_time(compare_ptr->mixers[k]) + offset;
+      switch (type)
+      {
+      case 0:
+        channel_volume_write_at(compare_ptr->inputs[k][channel], value, frame_time);
+        break;
+      case 1:
+        channel_balance_write_at(compare_ptr->inputs[k][channel], value, frame_time);
+        break;
+      case 2:
+        channel_out_mute_write_at(compare_ptr->inputs[k][channel], value > 0.0, frame_time);
+        break;
+      }
+    }
+  }
+}
+
+/* automation playback of input channel changes, from transport frame 0 */
+static bool
+fuzz_compare_write_automation(
+  struct fuzz_compare * compare_ptr,
+  struct fuzz_input * input_ptr,
+  jack_nframes_t frames,
+  char * path)
+{
+  static const char * types[] = {"volume", "balance", "out_mute"};
+  FILE * file;
+  unsigned int events;
+  unsigned int type;
+  int fd;
+  unsigned int i;
+
+  fd = mkstemp(path);
+  FUZZ_CHECK(fd != -1, "cannot create automation file");
+  file = fdopen(fd, "w");
+  FUZZ_CHECK(file != NULL, "cannot open automation file");
+
+  events = 1 + fuzz_byte(input_ptr) % FUZZ_COMPARE_EVENTS_MAX;
+  for (i = 0 ; i < events ; i++)
+  {
+    type = fuzz_byte(input_ptr) % 3;
+    fprintf(
+      file,
+      "%u\t%s\tin\tin %u\t-\t%g\n",
+      (unsigned int)(fuzz_u16(input_ptr) % frames),
+      types[type],
+      (unsigned int)(fuzz_byte(input_ptr) % compare_ptr->inputs_count),
+      type == 1 ? (int8_t)fuzz_byte(input_ptr) / 128.0 : (double)(fuzz_byte(input_ptr) & 1));
+  }
+
+  return fclose(file) == 0;
+}
+
+/* wait until automation playback of mixer has its events queued, the disk
+ * thread locks the mixer mutex after each fill of the ring */
+static void
+fuzz_wait_automation(
+  struct jack_mixer * mixer_ptr)
+{
+  struct automation_event event;
+  unsigned int locks;
+  int i;
+
+  __atomic_store_n(&fuzz_watched_mutex, &mixer_ptr->mutex, __ATOMIC_RELEASE);
+
+  for (i = 0 ; i < FUZZ_AUTOMATION_WAIT_MS && !automation_peek(mixer_ptr->automation_ptr, &event) ; i++)
+  {
+    usleep(1000);
+  }
+
+  locks = __atomic_load_n(&fuzz_watched_locks, __ATOMIC_ACQUIRE);
+  for ( ; i < FUZZ_AUTOMATION_WAIT_MS && __atomic_load_n(&fuzz_watched_locks, __ATOMIC_ACQUIRE) == locks ; i++)
+  {
+    usleep(1000);
+  }
+
+  __atomic_store_n(&fuzz_watched_mutex, NULL, __ATOMIC_RELEASE);
+
+  FUZZ_CHECK(i < FUZZ_AUTOMATION_WAIT_MS, "automation playback did not start");
+}
+
+static void
+fuzz_compare_outputs(
+  struct fuzz_compare * compare_ptr,
+  jack_nframes_t nframes)
+{
+  struct channel * channel_ptr;
+  struct channel * split_channel_ptr;
+  unsigned int i;
+
+  for (i = 0 ; i < compare_ptr->outputs_count ; i++)
+  {
+    channel_ptr = compare_ptr->outputs[0][i];
+    split_channel_ptr = compare_ptr->outputs[1][i];
+
+    FUZZ_CHECK(memcmp(jack_port_get_buffer(channel_ptr->port_left, nframes),
+                      jack_port_get_buffer(split_channel_ptr->port_left, nframes),
+                      nframes * sizeof(jack_default_audio_sample_t)) == 0,
+               "split mixer output differs");
+    if (channel_ptr->stereo)
+    {
+      FUZZ_CHECK(memcmp(jack_port_get_buffer(channel_ptr->port_right, nframes),
+                        jack_port_get_buffer(split_channel_ptr->port_right, nframes),
+                        nframes * sizeof(jack_default_audio_sample_t)) == 0,
+                 "split mixer output differs");
+    }
+  }
+}
+
+static void
+fuzz_compare_split(
+  struct fuzz_state * state_ptr,
+  struct fuzz_input * input_ptr)
+{
+  struct fuzz_compare compare;
+  char path[] = "/tmp/fuzz_automation_XXXXXX";
+  jack_nframes_t nframes;
+  unsigned int cycles;
+  bool automation;
+  unsigned int c;
+  unsigned int i;
+  unsigned int k;
+
+  fuzz_compare_create(&compare, input_ptr, state_ptr->mixer_ptr->layout);
+
+  nframes = jack_get_buffer_size(compare.mixers[0]->jack_client);
+  cycles = 1 + fuzz_byte(input_ptr) % FUZZ_COMPARE_CYCLES_MAX;
+  automation = fuzz_byte(input_ptr) & 1;
+
+  if (automation)
+  {
+    FUZZ_CHECK(fuzz_compare_write_automation(&compare, input_ptr, cycles * nframes, path), "cannot write automation file");
+
+    /* transport stopped for one cycle, automation is relocated to its
+     * frame and then rolls from there */
+    for (k = 0 ; k < 2 ; k++)
+    {
+      FUZZ_CHECK(mixer_automation_play(compare.mixers[k], path), "cannot start automation playback");
+      stub_set_transport(compare.mixers[k]->jack_client, false, 0);
+      stub_cycle_run(compare.mixers[k]->jack_client);
+      fuzz_wait_automation(compare.mixers[k]);
+      stub_set_transport(compare.mixers[k]->jack_client, true, 0);
+    }
+  }
+
+  for (c = 0 ; c < cycles ; c++)
+  {
+    fuzz_compare_schedule(&compare, input_ptr, nframes);
+
+    stub_cycle_begin(compare.mixers[0]->jack_client);
+    stub_cycle_begin(compare.mixers[1]->jack_client);
+
+    for (i = 0 ; i < compare.inputs_count ; i++)
+    {
+      fuzz_fill_audio(input_ptr, compare.inputs[0][i]->port_left, nframes);
+      memcpy(jack_port_get_buffer(compare.inputs[1][i]->port_left, nframes),
+             jack_port_get_buffer(compare.inputs[0][i]->port_left, nframes),
+             nframes * sizeof(jack_default_audio_sample_t));
+      if (compare.inputs[0][i]->stereo)
+      {
+        fuzz_fill_audio(input_ptr, compare.inputs[0][i]->port_right, nframes);
+        memcpy(jack_port_get_buffer(compare.inputs[1][i]->port_right, nframes),
+               jack_port_get_buffer(compare.inputs[0][i]->port_right, nframes),
+               nframes * sizeof(jack_default_audio_sample_t));
+      }
+    }
+
+    stub_cycle_process(compare.mixers[0]->jack_client);
+    stub_cycle_process(compare.mixers[1]->jack_client);
+
+    fuzz_compare_outputs(&compare, nframes);
+
+    stub_cycle_end(compare.mixers[0]->jack_client);
+    stub_cycle_end(compare.mixers[1]->jack_client);
+  }
+
+  destroy(compare.mixers[0]);
+  destroy(compare.mixers[1]);
+
+  if (automation)
+  {
+    unlink(path);
+  }
+}
+
+static void
+fuzz_step(
+  struct fuzz_state * state_ptr,
+  struct fuzz_input * input_ptr)
+{
+  static const jack_nframes_t buffer_sizes[] = {1, 2, 3, 16, 64, 127, 128, 1024, 4095, STUB_MAX_BUFFER_SIZE};
+  static const jack_nframes_t sample_rates[] = {8000, 22050, 44100, 48000, 96000, 192000};
+  struct channel * channel_ptr;
+  struct channel * input_channel_ptr;
+  char name[300];
+  uint8_t byte;
+  uint32_t frame_time;
+
+  frame_time = mixer_get_frame_time(state_ptr->mixer_ptr) + (int16_t)fuzz_u16(input_ptr);
+
+  switch (fuzz_byte(input_ptr) % 27)
+  {
+  case 0:
+    fuzz_add_channel(state_ptr, input_ptr, false);
+    break;
+  case 1:
+    fuzz_add_channel(state_ptr, input_ptr, true);
+    break;
+  case 2:
+    fuzz_remove_channel(state_ptr, input_ptr, false);
+    break;
+  case 3:
+    fuzz_remove_channel(state_ptr, input_ptr, true);
+    break;
+  case 4:
+    fuzz_set_midi_cc(state_ptr, input_ptr);
+    break;
+  case 5:
+  case 6:
+  case 7:
+    fuzz_cycle(state_ptr, input_ptr);
+    break;
+  case 8:
+    channel_ptr = fuzz_channel(state_ptr, input_ptr);
+    if (channel_ptr != NULL)
+    {
+      channel_volume_write(channel_ptr, fuzz_db(input_ptr));
+    }
+    break;
+  case 9:
+    channel_ptr = fuzz_channel(state_ptr, input_ptr);
+    if (channel_ptr != NULL)
+    {
+      channel_balance_write(channel_ptr, fuzz_db(input_ptr) / 32);
+    }
+    break;
+  case 10:
+    channel_ptr = fuzz_channel(state_ptr, input_ptr);
+    byte = fuzz_byte(input_ptr);
+    if (channel_ptr == NULL)
+    {
+      break;
+    }
+    switch (byte % 4)
+    {
+    case 0:
+      channel_volume_write_at(channel_ptr, fuzz_db(input_ptr), frame_time);
+      break;
+    case 1:
+      channel_balance_write_at(channel_ptr, fuzz_db(input_ptr) / 32, frame_time);
+      break;
+    case 2:
+      channel_out_mute_write_at(channel_ptr, byte & 0x10, frame_time);
+      break;
+    case 3:
+      input_channel_ptr = fuzz_input_channel(state_ptr, input_ptr);
+      channel_ptr = fuzz_output_channel(state_ptr, input_ptr);
+      if (channel_ptr != NULL && input_channel_ptr != NULL)
+      {
+        output_channel_set_muted_at(channel_ptr, input_channel_ptr, byte & 0x10, frame_time);
+      }
+      break;
+    }
+    break;
+  case 11:
+    channel_ptr = fuzz_channel(state_ptr, input_ptr);
+    byte = fuzz_byte(input_ptr);
+    if (channel_ptr == NULL)
+    {
+      break;
+    }
+    switch (byte % 8)
+    {
+    case 0:
+      channel_out_mute(channel_ptr);
+      break;
+    case 1:
+      channel_out_unmute(channel_ptr);
+      break;
+    case 2:
+      channel_solo(channel_ptr);
+      break;
+    case 3:
+      channel_unsolo(channel_ptr);
+      break;
+    case 4:
+      channel_abspeak_reset(channel_ptr);
+      break;
+    case 5:
+      channel_meter_subscribe(channel_ptr, byte >> 3);
+      break;
+    case 6:
+      channel_meter_unsubscribe(channel_ptr, byte >> 3);
+      break;
+    case 7:
+      channel_clip_count_reset(channel_ptr);
+      break;
+    }
+    break;
+  case 12:
+    channel_ptr = fuzz_output_channel(state_ptr, input_ptr);
+    input_channel_ptr = fuzz_input_channel(state_ptr, input_ptr);
+    byte = fuzz_byte(input_ptr);
+    if (channel_ptr == NULL || input_channel_ptr == NULL)
+    {
+      break;
+    }
+    if (byte & 1)
+    {
+      output_channel_set_solo(channel_ptr, input_channel_ptr, byte & 2);
+    }
+    else
+    {
+      output_channel_set_muted(channel_ptr, input_channel_ptr, byte & 2);
+    }
+    break;
+  case 13:
+    channel_ptr = fuzz_output_channel(state_ptr, input_ptr);
+    byte = fuzz_byte(input_ptr);
+    if (channel_ptr != NULL)
+    {
+      output_channel_set_prefader(channel_ptr, byte & 1);
+      output_channel_set_double_precision(channel_ptr, byte & 2);
+    }
+    break;
+  case 14:
+    channel_ptr = fuzz_channel(state_ptr, input_ptr);
+    if (channel_ptr != NULL)
+    {
+      channel_set_midi_scale(channel_ptr, (fuzz_byte(input_ptr) & 1) ? state_ptr->scale : NULL);
+    }
+    break;
+  case 15:
+    channel_ptr = fuzz_channel(state_ptr, input_ptr);
+    fuzz_name(state_ptr, input_ptr, name, sizeof(name));
+    if (channel_ptr != NULL)
+    {
+      channel_rename(channel_ptr, name);
+    }
+    break;
+  case 16:
+    byte = fuzz_byte(input_ptr);
+    stub_set_buffer_size(
+      state_ptr->client_ptr,
+      byte & 0x80 ? buffer_sizes[byte % (sizeof(buffer_sizes) / sizeof(buffer_sizes[0]))] : byte * 16u + 1);
+    break;
+  case 17:
+    byte = fuzz_byte(input_ptr);
+    stub_set_sample_rate(state_ptr->client_ptr, sample_rates[byte % (sizeof(sample_rates) / sizeof(sample_rates[0]))]);
+    break;
+  case 18:
+    byte = fuzz_byte(input_ptr);
+    stub_set_transport(state_ptr->client_ptr, byte & 1, fuzz_u16(input_ptr) * (jack_nframes_t)(byte >> 1));
+    break;
+  case 19:
+    channel_ptr = fuzz_input_channel(state_ptr, input_ptr);
+    if (channel_ptr != NULL)
+    {
+      channel_agc_enable(channel_ptr, fuzz_byte(input_ptr) & 1);
+    }
+    break;
+  case 20:
+    channel_ptr = fuzz_input_channel(state_ptr, input_ptr);
+    if (channel_ptr != NULL)
+    {
+      channel_agc_configure(channel_ptr, fuzz_db(input_ptr), fuzz_db(input_ptr), fuzz_db(input_ptr));
+    }
+    break;
+  case 21:
+    set_last_midi_channel(state_ptr->mixer_ptr, (int8_t)fuzz_byte(input_ptr) + 64);
+    break;
+  case 22:
+    mixer_read_events(state_ptr->mixer_ptr);
+    break;
+  case 23:
+    /* non-RT readers, outputs do not matter */
+    channel_ptr = fuzz_channel(state_ptr, input_ptr);
+    if (channel_ptr != NULL)
+    {
+      double left;
+      double right;
+
+      channel_stereo_meter_read(channel_ptr, &left, &right);
+      channel_mono_meter_read(channel_ptr, &left);
+      channel_abspeak_read(channel_ptr);
+      channel_clip_count_read(channel_ptr);
+      channel_volume_read(channel_ptr);
+      channel_balance_read(channel_ptr);
+      channel_agc_gain_read(channel_ptr);
+      channel_get_delay(channel_ptr);
+    }
+    break;
+  case 24:
+    channel_ptr = fuzz_input_channel(state_ptr, input_ptr);
+    if (channel_ptr != NULL)
+    {
+      byte = fuzz_byte(input_ptr);
+      if (byte & 1)
+      {
+        channel_set_delay_auto(channel_ptr, byte & 2);
+      }
+      else
+      {
+        /* past the longest delay too */
+        channel_set_delay(channel_ptr, fuzz_u16(input_ptr) / 100.0f);
+      }
+    }
+    break;
+  case 25:
+    channel_ptr = fuzz_output_channel(state_ptr, input_ptr);
+    input_channel_ptr = fuzz_channel(state_ptr, input_ptr);
+    byte = fuzz_byte(input_ptr);
+    if (channel_ptr != NULL)
+    {
+      output_channel_set_monitor_source(channel_ptr, (byte & 1) ? input_channel_ptr : NULL, byte & 2);
+    }
+    break;
+  case 26:
+    fuzz_compare_split(state_ptr, input_ptr);
+    break;
+  }
+}
+
+int
+LLVMFuzzerTestOneInput(
+  const uint8_t * data,
+  size_t size)
+{
+  static bool workers_started;
+  struct fuzz_input input;
+  struct fuzz_state state;
+  uint8_t byte;
+
+  fuzz_realtime_thread = true;
+
+  /* pool outlives mixers, like in the UI */
+  if (!workers_started)
+  {
+    fuzz_creating_realtime = true;
+    FUZZ_CHECK(mixer_set_worker_threads(2, false), "cannot start worker threads");
+    fuzz_creating_realtime = false;
+    workers_started = true;
+  }
+
+  input.data = data;
+  input.size = size;
+
+  memset(&state, 0, sizeof(state));
+
+  stub_configure(48000, fuzz_byte(&input) * 16u + 1);
+
+  /* split into up to 2 shard clients or not, either frame layout before
+   * channels exist, mixing shared with the worker pool or not */
+  byte = fuzz_byte(&input);
+  state.mixer_ptr = create_split("fuzz", false, (byte >> 2) % 3);
+  FUZZ_CHECK(state.mixer_ptr != NULL, "cannot create mixer");
+  state.client_ptr = state.mixer_ptr->jack_client;
+  state.mixer_ptr->layout = (byte & 1) ? KERNELS_LAYOUT_INTERLEAVED : KERNELS_LAYOUT_PLANAR;
+  if ((byte & 2) && state.mixer_ptr->workers_slot_ptr != NULL)
+  {
+    workers_detach(state.mixer_ptr->workers_slot_ptr);
+    state.mixer_ptr->workers_slot_ptr = NULL;
+  }
+
+  /* like the UI one */
+  state.scale = scale_create();
+  scale_add_threshold(state.scale, -70.0, 0.0);
+  scale_add_threshold(state.scale, -60.0, 0.05);
+  scale_add_threshold(state.scale, -50.0, 0.1);
+  scale_add_threshold(state.scale, -40.0, 0.15);
+  scale_add_threshold(state.scale, -30.0, 0.3);
+  scale_add_threshold(state.scale, -20.0, 0.5);
+  scale_add_threshold(state.scale, -10.0, 0.75);
+  scale_add_threshold(state.scale, 0.0, 1.0);
+  scale_calculate_coefficients(state.scale);
+
+  while (input.size > 0)
+  {
+    fuzz_step(&state, &input);
+    fuzz_check(&state);
+  }
+
+  /* a last cycle with whatever state was reached */
+  fuzz_cycle(&state, &input);
+
+  while (state.inputs_count > 0)
+  {
+    remove_channel(state.inputs[--state.inputs_count]);
+    fuzz_check(&state);
+  }
+
+  while (state.outputs_count > 0)
+  {
+    remove_output_channel(state.outputs[--state.outputs_count]);
+    fuzz_check(&state);
+  }
+
+  destroy(state.mixer_ptr);
+  scale_destroy(state.scale);
+
+  return 0;
+}
+
+#if !defined(FUZZ_LIBFUZZER)
+
+static bool
+fuzz_run_file(
+  FILE * file)
+{
+  uint8_t * data;
+  size_t size;
+  size_t allocated;
+  size_t ret;
+
+  data = NULL;
+  size = 0;
+  allocated = 0;
+
+  do
+  {
+    if (size == allocated)
+    {
+      allocated = allocated ? 2 * allocated : 4096;
+      data = realloc(data, allocated);
+      if (data == NULL)
+      {
+        return false;
+      }
+    }
+
+    ret = fread(data + size, 1, allocated - size, file);
+    size += ret;
+  }
+  while (ret > 0);
+
+  LLVMFuzzerTestOneInput(data, size);
+  free(data);
+
+  return true;
+}
+
+int
+main(
+  int argc,
+  char ** argv)
+{
+  FILE * file;
+  int i;
+
+  if (argc < 2)
+  {
+    return fuzz_run_file(stdin) ? 0 : 1;
+  }
+
+  for (i = 1 ; i < argc ; i++)
+  {
+    file = fopen(argv[i], "rb");
+    if (file == NULL)
+    {
+      fprintf(stderr, "Cannot open \"%s\"\n", argv[i]);
+      return 1;
+    }
+
+    fprintf(stderr, "%s\n", argv[i]);
+    if (!fuzz_run_file(file))
+    {
+      fclose(file);
+      return 1;
+    }
+    fclose(file);
+  }
+
+  return 0;
+}
+
+#endif
@@ -0,0 +1,1206 @@
+/* -*- Mode: C ; c-basic-offset: 2 -*- */
+/*****************************************************************************
+ *
+ *   This file is part of jack_mixer
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <jack/jack.h>
+#include <jack/ringbuffer.h>
+#include <jack/midiport.h>
+
+#include "list.h"
+#include "jack_stub.h"
+
+#define STUB_PORT_NAME_SIZE 256 /* including client name, like JACK */
+#define STUB_CONNECTIONS_MAX 16
+
+struct stub_midi_event
+{
+  jack_nframes_t time;
+  size_t size;
+  unsigned char * data_ptr;
+};
+
+struct stub_midi_buffer
+{
+  bool input;
+  jack_nframes_t nframes;
+  unsigned int count;
+  struct stub_midi_event events[STUB_MIDI_EVENTS];
+  size_t used;                          /* of data, output ports */
+  unsigned char data[STUB_MIDI_BYTES];
+};
+
+struct _jack_port
+{
+  struct list_head siblings;
+  jack_client_t * client_ptr;
+  char name[STUB_PORT_NAME_SIZE];
+  unsigned long flags;
+  bool midi;
+  void * buffer_ptr;                    /* during cycle only */
+  jack_port_t * connections[STUB_CONNECTIONS_MAX]; /* input ports fed, output ports only */
+  unsigned int connections_count;
+  jack_latency_range_t latencies[2];    /* by jack_latency_callback_mode_t */
+};
+
+struct _jack_client
+{
+  struct list_head siblings;
+  char name[STUB_PORT_NAME_SIZE];
+  struct list_head ports;
+  jack_nframes_t sample_rate;
+  jack_nframes_t buffer_size;
+  JackProcessCallback process;
+  void * process_arg;
+  JackSampleRateCallback sample_rate_changed;
+  void * sample_rate_arg;
+  JackBufferSizeCallback buffer_size_changed;
+  void * buffer_size_arg;
+  JackLatencyCallback latency;
+  void * latency_arg;
+  bool active;
+  bool in_cycle;
+  bool processed;                       /* in current cycle */
+  jack_nframes_t frame_time;            /* of current or next cycle start */
+  bool rolling;
+  jack_nframes_t transport_frame;
+};
+
+bool stub_in_process;
+
+static jack_nframes_t stub_sample_rate = 48000;
+static jack_nframes_t stub_buffer_size = 128;
+static LIST_HEAD(stub_clients);
+
+static void
+stub_fail(
+  const char * format,
+  ...)
+{
+  va_list ap;
+
+  va_start(ap, format);
+  fprintf(stderr, "jack stub: ");
+  vfprintf(stderr, format, ap);
+  fprintf(stderr, "\n");
+  va_end(ap);
+
+  abort();
+}
+
+static jack_nframes_t
+stub_clamp_buffer_size(
+  jack_nframes_t buffer_size)
+{
+  if (buffer_size < 1)
+  {
+    return 1;
+  }
+
+  if (buffer_size > STUB_MAX_BUFFER_SIZE)
+  {
+    return STUB_MAX_BUFFER_SIZE;
+  }
+
+  return buffer_size;
+}
+
+static void
+stub_free_buffer(
+  jack_port_t * port_ptr)
+{
+  struct stub_midi_buffer * midi_ptr;
+  unsigned int i;
+
+  if (port_ptr->buffer_ptr == NULL)
+  {
+    return;
+  }
+
+  if (port_ptr->midi)
+  {
+    midi_ptr = port_ptr->buffer_ptr;
+    if (midi_ptr->input)
+    {
+      for (i = 0 ; i < midi_ptr->count ; i++)
+      {
+        free(midi_ptr->events[i].data_ptr);
+      }
+    }
+  }
+
+  free(port_ptr->buffer_ptr);
+  port_ptr->buffer_ptr = NULL;
+}
+
+static jack_port_t *
+stub_find_port(
+  jack_client_t * client_ptr,
+  const char * name)
+{
+  struct list_head * node_ptr;
+  jack_port_t * port_ptr;
+
+  list_for_each(node_ptr, &client_ptr->ports)
+  {
+    port_ptr = list_entry(node_ptr, jack_port_t, siblings);
+    if (strcmp(port_ptr->name, name) == 0)
+    {
+      return port_ptr;
+    }
+  }
+
+  return NULL;
+}
+
+/* in any client */
+static jack_port_t *
+stub_find_any_port(
+  const char * name)
+{
+  struct list_head * node_ptr;
+  jack_port_t * port_ptr;
+
+  list_for_each(node_ptr, &stub_clients)
+  {
+    port_ptr = stub_find_port(list_entry(node_ptr, jack_client_t, siblings), name);
+    if (port_ptr != NULL)
+    {
+      return port_ptr;
+    }
+  }
+
+  return NULL;
+}
+
+/* drop connections from and to port */
+static void
+stub_disconnect(
+  jack_port_t * port_ptr)
+{
+  struct list_head * client_node_ptr;
+  struct list_head * node_ptr;
+  jack_port_t * other_ptr;
+  unsigned int i;
+
+  port_ptr->connections_count = 0;
+
+  list_for_each(client_node_ptr, &stub_clients)
+  {
+    list_for_each(node_ptr, &list_entry(client_node_ptr, jack_client_t, siblings)->ports)
+    {
+      other_ptr = list_entry(node_ptr, jack_port_t, siblings);
+      for (i = 0 ; i < other_ptr->connections_count ; )
+      {
+        if (other_ptr->connections[i] == port_ptr)
+        {
+          other_ptr->connections[i] = other_ptr->connections[--other_ptr->connections_count];
+        }
+        else
+        {
+          i++;
+        }
+      }
+    }
+  }
+}
+
+/* run function for clients fed by ports of client, JACK runs them after it */
+static void
+stub_for_each_fed(
+  jack_client_t * client_ptr,
+  void (* function)(jack_client_t * client_ptr))
+{
+  struct list_head * node_ptr;
+  jack_port_t * port_ptr;
+  unsigned int i;
+
+  list_for_each(node_ptr, &client_ptr->ports)
+  {
+    port_ptr = list_entry(node_ptr, jack_port_t, siblings);
+    for (i = 0 ; i < port_ptr->connections_count ; i++)
+    {
+      function(port_ptr->connections[i]->client_ptr);
+    }
+  }
+}
+
+static void
+stub_merge_latency(
+  jack_latency_range_t * range_ptr,
+  bool * empty_ptr,
+  const jack_latency_range_t * other_ptr)
+{
+  if (*empty_ptr)
+  {
+    *range_ptr = *other_ptr;
+    *empty_ptr = false;
+    return;
+  }
+
+  if (other_ptr->min < range_ptr->min)
+  {
+    range_ptr->min = other_ptr->min;
+  }
+  if (other_ptr->max > range_ptr->max)
+  {
+    range_ptr->max = other_ptr->max;
+  }
+}
+
+/* latency of ports of client from ports connected to them, like JACK does
+ * before calling the latency callback: capture latency of input ports
+ * comes from output ports feeding them, playback latency of output ports
+ * from input ports they feed */
+static void
+stub_propagate_latency(
+  jack_client_t * client_ptr,
+  jack_latency_callback_mode_t mode)
+{
+  struct list_head * node_ptr;
+  struct list_head * client_node_ptr;
+  struct list_head * other_node_ptr;
+  jack_port_t * port_ptr;
+  jack_port_t * other_ptr;
+  jack_latency_range_t range;
+  bool empty;
+  unsigned int i;
+
+  list_for_each(node_ptr, &client_ptr->ports)
+  {
+    port_ptr = list_entry(node_ptr, jack_port_t, siblings);
+    range.min = range.max = 0;
+    empty = true;
+
+    if (mode == JackPlaybackLatency)
+    {
+      for (i = 0 ; i < port_ptr->connections_count ; i++)
+      {
+        stub_merge_latency(&range, &empty, port_ptr->connections[i]->latencies + mode);
+      }
+    }
+    else if ((port_ptr->flags & JackPortIsInput) != 0)
+    {
+      list_for_each(client_node_ptr, &stub_clients)
+      {
+        list_for_each(other_node_ptr, &list_entry(client_node_ptr, jack_client_t, siblings)->ports)
+        {
+          other_ptr = list_entry(other_node_ptr, jack_port_t, siblings);
+          for (i = 0 ; i < other_ptr->connections_count ; i++)
+          {
+            if (other_ptr->connections[i] == port_ptr)
+            {
+              stub_merge_latency(&range, &empty, other_ptr->latencies + mode);
+            }
+          }
+        }
+      }
+    }
+
+    if (((port_ptr->flags & JackPortIsInput) != 0) == (mode == JackCaptureLatency) && !empty)
+    {
+      port_ptr->latencies[mode] = range;
+    }
+  }
+}
+
+static void
+stub_recompute_client_latency(
+  jack_client_t * client_ptr,
+  jack_latency_callback_mode_t mode)
+{
+  stub_propagate_latency(client_ptr, mode);
+  if (client_ptr->latency != NULL)
+  {
+    client_ptr->latency(mode, client_ptr->latency_arg);
+  }
+}
+
+static bool
+stub_port_full_name(
+  jack_client_t * client_ptr,
+  const char * short_name,
+  char * name)
+{
+  return snprintf(name, STUB_PORT_NAME_SIZE, "%s:%s", client_ptr->name, short_name) < STUB_PORT_NAME_SIZE;
+}
+
+void
+stub_configure(
+  jack_nframes_t sample_rate,
+  jack_nframes_t buffer_size)
+{
+  stub_sample_rate = sample_rate;
+  stub_buffer_size = stub_clamp_buffer_size(buffer_size);
+}
+
+void
+stub_cycle_begin(
+  jack_client_t * client_ptr)
+{
+  struct list_head * node_ptr;
+  jack_port_t * port_ptr;
+  struct stub_midi_buffer * midi_ptr;
+
+  if (client_ptr->in_cycle)
+  {
+    return;
+  }
+
+  list_for_each(node_ptr, &client_ptr->ports)
+  {
+    port_ptr = list_entry(node_ptr, jack_port_t, siblings);
+    if (port_ptr->midi)
+    {
+      midi_ptr = calloc(1, sizeof(struct stub_midi_buffer));
+      if (midi_ptr == NULL)
+      {
+        stub_fail("out of memory");
+      }
+      midi_ptr->input = (port_ptr->flags & JackPortIsInput) != 0;
+      midi_ptr->nframes = client_ptr->buffer_size;
+      port_ptr->buffer_ptr = midi_ptr;
+    }
+    else
+    {
+      port_ptr->buffer_ptr = calloc(client_ptr->buffer_size, sizeof(jack_default_audio_sample_t));
+      if (port_ptr->buffer_ptr == NULL)
+      {
+        stub_fail("out of memory");
+      }
+    }
+  }
+
+  client_ptr->in_cycle = true;
+
+  stub_for_each_fed(client_ptr, stub_cycle_begin);
+}
+
+bool
+stub_midi_write(
+  jack_port_t * port_ptr,
+  jack_nframes_t time,
+  const unsigned char * data,
+  size_t size)
+{
+  struct stub_midi_buffer * midi_ptr;
+  struct stub_midi_event * event_ptr;
+
+  midi_ptr = port_ptr->buffer_ptr;
+  if (midi_ptr == NULL || !port_ptr->midi || !midi_ptr->input)
+  {
+    stub_fail("MIDI written to \"%s\" outside of cycle or not MIDI input", port_ptr->name);
+  }
+
+  if (midi_ptr->count == STUB_MIDI_EVENTS)
+  {
+    return false;
+  }
+
+  time %= midi_ptr->nframes;
+  if (midi_ptr->count > 0 && time < midi_ptr->events[midi_ptr->count - 1].time)
+  {
+    time = midi_ptr->events[midi_ptr->count - 1].time;
+  }
+
+  event_ptr = midi_ptr->events + midi_ptr->count;
+
+  /* allocated separately, so reads past event size are caught */
+  event_ptr->data_ptr = malloc(size > 0 ? size : 1);
+  if (event_ptr->data_ptr == NULL)
+  {
+    stub_fail("out of memory");
+  }
+  memcpy(event_ptr->data_ptr, data, size);
+  event_ptr->time = time;
+  event_ptr->size = size;
+  midi_ptr->count++;
+
+  return true;
+}
+
+static void
+stub_cycle_process_fed(
+  jack_client_t * client_ptr)
+{
+  stub_cycle_process(client_ptr);
+}
+
+int
+stub_cycle_process(
+  jack_client_t * client_ptr)
+{
+  int ret;
+
+  stub_cycle_begin(client_ptr);
+
+  ret = 0;
+  if (client_ptr->processed)
+  {
+    return ret;
+  }
+
+  client_ptr->processed = true;
+  if (client_ptr->active && client_ptr->process != NULL)
+  {
+    stub_in_process = true;
+    ret = client_ptr->process(client_ptr->buffer_size, client_ptr->process_arg);
+    stub_in_process = false;
+  }
+
+  stub_for_each_fed(client_ptr, stub_cycle_process_fed);
+
+  return ret;
+}
+
+void
+stub_cycle_end(
+  jack_client_t * client_ptr)
+{
+  struct list_head * node_ptr;
+
+  if (!client_ptr->in_cycle)
+  {
+    return;
+  }
+
+  list_for_each(node_ptr, &client_ptr->ports)
+  {
+    stub_free_buffer(list_entry(node_ptr, jack_port_t, siblings));
+  }
+
+  client_ptr->in_cycle = false;
+  client_ptr->processed = false;
+  client_ptr->frame_time += client_ptr->buffer_size;
+  if (client_ptr->rolling)
+  {
+    client_ptr->transport_frame += client_ptr->buffer_size;
+  }
+
+  stub_for_each_fed(client_ptr, stub_cycle_end);
+}
+
+int
+stub_cycle_run(
+  jack_client_t * client_ptr)
+{
+  int ret;
+
+  ret = stub_cycle_process(client_ptr);
+  stub_cycle_end(client_ptr);
+
+  return ret;
+}
+
+void
+stub_set_buffer_size(
+  jack_client_t * client_ptr,
+  jack_nframes_t buffer_size)
+{
+  struct list_head * node_ptr;
+
+  buffer_size = stub_clamp_buffer_size(buffer_size);
+  stub_buffer_size = buffer_size;
+
+  /* server wide, like JACK */
+  list_for_each(node_ptr, &stub_clients)
+  {
+    client_ptr = list_entry(node_ptr, jack_client_t, siblings);
+    if (client_ptr->in_cycle)
+    {
+      stub_fail("buffer size changed during cycle");
+    }
+
+    if (buffer_size == client_ptr->buffer_size)
+    {
+      continue;
+    }
+
+    client_ptr->buffer_size = buffer_size;
+    if (client_ptr->buffer_size_changed != NULL)
+    {
+      client_ptr->buffer_size_changed(buffer_size, client_ptr->buffer_size_arg);
+    }
+  }
+}
+
+void
+stub_set_sample_rate(
+  jack_client_t * client_ptr,
+  jack_nframes_t sample_rate)
+{
+  struct list_head * node_ptr;
+
+  if (sample_rate == 0)
+  {
+    return;
+  }
+
+  stub_sample_rate = sample_rate;
+
+  /* server wide, like JACK */
+  list_for_each(node_ptr, &stub_clients)
+  {
+    client_ptr = list_entry(node_ptr, jack_client_t, siblings);
+    if (sample_rate == client_ptr->sample_rate)
+    {
+      continue;
+    }
+
+    client_ptr->sample_rate = sample_rate;
+    if (client_ptr->sample_rate_changed != NULL)
+    {
+      client_ptr->sample_rate_changed(sample_rate, client_ptr->sample_rate_arg);
+    }
+  }
+}
+
+void
+stub_set_transport(
+  jack_client_t * client_ptr,
+  bool rolling,
+  jack_nframes_t frame)
+{
+  client_ptr->rolling = rolling;
+  client_ptr->transport_frame = frame;
+}
+
+unsigned int
+stub_port_count(
+  jack_client_t * client_ptr)
+{
+  struct list_head * node_ptr;
+  unsigned int count;
+
+  count = 0;
+  list_for_each(node_ptr, &client_ptr->ports)
+  {
+    count++;
+  }
+
+  return count;
+}
+
+/* libjack API */
+
+jack_client_t *
+jack_client_open(
+  const char * client_name,
+  jack_options_t options,
+  jack_status_t * status,
+  ...)
+{
+  jack_client_t * client_ptr;
+
+  client_ptr = calloc(1, sizeof(jack_client_t));
+  if (client_ptr == NULL)
+  {
+    return NULL;
+  }
+
+  snprintf(client_ptr->name, sizeof(client_ptr->name), "%s", client_name);
+  INIT_LIST_HEAD(&client_ptr->ports);
+  client_ptr->sample_rate = stub_sample_rate;
+  client_ptr->buffer_size = stub_buffer_size;
+  list_add_tail(&client_ptr->siblings, &stub_clients);
+
+  return client_ptr;
+}
+
+int
+jack_client_close(
+  jack_client_t * client_ptr)
+{
+  struct list_head * node_ptr;
+  struct list_head * next_ptr;
+  jack_port_t * port_ptr;
+
+  list_for_each_safe(node_ptr, next_ptr, &client_ptr->ports)
+  {
+    port_ptr = list_entry(node_ptr, jack_port_t, siblings);
+    stub_disconnect(port_ptr);
+    list_del(&port_ptr->siblings);
+    stub_free_buffer(port_ptr);
+    free(port_ptr);
+  }
+
+  list_del(&client_ptr->siblings);
+  free(client_ptr);
+
+  return 0;
+}
+
+char *
+jack_get_client_name(
+  jack_client_t * client_ptr)
+{
+  return client_ptr->name;
+}
+
+int
+jack_client_real_time_priority(
+  jack_client_t * client_ptr)
+{
+  /* not real-time, workers keep their scheduling */
+  return -1;
+}
+
+jack_nframes_t
+jack_get_sample_rate(
+  jack_client_t * client_ptr)
+{
+  return client_ptr->sample_rate;
+}
+
+jack_nframes_t
+jack_get_buffer_size(
+  jack_client_t * client_ptr)
+{
+  return client_ptr->buffer_size;
+}
+
+int
+jack_set_process_callback(
+  jack_client_t * client_ptr,
+  JackProcessCallback process_callback,
+  void * arg)
+{
+  client_ptr->process = process_callback;
+  client_ptr->process_arg = arg;
+  return 0;
+}
+
+int
+jack_set_sample_rate_callback(
+  jack_client_t * client_ptr,
+  JackSampleRateCallback srate_callback,
+  void * arg)
+{
+  client_ptr->sample_rate_changed = srate_callback;
+  client_ptr->sample_rate_arg = arg;
+  return 0;
+}
+
+int
+jack_set_buffer_size_callback(
+  jack_client_t * client_ptr,
+  JackBufferSizeCallback bufsize_callback,
+  void * arg)
+{
+  client_ptr->buffer_size_changed = bufsize_callback;
+  client_ptr->buffer_size_arg = arg;
+  return 0;
+}
+
+int
+jack_set_latency_callback(
+  jack_client_t * client_ptr,
+  JackLatencyCallback latency_callback,
+  void * arg)
+{
+  client_ptr->latency = latency_callback;
+  client_ptr->latency_arg = arg;
+  return 0;
+}
+
+/* clients run in order they were opened, capture latencies flow that way */
+int
+jack_recompute_total_latencies(
+  jack_client_t * client_ptr)
+{
+  struct list_head * node_ptr;
+
+  if (stub_in_process)
+  {
+    stub_fail("latencies recomputed in process callback");
+  }
+
+  list_for_each(node_ptr, &stub_clients)
+  {
+    stub_recompute_client_latency(list_entry(node_ptr, jack_client_t, siblings), JackCaptureLatency);
+  }
+
+  list_for_each_prev(node_ptr, &stub_clients)
+  {
+    stub_recompute_client_latency(list_entry(node_ptr, jack_client_t, siblings), JackPlaybackLatency);
+  }
+
+  return 0;
+}
+
+void
+jack_port_get_latency_range(
+  jack_port_t * port_ptr,
+  jack_latency_callback_mode_t mode,
+  jack_latency_range_t * range_ptr)
+{
+  *range_ptr = port_ptr->latencies[mode];
+}
+
+void
+jack_port_set_latency_range(
+  jack_port_t * port_ptr,
+  jack_latency_callback_mode_t mode,
+  jack_latency_range_t * range_ptr)
+{
+  if (stub_in_process)
+  {
+    stub_fail("latency of port \"%s\" set in process callback", port_ptr->name);
+  }
+
+  port_ptr->latencies[mode] = *range_ptr;
+}
+
+int
+jack_activate(
+  jack_client_t * client_ptr)
+{
+  client_ptr->active = true;
+  return 0;
+}
+
+jack_nframes_t
+jack_frame_time(
+  const jack_client_t * client_ptr)
+{
+  return client_ptr->frame_time;
+}
+
+jack_nframes_t
+jack_last_frame_time(
+  const jack_client_t * client_ptr)
+{
+  return client_ptr->frame_time;
+}
+
+jack_transport_state_t
+jack_transport_query(
+  const jack_client_t * client_ptr,
+  jack_position_t * pos)
+{
+  if (pos != NULL)
+  {
+    memset(pos, 0, sizeof(jack_position_t));
+    pos->frame = client_ptr->transport_frame;
+    pos->frame_rate = client_ptr->sample_rate;
+  }
+
+  return client_ptr->rolling ? JackTransportRolling : JackTransportStopped;
+}
+
+jack_port_t *
+jack_port_register(
+  jack_client_t * client_ptr,
+  const char * port_name,
+  const char * port_type,
+  unsigned long flags,
+  unsigned long buffer_size)
+{
+  jack_port_t * port_ptr;
+  char name[STUB_PORT_NAME_SIZE];
+
+  if (stub_in_process)
+  {
+    stub_fail("port \"%s\" registered in process callback", port_name);
+  }
+
+  if (!stub_port_full_name(client_ptr, port_name, name) || stub_find_port(client_ptr, name) != NULL)
+  {
+    return NULL;
+  }
+
+  port_ptr = calloc(1, sizeof(jack_port_t));
+  if (port_ptr == NULL)
+  {
+    return NULL;
+  }
+
+  port_ptr->client_ptr = client_ptr;
+  strcpy(port_ptr->name, name);
+  port_ptr->flags = flags;
+  port_ptr->midi = strcmp(port_type, JACK_DEFAULT_MIDI_TYPE) == 0;
+  list_add_tail(&port_ptr->siblings, &client_ptr->ports);
+
+  return port_ptr;
+}
+
+int
+jack_port_unregister(
+  jack_client_t * client_ptr,
+  jack_port_t * port_ptr)
+{
+  if (stub_in_process)
+  {
+    stub_fail("port \"%s\" unregistered in process callback", port_ptr->name);
+  }
+
+  if (port_ptr->client_ptr != client_ptr)
+  {
+    stub_fail("port \"%s\" unregistered through other client", port_ptr->name);
+  }
+
+  stub_disconnect(port_ptr);
+  list_del(&port_ptr->siblings);
+  stub_free_buffer(port_ptr);
+  free(port_ptr);
+
+  return 0;
+}
+
+void *
+jack_port_get_buffer(
+  jack_port_t * port_ptr,
+  jack_nframes_t nframes)
+{
+  if (port_ptr->buffer_ptr == NULL)
+  {
+    stub_fail("buffer of \"%s\" requested outside of cycle", port_ptr->name);
+  }
+
+  if (nframes != port_ptr->client_ptr->buffer_size)
+  {
+    stub_fail("buffer of \"%s\" requested for %u frames, buffer size is %u",
+              port_ptr->name, (unsigned int)nframes, (unsigned int)port_ptr->client_ptr->buffer_size);
+  }
+
+  return port_ptr->buffer_ptr;
+}
+
+int
+jack_port_set_name(
+  jack_port_t * port_ptr,
+  const char * port_name)
+{
+  char name[STUB_PORT_NAME_SIZE];
+
+  if (!stub_port_full_name(port_ptr->client_ptr, port_name, name))
+  {
+    return -1;
+  }
+
+  if (stub_find_port(port_ptr->client_ptr, name) != NULL)
+  {
+    return -1;
+  }
+
+  strcpy(port_ptr->name, name);
+
+  return 0;
+}
+
+const char *
+jack_port_name(
+  const jack_port_t * port_ptr)
+{
+  return port_ptr->name;
+}
+
+int
+jack_port_connected(
+  const jack_port_t * port_ptr)
+{
+  struct list_head * client_node_ptr;
+  struct list_head * node_ptr;
+  jack_port_t * other_ptr;
+  unsigned int i;
+  int count;
+
+  count = port_ptr->connections_count;
+
+  list_for_each(client_node_ptr, &stub_clients)
+  {
+    list_for_each(node_ptr, &list_entry(client_node_ptr, jack_client_t, siblings)->ports)
+    {
+      other_ptr = list_entry(node_ptr, jack_port_t, siblings);
+      for (i = 0 ; i < other_ptr->connections_count ; i++)
+      {
+        if (other_ptr->connections[i] == port_ptr)
+        {
+          count++;
+        }
+      }
+    }
+  }
+
+  return count;
+}
+
+int
+jack_connect(
+  jack_client_t * client_ptr,
+  const char * source_port,
+  const char * destination_port)
+{
+  jack_port_t * source_ptr;
+  jack_port_t * destination_ptr;
+
+  if (stub_in_process)
+  {
+    stub_fail("ports connected in process callback");
+  }
+
+  source_ptr = stub_find_any_port(source_port);
+  destination_ptr = stub_find_any_port(destination_port);
+  if (source_ptr == NULL || destination_ptr == NULL ||
+      (source_ptr->flags & JackPortIsOutput) == 0 ||
+      (destination_ptr->flags & JackPortIsInput) == 0 ||
+      source_ptr->midi != destination_ptr->midi)
+  {
+    return -1;
+  }
+
+  if (source_ptr->connections_count == STUB_CONNECTIONS_MAX)
+  {
+    stub_fail("too many connections from \"%s\"", source_ptr->name);
+  }
+
+  source_ptr->connections[source_ptr->connections_count++] = destination_ptr;
+
+  return 0;
+}
+
+uint32_t
+jack_midi_get_event_count(
+  void * port_buffer)
+{
+  return ((struct stub_midi_buffer *)port_buffer)->count;
+}
+
+int
+jack_midi_event_get(
+  jack_midi_event_t * event,
+  void * port_buffer,
+  uint32_t event_index)
+{
+  struct stub_midi_buffer * midi_ptr;
+
+  midi_ptr = port_buffer;
+  if (!midi_ptr->input || event_index >= midi_ptr->count)
+  {
+    return ENODATA;
+  }
+
+  event->time = midi_ptr->events[event_index].time;
+  event->size = midi_ptr->events[event_index].size;
+  event->buffer = midi_ptr->events[event_index].data_ptr;
+
+  return 0;
+}
+
+void
+jack_midi_clear_buffer(
+  void * port_buffer)
+{
+  struct stub_midi_buffer * midi_ptr;
+
+  midi_ptr = port_buffer;
+  if (midi_ptr->input)
+  {
+    stub_fail("MIDI input buffer cleared");
+  }
+
+  midi_ptr->count = 0;
+  midi_ptr->used = 0;
+}
+
+jack_midi_data_t *
+jack_midi_event_reserve(
+  void * port_buffer,
+  jack_nframes_t time,
+  size_t data_size)
+{
+  struct stub_midi_buffer * midi_ptr;
+  struct stub_midi_event * event_ptr;
+
+  midi_ptr = port_buffer;
+  if (midi_ptr->input)
+  {
+    stub_fail("MIDI event reserved in input buffer");
+  }
+
+  /* like JACK, refuse events out of order or past the cycle */
+  if (time >= midi_ptr->nframes ||
+      (midi_ptr->count > 0 && time < midi_ptr->events[midi_ptr->count - 1].time) ||
+      midi_ptr->count == STUB_MIDI_EVENTS ||
+      data_size > STUB_MIDI_BYTES - midi_ptr->used)
+  {
+    return NULL;
+  }
+
+  event_ptr = midi_ptr->events + midi_ptr->count;
+  event_ptr->time = time;
+  event_ptr->size = data_size;
+  event_ptr->data_ptr = midi_ptr->data + midi_ptr->used;
+  midi_ptr->used += data_size;
+  midi_ptr->count++;
+
+  return event_ptr->data_ptr;
+}
+
+/* ringbuffer, same semantics as JACK one, single reader and single writer */
+
+jack_ringbuffer_t *
+jack_ringbuffer_create(
+  size_t sz)
+{
+  jack_ringbuffer_t * rb;
+  size_t size;
+
+  for (size = 2 ; size < sz ; size <<= 1);
+
+  rb = malloc(sizeof(jack_ringbuffer_t));
+  if (rb == NULL)
+  {
+    return NULL;
+  }
+
+  rb->buf = malloc(size);
+  if (rb->buf == NULL)
+  {
+    free(rb);
+    return NULL;
+  }
+
+  rb->size = size;
+  rb->size_mask = size - 1;
+  rb->write_ptr = 0;
+  rb->read_ptr = 0;
+  rb->mlocked = 0;
+
+  return rb;
+}
+
+void
+jack_ringbuffer_free(
+  jack_ringbuffer_t * rb)
+{
+  free(rb->buf);
+  free(rb);
+}
+
+int
+jack_ringbuffer_mlock(
+  jack_ringbuffer_t * rb)
+{
+  rb->mlocked = 1;
+  return 0;
+}
+
+void
+jack_ringbuffer_reset(
+  jack_ringbuffer_t * rb)
+{
+  rb->read_ptr = 0;
+  rb->write_ptr = 0;
+}
+
+size_t
+jack_ringbuffer_read_space(
+  const jack_ringbuffer_t * rb)
+{
+  return (__atomic_load_n(&rb->write_ptr, __ATOMIC_ACQUIRE) - rb->read_ptr) & rb->size_mask;
+}
+
+size_t
+jack_ringbuffer_write_space(
+  const jack_ringbuffer_t * rb)
+{
+  return (__atomic_load_n(&rb->read_ptr, __ATOMIC_ACQUIRE) - rb->write_ptr - 1) & rb->size_mask;
+}
+
+size_t
+jack_ringbuffer_peek(
+  jack_ringbuffer_t * rb,
+  char * dest,
+  size_t cnt)
+{
+  size_t first;
+  size_t read_ptr;
+
+  if (cnt > jack_ringbuffer_read_space(rb))
+  {
+    cnt = jack_ringbuffer_read_space(rb);
+  }
+
+  read_ptr = rb->read_ptr;
+  first = rb->size - read_ptr;
+  if (first > cnt)
+  {
+    first = cnt;
+  }
+
+  memcpy(dest, rb->buf + read_ptr, first);
+  memcpy(dest + first, rb->buf, cnt - first);
+
+  return cnt;
+}
+
+void
+jack_ringbuffer_read_advance(
+  jack_ringbuffer_t * rb,
+  size_t cnt)
+{
+  __atomic_store_n(&rb->read_ptr, (rb->read_ptr + cnt) & rb->size_mask, __ATOMIC_RELEASE);
+}
+
+size_t
+jack_ringbuffer_read(
+  jack_ringbuffer_t * rb,
+  char * dest,
+  size_t cnt)
+{
+  cnt = jack_ringbuffer_peek(rb, dest, cnt);
+  jack_ringbuffer_read_advance(rb, cnt);
+
+  return cnt;
+}
+
+size_t
+jack_ringbuffer_write(
+  jack_ringbuffer_t * rb,
+  const char * src,
+  size_t cnt)
+{
+  size_t first;
+  size_t write_ptr;
+
+  if (cnt > jack_ringbuffer_write_space(rb))
+  {
+    cnt = jack_ringbuffer_write_space(rb);
+  }
+
+  write_ptr = rb->write_ptr;
+  first = rb->size - write_ptr;
+  if (first > cnt)
+  {
+    first = cnt;
+  }
+
+  memcpy(rb->buf + write_ptr, src, first);
+  memcpy(rb->buf, src + first, cnt - first);
+
+  __atomic_store_n(&rb->write_ptr, (write_ptr + cnt) & rb->size_mask, __ATOMIC_RELEASE);
+
+  return cnt;
+}
@@ -0,0 +1,110 @@
+/* -*- Mode: C ; c-basic-offset: 2 -*- */
+/*****************************************************************************
+ *
+ *   This file is part of jack_mixer
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ *****************************************************************************/
+
+#ifndef JACK_STUB_H__5C1E9B47_2D8A_4F63_B0E7_93A4D6C2F815__INCLUDED
+#define JACK_STUB_H__5C1E9B47_2D8A_4F63_B0E7_93A4D6C2F815__INCLUDED
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <jack/jack.h>
+
+/*
+ * In-process replacement for libjack, for exercising the engine without a
+ * JACK server. There is no server thread: callbacks run when the stub is
+ * told to run them, from the calling thread.
+ *
+ * Port buffers are allocated for each cycle, exactly nframes long, so
+ * accesses past the buffer size are caught by AddressSanitizer.
+ *
+ * Clients fed through port connections take part in the cycles of the
+ * client feeding them, and run after it. Buffer size and sample rate are
+ * the same for all clients. Latency callbacks run only when latencies are
+ * recomputed, in the order clients were opened.
+ */
+
+#define STUB_MAX_BUFFER_SIZE 4096
+#define STUB_MIDI_EVENTS     64
+#define STUB_MIDI_BYTES      1024
+
+/* true while a process callback runs */
+extern bool stub_in_process;
+
+/* parameters of clients opened from now on */
+void
+stub_configure(
+  jack_nframes_t sample_rate,
+  jack_nframes_t buffer_size);
+
+/* Allocate port buffers of the next cycle, input ones are filled with
+ * silence and can be filled through jack_port_get_buffer() or
+ * stub_midi_write() before stub_cycle_run() */
+void
+stub_cycle_begin(
+  jack_client_t * client_ptr);
+
+/* queue event for MIDI input port, any size and content, false if full;
+ * time is clamped to the cycle and to the previous event time */
+bool
+stub_midi_write(
+  jack_port_t * port_ptr,
+  jack_nframes_t time,
+  const unsigned char * data,
+  size_t size);
+
+/* Run process callback and free cycle buffers, frame time advances by
+ * buffer size */
+int
+stub_cycle_run(
+  jack_client_t * client_ptr);
+
+/* stub_cycle_run() in two steps, port buffers can be inspected in between */
+int
+stub_cycle_process(
+  jack_client_t * client_ptr);
+
+void
+stub_cycle_end(
+  jack_client_t * client_ptr);
+
+/* Change buffer size, calling buffer size callback like JACK does, between
+ * cycles. Size is clamped to 1 - STUB_MAX_BUFFER_SIZE. */
+void
+stub_set_buffer_size(
+  jack_client_t * client_ptr,
+  jack_nframes_t buffer_size);
+
+void
+stub_set_sample_rate(
+  jack_client_t * client_ptr,
+  jack_nframes_t sample_rate);
+
+/* transport state reported from next cycle on */
+void
+stub_set_transport(
+  jack_client_t * client_ptr,
+  bool rolling,
+  jack_nframes_t frame);
+
+/* number of registered ports of the client, not yet unregistered */
+unsigned int
+stub_port_count(
+  jack_client_t * client_ptr);
+
+#endif /* #ifndef JACK_STUB_H__5C1E9B47_2D8A_4F63_B0E7_93A4D6C2F815__INCLUDED */
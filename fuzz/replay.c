@@ -0,0 +1,629 @@
+/* -*- Mode: C ; c-basic-offset: 2 -*- */
+/*****************************************************************************
+ *
+ *   This file is part of jack_mixer
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ *****************************************************************************/
+
+/*
+ * Offline replay of a capture made with mixer_capture_start(), on top of
+ * the JACK stub. Each captured cycle is run through process() again: the
+ * channel set, parameters and routing are restored, input buffers and MIDI
+ * are fed, parameter changes applied during the cycle are scheduled at the
+ * same frames. Output is then compared with the captured one bit for bit.
+ *
+ *   ./replay capture-file
+ *
+ * Exit status is 0 when all output matches, 1 on mismatch, 2 if the
+ * capture cannot be replayed.
+ */
+
+/* engine is built into the replayer, so channel state can be restored */
+#include "jack_mixer.c"
+
+#include "jack_stub.h"
+
+#define REPLAY_REPORT_MAX 20    /* mismatching buffers reported */
+
+struct replay_record
+{
+  struct replay_record * next;
+  struct capture_record header;
+  uint64_t payload[];           /* aligned for any payload member */
+};
+
+struct replay
+{
+  FILE * file;
+  struct jack_mixer * mixer_ptr;
+  jack_client_t * client_ptr;
+  struct channel * channels[AUTOMATION_SLOTS];
+  bool outputs[AUTOMATION_SLOTS];
+  char * names[AUTOMATION_SLOTS];
+  struct replay_record * cycle_ptr; /* records of cycle being read */
+  struct replay_record ** tail_ptr_ptr;
+  unsigned long cycles;
+  unsigned long mismatches;     /* output buffers */
+  unsigned long mismatched_samples;
+  bool truncated;               /* capture ends within a record */
+};
+
+static void
+replay_fail(
+  struct replay * replay_ptr,
+  const char * message)
+{
+  fprintf(stderr, "replay: cycle %lu: %s\n", replay_ptr->cycles, message);
+  exit(2);
+}
+
+/* NULL at end of file, or on a record cut short */
+static struct replay_record *
+replay_read(
+  struct replay * replay_ptr)
+{
+  struct capture_record header;
+  struct replay_record * record_ptr;
+
+  if (fread(&header, sizeof(header), 1, replay_ptr->file) != 1)
+  {
+    return NULL;
+  }
+
+  record_ptr = malloc(sizeof(struct replay_record) + header.size);
+  if (record_ptr == NULL)
+  {
+    replay_fail(replay_ptr, "out of memory");
+  }
+
+  record_ptr->next = NULL;
+  record_ptr->header = header;
+  if (header.size > 0 && fread(record_ptr->payload, header.size, 1, replay_ptr->file) != 1)
+  {
+    fprintf(stderr, "replay: capture ends with an incomplete record\n");
+    replay_ptr->truncated = true;
+    free(record_ptr);
+    return NULL;
+  }
+
+  return record_ptr;
+}
+
+static void
+replay_free_cycle(
+  struct replay * replay_ptr)
+{
+  struct replay_record * record_ptr;
+
+  while (replay_ptr->cycle_ptr != NULL)
+  {
+    record_ptr = replay_ptr->cycle_ptr;
+    replay_ptr->cycle_ptr = record_ptr->next;
+    free(record_ptr);
+  }
+
+  replay_ptr->tail_ptr_ptr = &replay_ptr->cycle_ptr;
+}
+
+static const void *
+replay_payload(
+  struct replay * replay_ptr,
+  const struct replay_record * record_ptr,
+  size_t size)
+{
+  if (record_ptr->header.size < size)
+  {
+    replay_fail(replay_ptr, "record too short");
+  }
+
+  return record_ptr->payload;
+}
+
+static struct channel *
+replay_channel(
+  struct replay * replay_ptr,
+  uint32_t slot,
+  bool output)
+{
+  if (slot >= AUTOMATION_SLOTS ||
+      replay_ptr->channels[slot] == NULL ||
+      replay_ptr->outputs[slot] != output)
+  {
+    replay_fail(replay_ptr, "record refers to unknown channel");
+  }
+
+  return replay_ptr->channels[slot];
+}
+
+static const char *
+replay_channel_name(
+  struct replay * replay_ptr,
+  uint32_t slot)
+{
+  return replay_ptr->names[slot] != NULL ? replay_ptr->names[slot] : replay_ptr->channels[slot]->name;
+}
+
+static void
+replay_add(
+  struct replay * replay_ptr,
+  const struct capture_channel * channel_ptr)
+{
+  char name[32];
+
+  if (channel_ptr->slot >= AUTOMATION_SLOTS || replay_ptr->channels[channel_ptr->slot] != NULL)
+  {
+    replay_fail(replay_ptr, "channel added to slot in use");
+  }
+
+  snprintf(name, sizeof(name), "slot %" PRIu32, channel_ptr->slot);
+
+  if (channel_ptr->output)
+  {
+    replay_ptr->channels[channel_ptr->slot] = add_output_channel(replay_ptr->mixer_ptr, name, channel_ptr->stereo, channel_ptr->system);
+  }
+  else
+  {
+    replay_ptr->channels[channel_ptr->slot] = add_channel(replay_ptr->mixer_ptr, name, channel_ptr->stereo);
+  }
+
+  if (replay_ptr->channels[channel_ptr->slot] == NULL)
+  {
+    replay_fail(replay_ptr, "cannot add channel");
+  }
+
+  replay_ptr->outputs[channel_ptr->slot] = channel_ptr->output;
+}
+
+static void
+replay_name(
+  struct replay * replay_ptr,
+  const struct replay_record * record_ptr)
+{
+  const struct capture_name * name_ptr;
+  size_t size;
+
+  name_ptr = replay_payload(replay_ptr, record_ptr, sizeof(struct capture_name));
+  if (name_ptr->slot >= AUTOMATION_SLOTS)
+  {
+    return;
+  }
+
+  size = record_ptr->header.size - sizeof(struct capture_name);
+  free(replay_ptr->names[name_ptr->slot]);
+  replay_ptr->names[name_ptr->slot] = strndup(name_ptr->name, size);
+}
+
+static void
+replay_remove(
+  struct replay * replay_ptr,
+  const struct capture_slot * slot_ptr)
+{
+  struct channel * channel_ptr;
+
+  if (slot_ptr->slot >= AUTOMATION_SLOTS)
+  {
+    replay_fail(replay_ptr, "removal of unknown channel");
+  }
+
+  channel_ptr = replay_channel(replay_ptr, slot_ptr->slot, replay_ptr->outputs[slot_ptr->slot]);
+
+  if (replay_ptr->outputs[slot_ptr->slot])
+  {
+    remove_output_channel(channel_ptr);
+  }
+  else
+  {
+    remove_channel(channel_ptr);
+  }
+
+  replay_ptr->channels[slot_ptr->slot] = NULL;
+  free(replay_ptr->names[slot_ptr->slot]);
+  replay_ptr->names[slot_ptr->slot] = NULL;
+}
+
+static void
+replay_state(
+  struct replay * replay_ptr,
+  const struct capture_state * state_ptr)
+{
+  struct channel * channel_ptr;
+
+  if (state_ptr->slot >= AUTOMATION_SLOTS)
+  {
+    replay_fail(replay_ptr, "state of unknown channel");
+  }
+
+  channel_ptr = replay_channel(replay_ptr, state_ptr->slot, replay_ptr->outputs[state_ptr->slot]);
+
+  channel_ptr->volume = state_ptr->controls.volume;
+  channel_ptr->volume_new = state_ptr->controls.volume_new;
+  channel_ptr->volume_idx = state_ptr->volume_idx;
+  channel_ptr->balance = state_ptr->controls.balance;
+  channel_ptr->balance_new = state_ptr->controls.balance_new;
+  channel_ptr->balance_idx = state_ptr->balance_idx;
+  channel_ptr->out_mute = state_ptr->controls.out_mute;
+  channel_ptr->agc_enabled = state_ptr->controls.agc_enabled;
+  channel_ptr->agc_target_db = state_ptr->controls.agc_target_db;
+  channel_ptr->agc_max_gain_db = state_ptr->controls.agc_max_gain_db;
+  channel_ptr->agc_gate_db = state_ptr->controls.agc_gate_db;
+  channel_ptr->agc_energy = state_ptr->agc_energy;
+  channel_ptr->agc_frames = state_ptr->agc_frames;
+  channel_ptr->agc_level = state_ptr->agc_level;
+  channel_ptr->agc_gain = state_ptr->agc_gain;
+  channel_ptr->agc_gain_new = state_ptr->agc_gain_new;
+  channel_ptr->agc_gain_idx = state_ptr->agc_gain_idx;
+
+  if (state_ptr->controls.solo)
+  {
+    channel_solo(channel_ptr);
+  }
+  else
+  {
+    channel_unsolo(channel_ptr);
+  }
+
+  if (replay_ptr->outputs[state_ptr->slot])
+  {
+    ((struct output_channel *)channel_ptr)->prefader = state_ptr->controls.prefader;
+    ((struct output_channel *)channel_ptr)->double_precision = state_ptr->controls.double_precision;
+    output_channel_apply_monitor(
+      (struct output_channel *)channel_ptr,
+      state_ptr->controls.monitor_slot == AUTOMATION_NO_SLOT ? NULL :
+      replay_channel(
+        replay_ptr,
+        state_ptr->controls.monitor_slot,
+        state_ptr->controls.monitor_slot < AUTOMATION_SLOTS && replay_ptr->outputs[state_ptr->controls.monitor_slot]),
+      state_ptr->controls.monitor_prefader);
+  }
+}
+
+static void
+replay_routing(
+  struct replay * replay_ptr,
+  const struct capture_routing * routing_ptr)
+{
+  struct channel * output_ptr;
+  struct channel * input_ptr;
+
+  output_ptr = replay_channel(replay_ptr, routing_ptr->slot, true);
+  input_ptr = replay_channel(replay_ptr, routing_ptr->input_slot, false);
+
+  output_channel_set_muted(output_ptr, input_ptr, routing_ptr->muted);
+  output_channel_set_solo(output_ptr, input_ptr, routing_ptr->soloed);
+}
+
+/* buffer of port a buffer record is for, its samples checked for size */
+static float *
+replay_port_buffer(
+  struct replay * replay_ptr,
+  const struct replay_record * record_ptr,
+  jack_nframes_t nframes,
+  bool output)
+{
+  const struct capture_buffer * buffer_ptr;
+  struct channel * channel_ptr;
+
+  buffer_ptr = replay_payload(replay_ptr, record_ptr, sizeof(struct capture_buffer) + nframes * sizeof(float));
+  channel_ptr = replay_channel(replay_ptr, buffer_ptr->slot, output);
+
+  if (buffer_ptr->right && !channel_ptr->stereo)
+  {
+    replay_fail(replay_ptr, "right buffer of mono channel");
+  }
+
+  return jack_port_get_buffer(buffer_ptr->right ? channel_ptr->port_right : channel_ptr->port_left, nframes);
+}
+
+static void
+replay_schedule(
+  struct replay * replay_ptr,
+  const struct capture_event * capture_event_ptr,
+  jack_nframes_t nframes)
+{
+  struct scheduled_event event;
+
+  memset(&event, 0, sizeof(event));
+
+  if (capture_event_ptr->offset >= nframes)
+  {
+    replay_fail(replay_ptr, "event past end of cycle");
+  }
+
+  event.frame_time = jack_last_frame_time(replay_ptr->client_ptr) + capture_event_ptr->offset;
+  event.channel_ptr = replay_channel(replay_ptr, capture_event_ptr->slot, capture_event_ptr->type == AUTOMATION_SEND_MUTE);
+  event.input_ptr = NULL;
+  event.node_ptr = NULL;
+  event.value = capture_event_ptr->value;
+
+  switch (capture_event_ptr->type)
+  {
+  case AUTOMATION_VOLUME:
+    event.type = SCHEDULED_VOLUME;
+    break;
+  case AUTOMATION_BALANCE:
+    event.type = SCHEDULED_BALANCE;
+    break;
+  case AUTOMATION_OUT_MUTE:
+    event.type = SCHEDULED_OUT_MUTE;
+    break;
+  case AUTOMATION_SEND_MUTE:
+    event.type = SCHEDULED_SEND_MUTE;
+    event.input_ptr = replay_channel(replay_ptr, capture_event_ptr->input_slot, false);
+    if (event.value != 0.0)
+    {
+      event.node_ptr = g_slist_alloc();
+    }
+    break;
+  default:
+    replay_fail(replay_ptr, "unknown event type");
+  }
+
+  if (!mixer_schedule(replay_ptr->mixer_ptr, &event))
+  {
+    replay_fail(replay_ptr, "cannot schedule event");
+  }
+}
+
+static void
+replay_compare(
+  struct replay * replay_ptr,
+  const struct replay_record * record_ptr,
+  jack_nframes_t nframes)
+{
+  const struct capture_buffer * buffer_ptr;
+  const float * samples;
+  jack_nframes_t i;
+  jack_nframes_t first;
+  unsigned int count;
+
+  samples = replay_port_buffer(replay_ptr, record_ptr, nframes, true);
+  buffer_ptr = (const struct capture_buffer *)record_ptr->payload;
+
+  if (memcmp(samples, buffer_ptr->samples, nframes * sizeof(float)) == 0)
+  {
+    return;
+  }
+
+  count = 0;
+  first = 0;
+  for (i = 0 ; i < nframes ; i++)
+  {
+    if (memcmp(samples + i, buffer_ptr->samples + i, sizeof(float)) != 0)
+    {
+      if (count == 0)
+      {
+        first = i;
+      }
+      count++;
+    }
+  }
+
+  if (replay_ptr->mismatches < REPLAY_REPORT_MAX)
+  {
+    printf(
+      "cycle %lu: \"%s\" %s differs in %u of %u samples, first at frame %u: %.9g instead of %.9g\n",
+      replay_ptr->cycles,
+      replay_channel_name(replay_ptr, buffer_ptr->slot),
+      buffer_ptr->right ? "right" : "left",
+      count,
+      (unsigned int)nframes,
+      (unsigned int)first,
+      samples[first],
+      buffer_ptr->samples[first]);
+  }
+
+  replay_ptr->mismatches++;
+  replay_ptr->mismatched_samples += count;
+}
+
+static void
+replay_cycle(
+  struct replay * replay_ptr)
+{
+  const struct capture_cycle * cycle_ptr;
+  const struct capture_midi * midi_ptr;
+  struct replay_record * record_ptr;
+  float * samples;
+
+  cycle_ptr = replay_payload(replay_ptr, replay_ptr->cycle_ptr, sizeof(struct capture_cycle));
+
+  if (cycle_ptr->nframes == 0 || cycle_ptr->nframes > STUB_MAX_BUFFER_SIZE)
+  {
+    replay_fail(replay_ptr, "buffer size not supported by the JACK stub");
+  }
+
+  if (replay_ptr->mixer_ptr == NULL)
+  {
+    stub_configure(cycle_ptr->sample_rate, cycle_ptr->nframes);
+    replay_ptr->mixer_ptr = create("replay", false);
+    if (replay_ptr->mixer_ptr == NULL)
+    {
+      replay_fail(replay_ptr, "cannot create mixer");
+    }
+    replay_ptr->client_ptr = replay_ptr->mixer_ptr->jack_client;
+  }
+
+  if (cycle_ptr->sample_rate != jack_get_sample_rate(replay_ptr->client_ptr))
+  {
+    stub_set_sample_rate(replay_ptr->client_ptr, cycle_ptr->sample_rate);
+  }
+  if (cycle_ptr->nframes != jack_get_buffer_size(replay_ptr->client_ptr))
+  {
+    stub_set_buffer_size(replay_ptr->client_ptr, cycle_ptr->nframes);
+  }
+  stub_set_transport(replay_ptr->client_ptr, cycle_ptr->transport_rolling, cycle_ptr->transport_frame);
+
+  /* channel set and parameters, between cycles */
+  for (record_ptr = replay_ptr->cycle_ptr->next ; record_ptr != NULL ; record_ptr = record_ptr->next)
+  {
+    switch (record_ptr->header.type)
+    {
+    case CAPTURE_CHANNEL:
+      replay_add(replay_ptr, replay_payload(replay_ptr, record_ptr, sizeof(struct capture_channel)));
+      break;
+    case CAPTURE_NAME:
+      replay_name(replay_ptr, record_ptr);
+      break;
+    case CAPTURE_REMOVE:
+      replay_remove(replay_ptr, replay_payload(replay_ptr, record_ptr, sizeof(struct capture_slot)));
+      break;
+    case CAPTURE_STATE:
+      replay_state(replay_ptr, replay_payload(replay_ptr, record_ptr, sizeof(struct capture_state)));
+      break;
+    case CAPTURE_ROUTING:
+      replay_routing(replay_ptr, replay_payload(replay_ptr, record_ptr, sizeof(struct capture_routing)));
+      break;
+    case CAPTURE_EVENT:
+      replay_schedule(replay_ptr, replay_payload(replay_ptr, record_ptr, sizeof(struct capture_event)), cycle_ptr->nframes);
+      break;
+    }
+  }
+
+  /* Output buffers start out as captured, so that samples the engine does
+   * not write (muted output channel) match too */
+  stub_cycle_begin(replay_ptr->client_ptr);
+  for (record_ptr = replay_ptr->cycle_ptr->next ; record_ptr != NULL ; record_ptr = record_ptr->next)
+  {
+    switch (record_ptr->header.type)
+    {
+    case CAPTURE_INPUT:
+    case CAPTURE_OUTPUT:
+      samples = replay_port_buffer(replay_ptr, record_ptr, cycle_ptr->nframes, record_ptr->header.type == CAPTURE_OUTPUT);
+      memcpy(samples, ((const struct capture_buffer *)record_ptr->payload)->samples, cycle_ptr->nframes * sizeof(float));
+      break;
+    case CAPTURE_MIDI:
+      midi_ptr = replay_payload(replay_ptr, record_ptr, sizeof(struct capture_midi));
+      stub_midi_write(
+        replay_ptr->mixer_ptr->port_midi_in,
+        midi_ptr->time,
+        midi_ptr->data,
+        midi_ptr->size < sizeof(midi_ptr->data) ? midi_ptr->size : sizeof(midi_ptr->data));
+      break;
+    }
+  }
+
+  stub_cycle_process(replay_ptr->client_ptr);
+
+  for (record_ptr = replay_ptr->cycle_ptr->next ; record_ptr != NULL ; record_ptr = record_ptr->next)
+  {
+    if (record_ptr->header.type == CAPTURE_OUTPUT)
+    {
+      replay_compare(replay_ptr, record_ptr, cycle_ptr->nframes);
+    }
+  }
+
+  stub_cycle_end(replay_ptr->client_ptr);
+
+  /* list nodes handed back by the process callback */
+  pthread_mutex_lock(&replay_ptr->mixer_ptr->mutex);
+  mixer_free_released_nodes(replay_ptr->mixer_ptr);
+  pthread_mutex_unlock(&replay_ptr->mixer_ptr->mutex);
+
+  replay_ptr->cycles++;
+}
+
+int
+main(
+  int argc,
+  char ** argv)
+{
+  struct replay replay;
+  struct replay_record * record_ptr;
+  char magic[sizeof(CAPTURE_MAGIC) - 1];
+  unsigned int slot;
+  struct capture_slot removed;
+
+  if (argc != 2)
+  {
+    fprintf(stderr, "usage: %s capture-file\n", argv[0]);
+    return 2;
+  }
+
+  memset(&replay, 0, sizeof(replay));
+  replay.tail_ptr_ptr = &replay.cycle_ptr;
+
+  replay.file = fopen(argv[1], "rb");
+  if (replay.file == NULL)
+  {
+    fprintf(stderr, "replay: cannot open \"%s\"\n", argv[1]);
+    return 2;
+  }
+
+  if (fread(magic, sizeof(magic), 1, replay.file) != 1 ||
+      memcmp(magic, CAPTURE_MAGIC, sizeof(magic)) != 0)
+  {
+    fprintf(stderr, "replay: \"%s\" is not a capture file\n", argv[1]);
+    return 2;
+  }
+
+  while ((record_ptr = replay_read(&replay)) != NULL)
+  {
+    if (record_ptr->header.type == CAPTURE_OVERRUN)
+    {
+      fprintf(stderr, "replay: capture overran, last cycle is incomplete\n");
+      free(record_ptr);
+      replay_free_cycle(&replay);
+      break;
+    }
+
+    if (record_ptr->header.type == CAPTURE_CYCLE && replay.cycle_ptr != NULL)
+    {
+      replay_cycle(&replay);
+      replay_free_cycle(&replay);
+    }
+
+    /* nothing comes before the first cycle, but be lenient */
+    if (record_ptr->header.type != CAPTURE_CYCLE && replay.cycle_ptr == NULL)
+    {
+      free(record_ptr);
+      continue;
+    }
+
+    *replay.tail_ptr_ptr = record_ptr;
+    replay.tail_ptr_ptr = &record_ptr->next;
+  }
+
+  /* last cycle is incomplete if capture did not stop cleanly */
+  if (replay.cycle_ptr != NULL && !replay.truncated)
+  {
+    replay_cycle(&replay);
+  }
+  replay_free_cycle(&replay);
+
+  fclose(replay.file);
+
+  printf(
+    "%lu cycles replayed, %lu output buffers differ, %lu samples\n",
+    replay.cycles,
+    replay.mismatches,
+    replay.mismatched_samples);
+
+  for (slot = 0 ; slot < AUTOMATION_SLOTS ; slot++)
+  {
+    if (replay.channels[slot] != NULL)
+    {
+      removed.slot = slot;
+      replay_remove(&replay, &removed);
+    }
+  }
+
+  if (replay.mixer_ptr != NULL)
+  {
+    destroy(replay.mixer_ptr);
+  }
+
+  return replay.mismatches == 0 ? 0 : 1;
+}
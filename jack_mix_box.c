@@ -26,7 +26,10 @@
  * input channels controlled by MIDI control change (CC) codes.
  *
  * Usage:
- *   jack_mix_box [ -n JACK_CLI_NAME ] MIDI_CC_1 MIDI_CC_2 ....
+ *   jack_mix_box [ -n JACK_CLI_NAME ] [ -s STATE_FILE ] MIDI_CC_1 MIDI_CC_2 ....
+ *
+ * With a state file, channel volumes are kept in it as they change, and are
+ * restored from it when jack_mix_box is restarted (after a crash, say).
  */
 
 #include <stdlib.h>
@@ -43,6 +46,9 @@ main(int argc, char *argv[])
 	jack_mixer_t mixer;
 	jack_mixer_channel_t main_mix_channel;
 	char *jack_cli_name = NULL;
+	char *state_file = NULL;
+	char *capture_file = NULL;
+	unsigned int workers = 0;
 	int channel_index;
 
 	while (1) {
@@ -50,11 +56,14 @@ main(int argc, char *argv[])
 		static struct option long_options[] =
 		{
 			{"name",  required_argument, 0, 'n'},
+			{"state", required_argument, 0, 's'},
+			{"capture", required_argument, 0, 'c'},
+			{"workers", required_argument, 0, 'w'},
 			{0, 0, 0, 0}
 		};
 		int option_index = 0;
 
-		c = getopt_long (argc, argv, "n:", long_options, &option_index);
+		c = getopt_long (argc, argv, "n:s:c:w:", long_options, &option_index);
 		if (c == -1)
 			break;
 
@@ -62,6 +71,15 @@ main(int argc, char *argv[])
 			case 'n':
 				jack_cli_name = strdup(optarg);
 				break;
+			case 's':
+				state_file = strdup(optarg);
+				break;
+			case 'c':
+				capture_file = strdup(optarg);
+				break;
+			case 'w':
+				workers = atoi(optarg);
+				break;
 			default:
 				fprintf(stderr, "Unknown argument, aborting.\n");
 				exit(1);
@@ -82,8 +100,24 @@ main(int argc, char *argv[])
 		jack_cli_name = strdup("jack_mix_box");
 	}
 
+	if (workers > 0 && !mixer_set_worker_threads(workers, true)) {
+		fprintf(stderr, "Failed to start %u worker threads, aborting\n", workers);
+		exit(1);
+	}
+
 	mixer = create(jack_cli_name, false);
 
+	if (state_file != NULL && !mixer_state_attach(mixer, state_file)) {
+		fprintf(stderr, "Failed to attach state file %s, aborting\n", state_file);
+		exit(1);
+	}
+	free(state_file);
+
+	if (capture_file != NULL && !mixer_capture_start(mixer, capture_file)) {
+		fprintf(stderr, "Failed to start capture to %s, aborting\n", capture_file);
+		exit(1);
+	}
+
 	channel_index = 0;
 	while (optind < argc) {
 		char *channel_name;
@@ -101,11 +135,27 @@ main(int argc, char *argv[])
 		}
 		channel_set_volume_midi_cc(channel, atoi(argv[optind++]));
 		channel_set_midi_scale(channel, scale);
-		channel_volume_write(channel, 0);
+		if (!channel_is_restored(channel)) {
+			channel_volume_write(channel, 0);
+		}
 	}
 
+	/* channels of a previous run that are gone now */
+	mixer_state_release_unclaimed(mixer);
+
 	while (true) {
+		unsigned int level;
+		float load;
+		uint32_t frame_time;
+
 		sleep(1);
+
+		/* publishes port latencies after MIDI routing changes */
+		mixer_read_events(mixer);
+
+		while (mixer_read_overload_transition(mixer, &level, &load, &frame_time)) {
+			fprintf(stderr, "Engine load %.0f%% of period, shed level %u\n", load * 100, level);
+		}
 	}
 
 	return 0;
@@ -29,30 +29,126 @@
 #include <stdbool.h>
 #include <math.h>
 #include <jack/jack.h>
+#include <jack/ringbuffer.h>
 #if defined(HAVE_JACK_MIDI)
 #include <jack/midiport.h>
 #endif
 #include <assert.h>
 #include <pthread.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/eventfd.h>
 
 #include <glib.h>
 
 #include "jack_mixer.h"
 //#define LOG_LEVEL LOG_LEVEL_DEBUG
 #include "log.h"
+#include "state.h"
+#include "automation.h"
+#include "capture.h"
+#include "kernels.h"
+#include "workers.h"
+#if defined(HAVE_SNDFILE)
+#include "player.h"
+#endif
 
 #include "jack_compat.h"
 
 #define VOLUME_TRANSITION_SECONDS 0.01
 #define PEAK_FRAMES_CHUNK 4800
-// we don't know how much to allocate, but we don't want to wait with 
-// allocating until we're in the process() callback, so we just take a 
-// fairly big chunk: 4 periods per buffer, 4096 samples per period.
-// (not sure if the '*4' is needed)
-#define MAX_BLOCK_SIZE (4 * 4096)
+#define AGC_BLOCKS_PER_SECOND 10
+#define AGC_ATTACK 0.5          /* level smoothing per block, level rising */
+#define AGC_RELEASE 0.1         /* level smoothing per block, level falling */
+#define SCHEDULED_EVENTS_MAX 1024
+#define OUT_MUTE_FLIPS_MAX 16     /* per input channel and cycle, for shard clients */
+#define GOVERNOR_AVERAGE_SECONDS 0.05 /* time constant of load average */
+#define GOVERNOR_HIGH_LOAD 0.7        /* of period, sheds next level if exceeded for GOVERNOR_SHED_SECONDS */
+#define GOVERNOR_LOW_LOAD 0.4         /* of period, restores a level if not reached for GOVERNOR_RESTORE_SECONDS */
+#define GOVERNOR_SHED_SECONDS 0.1
+#define GOVERNOR_RESTORE_SECONDS 2.0
+#define GOVERNOR_TRANSITIONS_MAX 64   /* buffered until the UI reads them */
+#define MIXER_JOBS_MAX 256            /* channels handed to the worker pool at once */
+#define MIXER_SHARDS_MAX 16
+#define DELAY_CHUNK_MIN 256           /* frames of delay line beyond longest delay, delayed per copy at least */
 
 #define FLOAT_EXISTS(x) (!((x) - (x)))
 
+/* mirror a channel parameter into its state file record, if any */
+#define STATE_STORE(channel, type, field, value)                              \
+  do                                                                          \
+  {                                                                           \
+    if ((channel)->state_record_ptr != NULL)                                  \
+    {                                                                         \
+      state_store_ ## type(&(channel)->state_record_ptr->field, (value));     \
+    }                                                                         \
+  } while (0)
+
+/* Per channel scratch buffers, sized for the JACK buffer size. When it
+ * grows, new buffers are allocated outside of the process callback and
+ * handed to it through channel pending_buffers_ptr. The process callback
+ * puts the buffers it stops using on retired_buffers_ptr list, to be freed
+ * outside of it again. */
+struct channel_buffers
+{
+  struct channel_buffers * next; /* retired list link */
+  jack_nframes_t size;
+  jack_default_audio_sample_t * tmp_mixed_frames_left;
+  jack_default_audio_sample_t * tmp_mixed_frames_right;
+  jack_default_audio_sample_t * frames_left;
+  jack_default_audio_sample_t * frames_right;
+  jack_default_audio_sample_t * prefader_frames_left;
+  jack_default_audio_sample_t * prefader_frames_right;
+  double * mixed_double_left;   /* output channel sums in double precision */
+  double * mixed_double_right;
+  jack_default_audio_sample_t samples[];
+};
+
+/* Delay line of an input channel, one ring of frames per side, sized for
+ * the longest delay at a sample rate. It is allocated outside of the
+ * process callback and handed to it like channel buffers. */
+struct channel_delay
+{
+  struct channel_delay * next;  /* retired list link */
+  jack_nframes_t size;          /* frames of each ring */
+  jack_nframes_t write_idx;     /* next frame written, process callback only */
+  jack_default_audio_sample_t * ring_left;
+  jack_default_audio_sample_t * ring_right;
+  jack_default_audio_sample_t samples[];
+};
+
+#define SCHEDULED_VOLUME    0
+#define SCHEDULED_BALANCE   1
+#define SCHEDULED_OUT_MUTE  2
+#define SCHEDULED_SEND_MUTE 3 /* input muted in output channel */
+#define SCHEDULED_PLAY      4 /* start player of channel from file start */
+#define SCHEDULED_STOP      5
+#define SCHEDULED_MONITOR   6 /* input_ptr becomes source of output channel, value is prefader */
+#define SCHEDULED_CANCEL    7 /* drop events of channel, it is being removed */
+/* types from SCHEDULED_CANCEL on are handled on receipt, not queued by frame time */
+#define SCHEDULED_CAPTURE_SEND_MUTE 8 /* record send mute change made outside of the process callback */
+
+struct overload_transition
+{
+  unsigned int level;
+  float load;
+  uint32_t frame_time;
+};
+
+/* parameter change to apply at a JACK frame time */
+struct scheduled_event
+{
+  jack_nframes_t frame_time;
+  unsigned int type;
+  struct channel * channel_ptr;
+  struct channel * input_ptr;   /* SCHEDULED_SEND_MUTE, SCHEDULED_MONITOR */
+  GSList * node_ptr;            /* SCHEDULED_SEND_MUTE, list node preallocated for the process callback */
+  unsigned int slot;            /* SCHEDULED_CAPTURE_SEND_MUTE, output channel */
+  unsigned int input_slot;      /* SCHEDULED_CAPTURE_SEND_MUTE */
+  float value;
+};
+
 struct channel
 {
   struct jack_mixer * mixer_ptr;
@@ -74,22 +170,48 @@ struct channel
   float meter_left;
   float meter_right;
   float abspeak;
-  jack_port_t * port_left;
+  jack_port_t * port_left;      /* NULL for player channels */
   jack_port_t * port_right;
+  struct player * player_ptr;   /* file played as input, instead of ports */
+  jack_nframes_t latency;       /* frames channel processing delays audio by, the delay of input channels */
+
+  float delay_ms;               /* set delay, unless following port latencies */
+  bool delay_auto;              /* delay aligns channel with the latest of auto ones */
+  jack_nframes_t delay_rate;    /* sample rate of last delay line handed over, 0 if none */
+  struct channel_delay * delay_ptr;          /* used by process callback */
+  struct channel_delay * pending_delay_ptr;  /* to be used from next cycle */
+  struct channel_delay * retired_delay_ptr;  /* no longer used, to be freed */
 
   jack_nframes_t peak_frames;
   float peak_left;
   float peak_right;
 
+  unsigned int meter_subscribers; /* MIXER_METER_PEAK subscriptions */
+  unsigned int clip_subscribers;  /* MIXER_METER_CLIP subscriptions */
+  unsigned int clip_count;
+
+  /* copies of buffers_ptr members, for the process callback */
   jack_default_audio_sample_t * tmp_mixed_frames_left;
   jack_default_audio_sample_t * tmp_mixed_frames_right;
   jack_default_audio_sample_t * frames_left;
   jack_default_audio_sample_t * frames_right;
   jack_default_audio_sample_t * prefader_frames_left;
   jack_default_audio_sample_t * prefader_frames_right;
+  double * mixed_double_left;
+  double * mixed_double_right;
+
+  struct channel_buffers * buffers_ptr;         /* used by process callback */
+  struct channel_buffers * pending_buffers_ptr; /* to be used from next cycle */
+  struct channel_buffers * retired_buffers_ptr; /* no longer used, to be freed */
 
   bool NaN_detected;
 
+  /* out_mute at cycle start and frames it flipped at since, so that shard
+   * clients mixing after the mixer client route input as it did */
+  bool cycle_out_mute;
+  jack_nframes_t out_mute_flips[OUT_MUTE_FLIPS_MAX];
+  unsigned int out_mute_flips_count;
+
   int midi_cc_volume_index;
   int midi_cc_balance_index;
   int midi_cc_mute_index;
@@ -104,20 +226,69 @@ struct channel
   bool midi_out_has_events;
 
   jack_mixer_scale_t midi_scale;
+
+  GSList * solo_node_ptr;       /* spare list node, for soloing through MIDI in the process callback */
+
+  struct state_record * state_record_ptr;
+  bool restored;
+
+  /* automatic gain, level detected in the meter pass and gain applied
+   * through a ramp like volume */
+  bool agc_enabled;
+  float agc_target_db;          /* short term RMS level to reach */
+  float agc_max_gain_db;
+  float agc_gate_db;            /* blocks below this RMS level do not change gain */
+  double agc_energy;            /* sum of squared input samples in current block */
+  jack_nframes_t agc_frames;
+  float agc_level;              /* smoothed mean square of input */
+  float agc_gain;
+  float agc_gain_new;
+  jack_nframes_t agc_gain_idx;
+
+  unsigned int automation_slot;
+  /* last recorded values, RT only */
+  float automation_volume;
+  float automation_balance;
+  float automation_out_mute;
+
+  struct capture_controls capture_controls; /* last captured, RT only */
+};
+
+/* Extra JACK client mixing some of the output channels. It is fed by the
+ * mixer client through a port, so JACK runs it once the mixer client has
+ * processed the input channels of the cycle. */
+struct mixer_shard
+{
+  struct jack_mixer * mixer_ptr;
+  jack_client_t * jack_client;
+  jack_port_t * port_sync;
+  unsigned int outputs_count;   /* output channels this client mixes */
 };
 
 struct output_channel {
   struct channel channel;
+  struct mixer_shard * shard_ptr; /* client owning the ports, NULL for the mixer one */
   GSList *soloed_channels;
   GSList *muted_channels;
   bool system; /* system channel, without any associated UI */
   bool prefader;
+  bool double_precision;        /* sum inputs in double, round once */
+  /* channel mixed instead of own routing, NULL for none, set by the
+   * process callback */
+  struct channel * monitor_source;
+  bool monitor_bus;             /* monitor_source is an output channel */
+  bool monitor_prefader;
+  /* routing of input channel slots last captured, RT only */
+  uint8_t capture_muted[AUTOMATION_SLOTS / 8];
+  uint8_t capture_soloed[AUTOMATION_SLOTS / 8];
 };
 
 struct jack_mixer
 {
-  pthread_mutex_t mutex;
+  pthread_mutex_t mutex;        /* serializes channel buffer allocation and event scheduling */
   jack_client_t * jack_client;
+  jack_nframes_t sample_rate;
+  jack_nframes_t buffers_size;  /* size of channel buffers, in frames */
   GSList *input_channels_list;
   GSList *output_channels_list;
   GSList *soloed_channels;
@@ -127,6 +298,61 @@ struct jack_mixer
   int last_midi_channel;
 
   struct channel* midi_cc_map[128];
+
+  GHashTable * channels_by_name;      /* input channels, by channel name */
+  GHashTable * channels_by_port_name; /* input channels, by full JACK port name */
+
+  struct mixer_state * state_ptr;
+
+  int event_fd;                 /* readable when pending_events is not zero */
+  unsigned int cycle_events;    /* MIXER_EVENT_* raised in current cycle, RT only */
+  unsigned int pending_events;  /* MIXER_EVENT_* not yet read by the UI */
+
+  jack_ringbuffer_t * scheduled_ring;     /* struct scheduled_event, to the process callback */
+  jack_ringbuffer_t * released_ring;      /* GSList nodes, from the process callback */
+  unsigned int scheduled_pending;         /* events written and not yet applied */
+  struct scheduled_event scheduled_events[SCHEDULED_EVENTS_MAX]; /* RT only, by frame time */
+  unsigned int scheduled_count;
+
+  struct
+  {
+    struct channel * channel_ptr;
+    bool output;
+  } automation_slots[AUTOMATION_SLOTS]; /* protected by mutex, read by the process callback */
+  unsigned int automation_next_slot;
+  struct automation * automation_ptr;    /* set by UI thread */
+  unsigned int automation_overruns;      /* events not recorded because disk thread lagged */
+  unsigned int process_cycles;
+  struct capture * capture_ptr;          /* set by UI thread */
+  GSList * stopped_automations;          /* stopped while the process callback did not run */
+  GSList * stopped_captures;             /* likewise, freed once the client is closed */
+
+  unsigned int shed_level;               /* MIXER_SHED_*, set by process callback */
+  unsigned int layout;                   /* KERNELS_LAYOUT_* of channel frames, fixed */
+  struct workers_slot * workers_slot_ptr; /* NULL if mixing is not shared with the worker pool */
+  struct mixer_shard shards[MIXER_SHARDS_MAX]; /* fixed after create */
+  unsigned int shards_count;
+  jack_port_t * port_shards_sync;        /* feeds the shard clients */
+  bool routing_changed;                  /* port latencies are stale, set by any thread */
+  jack_ringbuffer_t * overload_ring;     /* struct overload_transition, from the process callback */
+
+  /* RT only */
+  struct automation * automation_rt_ptr; /* automation used in current cycle */
+  bool automation_snapshot;              /* record all values at next rolling cycle */
+  jack_nframes_t automation_frame;       /* transport frame of changes being applied */
+  bool transport_rolling;
+  jack_nframes_t transport_frame;        /* at cycle start */
+  jack_nframes_t transport_next_frame;   /* expected at next cycle start, unless relocated */
+  struct capture * capture_rt_ptr;       /* capture used in current cycle */
+  struct channel * capture_channels[AUTOMATION_SLOTS]; /* by slot, channels the capture knows */
+  size_t capture_output_size;            /* bytes output buffers of current cycle take */
+  jack_nframes_t capture_offset;         /* frame in cycle of changes being applied */
+  float governor_load;                   /* average process callback time, as fraction of period */
+  jack_nframes_t governor_high_frames;   /* for how long load was above GOVERNOR_HIGH_LOAD */
+  jack_nframes_t governor_low_frames;    /* for how long load was below GOVERNOR_LOW_LOAD */
+  void * jobs[MIXER_JOBS_MAX];           /* channels of batch given to the worker pool */
+  jack_nframes_t jobs_start;
+  jack_nframes_t jobs_end;
 };
 
 static jack_mixer_output_channel_t create_output_channel(
@@ -140,6 +366,20 @@ update_channel_buffers(
   struct channel * channel_ptr,
   jack_nframes_t nframes);
 
+static void
+output_channel_state_store_routing(
+  struct output_channel * output_channel_ptr,
+  struct channel * input_ptr,
+  bool value,
+  bool solo);
+
+static void
+mixer_capture_state(
+  struct jack_mixer * mixer_ptr,
+  struct channel * channel_ptr,
+  bool output,
+  bool force);
+
 
 float
 value_to_db(
@@ -160,335 +400,286 @@ db_to_value(
   return powf(10.0, db/20.0);
 }
 
-#define channel_ptr ((struct channel *)channel)
-
-const char*
-channel_get_name(
-  jack_mixer_channel_t channel)
+static struct channel_buffers *
+channel_buffers_alloc(
+  jack_nframes_t size)
 {
-  return channel_ptr->name;
+  struct channel_buffers * buffers_ptr;
+
+  buffers_ptr = calloc(1, sizeof(struct channel_buffers) + 6 * size * sizeof(jack_default_audio_sample_t) + 2 * size * sizeof(double));
+  if (buffers_ptr == NULL)
+  {
+    return NULL;
+  }
+
+  buffers_ptr->size = size;
+  buffers_ptr->tmp_mixed_frames_left = buffers_ptr->samples;
+  buffers_ptr->tmp_mixed_frames_right = buffers_ptr->samples + size;
+  buffers_ptr->frames_left = buffers_ptr->samples + 2 * size;
+  buffers_ptr->frames_right = buffers_ptr->samples + 3 * size;
+  buffers_ptr->prefader_frames_left = buffers_ptr->samples + 4 * size;
+  buffers_ptr->prefader_frames_right = buffers_ptr->samples + 5 * size;
+  buffers_ptr->mixed_double_left = (double *)(buffers_ptr->samples + 6 * size);
+  buffers_ptr->mixed_double_right = buffers_ptr->mixed_double_left + size;
+
+  return buffers_ptr;
 }
 
-void
-channel_rename(
-  jack_mixer_channel_t channel,
-  const char * name)
+static void
+channel_buffers_free_list(
+  struct channel_buffers * buffers_ptr)
 {
-  char * new_name;
-  size_t channel_name_size;
-  char * port_name;
-  int ret;
+  struct channel_buffers * next_ptr;
 
-  new_name = strdup(name);
-  if (new_name == NULL)
+  while (buffers_ptr != NULL)
   {
-    return;
+    next_ptr = buffers_ptr->next;
+    free(buffers_ptr);
+    buffers_ptr = next_ptr;
   }
+}
 
-  if (channel_ptr->name)
+static void
+channel_use_buffers(
+  struct channel * channel_ptr,
+  struct channel_buffers * buffers_ptr)
+{
+  channel_ptr->buffers_ptr = buffers_ptr;
+  channel_ptr->tmp_mixed_frames_left = buffers_ptr->tmp_mixed_frames_left;
+  channel_ptr->tmp_mixed_frames_right = buffers_ptr->tmp_mixed_frames_right;
+  channel_ptr->frames_left = buffers_ptr->frames_left;
+  channel_ptr->frames_right = buffers_ptr->frames_right;
+  channel_ptr->prefader_frames_left = buffers_ptr->prefader_frames_left;
+  channel_ptr->prefader_frames_right = buffers_ptr->prefader_frames_right;
+  channel_ptr->mixed_double_left = buffers_ptr->mixed_double_left;
+  channel_ptr->mixed_double_right = buffers_ptr->mixed_double_right;
+}
+
+/* must not be called from the process callback, mixer mutex must be locked */
+static bool
+channel_init_buffers(
+  struct channel * channel_ptr)
+{
+  struct channel_buffers * buffers_ptr;
+
+  buffers_ptr = channel_buffers_alloc(channel_ptr->mixer_ptr->buffers_size);
+  if (buffers_ptr == NULL)
   {
-    free(channel_ptr->name);
+    return false;
   }
 
-  channel_ptr->name = new_name;
+  channel_use_buffers(channel_ptr, buffers_ptr);
+  channel_ptr->pending_buffers_ptr = NULL;
+  channel_ptr->retired_buffers_ptr = NULL;
 
-  if (channel_ptr->stereo)
+  return true;
+}
+
+/* must not be called from the process callback, mixer mutex must be locked */
+static bool
+channel_replace_buffers(
+  struct channel * channel_ptr,
+  jack_nframes_t size)
+{
+  struct channel_buffers * buffers_ptr;
+
+  buffers_ptr = channel_buffers_alloc(size);
+  if (buffers_ptr == NULL)
   {
-    channel_name_size = strlen(name);
-    port_name = malloc(channel_name_size + 3);
-    memcpy(port_name, name, channel_name_size);
+    return false;
+  }
 
-    port_name[channel_name_size] = ' ';
-    port_name[channel_name_size+1] = 'L';
-    port_name[channel_name_size+2] = 0;
+  channel_buffers_free_list(__atomic_exchange_n(&channel_ptr->retired_buffers_ptr, NULL, __ATOMIC_ACQUIRE));
 
-    ret = jack_port_set_name(channel_ptr->port_left, port_name);
-    if (ret != 0)
-    {
-      /* what could we do here? */
-    }
+  /* previous pending buffers, if process callback didn't pick them yet, were never used */
+  free(__atomic_exchange_n(&channel_ptr->pending_buffers_ptr, buffers_ptr, __ATOMIC_ACQ_REL));
 
-    port_name[channel_name_size+1] = 'R';
+  return true;
+}
 
-    ret = jack_port_set_name(channel_ptr->port_right, port_name);
-    if (ret != 0)
-    {
-      /* what could we do here? */
-    }
+static void
+channel_delay_free_list(
+  struct channel_delay * delay_ptr)
+{
+  struct channel_delay * next_ptr;
 
-    free(port_name);
-  }
-  else
+  while (delay_ptr != NULL)
   {
-    ret = jack_port_set_name(channel_ptr->port_left, name);
-    if (ret != 0)
-    {
-      /* what could we do here? */
-    }
+    next_ptr = delay_ptr->next;
+    free(delay_ptr);
+    delay_ptr = next_ptr;
   }
 }
 
-bool
-channel_is_stereo(
-  jack_mixer_channel_t channel)
+static jack_nframes_t
+mixer_delay_max_frames(
+  struct jack_mixer * mixer_ptr)
 {
-  return channel_ptr->stereo;
+  return (uint64_t)mixer_ptr->sample_rate * MIXER_DELAY_MAX_MS / 1000;
 }
 
-int
-channel_get_balance_midi_cc(
-  jack_mixer_channel_t channel)
+/* Hand a delay line for current sample rate to the process callback, if
+ * it has none for it. Must not be called from the process callback, mixer
+ * mutex must be locked. */
+static bool
+channel_prepare_delay(
+  struct channel * channel_ptr)
 {
-  return channel_ptr->midi_cc_balance_index;
-}
+  struct channel_delay * delay_ptr;
+  jack_nframes_t size;
 
-static void
-channel_unset_midi_cc_map(
-  jack_mixer_channel_t channel,
-  int new_cc) {
-  if (channel_ptr->mixer_ptr->midi_cc_map[new_cc]->midi_cc_volume_index == new_cc) {
-    channel_ptr->mixer_ptr->midi_cc_map[new_cc]->midi_cc_volume_index = -1;
-  } else if (channel_ptr->mixer_ptr->midi_cc_map[new_cc]->midi_cc_balance_index == new_cc) {
-  channel_ptr->mixer_ptr->midi_cc_map[new_cc]->midi_cc_balance_index = -1;
-  } else if (channel_ptr->mixer_ptr->midi_cc_map[new_cc]->midi_cc_mute_index == new_cc) {
-  channel_ptr->mixer_ptr->midi_cc_map[new_cc]->midi_cc_mute_index = -1;
-  } else if (channel_ptr->mixer_ptr->midi_cc_map[new_cc]->midi_cc_solo_index == new_cc) {
-  channel_ptr->mixer_ptr->midi_cc_map[new_cc]->midi_cc_solo_index = -1;
+  if (channel_ptr->delay_rate == channel_ptr->mixer_ptr->sample_rate)
+  {
+    return true;
   }
-}
 
-unsigned int
-channel_set_balance_midi_cc(
-  jack_mixer_channel_t channel,
-  int new_cc)
-{
-  if (new_cc < 0 || new_cc > 127) {
-    return 2; /* error: outside limit CC */
-  }
-  if (channel_ptr->mixer_ptr->midi_cc_map[new_cc] != NULL) {
-    channel_unset_midi_cc_map(channel, new_cc);
-  }
-  if (channel_ptr->midi_cc_balance_index != -1) {
-    channel_ptr->mixer_ptr->midi_cc_map[channel_ptr->midi_cc_balance_index] = NULL;
+  size = mixer_delay_max_frames(channel_ptr->mixer_ptr) + DELAY_CHUNK_MIN;
+  delay_ptr = calloc(1, sizeof(struct channel_delay) + (channel_ptr->stereo ? 2 : 1) * size * sizeof(jack_default_audio_sample_t));
+  if (delay_ptr == NULL)
+  {
+    LOG_ERROR("Cannot allocate delay line of channel \"%s\"", channel_ptr->name);
+    return false;
   }
-  channel_ptr->mixer_ptr->midi_cc_map[new_cc] = channel_ptr;
-  channel_ptr->midi_cc_balance_index = new_cc;
-  return 0;
+
+  delay_ptr->size = size;
+  delay_ptr->ring_left = delay_ptr->samples;
+  delay_ptr->ring_right = channel_ptr->stereo ? delay_ptr->samples + size : NULL;
+
+  channel_delay_free_list(__atomic_exchange_n(&channel_ptr->retired_delay_ptr, NULL, __ATOMIC_ACQUIRE));
+  free(__atomic_exchange_n(&channel_ptr->pending_delay_ptr, delay_ptr, __ATOMIC_ACQ_REL));
+
+  channel_ptr->delay_rate = channel_ptr->mixer_ptr->sample_rate;
+
+  return true;
 }
 
-int
-channel_get_volume_midi_cc(
-  jack_mixer_channel_t channel)
+/* channel must not be used by the process callback anymore */
+static void
+channel_free_buffers(
+  struct channel * channel_ptr)
 {
-  return channel_ptr->midi_cc_volume_index;
+  free(channel_ptr->pending_buffers_ptr);
+  channel_buffers_free_list(channel_ptr->retired_buffers_ptr);
+  free(channel_ptr->buffers_ptr);
+
+  free(channel_ptr->pending_delay_ptr);
+  channel_delay_free_list(channel_ptr->retired_delay_ptr);
+  free(channel_ptr->delay_ptr);
 }
 
-unsigned int
-channel_set_volume_midi_cc(
-  jack_mixer_channel_t channel, int new_cc)
+/* mutex must be held, slots are reused as late as possible */
+static void
+mixer_assign_slot(
+  struct channel * channel_ptr,
+  bool output)
 {
-  if (new_cc< 0 || new_cc > 127) {
-    return 2; /* error: outside limit CC */
-  }
-  if (channel_ptr->mixer_ptr->midi_cc_map[new_cc] != NULL) {
-    channel_unset_midi_cc_map(channel, new_cc);
-  }
-  if (channel_ptr->midi_cc_volume_index != -1) {
-    channel_ptr->mixer_ptr->midi_cc_map[channel_ptr->midi_cc_volume_index] = NULL;
+  struct jack_mixer * mixer_ptr = channel_ptr->mixer_ptr;
+  unsigned int i;
+  unsigned int slot;
+
+  channel_ptr->automation_slot = AUTOMATION_NO_SLOT;
+  channel_ptr->automation_volume = NAN;
+  channel_ptr->automation_balance = NAN;
+  channel_ptr->automation_out_mute = NAN;
+
+  for (i = 0 ; i < AUTOMATION_SLOTS ; i++)
+  {
+    slot = (mixer_ptr->automation_next_slot + i) % AUTOMATION_SLOTS;
+    if (mixer_ptr->automation_slots[slot].channel_ptr == NULL)
+    {
+      mixer_ptr->automation_slots[slot].channel_ptr = channel_ptr;
+      mixer_ptr->automation_slots[slot].output = output;
+      mixer_ptr->automation_next_slot = (slot + 1) % AUTOMATION_SLOTS;
+      channel_ptr->automation_slot = slot;
+      return;
+    }
   }
-  channel_ptr->mixer_ptr->midi_cc_map[new_cc] = channel_ptr;
-  channel_ptr->midi_cc_volume_index = new_cc;
-  return 0;
-}
 
-int
-channel_get_mute_midi_cc(
-  jack_mixer_channel_t channel)
-{
-  return channel_ptr->midi_cc_mute_index;
+  LOG_WARNING("No automation slot for channel \"%s\"", channel_ptr->name);
 }
 
-unsigned int
-channel_set_mute_midi_cc(
-  jack_mixer_channel_t channel,
-  int new_cc)
+static void
+mixer_release_slot(
+  struct channel * channel_ptr)
 {
-  if (new_cc < 0 || new_cc > 127) {
-    return 2; /* error: outside limit CC */
-  }
-  if (channel_ptr->mixer_ptr->midi_cc_map[new_cc] != NULL) {
-     channel_unset_midi_cc_map(channel, new_cc);
-  }
+  pthread_mutex_lock(&channel_ptr->mixer_ptr->mutex);
 
-  if (channel_ptr->midi_cc_mute_index != -1) {
-    channel_ptr->mixer_ptr->midi_cc_map[channel_ptr->midi_cc_mute_index] = NULL;
+  if (channel_ptr->automation_slot != AUTOMATION_NO_SLOT)
+  {
+    channel_ptr->mixer_ptr->automation_slots[channel_ptr->automation_slot].channel_ptr = NULL;
+    channel_ptr->automation_slot = AUTOMATION_NO_SLOT;
   }
-  channel_ptr->mixer_ptr->midi_cc_map[new_cc] = channel_ptr;
-  channel_ptr->midi_cc_mute_index = new_cc;
-  return 0;
+
+  pthread_mutex_unlock(&channel_ptr->mixer_ptr->mutex);
 }
 
-int
-channel_get_solo_midi_cc(
-  jack_mixer_channel_t channel)
+/* latencies are published again once the UI reads events */
+static inline void
+mixer_routing_changed(
+  struct jack_mixer * mixer_ptr)
 {
-  return channel_ptr->midi_cc_solo_index;
+  __atomic_store_n(&mixer_ptr->routing_changed, true, __ATOMIC_RELEASE);
 }
 
-unsigned int
-channel_set_solo_midi_cc(
-  jack_mixer_channel_t channel,
-  int new_cc)
+/* put set delay of input channel in effect, mixer mutex must be locked */
+static bool
+channel_use_set_delay(
+  struct channel * channel_ptr)
 {
-  if (new_cc < 0 || new_cc > 127) {
-    return 2; /* error: outside limit CC */
-  }
-  if (channel_ptr->mixer_ptr->midi_cc_map[new_cc] != NULL) {
-    channel_unset_midi_cc_map(channel, new_cc);
-  }
-  if (channel_ptr->midi_cc_solo_index != -1) {
-    channel_ptr->mixer_ptr->midi_cc_map[channel_ptr->midi_cc_solo_index] = NULL;
+  jack_nframes_t frames;
+
+  frames = channel_ptr->delay_ms * channel_ptr->mixer_ptr->sample_rate / 1000.0 + 0.5;
+  if (frames > 0 && !channel_prepare_delay(channel_ptr))
+  {
+    frames = 0;
   }
-  channel_ptr->mixer_ptr->midi_cc_map[new_cc] = channel_ptr;
-  channel_ptr->midi_cc_solo_index = new_cc;
-  return 0;
+
+  __atomic_store_n(&channel_ptr->latency, frames, __ATOMIC_RELAXED);
+  mixer_routing_changed(channel_ptr->mixer_ptr);
+
+  return frames > 0 || channel_ptr->delay_ms == 0.0;
 }
 
-void
-channel_autoset_midi_cc(
-  jack_mixer_channel_t channel)
+/* allocate channel buffers and make channel visible to the process callback */
+static bool
+mixer_link_channel(
+  struct channel * channel_ptr,
+  GSList ** list_ptr_ptr)
 {
-  struct jack_mixer *mixer_ptr;
-  int i;
+  pthread_mutex_lock(&channel_ptr->mixer_ptr->mutex);
 
-  mixer_ptr = channel_ptr->mixer_ptr;
+  channel_ptr->automation_slot = AUTOMATION_NO_SLOT;
 
-  for (i = 11 ; i < 128 ; i++)
+  if (!channel_init_buffers(channel_ptr))
   {
-    if (mixer_ptr->midi_cc_map[i] == NULL)
-    {
-      mixer_ptr->midi_cc_map[i] = channel_ptr;
-      channel_ptr->midi_cc_volume_index = i;
-
-      LOG_NOTICE("New channel \"%s\" volume mapped to CC#%i", channel_ptr->name, i);
-
-      break;
-    }
+    pthread_mutex_unlock(&channel_ptr->mixer_ptr->mutex);
+    LOG_ERROR("Cannot allocate buffers for channel \"%s\"", channel_ptr->name);
+    return false;
   }
 
-  for (; i < 128 ; i++)
-  {
-    if (mixer_ptr->midi_cc_map[i] == NULL)
-    {
-      mixer_ptr->midi_cc_map[i] = channel_ptr;
-      channel_ptr->midi_cc_balance_index = i;
+  mixer_assign_slot(channel_ptr, list_ptr_ptr == &channel_ptr->mixer_ptr->output_channels_list);
 
-      LOG_NOTICE("New channel \"%s\" balance mapped to CC#%i", channel_ptr->name, i);
+  *list_ptr_ptr = g_slist_prepend(*list_ptr_ptr, channel_ptr);
+  mixer_routing_changed(channel_ptr->mixer_ptr);
 
-      break;
-    }
-  }
+  pthread_mutex_unlock(&channel_ptr->mixer_ptr->mutex);
 
-  for (; i < 128 ; i++)
-  {
-    if (mixer_ptr->midi_cc_map[i] == NULL)
-    {
-      mixer_ptr->midi_cc_map[i] = channel_ptr;
-      channel_ptr->midi_cc_mute_index = i;
+  return true;
+}
 
-      LOG_NOTICE("New channel \"%s\" mute mapped to CC#%i", channel_ptr->name, i);
-
-      break;
-    }
-  }
-
-  for (; i < 128 ; i++)
-  {
-    if (mixer_ptr->midi_cc_map[i] == NULL)
-    {
-      mixer_ptr->midi_cc_map[i] = channel_ptr;
-      channel_ptr->midi_cc_solo_index = i;
-
-      LOG_NOTICE("New channel \"%s\" solo mapped to CC#%i", channel_ptr->name, i);
-
-      break;
-    }
-  }
-}
-
-void
-remove_channel(
-  jack_mixer_channel_t channel)
-{
-  GSList *list_ptr;
-  channel_ptr->mixer_ptr->input_channels_list = g_slist_remove(
-                  channel_ptr->mixer_ptr->input_channels_list, channel_ptr);
-  free(channel_ptr->name);
-
-  /* remove references to input channel from all output channels */
-  for (list_ptr = channel_ptr->mixer_ptr->output_channels_list; list_ptr; list_ptr = g_slist_next(list_ptr))
-  {
-    struct output_channel *output_channel_ptr = list_ptr->data;
-    output_channel_set_solo(output_channel_ptr, channel, false);
-    output_channel_set_muted(output_channel_ptr, channel, false);
-  }
-
-  jack_port_unregister(channel_ptr->mixer_ptr->jack_client, channel_ptr->port_left);
-  if (channel_ptr->stereo)
-  {
-    jack_port_unregister(channel_ptr->mixer_ptr->jack_client, channel_ptr->port_right);
-  }
-
-  if (channel_ptr->midi_cc_volume_index != -1)
-  {
-    assert(channel_ptr->mixer_ptr->midi_cc_map[channel_ptr->midi_cc_volume_index] == channel_ptr);
-    channel_ptr->mixer_ptr->midi_cc_map[channel_ptr->midi_cc_volume_index] = NULL;
-  }
-
-  if (channel_ptr->midi_cc_balance_index != -1)
-  {
-    assert(channel_ptr->mixer_ptr->midi_cc_map[channel_ptr->midi_cc_balance_index] == channel_ptr);
-    channel_ptr->mixer_ptr->midi_cc_map[channel_ptr->midi_cc_balance_index] = NULL;
-  }
-
-  if (channel_ptr->midi_cc_mute_index != -1)
-  {
-    assert(channel_ptr->mixer_ptr->midi_cc_map[channel_ptr->midi_cc_mute_index] == channel_ptr);
-    channel_ptr->mixer_ptr->midi_cc_map[channel_ptr->midi_cc_mute_index] = NULL;
-  }
-  if (channel_ptr->midi_cc_solo_index != -1)
-  {
-    assert(channel_ptr->mixer_ptr->midi_cc_map[channel_ptr->midi_cc_solo_index] == channel_ptr);
-    channel_ptr->mixer_ptr->midi_cc_map[channel_ptr->midi_cc_solo_index] = NULL;
-  }
-  free(channel_ptr);
-}
-
-void
-channel_stereo_meter_read(
-  jack_mixer_channel_t channel,
-  double * left_ptr,
-  double * right_ptr)
-{
-  assert(channel_ptr);
-  *left_ptr = value_to_db(channel_ptr->meter_left);
-  *right_ptr = value_to_db(channel_ptr->meter_right);
-}
-
-void
-channel_mono_meter_read(
-  jack_mixer_channel_t channel,
-  double * mono_ptr)
+static unsigned int
+volume_transition_steps(
+  struct channel * channel_ptr)
 {
-  *mono_ptr = value_to_db(channel_ptr->meter_left);
+  return channel_ptr->volume_transition_seconds * channel_ptr->mixer_ptr->sample_rate + 1;
 }
 
-void
-channel_volume_write(
-  jack_mixer_channel_t channel,
-  double volume)
+/* start ramp to new volume, from where current ramp is */
+static inline void
+channel_ramp_volume(
+  struct channel * channel_ptr,
+  float volume)
 {
-  assert(channel_ptr);
   /*If changing volume and find we're in the middle of a previous transition,
    *then set current volume to place in transition to avoid a jump.*/
   if (channel_ptr->volume_new != channel_ptr->volume) {
@@ -497,24 +688,14 @@ channel_volume_write(
      channel_ptr->num_volume_transition_steps;
   }
   channel_ptr->volume_idx = 0;
-  channel_ptr->volume_new = db_to_value(volume);
-  channel_ptr->midi_out_has_events = true;
-}
-
-double
-channel_volume_read(
-  jack_mixer_channel_t channel)
-{
-  assert(channel_ptr);
-  return value_to_db(channel_ptr->volume_new);
+  channel_ptr->volume_new = volume;
 }
 
-void
-channel_balance_write(
-  jack_mixer_channel_t channel,
-  double balance)
+static inline void
+channel_ramp_balance(
+  struct channel * channel_ptr,
+  float balance)
 {
-  assert(channel_ptr);
   if (channel_ptr->balance != channel_ptr->balance_new) {
     channel_ptr->balance = channel_ptr->balance + channel_ptr->balance_idx *
       (channel_ptr->balance_new - channel_ptr->balance) /
@@ -524,773 +705,4491 @@ channel_balance_write(
   channel_ptr->balance_new = balance;
 }
 
-double
-channel_balance_read(
-  jack_mixer_channel_t channel)
+static void
+mixer_free_released_nodes(
+  struct jack_mixer * mixer_ptr)
 {
-  assert(channel_ptr);
-  return channel_ptr->balance_new;
+  GSList * node_ptr;
+
+  while (jack_ringbuffer_read(mixer_ptr->released_ring, (char *)&node_ptr, sizeof(node_ptr)) == sizeof(node_ptr))
+  {
+    g_slist_free_1(node_ptr);
+  }
 }
 
-double
-channel_abspeak_read(
-  jack_mixer_channel_t channel)
+/* must not be called from the process callback */
+static bool
+mixer_schedule(
+  struct jack_mixer * mixer_ptr,
+  struct scheduled_event * event_ptr)
 {
-  assert(channel_ptr);
-  if (channel_ptr->NaN_detected)
+  bool ret;
+
+  ret = false;
+
+  pthread_mutex_lock(&mixer_ptr->mutex);
+
+  mixer_free_released_nodes(mixer_ptr);
+
+  if (event_ptr->type < SCHEDULED_CANCEL &&
+      __atomic_load_n(&mixer_ptr->scheduled_pending, __ATOMIC_ACQUIRE) >= SCHEDULED_EVENTS_MAX)
   {
-    return sqrt(-1);
+    LOG_ERROR("Too many scheduled events");
+    goto unlock;
   }
-  else
+
+  if (jack_ringbuffer_write_space(mixer_ptr->scheduled_ring) < sizeof(struct scheduled_event))
   {
-    return value_to_db(channel_ptr->abspeak);
+    LOG_ERROR("Scheduled events queue is full");
+    goto unlock;
   }
-}
 
-void
-channel_abspeak_reset(
-  jack_mixer_channel_t channel)
-{
-  channel_ptr->abspeak = 0;
-  channel_ptr->NaN_detected = false;
-}
+  if (event_ptr->type < SCHEDULED_CANCEL)
+  {
+    __atomic_fetch_add(&mixer_ptr->scheduled_pending, 1, __ATOMIC_ACQ_REL);
+  }
 
-void
-channel_out_mute(
-  jack_mixer_channel_t channel)
-{
-  channel_ptr->out_mute = true;
-}
+  jack_ringbuffer_write(mixer_ptr->scheduled_ring, (const char *)event_ptr, sizeof(struct scheduled_event));
+  ret = true;
 
-void
-channel_out_unmute(
-  jack_mixer_channel_t channel)
-{
-  channel_ptr->out_mute = false;
-}
+unlock:
+  pthread_mutex_unlock(&mixer_ptr->mutex);
 
-bool
-channel_is_out_muted(
-  jack_mixer_channel_t channel)
-{
-  return channel_ptr->out_mute;
+  return ret;
 }
 
-void
-channel_solo(
-  jack_mixer_channel_t channel)
+static bool
+channel_schedule(
+  struct channel * channel_ptr,
+  unsigned int type,
+  float value,
+  jack_nframes_t frame_time)
 {
-  if (g_slist_find(channel_ptr->mixer_ptr->soloed_channels, channel) != NULL)
-    return;
-  channel_ptr->mixer_ptr->soloed_channels = g_slist_prepend(channel_ptr->mixer_ptr->soloed_channels, channel);
-}
+  struct scheduled_event event;
 
-void
-channel_unsolo(
-  jack_mixer_channel_t channel)
-{
-  if (g_slist_find(channel_ptr->mixer_ptr->soloed_channels, channel) == NULL)
-    return;
-  channel_ptr->mixer_ptr->soloed_channels = g_slist_remove(channel_ptr->mixer_ptr->soloed_channels, channel);
+  event.frame_time = frame_time;
+  event.type = type;
+  event.channel_ptr = channel_ptr;
+  event.input_ptr = NULL;
+  event.node_ptr = NULL;
+  event.value = value;
+
+  return mixer_schedule(channel_ptr->mixer_ptr, &event);
 }
 
-bool
-channel_is_soloed(
-  jack_mixer_channel_t channel)
+/* wait for the process callback to finish the cycle that may still use
+ * something just taken away from it; give up after a second, JACK is not
+ * running us then and the caller must not free it */
+static bool
+mixer_wait_cycles(
+  struct jack_mixer * mixer_ptr)
 {
-  if (g_slist_find(channel_ptr->mixer_ptr->soloed_channels, channel))
-    return true;
+  unsigned int cycles;
+  int i;
+
+  cycles = __atomic_load_n(&mixer_ptr->process_cycles, __ATOMIC_ACQUIRE);
+  for (i = 0 ; i < 100 ; i++)
+  {
+    if (__atomic_load_n(&mixer_ptr->process_cycles, __ATOMIC_ACQUIRE) - cycles >= 2)
+    {
+      return true;
+    }
+    usleep(10000);
+  }
+
   return false;
 }
 
-void
-channel_set_midi_scale(
-  jack_mixer_channel_t channel,
-  jack_mixer_scale_t scale)
+/* drop events queued for a channel being removed, so the process callback
+ * lets go of it; false if it could not be told, it does not run, and the
+ * channel must not be freed */
+static bool
+channel_cancel_scheduled(
+  struct channel * channel_ptr)
 {
-  channel_ptr->midi_scale = scale;
-}
+  while (!channel_schedule(channel_ptr, SCHEDULED_CANCEL, 0.0, 0))
+  {
+    /* queue is full, it empties every cycle */
+    if (!mixer_wait_cycles(channel_ptr->mixer_ptr))
+    {
+      LOG_WARNING("Process callback does not run, channel \"%s\" is not freed", channel_ptr->name);
+      return false;
+    }
+  }
 
-void
-channel_set_midi_change_callback(
-  jack_mixer_channel_t channel,
-  void (*midi_change_callback) (void*),
-  void *user_data)
-{
-  channel_ptr->midi_change_callback = midi_change_callback;
-  channel_ptr->midi_change_callback_data = user_data;
+  return true;
 }
 
-bool
-channel_get_midi_in_got_events(
-  jack_mixer_channel_t channel)
+/* mixer_schedule() for count channels at once, all events or none */
+static bool
+mixer_schedule_bulk(
+  struct jack_mixer * mixer_ptr,
+  unsigned int type,
+  const jack_mixer_channel_t * channels,
+  const double * values,
+  unsigned int count,
+  jack_nframes_t frame_time)
 {
-  bool t = channel_ptr->midi_in_got_events;
-  channel_ptr->midi_in_got_events = false;
-  return t;
-}
+  struct scheduled_event event;
+  unsigned int i;
+  bool ret;
 
-#undef channel_ptr
+  for (i = 0; i < count; i++)
+  {
+    if (((struct channel *)channels[i])->mixer_ptr != mixer_ptr)
+    {
+      LOG_ERROR("Channel \"%s\" is not one of this mixer", ((struct channel *)channels[i])->name);
+      return false;
+    }
+  }
 
-/* process input channels and mix them into main mix */
-static inline void
-mix_one(
-  struct output_channel *output_mix_channel,
-  GSList *channels_list,
-  jack_nframes_t start,         /* index of first sample to process */
-  jack_nframes_t end)           /* index of sample to stop processing before */
-{
-  jack_nframes_t i;
-  GSList *node_ptr;
-  struct channel * channel_ptr;
-  jack_default_audio_sample_t frame_left;
-  jack_default_audio_sample_t frame_right;
-  struct channel *mix_channel = (struct channel*)output_mix_channel;
+  ret = false;
 
-  for (i = start; i < end; i++)
+  pthread_mutex_lock(&mixer_ptr->mutex);
+
+  mixer_free_released_nodes(mixer_ptr);
+
+  if (__atomic_load_n(&mixer_ptr->scheduled_pending, __ATOMIC_ACQUIRE) + count > SCHEDULED_EVENTS_MAX)
   {
-    mix_channel->left_buffer_ptr[i] = mix_channel->tmp_mixed_frames_left[i] = 0.0;
-    if (mix_channel->stereo)
-      mix_channel->right_buffer_ptr[i] = mix_channel->tmp_mixed_frames_right[i] = 0.0;
+    LOG_ERROR("Too many scheduled events");
+    goto unlock;
   }
 
-  for (node_ptr = channels_list; node_ptr; node_ptr = g_slist_next(node_ptr))
+  if (jack_ringbuffer_write_space(mixer_ptr->scheduled_ring) < count * sizeof(struct scheduled_event))
   {
-    channel_ptr = node_ptr->data;
+    LOG_ERROR("Scheduled events queue is full");
+    goto unlock;
+  }
 
-    if (g_slist_find(output_mix_channel->muted_channels, channel_ptr) != NULL || channel_ptr->out_mute) {
-      /* skip muted channels */
-      continue;
-    }
+  __atomic_fetch_add(&mixer_ptr->scheduled_pending, count, __ATOMIC_ACQ_REL);
 
-    if ((!channel_ptr->mixer_ptr->soloed_channels && !output_mix_channel->soloed_channels) ||
-        (channel_ptr->mixer_ptr->soloed_channels && 
-         g_slist_find(channel_ptr->mixer_ptr->soloed_channels, channel_ptr) != NULL) ||
-        (output_mix_channel->soloed_channels &&
-        g_slist_find(output_mix_channel->soloed_channels, channel_ptr) != NULL)) {
+  event.frame_time = frame_time;
+  event.type = type;
+  event.input_ptr = NULL;
+  event.node_ptr = NULL;
 
-      for (i = start ; i < end ; i++)
-      {
-        if (! output_mix_channel->prefader) {
-          frame_left = channel_ptr->frames_left[i-start];
-        } else {
-          frame_left = channel_ptr->prefader_frames_left[i-start];
-        }
-        if (frame_left == NAN)
-          break;
-        mix_channel->tmp_mixed_frames_left[i] += frame_left;
-        if (mix_channel->stereo)
-        {
-          if (! output_mix_channel->prefader) {
-            frame_right = channel_ptr->frames_right[i-start];
-          } else {
-            frame_right = channel_ptr->prefader_frames_right[i-start];
-          }
-          if (frame_right == NAN)
-            break;
-          mix_channel->tmp_mixed_frames_right[i] += frame_right;
-        }
-      }
+  for (i = 0; i < count; i++)
+  {
+    event.channel_ptr = channels[i];
+    event.value = values[i];
+    if (type == SCHEDULED_OUT_MUTE)
+    {
+      event.value = values[i] != 0.0 ? 1.0 : 0.0;
     }
+
+    jack_ringbuffer_write(mixer_ptr->scheduled_ring, (const char *)&event, sizeof(struct scheduled_event));
   }
 
-  /* process main mix channel */
-  unsigned int steps = mix_channel->num_volume_transition_steps;
-  for (i = start ; i < end ; i++)
-  {
-    if (! output_mix_channel->prefader) {
-      float volume = mix_channel->volume;
-      float volume_new = mix_channel->volume_new;
-      float vol = volume;
-      float balance = mix_channel->balance;
-      float balance_new = mix_channel->balance_new;
+  ret = true;
+
+unlock:
+  pthread_mutex_unlock(&mixer_ptr->mutex);
+
+  return ret;
+}
+
+static void
+mixer_index_channel(
+  struct channel * channel_ptr)
+{
+  struct jack_mixer * mixer_ptr = channel_ptr->mixer_ptr;
+
+  g_hash_table_replace(mixer_ptr->channels_by_name, g_strdup(channel_ptr->name), channel_ptr);
+  if (channel_ptr->port_left == NULL)
+  {
+    return;
+  }
+
+  g_hash_table_replace(mixer_ptr->channels_by_port_name, g_strdup(jack_port_name(channel_ptr->port_left)), channel_ptr);
+  if (channel_ptr->stereo)
+  {
+    g_hash_table_replace(mixer_ptr->channels_by_port_name, g_strdup(jack_port_name(channel_ptr->port_right)), channel_ptr);
+  }
+}
+
+/* returns whether channel was indexed, port names are unique so they tell */
+static bool
+mixer_unindex_channel(
+  struct channel * channel_ptr)
+{
+  struct jack_mixer * mixer_ptr = channel_ptr->mixer_ptr;
+
+  /* player channels have no ports, they are indexed by name only */
+  if (channel_ptr->port_left == NULL)
+  {
+    if (g_hash_table_lookup(mixer_ptr->channels_by_name, channel_ptr->name) != channel_ptr)
+    {
+      return false;
+    }
+
+    g_hash_table_remove(mixer_ptr->channels_by_name, channel_ptr->name);
+    return true;
+  }
+
+  if (g_hash_table_lookup(mixer_ptr->channels_by_port_name, jack_port_name(channel_ptr->port_left)) != channel_ptr)
+  {
+    return false;
+  }
+
+  /* another channel with the same name may have taken over the name entry */
+  if (g_hash_table_lookup(mixer_ptr->channels_by_name, channel_ptr->name) == channel_ptr)
+  {
+    g_hash_table_remove(mixer_ptr->channels_by_name, channel_ptr->name);
+  }
+
+  g_hash_table_remove(mixer_ptr->channels_by_port_name, jack_port_name(channel_ptr->port_left));
+  if (channel_ptr->stereo)
+  {
+    g_hash_table_remove(mixer_ptr->channels_by_port_name, jack_port_name(channel_ptr->port_right));
+  }
+
+  return true;
+}
+
+#define channel_ptr ((struct channel *)channel)
+
+const char*
+channel_get_name(
+  jack_mixer_channel_t channel)
+{
+  return channel_ptr->name;
+}
+
+void
+channel_rename(
+  jack_mixer_channel_t channel,
+  const char * name)
+{
+  char * new_name;
+  size_t channel_name_size;
+  char * port_name;
+  int ret;
+  bool indexed;
+
+  new_name = strdup(name);
+  if (new_name == NULL)
+  {
+    return;
+  }
+
+  indexed = mixer_unindex_channel(channel_ptr);
+
+  /* automation disk thread reads names under the mutex */
+  pthread_mutex_lock(&channel_ptr->mixer_ptr->mutex);
+
+  if (channel_ptr->name)
+  {
+    free(channel_ptr->name);
+  }
+
+  channel_ptr->name = new_name;
+
+  pthread_mutex_unlock(&channel_ptr->mixer_ptr->mutex);
+
+  if (channel_ptr->state_record_ptr != NULL)
+  {
+    state_record_set_name(channel_ptr->state_record_ptr, name);
+  }
+
+  if (channel_ptr->port_left == NULL)
+  {
+    /* player channel, no ports to rename */
+  }
+  else if (channel_ptr->stereo)
+  {
+    channel_name_size = strlen(name);
+    port_name = malloc(channel_name_size + 3);
+    memcpy(port_name, name, channel_name_size);
+
+    port_name[channel_name_size] = ' ';
+    port_name[channel_name_size+1] = 'L';
+    port_name[channel_name_size+2] = 0;
+
+    ret = jack_port_set_name(channel_ptr->port_left, port_name);
+    if (ret != 0)
+    {
+      /* what could we do here? */
+    }
+
+    port_name[channel_name_size+1] = 'R';
+
+    ret = jack_port_set_name(channel_ptr->port_right, port_name);
+    if (ret != 0)
+    {
+      /* what could we do here? */
+    }
+
+    free(port_name);
+  }
+  else
+  {
+    ret = jack_port_set_name(channel_ptr->port_left, name);
+    if (ret != 0)
+    {
+      /* what could we do here? */
+    }
+  }
+
+  if (indexed)
+  {
+    mixer_index_channel(channel_ptr);
+  }
+}
+
+bool
+channel_is_stereo(
+  jack_mixer_channel_t channel)
+{
+  return channel_ptr->stereo;
+}
+
+int
+channel_get_balance_midi_cc(
+  jack_mixer_channel_t channel)
+{
+  return channel_ptr->midi_cc_balance_index;
+}
+
+static void
+channel_unset_midi_cc_map(
+  jack_mixer_channel_t channel,
+  int new_cc) {
+  struct channel * mapped_ptr = channel_ptr->mixer_ptr->midi_cc_map[new_cc];
+
+  if (mapped_ptr->midi_cc_volume_index == new_cc) {
+    mapped_ptr->midi_cc_volume_index = -1;
+    STATE_STORE(mapped_ptr, int, midi_cc_volume, -1);
+  } else if (mapped_ptr->midi_cc_balance_index == new_cc) {
+    mapped_ptr->midi_cc_balance_index = -1;
+    STATE_STORE(mapped_ptr, int, midi_cc_balance, -1);
+  } else if (mapped_ptr->midi_cc_mute_index == new_cc) {
+    mapped_ptr->midi_cc_mute_index = -1;
+    STATE_STORE(mapped_ptr, int, midi_cc_mute, -1);
+  } else if (mapped_ptr->midi_cc_solo_index == new_cc) {
+    mapped_ptr->midi_cc_solo_index = -1;
+    STATE_STORE(mapped_ptr, int, midi_cc_solo, -1);
+  }
+}
+
+unsigned int
+channel_set_balance_midi_cc(
+  jack_mixer_channel_t channel,
+  int new_cc)
+{
+  if (new_cc < 0 || new_cc > 127) {
+    return 2; /* error: outside limit CC */
+  }
+  if (channel_ptr->mixer_ptr->midi_cc_map[new_cc] != NULL) {
+    channel_unset_midi_cc_map(channel, new_cc);
+  }
+  if (channel_ptr->midi_cc_balance_index != -1) {
+    channel_ptr->mixer_ptr->midi_cc_map[channel_ptr->midi_cc_balance_index] = NULL;
+  }
+  channel_ptr->mixer_ptr->midi_cc_map[new_cc] = channel_ptr;
+  channel_ptr->midi_cc_balance_index = new_cc;
+  STATE_STORE(channel_ptr, int, midi_cc_balance, new_cc);
+  return 0;
+}
+
+int
+channel_get_volume_midi_cc(
+  jack_mixer_channel_t channel)
+{
+  return channel_ptr->midi_cc_volume_index;
+}
+
+unsigned int
+channel_set_volume_midi_cc(
+  jack_mixer_channel_t channel, int new_cc)
+{
+  if (new_cc< 0 || new_cc > 127) {
+    return 2; /* error: outside limit CC */
+  }
+  if (channel_ptr->mixer_ptr->midi_cc_map[new_cc] != NULL) {
+    channel_unset_midi_cc_map(channel, new_cc);
+  }
+  if (channel_ptr->midi_cc_volume_index != -1) {
+    channel_ptr->mixer_ptr->midi_cc_map[channel_ptr->midi_cc_volume_index] = NULL;
+  }
+  channel_ptr->mixer_ptr->midi_cc_map[new_cc] = channel_ptr;
+  channel_ptr->midi_cc_volume_index = new_cc;
+  STATE_STORE(channel_ptr, int, midi_cc_volume, new_cc);
+  return 0;
+}
+
+int
+channel_get_mute_midi_cc(
+  jack_mixer_channel_t channel)
+{
+  return channel_ptr->midi_cc_mute_index;
+}
+
+unsigned int
+channel_set_mute_midi_cc(
+  jack_mixer_channel_t channel,
+  int new_cc)
+{
+  if (new_cc < 0 || new_cc > 127) {
+    return 2; /* error: outside limit CC */
+  }
+  if (channel_ptr->mixer_ptr->midi_cc_map[new_cc] != NULL) {
+     channel_unset_midi_cc_map(channel, new_cc);
+  }
+
+  if (channel_ptr->midi_cc_mute_index != -1) {
+    channel_ptr->mixer_ptr->midi_cc_map[channel_ptr->midi_cc_mute_index] = NULL;
+  }
+  channel_ptr->mixer_ptr->midi_cc_map[new_cc] = channel_ptr;
+  channel_ptr->midi_cc_mute_index = new_cc;
+  STATE_STORE(channel_ptr, int, midi_cc_mute, new_cc);
+  return 0;
+}
+
+int
+channel_get_solo_midi_cc(
+  jack_mixer_channel_t channel)
+{
+  return channel_ptr->midi_cc_solo_index;
+}
+
+unsigned int
+channel_set_solo_midi_cc(
+  jack_mixer_channel_t channel,
+  int new_cc)
+{
+  if (new_cc < 0 || new_cc > 127) {
+    return 2; /* error: outside limit CC */
+  }
+  if (channel_ptr->mixer_ptr->midi_cc_map[new_cc] != NULL) {
+    channel_unset_midi_cc_map(channel, new_cc);
+  }
+  if (channel_ptr->midi_cc_solo_index != -1) {
+    channel_ptr->mixer_ptr->midi_cc_map[channel_ptr->midi_cc_solo_index] = NULL;
+  }
+  channel_ptr->mixer_ptr->midi_cc_map[new_cc] = channel_ptr;
+  channel_ptr->midi_cc_solo_index = new_cc;
+  STATE_STORE(channel_ptr, int, midi_cc_solo, new_cc);
+  return 0;
+}
+
+void
+channel_autoset_midi_cc(
+  jack_mixer_channel_t channel)
+{
+  struct jack_mixer *mixer_ptr;
+  int i;
+
+  mixer_ptr = channel_ptr->mixer_ptr;
+
+  for (i = 11 ; i < 128 && channel_ptr->midi_cc_volume_index == -1 ; i++)
+  {
+    if (mixer_ptr->midi_cc_map[i] == NULL)
+    {
+      mixer_ptr->midi_cc_map[i] = channel_ptr;
+      channel_ptr->midi_cc_volume_index = i;
+      STATE_STORE(channel_ptr, int, midi_cc_volume, i);
+
+      LOG_NOTICE("New channel \"%s\" volume mapped to CC#%i", channel_ptr->name, i);
+
+      break;
+    }
+  }
+
+  for (; i < 128 && channel_ptr->midi_cc_balance_index == -1 ; i++)
+  {
+    if (mixer_ptr->midi_cc_map[i] == NULL)
+    {
+      mixer_ptr->midi_cc_map[i] = channel_ptr;
+      channel_ptr->midi_cc_balance_index = i;
+      STATE_STORE(channel_ptr, int, midi_cc_balance, i);
+
+      LOG_NOTICE("New channel \"%s\" balance mapped to CC#%i", channel_ptr->name, i);
+
+      break;
+    }
+  }
+
+  for (; i < 128 && channel_ptr->midi_cc_mute_index == -1 ; i++)
+  {
+    if (mixer_ptr->midi_cc_map[i] == NULL)
+    {
+      mixer_ptr->midi_cc_map[i] = channel_ptr;
+      channel_ptr->midi_cc_mute_index = i;
+      STATE_STORE(channel_ptr, int, midi_cc_mute, i);
+
+      LOG_NOTICE("New channel \"%s\" mute mapped to CC#%i", channel_ptr->name, i);
+
+      break;
+    }
+  }
+
+  for (; i < 128 && channel_ptr->midi_cc_solo_index == -1 ; i++)
+  {
+    if (mixer_ptr->midi_cc_map[i] == NULL)
+    {
+      mixer_ptr->midi_cc_map[i] = channel_ptr;
+      channel_ptr->midi_cc_solo_index = i;
+      STATE_STORE(channel_ptr, int, midi_cc_solo, i);
+
+      LOG_NOTICE("New channel \"%s\" solo mapped to CC#%i", channel_ptr->name, i);
+
+      break;
+    }
+  }
+}
+
+void
+remove_channel(
+  jack_mixer_channel_t channel)
+{
+  GSList *list_ptr;
+  bool cancelled;
+
+  /* routing lists are changed under the mutex, the latency callback walks
+   * them; nodes the process callback unlinks are freed under it too */
+  pthread_mutex_lock(&channel_ptr->mixer_ptr->mutex);
+  channel_ptr->mixer_ptr->input_channels_list = g_slist_remove(
+                  channel_ptr->mixer_ptr->input_channels_list, channel_ptr);
+  for (list_ptr = channel_ptr->mixer_ptr->output_channels_list; list_ptr; list_ptr = g_slist_next(list_ptr))
+  {
+    if (((struct output_channel *)list_ptr->data)->monitor_source == channel_ptr)
+    {
+      ((struct output_channel *)list_ptr->data)->monitor_source = NULL;
+    }
+  }
+  pthread_mutex_unlock(&channel_ptr->mixer_ptr->mutex);
+
+  mixer_routing_changed(channel_ptr->mixer_ptr);
+  channel_unsolo(channel);
+  mixer_unindex_channel(channel_ptr);
+  mixer_release_slot(channel_ptr);
+  cancelled = channel_cancel_scheduled(channel_ptr);
+  free(channel_ptr->name);
+
+  /* remove references to input channel from all output channels */
+  for (list_ptr = channel_ptr->mixer_ptr->output_channels_list; list_ptr; list_ptr = g_slist_next(list_ptr))
+  {
+    struct output_channel *output_channel_ptr = list_ptr->data;
+    output_channel_set_solo(output_channel_ptr, channel, false);
+    output_channel_set_muted(output_channel_ptr, channel, false);
+  }
+
+  if (channel_ptr->port_left != NULL)
+  {
+    jack_port_unregister(channel_ptr->mixer_ptr->jack_client, channel_ptr->port_left);
+    if (channel_ptr->stereo)
+    {
+      jack_port_unregister(channel_ptr->mixer_ptr->jack_client, channel_ptr->port_right);
+    }
+  }
+
+  if (channel_ptr->midi_cc_volume_index != -1)
+  {
+    assert(channel_ptr->mixer_ptr->midi_cc_map[channel_ptr->midi_cc_volume_index] == channel_ptr);
+    channel_ptr->mixer_ptr->midi_cc_map[channel_ptr->midi_cc_volume_index] = NULL;
+  }
+
+  if (channel_ptr->midi_cc_balance_index != -1)
+  {
+    assert(channel_ptr->mixer_ptr->midi_cc_map[channel_ptr->midi_cc_balance_index] == channel_ptr);
+    channel_ptr->mixer_ptr->midi_cc_map[channel_ptr->midi_cc_balance_index] = NULL;
+  }
+
+  if (channel_ptr->midi_cc_mute_index != -1)
+  {
+    assert(channel_ptr->mixer_ptr->midi_cc_map[channel_ptr->midi_cc_mute_index] == channel_ptr);
+    channel_ptr->mixer_ptr->midi_cc_map[channel_ptr->midi_cc_mute_index] = NULL;
+  }
+  if (channel_ptr->midi_cc_solo_index != -1)
+  {
+    assert(channel_ptr->mixer_ptr->midi_cc_map[channel_ptr->midi_cc_solo_index] == channel_ptr);
+    channel_ptr->mixer_ptr->midi_cc_map[channel_ptr->midi_cc_solo_index] = NULL;
+  }
+
+  if (channel_ptr->state_record_ptr != NULL)
+  {
+    state_record_release(channel_ptr->mixer_ptr->state_ptr, channel_ptr->state_record_ptr);
+  }
+
+  /* queued events still reach the channel and its player */
+  if (!cancelled)
+  {
+    return;
+  }
+
+  g_slist_free_1(channel_ptr->solo_node_ptr);
+#if defined(HAVE_SNDFILE)
+  if (channel_ptr->player_ptr != NULL)
+  {
+    player_close(channel_ptr->player_ptr);
+  }
+#endif
+  channel_free_buffers(channel_ptr);
+
+  free(channel_ptr);
+}
+
+void
+channel_stereo_meter_read(
+  jack_mixer_channel_t channel,
+  double * left_ptr,
+  double * right_ptr)
+{
+  assert(channel_ptr);
+  *left_ptr = value_to_db(channel_ptr->meter_left);
+  *right_ptr = value_to_db(channel_ptr->meter_right);
+}
+
+void
+channel_meter_subscribe(
+  jack_mixer_channel_t channel,
+  unsigned int meters)
+{
+  assert(channel_ptr);
+
+  if (meters & MIXER_METER_PEAK)
+  {
+    __atomic_add_fetch(&channel_ptr->meter_subscribers, 1, __ATOMIC_RELAXED);
+  }
+
+  if (meters & MIXER_METER_CLIP)
+  {
+    __atomic_add_fetch(&channel_ptr->clip_subscribers, 1, __ATOMIC_RELAXED);
+  }
+}
+
+static void
+meter_subscribers_release(
+  unsigned int * subscribers_ptr)
+{
+  unsigned int count;
+
+  count = __atomic_load_n(subscribers_ptr, __ATOMIC_RELAXED);
+  do
+  {
+    if (count == 0)
+    {
+      LOG_DEBUG("Unbalanced meter unsubscribe ignored");
+      return;
+    }
+  }
+  while (!__atomic_compare_exchange_n(subscribers_ptr, &count, count - 1, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+void
+channel_meter_unsubscribe(
+  jack_mixer_channel_t channel,
+  unsigned int meters)
+{
+  assert(channel_ptr);
+
+  if (meters & MIXER_METER_PEAK)
+  {
+    meter_subscribers_release(&channel_ptr->meter_subscribers);
+  }
+
+  if (meters & MIXER_METER_CLIP)
+  {
+    meter_subscribers_release(&channel_ptr->clip_subscribers);
+  }
+}
+
+unsigned int
+channel_clip_count_read(
+  jack_mixer_channel_t channel)
+{
+  assert(channel_ptr);
+  return channel_ptr->clip_count;
+}
+
+void
+channel_clip_count_reset(
+  jack_mixer_channel_t channel)
+{
+  channel_ptr->clip_count = 0;
+}
+
+void
+channel_mono_meter_read(
+  jack_mixer_channel_t channel,
+  double * mono_ptr)
+{
+  *mono_ptr = value_to_db(channel_ptr->meter_left);
+}
+
+void
+channel_volume_write(
+  jack_mixer_channel_t channel,
+  double volume)
+{
+  assert(channel_ptr);
+  channel_ramp_volume(channel_ptr, db_to_value(volume));
+  channel_ptr->midi_out_has_events = true;
+  STATE_STORE(channel_ptr, float, volume, channel_ptr->volume_new);
+}
+
+double
+channel_volume_read(
+  jack_mixer_channel_t channel)
+{
+  assert(channel_ptr);
+  return value_to_db(channel_ptr->volume_new);
+}
+
+void
+channel_balance_write(
+  jack_mixer_channel_t channel,
+  double balance)
+{
+  assert(channel_ptr);
+  channel_ramp_balance(channel_ptr, balance);
+  STATE_STORE(channel_ptr, float, balance, channel_ptr->balance_new);
+}
+
+double
+channel_balance_read(
+  jack_mixer_channel_t channel)
+{
+  assert(channel_ptr);
+  return channel_ptr->balance_new;
+}
+
+double
+channel_abspeak_read(
+  jack_mixer_channel_t channel)
+{
+  assert(channel_ptr);
+  if (channel_ptr->NaN_detected)
+  {
+    return sqrt(-1);
+  }
+  else
+  {
+    return value_to_db(channel_ptr->abspeak);
+  }
+}
+
+void
+channel_abspeak_reset(
+  jack_mixer_channel_t channel)
+{
+  channel_ptr->abspeak = 0;
+  channel_ptr->NaN_detected = false;
+}
+
+void
+channel_out_mute(
+  jack_mixer_channel_t channel)
+{
+  channel_ptr->out_mute = true;
+  STATE_STORE(channel_ptr, bool, out_mute, true);
+  mixer_routing_changed(channel_ptr->mixer_ptr);
+}
+
+void
+channel_out_unmute(
+  jack_mixer_channel_t channel)
+{
+  channel_ptr->out_mute = false;
+  STATE_STORE(channel_ptr, bool, out_mute, false);
+  mixer_routing_changed(channel_ptr->mixer_ptr);
+}
+
+bool
+channel_volume_write_at(
+  jack_mixer_channel_t channel,
+  double volume,
+  uint32_t frame_time)
+{
+  return channel_schedule(channel_ptr, SCHEDULED_VOLUME, volume, frame_time);
+}
+
+bool
+channel_balance_write_at(
+  jack_mixer_channel_t channel,
+  double balance,
+  uint32_t frame_time)
+{
+  return channel_schedule(channel_ptr, SCHEDULED_BALANCE, balance, frame_time);
+}
+
+bool
+channel_out_mute_write_at(
+  jack_mixer_channel_t channel,
+  bool out_mute,
+  uint32_t frame_time)
+{
+  return channel_schedule(channel_ptr, SCHEDULED_OUT_MUTE, out_mute ? 1.0 : 0.0, frame_time);
+}
+
+bool
+channel_is_out_muted(
+  jack_mixer_channel_t channel)
+{
+  return channel_ptr->out_mute;
+}
+
+void
+channel_solo(
+  jack_mixer_channel_t channel)
+{
+  pthread_mutex_lock(&channel_ptr->mixer_ptr->mutex);
+  if (g_slist_find(channel_ptr->mixer_ptr->soloed_channels, channel) != NULL)
+  {
+    pthread_mutex_unlock(&channel_ptr->mixer_ptr->mutex);
+    return;
+  }
+  channel_ptr->mixer_ptr->soloed_channels = g_slist_prepend(channel_ptr->mixer_ptr->soloed_channels, channel);
+  pthread_mutex_unlock(&channel_ptr->mixer_ptr->mutex);
+  STATE_STORE(channel_ptr, bool, solo, true);
+  mixer_routing_changed(channel_ptr->mixer_ptr);
+}
+
+void
+channel_unsolo(
+  jack_mixer_channel_t channel)
+{
+  pthread_mutex_lock(&channel_ptr->mixer_ptr->mutex);
+  if (g_slist_find(channel_ptr->mixer_ptr->soloed_channels, channel) == NULL)
+  {
+    pthread_mutex_unlock(&channel_ptr->mixer_ptr->mutex);
+    return;
+  }
+  channel_ptr->mixer_ptr->soloed_channels = g_slist_remove(channel_ptr->mixer_ptr->soloed_channels, channel);
+  pthread_mutex_unlock(&channel_ptr->mixer_ptr->mutex);
+  if (channel_ptr->solo_node_ptr == NULL)
+  {
+    /* it was used by the process callback */
+    channel_ptr->solo_node_ptr = g_slist_alloc();
+  }
+  STATE_STORE(channel_ptr, bool, solo, false);
+  mixer_routing_changed(channel_ptr->mixer_ptr);
+}
+
+bool
+channel_is_soloed(
+  jack_mixer_channel_t channel)
+{
+  if (g_slist_find(channel_ptr->mixer_ptr->soloed_channels, channel))
+    return true;
+  return false;
+}
+
+void
+channel_set_midi_scale(
+  jack_mixer_channel_t channel,
+  jack_mixer_scale_t scale)
+{
+  channel_ptr->midi_scale = scale;
+}
+
+void
+channel_set_midi_change_callback(
+  jack_mixer_channel_t channel,
+  void (*midi_change_callback) (void*),
+  void *user_data)
+{
+  channel_ptr->midi_change_callback = midi_change_callback;
+  channel_ptr->midi_change_callback_data = user_data;
+}
+
+bool
+channel_get_midi_in_got_events(
+  jack_mixer_channel_t channel)
+{
+  bool t = channel_ptr->midi_in_got_events;
+  channel_ptr->midi_in_got_events = false;
+  return t;
+}
+
+bool
+channel_is_restored(
+  jack_mixer_channel_t channel)
+{
+  return channel_ptr->restored;
+}
+
+void
+channel_agc_enable(
+  jack_mixer_channel_t channel,
+  bool enabled)
+{
+  channel_ptr->agc_enabled = enabled;
+}
+
+bool
+channel_is_agc_enabled(
+  jack_mixer_channel_t channel)
+{
+  return channel_ptr->agc_enabled;
+}
+
+void
+channel_agc_configure(
+  jack_mixer_channel_t channel,
+  double target_db,
+  double max_gain_db,
+  double gate_db)
+{
+  channel_ptr->agc_target_db = target_db;
+  channel_ptr->agc_max_gain_db = max_gain_db;
+  channel_ptr->agc_gate_db = gate_db;
+}
+
+double
+channel_agc_target_read(
+  jack_mixer_channel_t channel)
+{
+  return channel_ptr->agc_target_db;
+}
+
+double
+channel_agc_max_gain_read(
+  jack_mixer_channel_t channel)
+{
+  return channel_ptr->agc_max_gain_db;
+}
+
+double
+channel_agc_gate_read(
+  jack_mixer_channel_t channel)
+{
+  return channel_ptr->agc_gate_db;
+}
+
+double
+channel_agc_gain_read(
+  jack_mixer_channel_t channel)
+{
+  return value_to_db(channel_ptr->agc_gain_new);
+}
+
+bool
+channel_set_delay(
+  jack_mixer_channel_t channel,
+  float milliseconds)
+{
+  bool ret;
+
+  if (!(milliseconds >= 0.0 && milliseconds <= MIXER_DELAY_MAX_MS))
+  {
+    LOG_ERROR("Delay of channel \"%s\" must be from 0 to %u ms", channel_ptr->name, MIXER_DELAY_MAX_MS);
+    return false;
+  }
+
+  if (channel_ptr->player_ptr != NULL && milliseconds > 0.0)
+  {
+    LOG_ERROR("Player channel \"%s\" cannot be delayed", channel_ptr->name);
+    return false;
+  }
+
+  pthread_mutex_lock(&channel_ptr->mixer_ptr->mutex);
+
+  ret = true;
+  channel_ptr->delay_ms = milliseconds;
+  if (!channel_ptr->delay_auto)
+  {
+    ret = channel_use_set_delay(channel_ptr);
+  }
+
+  pthread_mutex_unlock(&channel_ptr->mixer_ptr->mutex);
+
+  return ret;
+}
+
+float
+channel_get_delay(
+  jack_mixer_channel_t channel)
+{
+  return __atomic_load_n(&channel_ptr->latency, __ATOMIC_RELAXED) * 1000.0 / channel_ptr->mixer_ptr->sample_rate;
+}
+
+void
+channel_set_delay_auto(
+  jack_mixer_channel_t channel,
+  bool enabled)
+{
+  if (channel_ptr->player_ptr != NULL && enabled)
+  {
+    LOG_ERROR("Player channel \"%s\" cannot be delayed", channel_ptr->name);
+    return;
+  }
+
+  pthread_mutex_lock(&channel_ptr->mixer_ptr->mutex);
+
+  channel_ptr->delay_auto = enabled;
+  if (enabled)
+  {
+    /* delay is set once latencies are recomputed */
+    mixer_routing_changed(channel_ptr->mixer_ptr);
+  }
+  else
+  {
+    channel_use_set_delay(channel_ptr);
+  }
+
+  pthread_mutex_unlock(&channel_ptr->mixer_ptr->mutex);
+}
+
+bool
+channel_is_delay_auto(
+  jack_mixer_channel_t channel)
+{
+  return channel_ptr->delay_auto;
+}
+
+bool
+channel_play_at(
+  jack_mixer_channel_t channel,
+  uint32_t frame_time)
+{
+  if (channel_ptr->player_ptr == NULL)
+  {
+    LOG_ERROR("Channel \"%s\" is not a player channel", channel_ptr->name);
+    return false;
+  }
+
+  return channel_schedule(channel_ptr, SCHEDULED_PLAY, 0.0, frame_time);
+}
+
+bool
+channel_stop_at(
+  jack_mixer_channel_t channel,
+  uint32_t frame_time)
+{
+  if (channel_ptr->player_ptr == NULL)
+  {
+    LOG_ERROR("Channel \"%s\" is not a player channel", channel_ptr->name);
+    return false;
+  }
+
+  return channel_schedule(channel_ptr, SCHEDULED_STOP, 0.0, frame_time);
+}
+
+bool
+channel_is_player(
+  jack_mixer_channel_t channel)
+{
+  return channel_ptr->player_ptr != NULL;
+}
+
+bool
+channel_is_playing(
+  jack_mixer_channel_t channel)
+{
+#if defined(HAVE_SNDFILE)
+  if (channel_ptr->player_ptr != NULL)
+  {
+    return player_is_playing(channel_ptr->player_ptr);
+  }
+#endif
+
+  return false;
+}
+
+#undef channel_ptr
+
+/* whether input channel is mixed into output channel, muting and solo
+ * considered, with out_mute of input channel */
+static inline bool
+output_channel_routes(
+  struct output_channel * output_channel_ptr,
+  struct channel * channel_ptr,
+  bool out_mute)
+{
+  if (g_slist_find(output_channel_ptr->muted_channels, channel_ptr) != NULL || out_mute)
+    return false;
+
+  return (!channel_ptr->mixer_ptr->soloed_channels && !output_channel_ptr->soloed_channels) ||
+    (channel_ptr->mixer_ptr->soloed_channels &&
+     g_slist_find(channel_ptr->mixer_ptr->soloed_channels, channel_ptr) != NULL) ||
+    (output_channel_ptr->soloed_channels &&
+     g_slist_find(output_channel_ptr->soloed_channels, channel_ptr) != NULL);
+}
+
+/* whether input channel is mixed into output channel, through its monitor
+ * source if it has one */
+static inline bool
+output_channel_mixes(
+  struct output_channel * output_channel_ptr,
+  struct channel * channel_ptr,
+  bool out_mute)
+{
+  struct channel * source_ptr = output_channel_ptr->monitor_source;
+
+  if (source_ptr == NULL)
+    return output_channel_routes(output_channel_ptr, channel_ptr, out_mute);
+
+  if (output_channel_ptr->monitor_bus)
+    return output_channel_routes((struct output_channel *)source_ptr, channel_ptr, out_mute);
+
+  /* input alone, before or after its fader, silent while muted */
+  return channel_ptr == source_ptr && !out_mute;
+}
+
+/* out_mute of input channel at frame of the cycle, as calc_channel_frames()
+ * went through it; *end_ptr is lowered to the frame it flips at next */
+static inline bool
+channel_out_mute_span(
+  struct channel * channel_ptr,
+  jack_nframes_t frame,
+  jack_nframes_t * end_ptr)
+{
+  bool out_mute = channel_ptr->cycle_out_mute;
+  unsigned int i;
+
+  for (i = 0; i < channel_ptr->out_mute_flips_count; i++)
+  {
+    if (channel_ptr->out_mute_flips[i] > frame)
+    {
+      if (channel_ptr->out_mute_flips[i] < *end_ptr)
+        *end_ptr = channel_ptr->out_mute_flips[i];
+      break;
+    }
+    out_mute = !out_mute;
+  }
+
+  return out_mute;
+}
+
+/* process input channels and mix them into main mix */
+static inline void
+mix_one(
+  struct output_channel *output_mix_channel,
+  GSList *channels_list,
+  jack_nframes_t start,         /* index of first sample to process */
+  jack_nframes_t end)           /* index of sample to stop processing before */
+{
+  jack_nframes_t i;
+  jack_nframes_t span_start;
+  jack_nframes_t span_end;
+  GSList *node_ptr;
+  struct channel * channel_ptr;
+  jack_default_audio_sample_t frame_left;
+  jack_default_audio_sample_t frame_right;
+  struct channel *mix_channel = (struct channel*)output_mix_channel;
+  bool precise = output_mix_channel->double_precision;
+  /* sums are interleaved in tmp_mixed_frames_left, for mono too */
+  unsigned int stride = mix_channel->mixer_ptr->layout == KERNELS_LAYOUT_INTERLEAVED ? 2 : 1;
+  float * mixed_left = mix_channel->tmp_mixed_frames_left;
+  float * mixed_right = stride == 2 ? mixed_left + 1 : mix_channel->tmp_mixed_frames_right;
+  bool meters = mix_channel->mixer_ptr->shed_level < MIXER_SHED_OUTPUT_METERS &&
+    __atomic_load_n(&mix_channel->meter_subscribers, __ATOMIC_RELAXED) > 0;
+  bool clips = __atomic_load_n(&mix_channel->clip_subscribers, __ATOMIC_RELAXED) > 0;
+  /* a monitored input is taken as is, a monitored bus as that bus mixes
+   * it, with its fader and mute after the fader */
+  struct channel * source_ptr = output_mix_channel->monitor_source;
+  struct output_channel * bus_ptr = source_ptr != NULL && output_mix_channel->monitor_bus ? (struct output_channel *)source_ptr : NULL;
+  bool taps_prefader = output_mix_channel->prefader;
+  bool fader = !output_mix_channel->prefader;
+  bool out_mute = mix_channel->out_mute;
+
+  if (bus_ptr != NULL)
+  {
+    taps_prefader = bus_ptr->prefader;
+    fader = !bus_ptr->prefader && !output_mix_channel->monitor_prefader;
+    out_mute = out_mute || (!output_mix_channel->monitor_prefader && source_ptr->out_mute);
+    if (fader && mix_channel->volume_new != source_ptr->volume_new)
+      channel_ramp_volume(mix_channel, source_ptr->volume_new);
+    if (fader && mix_channel->balance_new != source_ptr->balance_new)
+      channel_ramp_balance(mix_channel, source_ptr->balance_new);
+  }
+  else if (source_ptr != NULL)
+  {
+    taps_prefader = output_mix_channel->monitor_prefader;
+    fader = false;
+  }
+
+  for (i = start; i < end; i++)
+  {
+    mix_channel->left_buffer_ptr[i] = mixed_left[i * stride] = 0.0;
+    mixed_right[i * stride] = 0.0;
+    if (mix_channel->stereo)
+      mix_channel->right_buffer_ptr[i] = 0.0;
+  }
+
+  if (precise)
+  {
+    /* left and right sums are adjacent, interleaved ones too */
+    memset(mix_channel->mixed_double_left + start * stride, 0, (end - start) * stride * sizeof(double));
+    if (stride == 1)
+      memset(mix_channel->mixed_double_right + start, 0, (end - start) * sizeof(double));
+  }
+
+  for (node_ptr = channels_list; node_ptr; node_ptr = g_slist_next(node_ptr))
+  {
+    channel_ptr = node_ptr->data;
+
+    /* spans of the range with out_mute of input unchanged, more than one
+     * only in shard clients, which mix after all sub-ranges of the cycle */
+    for (span_start = start; span_start < end; span_start = span_end)
+    {
+      const float * frames_left;
+      const float * frames_right;
+
+      span_end = end;
+      if (!output_channel_mixes(output_mix_channel, channel_ptr,
+                                channel_out_mute_span(channel_ptr, span_start, &span_end)))
+        continue;
+
+      /* input frames are kept for the whole cycle */
+      if (!taps_prefader) {
+        frames_left = channel_ptr->frames_left + span_start * stride;
+        frames_right = channel_ptr->frames_right + span_start * stride;
+      } else {
+        frames_left = channel_ptr->prefader_frames_left + span_start * stride;
+        frames_right = channel_ptr->prefader_frames_right + span_start * stride;
+      }
+
+      if (stride == 2)
+      {
+        /* both sides in one pass, mono output channel ignores right */
+        if (precise)
+          kernel_accumulate_double(mix_channel->mixed_double_left + 2 * span_start, frames_left, 2 * (span_end - span_start));
+        else
+          kernel_accumulate(mixed_left + 2 * span_start, frames_left, 2 * (span_end - span_start));
+      }
+      else if (precise)
+      {
+        kernel_accumulate_double(mix_channel->mixed_double_left + span_start, frames_left, span_end - span_start);
+        if (mix_channel->stereo)
+          kernel_accumulate_double(mix_channel->mixed_double_right + span_start, frames_right, span_end - span_start);
+      }
+      else
+      {
+        kernel_accumulate(mixed_left + span_start, frames_left, span_end - span_start);
+        if (mix_channel->stereo)
+          kernel_accumulate(mixed_right + span_start, frames_right, span_end - span_start);
+      }
+    }
+  }
+
+  if (precise)
+  {
+    /* double has 29 bits more than float, carries of N inputs take log2 N
+     * of them: sums are exact for any order of inputs while their levels
+     * are within 2^(29 - log2 N) of each other, 2^23 for 64 inputs, and
+     * the bus does not depend on list order then */
+    if (stride == 2)
+    {
+      kernel_round_double(mixed_left + 2 * start, mix_channel->mixed_double_left + 2 * start, 2 * (end - start));
+    }
+    else
+    {
+      kernel_round_double(mixed_left + start, mix_channel->mixed_double_left + start, end - start);
+      if (mix_channel->stereo)
+        kernel_round_double(mixed_right + start, mix_channel->mixed_double_right + start, end - start);
+    }
+  }
+
+  /* process main mix channel */
+  unsigned int steps = mix_channel->num_volume_transition_steps;
+  for (i = start ; i < end ; i++)
+  {
+    if (fader) {
+      float volume = mix_channel->volume;
+      float volume_new = mix_channel->volume_new;
+      float vol = volume;
+      float balance = mix_channel->balance;
+      float balance_new = mix_channel->balance_new;
       float bal = balance;
       if (volume != volume_new) {
         vol = mix_channel->volume_idx * (volume_new - volume) / steps + volume;
       }
-      if (balance != balance_new) {
-        bal = mix_channel->balance_idx * (balance_new - balance) / steps + balance;
+      if (balance != balance_new) {
+        bal = mix_channel->balance_idx * (balance_new - balance) / steps + balance;
+      }
+
+      float vol_l;
+      float vol_r;
+      if (mix_channel->stereo) {
+        if (bal > 0) {
+          vol_l = vol * (1 - bal);
+          vol_r = vol;
+        } else {
+          vol_l = vol;
+          vol_r = vol * (1 + bal);
+        }
+      } else {
+        vol_l = vol * (1 - bal);
+        vol_r = vol * (1 + bal);
+      }
+      mixed_left[i * stride] *= vol_l;
+      mixed_right[i * stride] *= vol_r;
+    }
+
+    if (clips &&
+        (fabsf(mixed_left[i * stride]) >= 1.0 ||
+         (mix_channel->stereo && fabsf(mixed_right[i * stride]) >= 1.0)))
+    {
+      mix_channel->clip_count++;
+    }
+
+    /* not subscribed or shed by overload governor */
+    if (meters)
+    {
+      frame_left = fabsf(mixed_left[i * stride]);
+      if (mix_channel->peak_left < frame_left)
+      {
+        mix_channel->peak_left = frame_left;
+
+        if (frame_left > mix_channel->abspeak)
+        {
+          mix_channel->abspeak = frame_left;
+        }
+      }
+
+      if (mix_channel->stereo)
+      {
+        frame_right = fabsf(mixed_right[i * stride]);
+        if (mix_channel->peak_right < frame_right)
+        {
+          mix_channel->peak_right = frame_right;
+
+          if (frame_right > mix_channel->abspeak)
+          {
+            mix_channel->abspeak = frame_right;
+          }
+        }
+      }
+
+      mix_channel->peak_frames++;
+    }
+
+    if (mix_channel->peak_frames >= PEAK_FRAMES_CHUNK)
+    {
+      /* may run on a worker thread */
+      __atomic_fetch_or(&mix_channel->mixer_ptr->cycle_events, MIXER_EVENT_METERS, __ATOMIC_RELAXED);
+      mix_channel->meter_left = mix_channel->peak_left;
+      mix_channel->peak_left = 0.0;
+
+      if (mix_channel->stereo)
+      {
+        mix_channel->meter_right = mix_channel->peak_right;
+        mix_channel->peak_right = 0.0;
+      }
+
+      mix_channel->peak_frames = 0;
+    }
+    mix_channel->volume_idx++;
+    if ((mix_channel->volume != mix_channel->volume_new) && (mix_channel->volume_idx >= steps)) {
+      mix_channel->volume = mix_channel->volume_new;
+      mix_channel->volume_idx = 0;
+    }
+    mix_channel->balance_idx++;
+    if ((mix_channel->balance != mix_channel->balance_new) && (mix_channel->balance_idx >= steps)) {
+      mix_channel->balance = mix_channel->balance_new;
+      mix_channel->balance_idx = 0;
+    }
+
+    if (!out_mute) {
+        mix_channel->left_buffer_ptr[i] = mixed_left[i * stride];
+        if (mix_channel->stereo)
+          mix_channel->right_buffer_ptr[i] = mixed_right[i * stride];
+    }
+  }
+}
+
+/* start ramp to new automatic gain, from where current ramp is */
+static inline void
+channel_agc_set_gain(
+  struct channel * channel_ptr,
+  float gain)
+{
+  if (channel_ptr->agc_gain != channel_ptr->agc_gain_new)
+  {
+    channel_ptr->agc_gain = channel_ptr->agc_gain + channel_ptr->agc_gain_idx *
+      (channel_ptr->agc_gain_new - channel_ptr->agc_gain) /
+      channel_ptr->num_volume_transition_steps;
+  }
+  channel_ptr->agc_gain_idx = 0;
+  channel_ptr->agc_gain_new = gain;
+}
+
+/* end of detector block, derive gain from input level */
+static void
+channel_agc_update(
+  struct channel * channel_ptr)
+{
+  float mean_square;
+  float gate;
+  float gain;
+  float max_gain;
+
+  mean_square = channel_ptr->agc_energy / (channel_ptr->agc_frames * (channel_ptr->stereo ? 2 : 1));
+  channel_ptr->agc_energy = 0.0;
+  channel_ptr->agc_frames = 0;
+
+  /* NaN input, leave gain as it is */
+  if (!FLOAT_EXISTS(mean_square))
+  {
+    return;
+  }
+
+  gate = db_to_value(channel_ptr->agc_gate_db);
+  if (mean_square > gate * gate)
+  {
+    channel_ptr->agc_level += (mean_square > channel_ptr->agc_level ? AGC_ATTACK : AGC_RELEASE) *
+      (mean_square - channel_ptr->agc_level);
+  }
+
+  if (channel_ptr->agc_level <= 0.0)
+  {
+    return;
+  }
+
+  gain = db_to_value(channel_ptr->agc_target_db) / sqrtf(channel_ptr->agc_level);
+  max_gain = db_to_value(channel_ptr->agc_max_gain_db);
+  if (gain > max_gain)
+  {
+    gain = max_gain;
+  }
+
+  channel_agc_set_gain(channel_ptr, gain);
+}
+
+static inline void
+calc_channel_frames(
+  struct channel *channel_ptr,
+  jack_nframes_t start,
+  jack_nframes_t end)
+{
+  jack_nframes_t i;
+  jack_nframes_t span_end = end;
+  jack_default_audio_sample_t frame_left;
+  jack_default_audio_sample_t frame_right;
+  unsigned int steps = channel_ptr->num_volume_transition_steps;
+  jack_nframes_t agc_block = channel_ptr->mixer_ptr->sample_rate / AGC_BLOCKS_PER_SECOND;
+  bool meters = channel_ptr->mixer_ptr->shed_level < MIXER_SHED_INPUT_METERS &&
+    __atomic_load_n(&channel_ptr->meter_subscribers, __ATOMIC_RELAXED) > 0;
+  bool clips = __atomic_load_n(&channel_ptr->clip_subscribers, __ATOMIC_RELAXED) > 0;
+  /* right follows left in frames_left and prefader_frames_left when interleaved */
+  unsigned int stride = channel_ptr->mixer_ptr->layout == KERNELS_LAYOUT_INTERLEAVED ? 2 : 1;
+  float * frames_left = channel_ptr->frames_left;
+  float * frames_right = stride == 2 ? frames_left + 1 : channel_ptr->frames_right;
+  float * prefader_left = channel_ptr->prefader_frames_left;
+  float * prefader_right = stride == 2 ? prefader_left + 1 : channel_ptr->prefader_frames_right;
+
+  if (start == 0)
+  {
+    channel_ptr->cycle_out_mute = channel_ptr->out_mute;
+    channel_ptr->out_mute_flips_count = 0;
+  }
+  else if (channel_out_mute_span(channel_ptr, start, &span_end) != channel_ptr->out_mute)
+  {
+    /* when full, last flip is dropped instead, state between them is off */
+    if (channel_ptr->out_mute_flips_count == OUT_MUTE_FLIPS_MAX)
+      channel_ptr->out_mute_flips_count--;
+    else
+      channel_ptr->out_mute_flips[channel_ptr->out_mute_flips_count++] = start;
+  }
+
+  if (!channel_ptr->agc_enabled)
+  {
+    channel_ptr->agc_energy = 0.0;
+    channel_ptr->agc_frames = 0;
+    channel_ptr->agc_level = 0.0;
+    if (channel_ptr->agc_gain_new != 1.0)
+    {
+      channel_agc_set_gain(channel_ptr, 1.0);
+    }
+  }
+
+  for (i = start ; i < end ; i++)
+  {
+    prefader_left[i * stride] = channel_ptr->left_buffer_ptr[i];
+    if (channel_ptr->stereo)
+      prefader_right[i * stride] = channel_ptr->right_buffer_ptr[i];
+
+    if (!FLOAT_EXISTS(channel_ptr->left_buffer_ptr[i]))
+    {
+      channel_ptr->NaN_detected = true;
+      frames_left[i * stride] = NAN;
+      break;
+    }
+    float volume = channel_ptr->volume;
+    float volume_new = channel_ptr->volume_new;
+    float vol = volume;
+    float balance = channel_ptr->balance;
+    float balance_new = channel_ptr->balance_new;
+    float bal = balance;
+    if (channel_ptr->volume != channel_ptr->volume_new) {
+      vol = channel_ptr->volume_idx * (volume_new - volume) / steps + volume;
+    }
+    if (channel_ptr->balance != channel_ptr->balance_new) {
+      bal = channel_ptr->balance_idx * (balance_new - balance) / steps + balance;
+    }
+    if (channel_ptr->agc_gain != channel_ptr->agc_gain_new) {
+      vol *= channel_ptr->agc_gain_idx * (channel_ptr->agc_gain_new - channel_ptr->agc_gain) / steps + channel_ptr->agc_gain;
+    } else {
+      vol *= channel_ptr->agc_gain;
+    }
+    if (channel_ptr->agc_enabled)
+    {
+      channel_ptr->agc_energy += channel_ptr->left_buffer_ptr[i] * channel_ptr->left_buffer_ptr[i];
+      if (channel_ptr->stereo)
+      {
+        channel_ptr->agc_energy += channel_ptr->right_buffer_ptr[i] * channel_ptr->right_buffer_ptr[i];
+      }
+      channel_ptr->agc_frames++;
+      if (channel_ptr->agc_frames >= agc_block)
+      {
+        channel_agc_update(channel_ptr);
+      }
+    }
+    float vol_l;
+    float vol_r;
+    if (channel_ptr->stereo) {
+      if (bal > 0) {
+        vol_l = vol * (1 - bal);
+        vol_r = vol;
+      } else {
+        vol_l = vol;
+        vol_r = vol * (1 + bal);
+      }
+    } else {
+      vol_l = vol * (1 - bal);
+      vol_r = vol * (1 + bal);
+    }
+    frame_left = channel_ptr->left_buffer_ptr[i] * vol_l;
+    if (channel_ptr->stereo)
+    {
+      if (!FLOAT_EXISTS(channel_ptr->right_buffer_ptr[i]))
+      {
+        channel_ptr->NaN_detected = true;
+        frames_right[i * stride] = NAN;
+        break;
+      }
+
+      frame_right = channel_ptr->right_buffer_ptr[i] * vol_r;
+    }
+    else
+    {
+      frame_right = channel_ptr->left_buffer_ptr[i] * vol_r;
+    }
+    frames_left[i * stride] = frame_left;
+    frames_right[i * stride] = frame_right;
+
+    if (clips && (fabsf(frame_left) >= 1.0 || fabsf(frame_right) >= 1.0))
+    {
+      channel_ptr->clip_count++;
+    }
+
+    /* not subscribed or shed by overload governor */
+    if (meters)
+    {
+      if (channel_ptr->stereo)
+      {
+        frame_left = fabsf(frame_left);
+        frame_right = fabsf(frame_right);
+
+        if (channel_ptr->peak_left < frame_left)
+        {
+          channel_ptr->peak_left = frame_left;
+
+          if (frame_left > channel_ptr->abspeak)
+          {
+            channel_ptr->abspeak = frame_left;
+          }
+        }
+
+        if (channel_ptr->peak_right < frame_right)
+        {
+          channel_ptr->peak_right = frame_right;
+
+          if (frame_right > channel_ptr->abspeak)
+          {
+            channel_ptr->abspeak = frame_right;
+          }
+        }
+      }
+      else
+      {
+        frame_left = (fabsf(frame_left) + fabsf(frame_right)) / 2;
+
+        if (channel_ptr->peak_left < frame_left)
+        {
+          channel_ptr->peak_left = frame_left;
+
+          if (frame_left > channel_ptr->abspeak)
+          {
+            channel_ptr->abspeak = frame_left;
+          }
+        }
+      }
+
+      channel_ptr->peak_frames++;
+    }
+
+    if (channel_ptr->peak_frames >= PEAK_FRAMES_CHUNK)
+    {
+      /* may run on a worker thread */
+      __atomic_fetch_or(&channel_ptr->mixer_ptr->cycle_events, MIXER_EVENT_METERS, __ATOMIC_RELAXED);
+      channel_ptr->meter_left = channel_ptr->peak_left;
+      channel_ptr->peak_left = 0.0;
+
+      if (channel_ptr->stereo)
+      {
+        channel_ptr->meter_right = channel_ptr->peak_right;
+        channel_ptr->peak_right = 0.0;
+      }
+
+      channel_ptr->peak_frames = 0;
+    }
+    channel_ptr->volume_idx++;
+    if ((channel_ptr->volume != channel_ptr->volume_new) &&
+     (channel_ptr->volume_idx >= steps)) {
+      channel_ptr->volume = channel_ptr->volume_new;
+      channel_ptr->volume_idx = 0;
+    }
+    channel_ptr->balance_idx++;
+    if ((channel_ptr->balance != channel_ptr->balance_new) &&
+     (channel_ptr->balance_idx >= steps)) {
+      channel_ptr->balance = channel_ptr->balance_new;
+      channel_ptr->balance_idx = 0;
+     }
+    channel_ptr->agc_gain_idx++;
+    if ((channel_ptr->agc_gain != channel_ptr->agc_gain_new) &&
+     (channel_ptr->agc_gain_idx >= steps)) {
+      channel_ptr->agc_gain = channel_ptr->agc_gain_new;
+      channel_ptr->agc_gain_idx = 0;
+    }
+  }
+}
+
+/* worker pool job, one input channel */
+static void
+mix_input_job(
+  void * context,
+  unsigned int index)
+{
+  struct jack_mixer * mixer_ptr = context;
+
+  calc_channel_frames(mixer_ptr->jobs[index], mixer_ptr->jobs_start, mixer_ptr->jobs_end);
+}
+
+/* worker pool job, one output channel */
+static void
+mix_output_job(
+  void * context,
+  unsigned int index)
+{
+  struct jack_mixer * mixer_ptr = context;
+
+  mix_one(mixer_ptr->jobs[index], mixer_ptr->input_channels_list, mixer_ptr->jobs_start, mixer_ptr->jobs_end);
+}
+
+static inline void
+mix(
+  struct jack_mixer * mixer_ptr,
+  jack_nframes_t start,         /* index of first sample to process */
+  jack_nframes_t end)           /* index of sample to stop processing before */
+{
+  GSList *node_ptr;
+  struct output_channel * output_channel_ptr;
+  struct channel *channel_ptr;
+  bool shared;
+  unsigned int count;
+
+  /* channels of a kind do not depend on each other, outputs only on inputs */
+  shared = mixer_ptr->workers_slot_ptr != NULL && workers_active();
+  mixer_ptr->jobs_start = start;
+  mixer_ptr->jobs_end = end;
+  count = 0;
+
+  for (node_ptr = mixer_ptr->input_channels_list; node_ptr; node_ptr = g_slist_next(node_ptr))
+  {
+    channel_ptr = (struct channel*)node_ptr->data;
+
+    if (!shared)
+    {
+      calc_channel_frames(channel_ptr, start, end);
+      continue;
+    }
+
+    mixer_ptr->jobs[count++] = channel_ptr;
+    if (count == MIXER_JOBS_MAX || g_slist_next(node_ptr) == NULL)
+    {
+      workers_run(mixer_ptr->workers_slot_ptr, mix_input_job, mixer_ptr, count);
+      count = 0;
+    }
+  }
+
+  for (node_ptr = mixer_ptr->output_channels_list; node_ptr; node_ptr = g_slist_next(node_ptr))
+  {
+    output_channel_ptr = node_ptr->data;
+    channel_ptr = (struct channel*)output_channel_ptr;
+
+    if (output_channel_ptr->shard_ptr != NULL)
+    {
+      /* mixed by its shard client, later in the cycle */
+      continue;
+    }
+
+    if (output_channel_ptr->system)
+    {
+      /* Don't bother mixing the channels if we are not connected */
+      if (channel_ptr->stereo)
+      {
+        if (jack_port_connected(channel_ptr->port_left) == 0 &&
+            jack_port_connected(channel_ptr->port_right) == 0)
+          continue;
+      } else {
+         if (jack_port_connected(channel_ptr->port_left) == 0)
+           continue;
+      }
+    }
+
+    if (!shared)
+    {
+      mix_one(output_channel_ptr, mixer_ptr->input_channels_list, start, end);
+      continue;
+    }
+
+    mixer_ptr->jobs[count++] = output_channel_ptr;
+    if (count == MIXER_JOBS_MAX)
+    {
+      workers_run(mixer_ptr->workers_slot_ptr, mix_output_job, mixer_ptr, count);
+      count = 0;
+    }
+  }
+
+  if (count > 0)
+  {
+    workers_run(mixer_ptr->workers_slot_ptr, mix_output_job, mixer_ptr, count);
+  }
+}
+
+static inline void
+update_channel_buffers(
+  struct channel * channel_ptr,
+  jack_nframes_t nframes)
+{
+  struct channel_buffers * buffers_ptr;
+  struct channel_buffers * retired_ptr;
+
+  buffers_ptr = __atomic_exchange_n(&channel_ptr->pending_buffers_ptr, NULL, __ATOMIC_ACQUIRE);
+  if (buffers_ptr != NULL)
+  {
+    retired_ptr = channel_ptr->buffers_ptr;
+    channel_use_buffers(channel_ptr, buffers_ptr);
+
+    retired_ptr->next = __atomic_load_n(&channel_ptr->retired_buffers_ptr, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(
+             &channel_ptr->retired_buffers_ptr,
+             &retired_ptr->next,
+             retired_ptr,
+             true,
+             __ATOMIC_RELEASE,
+             __ATOMIC_RELAXED));
+  }
+
+  if (channel_ptr->port_left == NULL)
+  {
+    /* player channel, filled before the cycle is mixed */
+    channel_ptr->left_buffer_ptr = channel_ptr->tmp_mixed_frames_left;
+    channel_ptr->right_buffer_ptr = channel_ptr->tmp_mixed_frames_right;
+    return;
+  }
+
+  channel_ptr->left_buffer_ptr = jack_port_get_buffer(channel_ptr->port_left, nframes);
+
+  if (channel_ptr->stereo)
+  {
+    channel_ptr->right_buffer_ptr = jack_port_get_buffer(channel_ptr->port_right, nframes);
+  }
+}
+
+/* copy count frames to ring, from index on, wrapping around */
+static inline void
+delay_ring_write(
+  jack_default_audio_sample_t * ring_ptr,
+  jack_nframes_t size,
+  jack_nframes_t index,
+  const jack_default_audio_sample_t * frames_ptr,
+  jack_nframes_t count)
+{
+  jack_nframes_t first = count < size - index ? count : size - index;
+
+  memcpy(ring_ptr + index, frames_ptr, first * sizeof(jack_default_audio_sample_t));
+  memcpy(ring_ptr, frames_ptr + first, (count - first) * sizeof(jack_default_audio_sample_t));
+}
+
+/* copy count frames from ring, from index on, wrapping around */
+static inline void
+delay_ring_read(
+  const jack_default_audio_sample_t * ring_ptr,
+  jack_nframes_t size,
+  jack_nframes_t index,
+  jack_default_audio_sample_t * frames_ptr,
+  jack_nframes_t count)
+{
+  jack_nframes_t first = count < size - index ? count : size - index;
+
+  memcpy(frames_ptr, ring_ptr + index, first * sizeof(jack_default_audio_sample_t));
+  memcpy(frames_ptr + first, ring_ptr, (count - first) * sizeof(jack_default_audio_sample_t));
+}
+
+/* Delay input of channel for the cycle, before its fader. Input goes to
+ * the ring and frames written delay frames earlier come out into the
+ * channel scratch buffers, which input frames are then read from. Copies
+ * go in chunks short enough not to overwrite frames still to be read. */
+static void
+channel_delay_frames(
+  struct channel * channel_ptr,
+  jack_nframes_t nframes)
+{
+  struct channel_delay * delay_ptr;
+  struct channel_delay * retired_ptr;
+  jack_nframes_t delay;
+  jack_nframes_t done;
+  jack_nframes_t count;
+  jack_nframes_t read_idx;
+
+  delay_ptr = __atomic_exchange_n(&channel_ptr->pending_delay_ptr, NULL, __ATOMIC_ACQUIRE);
+  if (delay_ptr != NULL)
+  {
+    retired_ptr = channel_ptr->delay_ptr;
+    channel_ptr->delay_ptr = delay_ptr;
+
+    if (retired_ptr != NULL)
+    {
+      retired_ptr->next = __atomic_load_n(&channel_ptr->retired_delay_ptr, __ATOMIC_RELAXED);
+      while (!__atomic_compare_exchange_n(
+               &channel_ptr->retired_delay_ptr,
+               &retired_ptr->next,
+               retired_ptr,
+               true,
+               __ATOMIC_RELEASE,
+               __ATOMIC_RELAXED));
+    }
+  }
+
+  delay_ptr = channel_ptr->delay_ptr;
+  if (delay_ptr == NULL)
+  {
+    return;
+  }
+
+  /* line is written with no delay too, so that history is there once one is set */
+  delay = __atomic_load_n(&channel_ptr->latency, __ATOMIC_RELAXED);
+  if (delay > delay_ptr->size - DELAY_CHUNK_MIN)
+  {
+    delay = delay_ptr->size - DELAY_CHUNK_MIN;
+  }
+
+  for (done = 0; done < nframes; done += count)
+  {
+    count = nframes - done < delay_ptr->size - delay ? nframes - done : delay_ptr->size - delay;
+    read_idx = (delay_ptr->write_idx + delay_ptr->size - delay) % delay_ptr->size;
+
+    delay_ring_write(delay_ptr->ring_left, delay_ptr->size, delay_ptr->write_idx, channel_ptr->left_buffer_ptr + done, count);
+    if (delay > 0)
+    {
+      delay_ring_read(delay_ptr->ring_left, delay_ptr->size, read_idx, channel_ptr->tmp_mixed_frames_left + done, count);
+    }
+
+    if (channel_ptr->stereo)
+    {
+      delay_ring_write(delay_ptr->ring_right, delay_ptr->size, delay_ptr->write_idx, channel_ptr->right_buffer_ptr + done, count);
+      if (delay > 0)
+      {
+        delay_ring_read(delay_ptr->ring_right, delay_ptr->size, read_idx, channel_ptr->tmp_mixed_frames_right + done, count);
+      }
+    }
+
+    delay_ptr->write_idx = (delay_ptr->write_idx + count) % delay_ptr->size;
+  }
+
+  /* scratch buffers of input channels are not used otherwise */
+  if (delay > 0)
+  {
+    channel_ptr->left_buffer_ptr = channel_ptr->tmp_mixed_frames_left;
+    channel_ptr->right_buffer_ptr = channel_ptr->tmp_mixed_frames_right;
+  }
+}
+
+/* Process callback of a shard client. Changes to its output channels were
+ * applied by the mixer client at their frame, they take effect from the
+ * start of the cycle here. */
+static int
+shard_process(
+  jack_nframes_t nframes,
+  void * arg)
+{
+  struct mixer_shard * shard_ptr = arg;
+  struct output_channel * output_channel_ptr;
+  GSList *node_ptr;
+
+  for (node_ptr = shard_ptr->mixer_ptr->output_channels_list; node_ptr; node_ptr = g_slist_next(node_ptr))
+  {
+    output_channel_ptr = node_ptr->data;
+    if (output_channel_ptr->shard_ptr != shard_ptr)
+    {
+      continue;
+    }
+
+    update_channel_buffers((struct channel *)output_channel_ptr, nframes);
+    mix_one(output_channel_ptr, shard_ptr->mixer_ptr->input_channels_list, 0, nframes);
+  }
+
+  return 0;
+}
+
+#if defined(HAVE_JACK_LATENCY)
+
+/* merge latency range of channel ports, plus delay, into range */
+static void
+latency_merge_channel(
+  jack_latency_range_t * range_ptr,
+  bool * empty_ptr,
+  struct channel * channel_ptr,
+  jack_latency_callback_mode_t mode,
+  jack_nframes_t delay)
+{
+  jack_latency_range_t port_range;
+  jack_port_t * port_ptr;
+  int i;
+
+  for (i = 0; i < (channel_ptr->stereo ? 2 : 1); i++)
+  {
+    port_ptr = i == 0 ? channel_ptr->port_left : channel_ptr->port_right;
+    port_range.min = port_range.max = 0;
+    if (port_ptr != NULL)
+    {
+      jack_port_get_latency_range(port_ptr, mode, &port_range);
+    }
+    port_range.min += delay;
+    port_range.max += delay;
+
+    if (*empty_ptr)
+    {
+      *range_ptr = port_range;
+      *empty_ptr = false;
+      continue;
+    }
+
+    if (port_range.min < range_ptr->min)
+    {
+      range_ptr->min = port_range.min;
+    }
+
+    if (port_range.max > range_ptr->max)
+    {
+      range_ptr->max = port_range.max;
+    }
+  }
+}
+
+/* Delay input channels following port latencies so that their audio is as
+ * late as the one of the latest of them, by capture latency of their
+ * ports. Mixer mutex must be locked. */
+static void
+mixer_align_inputs(
+  struct jack_mixer * mixer_ptr)
+{
+  GSList * node_ptr;
+  struct channel * channel_ptr;
+  jack_latency_range_t range;
+  jack_nframes_t latest;
+  jack_nframes_t frames;
+  jack_nframes_t max_frames;
+
+  latest = 0;
+  for (node_ptr = mixer_ptr->input_channels_list; node_ptr; node_ptr = g_slist_next(node_ptr))
+  {
+    channel_ptr = node_ptr->data;
+    if (!channel_ptr->delay_auto)
+    {
+      continue;
+    }
+
+    jack_port_get_latency_range(channel_ptr->port_left, JackCaptureLatency, &range);
+    latest = range.max > latest ? range.max : latest;
+    if (channel_ptr->stereo)
+    {
+      jack_port_get_latency_range(channel_ptr->port_right, JackCaptureLatency, &range);
+      latest = range.max > latest ? range.max : latest;
+    }
+  }
+
+  max_frames = mixer_delay_max_frames(mixer_ptr);
+
+  for (node_ptr = mixer_ptr->input_channels_list; node_ptr; node_ptr = g_slist_next(node_ptr))
+  {
+    channel_ptr = node_ptr->data;
+    if (!channel_ptr->delay_auto)
+    {
+      continue;
+    }
+
+    /* sides are delayed alike, the later one is aligned */
+    jack_port_get_latency_range(channel_ptr->port_left, JackCaptureLatency, &range);
+    frames = latest - range.max;
+    if (channel_ptr->stereo)
+    {
+      jack_port_get_latency_range(channel_ptr->port_right, JackCaptureLatency, &range);
+      frames = latest - range.max < frames ? latest - range.max : frames;
+    }
+
+    if (frames > max_frames)
+    {
+      LOG_WARNING("Channel \"%s\" needs %" PRIu32 " frames of delay, more than %u ms", channel_ptr->name, frames, MIXER_DELAY_MAX_MS);
+      frames = max_frames;
+    }
+
+    if (frames > 0 && !channel_prepare_delay(channel_ptr))
+    {
+      frames = 0;
+    }
+
+    __atomic_store_n(&channel_ptr->latency, frames, __ATOMIC_RELAXED);
+  }
+}
+
+/* Capture latency of an output channel is the one of inputs routed to it,
+ * playback latency of an input channel the one of outputs it is routed
+ * to, both plus what channel processing delays audio by. Only ports of
+ * the client called back are set, shard_ptr is NULL for the mixer one. */
+static void
+mixer_update_latencies(
+  struct jack_mixer * mixer_ptr,
+  struct mixer_shard * shard_ptr,
+  jack_latency_callback_mode_t mode)
+{
+  GSList * output_node_ptr;
+  GSList * input_node_ptr;
+  struct output_channel * output_channel_ptr;
+  struct channel * channel_ptr;
+  jack_latency_range_t range;
+  bool empty;
+
+  /* against channels being added or removed and routing changes, RT
+   * ones free list nodes under the mutex */
+  pthread_mutex_lock(&mixer_ptr->mutex);
+
+  /* input ports are in the mixer client, JACK calls it back first */
+  if (mode == JackCaptureLatency && shard_ptr == NULL)
+  {
+    mixer_align_inputs(mixer_ptr);
+  }
+
+  for (output_node_ptr = mixer_ptr->output_channels_list;
+       mode == JackCaptureLatency && output_node_ptr;
+       output_node_ptr = g_slist_next(output_node_ptr))
+  {
+    output_channel_ptr = output_node_ptr->data;
+    if (output_channel_ptr->shard_ptr != shard_ptr)
+    {
+      continue;
+    }
+
+    range.min = range.max = 0;
+    empty = true;
+    for (input_node_ptr = mixer_ptr->input_channels_list; input_node_ptr; input_node_ptr = g_slist_next(input_node_ptr))
+    {
+      channel_ptr = input_node_ptr->data;
+      if (output_channel_mixes(output_channel_ptr, channel_ptr, channel_ptr->out_mute))
+      {
+        latency_merge_channel(&range, &empty, channel_ptr, mode, channel_ptr->latency);
+      }
+    }
+
+    channel_ptr = (struct channel *)output_channel_ptr;
+    range.min += channel_ptr->latency;
+    range.max += channel_ptr->latency;
+    jack_port_set_latency_range(channel_ptr->port_left, mode, &range);
+    if (channel_ptr->stereo)
+    {
+      jack_port_set_latency_range(channel_ptr->port_right, mode, &range);
+    }
+  }
+
+  /* input channels are in the mixer client */
+  for (input_node_ptr = mixer_ptr->input_channels_list;
+       mode == JackPlaybackLatency && shard_ptr == NULL && input_node_ptr;
+       input_node_ptr = g_slist_next(input_node_ptr))
+  {
+    channel_ptr = input_node_ptr->data;
+
+    range.min = range.max = 0;
+    empty = true;
+    for (output_node_ptr = mixer_ptr->output_channels_list; output_node_ptr; output_node_ptr = g_slist_next(output_node_ptr))
+    {
+      output_channel_ptr = output_node_ptr->data;
+      if (output_channel_mixes(output_channel_ptr, channel_ptr, channel_ptr->out_mute))
+      {
+        latency_merge_channel(&range, &empty, (struct channel *)output_channel_ptr, mode, output_channel_ptr->channel.latency);
+      }
+    }
+
+    if (channel_ptr->port_left == NULL)
+    {
+      continue;
+    }
+
+    range.min += channel_ptr->latency;
+    range.max += channel_ptr->latency;
+    jack_port_set_latency_range(channel_ptr->port_left, mode, &range);
+    if (channel_ptr->stereo)
+    {
+      jack_port_set_latency_range(channel_ptr->port_right, mode, &range);
+    }
+  }
+
+  pthread_mutex_unlock(&mixer_ptr->mutex);
+}
+
+static void
+shard_latency(
+  jack_latency_callback_mode_t mode,
+  void * arg)
+{
+  struct mixer_shard * shard_ptr = arg;
+
+  mixer_update_latencies(shard_ptr->mixer_ptr, shard_ptr, mode);
+}
+
+#endif /* #if defined(HAVE_JACK_LATENCY) */
+
+/* wake the UI, only once until it reads the events */
+static void
+mixer_signal_events(
+  struct jack_mixer * mixer_ptr)
+{
+  uint64_t one = 1;
+
+  if (mixer_ptr->cycle_events == 0)
+  {
+    return;
+  }
+
+  if (__atomic_fetch_or(&mixer_ptr->pending_events, mixer_ptr->cycle_events, __ATOMIC_ACQ_REL) == 0)
+  {
+    if (write(mixer_ptr->event_fd, &one, sizeof(one)) != sizeof(one))
+    {
+      /* eventfd counter is already non zero, nothing is lost */
+    }
+  }
+
+  mixer_ptr->cycle_events = 0;
+}
+
+static void
+mixer_release_node(
+  struct jack_mixer * mixer_ptr,
+  GSList * node_ptr)
+{
+  if (node_ptr == NULL)
+  {
+    return;
+  }
+
+  if (jack_ringbuffer_write(mixer_ptr->released_ring, (const char *)&node_ptr, sizeof(node_ptr)) != sizeof(node_ptr))
+  {
+    /* cannot happen, ring is sized for all pending events; leak rather than free here */
+  }
+}
+
+/* record change, at automation_frame, if recording and transport is rolling */
+static void
+mixer_capture(
+  struct jack_mixer * mixer_ptr,
+  unsigned int slot,
+  unsigned int input_slot,
+  unsigned int type,
+  float value)
+{
+  struct automation_event event;
+
+  if (mixer_ptr->automation_rt_ptr == NULL ||
+      !automation_is_recording(mixer_ptr->automation_rt_ptr) ||
+      !mixer_ptr->transport_rolling ||
+      slot == AUTOMATION_NO_SLOT)
+  {
+    return;
+  }
+
+  event.frame = mixer_ptr->automation_frame;
+  event.generation = 0;
+  event.slot = slot;
+  event.input_slot = input_slot;
+  event.type = type;
+  event.value = value;
+  event.node_ptr = NULL;
+
+  if (!automation_record(mixer_ptr->automation_rt_ptr, &event))
+  {
+    __atomic_fetch_add(&mixer_ptr->automation_overruns, 1, __ATOMIC_RELAXED);
+  }
+}
+
+/* record channel parameters that changed since they were last recorded */
+static void
+mixer_capture_changes(
+  struct jack_mixer * mixer_ptr,
+  struct channel * channel_ptr)
+{
+  float out_mute;
+
+  if (mixer_ptr->automation_rt_ptr == NULL ||
+      !automation_is_recording(mixer_ptr->automation_rt_ptr) ||
+      !mixer_ptr->transport_rolling)
+  {
+    return;
+  }
+
+  if (channel_ptr->automation_volume != channel_ptr->volume_new)
+  {
+    channel_ptr->automation_volume = channel_ptr->volume_new;
+    mixer_capture(mixer_ptr, channel_ptr->automation_slot, AUTOMATION_NO_SLOT, AUTOMATION_VOLUME, value_to_db(channel_ptr->volume_new));
+  }
+
+  if (channel_ptr->automation_balance != channel_ptr->balance_new)
+  {
+    channel_ptr->automation_balance = channel_ptr->balance_new;
+    mixer_capture(mixer_ptr, channel_ptr->automation_slot, AUTOMATION_NO_SLOT, AUTOMATION_BALANCE, channel_ptr->balance_new);
+  }
+
+  out_mute = channel_ptr->out_mute ? 1.0 : 0.0;
+  if (channel_ptr->automation_out_mute != out_mute)
+  {
+    channel_ptr->automation_out_mute = out_mute;
+    mixer_capture(mixer_ptr, channel_ptr->automation_slot, AUTOMATION_NO_SLOT, AUTOMATION_OUT_MUTE, out_mute);
+  }
+}
+
+/* RT safe version of output_channel_set_muted(), list node is preallocated */
+static void
+output_channel_apply_muted(
+  struct output_channel * output_channel_ptr,
+  struct channel * input_ptr,
+  GSList * node_ptr,
+  bool muted_value)
+{
+  GSList ** link_ptr_ptr;
+
+  mixer_routing_changed(input_ptr->mixer_ptr);
+
+  if (muted_value)
+  {
+    if (g_slist_find(output_channel_ptr->muted_channels, input_ptr) == NULL)
+    {
+      node_ptr->data = input_ptr;
+      node_ptr->next = output_channel_ptr->muted_channels;
+      output_channel_ptr->muted_channels = node_ptr;
+      node_ptr = NULL;
+    }
+  }
+  else
+  {
+    for (link_ptr_ptr = &output_channel_ptr->muted_channels; *link_ptr_ptr; link_ptr_ptr = &(*link_ptr_ptr)->next)
+    {
+      if ((*link_ptr_ptr)->data == input_ptr)
+      {
+        node_ptr = *link_ptr_ptr;
+        *link_ptr_ptr = node_ptr->next;
+        break;
+      }
+    }
+  }
+
+  mixer_release_node(input_ptr->mixer_ptr, node_ptr);
+  output_channel_state_store_routing(output_channel_ptr, input_ptr, muted_value, false);
+  mixer_capture(
+    input_ptr->mixer_ptr,
+    output_channel_ptr->channel.automation_slot,
+    input_ptr->automation_slot,
+    AUTOMATION_SEND_MUTE,
+    muted_value ? 1.0 : 0.0);
+}
+
+/* process callback side of output_channel_set_monitor_source(), applied
+ * at cycle start */
+static void
+output_channel_apply_monitor(
+  struct output_channel * output_channel_ptr,
+  struct channel * source_ptr,
+  bool prefader)
+{
+  struct jack_mixer * mixer_ptr = output_channel_ptr->channel.mixer_ptr;
+  unsigned int slot = output_channel_ptr->channel.automation_slot;
+
+  output_channel_ptr->monitor_source = source_ptr;
+  output_channel_ptr->monitor_bus =
+    source_ptr != NULL && g_slist_find(mixer_ptr->output_channels_list, source_ptr) != NULL;
+  output_channel_ptr->monitor_prefader = prefader;
+  mixer_routing_changed(mixer_ptr);
+
+  /* replay applies states before mixing the cycle too */
+  if (mixer_ptr->capture_rt_ptr != NULL &&
+      slot != AUTOMATION_NO_SLOT &&
+      mixer_ptr->capture_channels[slot] == &output_channel_ptr->channel &&
+      capture_reserve(mixer_ptr->capture_rt_ptr, CAPTURE_RECORD_SIZE(sizeof(struct capture_state)) + mixer_ptr->capture_output_size))
+  {
+    mixer_capture_state(mixer_ptr, &output_channel_ptr->channel, true, false);
+  }
+}
+
+/* record parameter change applied during the cycle, at capture_offset */
+static void
+mixer_capture_event(
+  const struct scheduled_event * event_ptr)
+{
+  struct jack_mixer * mixer_ptr = event_ptr->channel_ptr->mixer_ptr;
+  struct capture_event event;
+
+  if (mixer_ptr->capture_rt_ptr == NULL ||
+      event_ptr->channel_ptr->automation_slot == AUTOMATION_NO_SLOT ||
+      !capture_reserve(mixer_ptr->capture_rt_ptr, CAPTURE_RECORD_SIZE(sizeof(event)) + mixer_ptr->capture_output_size))
+  {
+    return;
+  }
+
+  event.offset = mixer_ptr->capture_offset;
+  event.slot = event_ptr->channel_ptr->automation_slot;
+  event.input_slot = AUTOMATION_NO_SLOT;
+  event.value = event_ptr->value;
+
+  switch (event_ptr->type)
+  {
+  case SCHEDULED_VOLUME:
+    event.type = AUTOMATION_VOLUME;
+    break;
+  case SCHEDULED_BALANCE:
+    event.type = AUTOMATION_BALANCE;
+    break;
+  case SCHEDULED_OUT_MUTE:
+    event.type = AUTOMATION_OUT_MUTE;
+    break;
+  case SCHEDULED_SEND_MUTE:
+    event.type = AUTOMATION_SEND_MUTE;
+    event.input_slot = event_ptr->input_ptr->automation_slot;
+    break;
+  default:
+    return;
+  }
+
+  capture_write(mixer_ptr->capture_rt_ptr, CAPTURE_EVENT, &event, sizeof(event));
+}
+
+static void
+mixer_apply_scheduled(
+  struct scheduled_event * event_ptr)
+{
+  mixer_capture_event(event_ptr);
+
+  switch (event_ptr->type)
+  {
+  case SCHEDULED_VOLUME:
+    channel_volume_write(event_ptr->channel_ptr, event_ptr->value);
+    break;
+  case SCHEDULED_BALANCE:
+    channel_balance_write(event_ptr->channel_ptr, event_ptr->value);
+    break;
+  case SCHEDULED_OUT_MUTE:
+    if (event_ptr->value != 0.0)
+    {
+      channel_out_mute(event_ptr->channel_ptr);
+    }
+    else
+    {
+      channel_out_unmute(event_ptr->channel_ptr);
+    }
+    break;
+  case SCHEDULED_SEND_MUTE:
+    output_channel_apply_muted(
+      (struct output_channel *)event_ptr->channel_ptr,
+      event_ptr->input_ptr,
+      event_ptr->node_ptr,
+      event_ptr->value != 0.0);
+    break;
+#if defined(HAVE_SNDFILE)
+  case SCHEDULED_PLAY:
+    /* arrived after mixer_play(), takes effect next cycle */
+    player_start(event_ptr->channel_ptr->player_ptr);
+    break;
+  case SCHEDULED_STOP:
+    player_stop(event_ptr->channel_ptr->player_ptr);
+    break;
+#endif
+  case SCHEDULED_MONITOR:
+    output_channel_apply_monitor(
+      (struct output_channel *)event_ptr->channel_ptr,
+      event_ptr->input_ptr,
+      event_ptr->value != 0.0);
+    break;
+  }
+}
+
+static void
+mixer_drop_scheduled(
+  struct jack_mixer * mixer_ptr,
+  unsigned int index)
+{
+  mixer_ptr->scheduled_count--;
+  memmove(
+    mixer_ptr->scheduled_events + index,
+    mixer_ptr->scheduled_events + index + 1,
+    (mixer_ptr->scheduled_count - index) * sizeof(struct scheduled_event));
+  __atomic_fetch_sub(&mixer_ptr->scheduled_pending, 1, __ATOMIC_ACQ_REL);
+}
+
+/* move events from the queue into frame time ordered array */
+static void
+mixer_receive_scheduled(
+  struct jack_mixer * mixer_ptr)
+{
+  struct scheduled_event event;
+  unsigned int i;
+
+  while (jack_ringbuffer_read(mixer_ptr->scheduled_ring, (char *)&event, sizeof(event)) == sizeof(event))
+  {
+    if (event.type == SCHEDULED_CANCEL)
+    {
+      i = 0;
+      while (i < mixer_ptr->scheduled_count)
+      {
+        if (mixer_ptr->scheduled_events[i].channel_ptr == event.channel_ptr ||
+            mixer_ptr->scheduled_events[i].input_ptr == event.channel_ptr)
+        {
+          mixer_release_node(mixer_ptr, mixer_ptr->scheduled_events[i].node_ptr);
+          mixer_drop_scheduled(mixer_ptr, i);
+        }
+        else
+        {
+          i++;
+        }
+      }
+      continue;
+    }
+
+    if (event.type == SCHEDULED_CAPTURE_SEND_MUTE)
+    {
+      mixer_capture(mixer_ptr, event.slot, event.input_slot, AUTOMATION_SEND_MUTE, event.value);
+      continue;
+    }
+
+    /* keep order of events with same frame time */
+    i = mixer_ptr->scheduled_count;
+    while (i > 0 && (int32_t)(event.frame_time - mixer_ptr->scheduled_events[i - 1].frame_time) < 0)
+    {
+      mixer_ptr->scheduled_events[i] = mixer_ptr->scheduled_events[i - 1];
+      i--;
+    }
+    mixer_ptr->scheduled_events[i] = event;
+    mixer_ptr->scheduled_count++;
+  }
+}
+
+/* follow JACK transport, pick up automation started or stopped by the UI */
+static void
+mixer_update_transport(
+  struct jack_mixer * mixer_ptr,
+  jack_nframes_t nframes)
+{
+  jack_position_t position;
+  struct automation * automation_ptr;
+  bool relocated;
+  GSList * list_ptr;
+  struct channel * channel_ptr;
+
+  mixer_ptr->transport_rolling = jack_transport_query(mixer_ptr->jack_client, &position) == JackTransportRolling;
+  relocated = position.frame != mixer_ptr->transport_next_frame;
+  mixer_ptr->transport_frame = position.frame;
+  mixer_ptr->transport_next_frame = position.frame + (mixer_ptr->transport_rolling ? nframes : 0);
+
+  automation_ptr = __atomic_load_n(&mixer_ptr->automation_ptr, __ATOMIC_ACQUIRE);
+  if (automation_ptr != mixer_ptr->automation_rt_ptr)
+  {
+    mixer_ptr->automation_rt_ptr = automation_ptr;
+    relocated = true;
+
+    if (automation_ptr != NULL && automation_is_recording(automation_ptr))
+    {
+      for (list_ptr = mixer_ptr->input_channels_list; list_ptr; list_ptr = g_slist_next(list_ptr))
+      {
+        channel_ptr = list_ptr->data;
+        channel_ptr->automation_volume = NAN;
+        channel_ptr->automation_balance = NAN;
+        channel_ptr->automation_out_mute = NAN;
+      }
+      for (list_ptr = mixer_ptr->output_channels_list; list_ptr; list_ptr = g_slist_next(list_ptr))
+      {
+        channel_ptr = list_ptr->data;
+        channel_ptr->automation_volume = NAN;
+        channel_ptr->automation_balance = NAN;
+        channel_ptr->automation_out_mute = NAN;
+      }
+      mixer_ptr->automation_snapshot = true;
+    }
+  }
+
+  if (relocated && automation_ptr != NULL && !automation_is_recording(automation_ptr))
+  {
+    automation_relocate(automation_ptr, position.frame);
+  }
+}
+
+/* record changes made since previous cycle, by the UI or by MIDI */
+static void
+mixer_capture_cycle(
+  struct jack_mixer * mixer_ptr)
+{
+  GSList * list_ptr;
+  GSList * input_list_ptr;
+  struct output_channel * output_channel_ptr;
+  struct channel * input_ptr;
+
+  for (list_ptr = mixer_ptr->input_channels_list; list_ptr; list_ptr = g_slist_next(list_ptr))
+  {
+    mixer_capture_changes(mixer_ptr, list_ptr->data);
+  }
+
+  for (list_ptr = mixer_ptr->output_channels_list; list_ptr; list_ptr = g_slist_next(list_ptr))
+  {
+    mixer_capture_changes(mixer_ptr, list_ptr->data);
+  }
+
+  /* send mutes are recorded as they change, except initial ones */
+  if (!mixer_ptr->automation_snapshot ||
+      mixer_ptr->automation_rt_ptr == NULL ||
+      !mixer_ptr->transport_rolling)
+  {
+    return;
+  }
+
+  for (list_ptr = mixer_ptr->output_channels_list; list_ptr; list_ptr = g_slist_next(list_ptr))
+  {
+    output_channel_ptr = list_ptr->data;
+    for (input_list_ptr = mixer_ptr->input_channels_list; input_list_ptr; input_list_ptr = g_slist_next(input_list_ptr))
+    {
+      input_ptr = input_list_ptr->data;
+      mixer_capture(
+        mixer_ptr,
+        output_channel_ptr->channel.automation_slot,
+        input_ptr->automation_slot,
+        AUTOMATION_SEND_MUTE,
+        g_slist_find(output_channel_ptr->muted_channels, input_ptr) != NULL ? 1.0 : 0.0);
+    }
+  }
+
+  mixer_ptr->automation_snapshot = false;
+}
+
+/* next playback event due while transport rolls, events from before a
+ * relocation are dropped */
+static bool
+mixer_next_automation(
+  struct jack_mixer * mixer_ptr,
+  struct automation_event * event_ptr)
+{
+  if (mixer_ptr->automation_rt_ptr == NULL ||
+      automation_is_recording(mixer_ptr->automation_rt_ptr) ||
+      !mixer_ptr->transport_rolling)
+  {
+    return false;
+  }
+
+  while (automation_peek(mixer_ptr->automation_rt_ptr, event_ptr))
+  {
+    if (event_ptr->generation == automation_generation(mixer_ptr->automation_rt_ptr))
+    {
+      return true;
+    }
+
+    mixer_release_node(mixer_ptr, event_ptr->node_ptr);
+    automation_advance(mixer_ptr->automation_rt_ptr);
+  }
+
+  return false;
+}
+
+static void
+mixer_apply_automation(
+  struct jack_mixer * mixer_ptr,
+  const struct automation_event * event_ptr)
+{
+  struct scheduled_event event;
+
+  event.channel_ptr = mixer_ptr->automation_slots[event_ptr->slot].channel_ptr;
+  event.input_ptr = NULL;
+  event.node_ptr = event_ptr->node_ptr;
+  event.value = event_ptr->value;
+
+  switch (event_ptr->type)
+  {
+  case AUTOMATION_VOLUME:
+    event.type = SCHEDULED_VOLUME;
+    break;
+  case AUTOMATION_BALANCE:
+    event.type = SCHEDULED_BALANCE;
+    break;
+  case AUTOMATION_OUT_MUTE:
+    event.type = SCHEDULED_OUT_MUTE;
+    break;
+  case AUTOMATION_SEND_MUTE:
+    event.type = SCHEDULED_SEND_MUTE;
+    if (!mixer_ptr->automation_slots[event_ptr->slot].output)
+    {
+      event.channel_ptr = NULL;
+    }
+    event.input_ptr = mixer_ptr->automation_slots[event_ptr->input_slot].channel_ptr;
+    if (event.input_ptr == NULL)
+    {
+      event.channel_ptr = NULL;
+    }
+    break;
+  default:
+    event.channel_ptr = NULL;
+  }
+
+  /* channel was removed after event was read */
+  if (event.channel_ptr == NULL)
+  {
+    mixer_release_node(mixer_ptr, event.node_ptr);
+    return;
+  }
+
+  mixer_apply_scheduled(&event);
+}
+
+#if defined(HAVE_SNDFILE)
+
+/* Fill buffers of player channels for the cycle, starting and stopping
+ * players at the frames of their events due in it. Runs before the input
+ * buffers are captured and mixed. */
+static void
+mixer_play(
+  struct jack_mixer * mixer_ptr,
+  jack_nframes_t nframes)
+{
+  GSList * node_ptr;
+  struct channel * channel_ptr;
+  struct scheduled_event * event_ptr;
+  jack_nframes_t cycle_start;
+  jack_nframes_t start;
+  int32_t offset;
+  unsigned int i;
+
+  mixer_receive_scheduled(mixer_ptr);
+  cycle_start = jack_last_frame_time(mixer_ptr->jack_client);
+
+  for (node_ptr = mixer_ptr->input_channels_list; node_ptr; node_ptr = g_slist_next(node_ptr))
+  {
+    channel_ptr = node_ptr->data;
+    if (channel_ptr->player_ptr == NULL)
+    {
+      continue;
+    }
+
+    start = 0;
+    i = 0;
+    while (i < mixer_ptr->scheduled_count)
+    {
+      event_ptr = mixer_ptr->scheduled_events + i;
+      offset = (int32_t)(event_ptr->frame_time - cycle_start);
+      if (offset >= (int32_t)nframes)
+      {
+        break;
+      }
+
+      if (event_ptr->channel_ptr != channel_ptr ||
+          (event_ptr->type != SCHEDULED_PLAY && event_ptr->type != SCHEDULED_STOP))
+      {
+        i++;
+        continue;
+      }
+
+      /* late events are applied at cycle start */
+      if (offset > (int32_t)start)
+      {
+        player_read(channel_ptr->player_ptr, channel_ptr->left_buffer_ptr + start, channel_ptr->right_buffer_ptr + start, offset - start);
+        start = offset;
+      }
+
+      if (event_ptr->type == SCHEDULED_PLAY)
+      {
+        player_start(channel_ptr->player_ptr);
+      }
+      else
+      {
+        player_stop(channel_ptr->player_ptr);
+      }
+      mixer_drop_scheduled(mixer_ptr, i);
+    }
+
+    player_read(channel_ptr->player_ptr, channel_ptr->left_buffer_ptr + start, channel_ptr->right_buffer_ptr + start, nframes - start);
+  }
+}
+
+#endif /* #if defined(HAVE_SNDFILE) */
+
+/* mix the cycle, split at frames of scheduled and automation events due in it */
+static void
+mix_scheduled(
+  struct jack_mixer * mixer_ptr,
+  jack_nframes_t nframes)
+{
+  jack_nframes_t cycle_start;
+  jack_nframes_t start;
+  int32_t offset;
+  int32_t automation_offset;
+  struct automation_event automation_event;
+  struct channel * channel_ptr;
+
+  mixer_ptr->automation_frame = mixer_ptr->transport_frame;
+
+  mixer_receive_scheduled(mixer_ptr);
+  mixer_capture_cycle(mixer_ptr);
+
+  cycle_start = jack_last_frame_time(mixer_ptr->jack_client);
+  start = 0;
+
+  while (true)
+  {
+    offset = INT32_MAX;
+    if (mixer_ptr->scheduled_count > 0)
+    {
+      offset = (int32_t)(mixer_ptr->scheduled_events[0].frame_time - cycle_start);
+    }
+
+    automation_offset = INT32_MAX;
+    if (mixer_next_automation(mixer_ptr, &automation_event))
+    {
+      automation_offset = (int32_t)(automation_event.frame - mixer_ptr->transport_frame);
+    }
+
+    if (offset >= (int32_t)nframes && automation_offset >= (int32_t)nframes)
+    {
+      break;
+    }
+
+    /* late events are applied at cycle start */
+    if (automation_offset < offset)
+    {
+      offset = automation_offset;
+    }
+    if (offset > (int32_t)start)
+    {
+      mix(mixer_ptr, start, offset);
+      start = offset;
+    }
+    mixer_ptr->automation_frame = mixer_ptr->transport_frame + start;
+    mixer_ptr->capture_offset = start;
+
+    if (automation_offset == offset)
+    {
+      mixer_apply_automation(mixer_ptr, &automation_event);
+      automation_advance(mixer_ptr->automation_rt_ptr);
+      continue;
+    }
+
+    channel_ptr = mixer_ptr->scheduled_events[0].channel_ptr;
+    mixer_apply_scheduled(mixer_ptr->scheduled_events);
+    mixer_drop_scheduled(mixer_ptr, 0);
+    mixer_capture_changes(mixer_ptr, channel_ptr);
+  }
+
+  if (start < nframes)
+  {
+    mix(mixer_ptr, start, nframes);
+  }
+}
+
+static bool
+capture_bit(
+  const uint8_t * bits,
+  unsigned int slot)
+{
+  return (bits[slot / 8] & (1 << (slot % 8))) != 0;
+}
+
+static void
+capture_set_bit(
+  uint8_t * bits,
+  unsigned int slot,
+  bool value)
+{
+  if (value)
+  {
+    bits[slot / 8] |= 1 << (slot % 8);
+  }
+  else
+  {
+    bits[slot / 8] &= ~(1 << (slot % 8));
+  }
+}
+
+/* record channel parameters, whole state when any control changed; ramp
+ * and gain internals follow from controls and input afterwards */
+static void
+mixer_capture_state(
+  struct jack_mixer * mixer_ptr,
+  struct channel * channel_ptr,
+  bool output,
+  bool force)
+{
+  struct capture_state state;
+
+  memset(&state, 0, sizeof(state));
+  state.slot = channel_ptr->automation_slot;
+  state.controls.volume = channel_ptr->volume;
+  state.controls.volume_new = channel_ptr->volume_new;
+  state.controls.balance = channel_ptr->balance;
+  state.controls.balance_new = channel_ptr->balance_new;
+  state.controls.out_mute = channel_ptr->out_mute;
+  state.controls.solo = g_slist_find(mixer_ptr->soloed_channels, channel_ptr) != NULL;
+  state.controls.prefader = output && ((struct output_channel *)channel_ptr)->prefader;
+  state.controls.double_precision = output && ((struct output_channel *)channel_ptr)->double_precision;
+  state.controls.monitor_slot = AUTOMATION_NO_SLOT;
+  if (output && ((struct output_channel *)channel_ptr)->monitor_source != NULL)
+  {
+    state.controls.monitor_slot = ((struct output_channel *)channel_ptr)->monitor_source->automation_slot;
+    state.controls.monitor_prefader = ((struct output_channel *)channel_ptr)->monitor_prefader;
+  }
+  state.controls.agc_enabled = channel_ptr->agc_enabled;
+  state.controls.agc_target_db = channel_ptr->agc_target_db;
+  state.controls.agc_max_gain_db = channel_ptr->agc_max_gain_db;
+  state.controls.agc_gate_db = channel_ptr->agc_gate_db;
+
+  if (!force && memcmp(&state.controls, &channel_ptr->capture_controls, sizeof(state.controls)) == 0)
+  {
+    return;
+  }
+
+  channel_ptr->capture_controls = state.controls;
+
+  state.volume_idx = channel_ptr->volume_idx;
+  state.balance_idx = channel_ptr->balance_idx;
+  state.agc_energy = channel_ptr->agc_energy;
+  state.agc_frames = channel_ptr->agc_frames;
+  state.agc_level = channel_ptr->agc_level;
+  state.agc_gain = channel_ptr->agc_gain;
+  state.agc_gain_new = channel_ptr->agc_gain_new;
+  state.agc_gain_idx = channel_ptr->agc_gain_idx;
+
+  capture_write(mixer_ptr->capture_rt_ptr, CAPTURE_STATE, &state, sizeof(state));
+}
+
+/* Record what the cycle mixes: channel set and parameters after MIDI
+ * control, input buffers and MIDI input. Channels are recorded in reverse
+ * list order, so that prepending them on replay gives the same mix order.
+ * Channels without slot are not captured. */
+static void
+mixer_capture_begin(
+  struct jack_mixer * mixer_ptr,
+  jack_nframes_t nframes)
+{
+  struct capture * capture_ptr;
+  struct channel * channels[AUTOMATION_SLOTS];
+  uint8_t seen[AUTOMATION_SLOTS / 8];
+  uint8_t fresh[AUTOMATION_SLOTS / 8];
+  unsigned int count;
+  unsigned int inputs;
+  unsigned int i;
+  unsigned int j;
+  unsigned int slot;
+  size_t size;
+  GSList * list_ptr;
+  struct channel * channel_ptr;
+  struct output_channel * output_channel_ptr;
+  struct capture_cycle cycle;
+  struct capture_channel channel;
+  struct capture_slot removed;
+  struct capture_routing routing;
+  jack_position_t position;
+#if defined(HAVE_JACK_MIDI)
+  void * midi_buffer;
+  jack_nframes_t event_count;
+  jack_midi_event_t in_event;
+  struct capture_midi midi;
+#endif
+
+  capture_ptr = __atomic_load_n(&mixer_ptr->capture_ptr, __ATOMIC_ACQUIRE);
+  if (capture_ptr != mixer_ptr->capture_rt_ptr)
+  {
+    mixer_ptr->capture_rt_ptr = capture_ptr;
+    memset(mixer_ptr->capture_channels, 0, sizeof(mixer_ptr->capture_channels));
+  }
+
+  if (capture_ptr == NULL || capture_failed(capture_ptr))
+  {
+    return;
+  }
+
+  count = 0;
+  for (list_ptr = mixer_ptr->input_channels_list; list_ptr && count < AUTOMATION_SLOTS; list_ptr = g_slist_next(list_ptr))
+  {
+    channel_ptr = list_ptr->data;
+    if (channel_ptr->automation_slot != AUTOMATION_NO_SLOT)
+    {
+      channels[count++] = channel_ptr;
+    }
+  }
+  inputs = count;
+  for (list_ptr = mixer_ptr->output_channels_list; list_ptr && count < AUTOMATION_SLOTS; list_ptr = g_slist_next(list_ptr))
+  {
+    channel_ptr = list_ptr->data;
+    if (channel_ptr->automation_slot != AUTOMATION_NO_SLOT)
+    {
+      channels[count++] = channel_ptr;
+    }
+  }
+
+#if defined(HAVE_JACK_MIDI)
+  midi_buffer = jack_port_get_buffer(mixer_ptr->port_midi_in, nframes);
+  event_count = jack_midi_get_event_count(midi_buffer);
+#endif
+
+  /* the whole cycle, except changes applied during it, must fit */
+  mixer_ptr->capture_output_size = (count - inputs) * 2 * CAPTURE_SAMPLES_SIZE(nframes);
+  size = CAPTURE_RECORD_SIZE(sizeof(struct capture_cycle));
+  size += AUTOMATION_SLOTS * CAPTURE_RECORD_SIZE(sizeof(struct capture_slot));
+  size += count * (CAPTURE_RECORD_SIZE(sizeof(struct capture_channel)) + CAPTURE_RECORD_SIZE(sizeof(struct capture_state)));
+  size += (count - inputs) * inputs * CAPTURE_RECORD_SIZE(sizeof(struct capture_routing));
+  size += inputs * 2 * CAPTURE_SAMPLES_SIZE(nframes);
+#if defined(HAVE_JACK_MIDI)
+  size += event_count * CAPTURE_RECORD_SIZE(sizeof(struct capture_midi));
+#endif
+  if (!capture_reserve(capture_ptr, size + mixer_ptr->capture_output_size))
+  {
+    return;
+  }
+
+  cycle.nframes = nframes;
+  cycle.sample_rate = mixer_ptr->sample_rate;
+  cycle.frame_time = jack_last_frame_time(mixer_ptr->jack_client);
+  cycle.transport_rolling = jack_transport_query(mixer_ptr->jack_client, &position) == JackTransportRolling;
+  cycle.transport_frame = position.frame;
+  capture_write(capture_ptr, CAPTURE_CYCLE, &cycle, sizeof(cycle));
+
+  /* channels gone, or replaced by another one in their slot */
+  memset(seen, 0, sizeof(seen));
+  for (i = 0 ; i < count ; i++)
+  {
+    slot = channels[i]->automation_slot;
+    capture_set_bit(seen, slot, true);
+    if (mixer_ptr->capture_channels[slot] != NULL && mixer_ptr->capture_channels[slot] != channels[i])
+    {
+      mixer_ptr->capture_channels[slot] = NULL;
+      removed.slot = slot;
+      capture_write(capture_ptr, CAPTURE_REMOVE, &removed, sizeof(removed));
+    }
+  }
+  for (slot = 0 ; slot < AUTOMATION_SLOTS ; slot++)
+  {
+    if (mixer_ptr->capture_channels[slot] != NULL && !capture_bit(seen, slot))
+    {
+      mixer_ptr->capture_channels[slot] = NULL;
+      removed.slot = slot;
+      capture_write(capture_ptr, CAPTURE_REMOVE, &removed, sizeof(removed));
+    }
+  }
+
+  memset(fresh, 0, sizeof(fresh));
+  for (i = count ; i > 0 ; i--)
+  {
+    channel_ptr = channels[i - 1];
+    slot = channel_ptr->automation_slot;
+    if (mixer_ptr->capture_channels[slot] == NULL)
+    {
+      mixer_ptr->capture_channels[slot] = channel_ptr;
+      capture_set_bit(fresh, slot, true);
+      channel.slot = slot;
+      channel.output = i > inputs;
+      channel.stereo = channel_ptr->stereo;
+      channel.system = i > inputs && ((struct output_channel *)channel_ptr)->system;
+      capture_write(capture_ptr, CAPTURE_CHANNEL, &channel, sizeof(channel));
+    }
+  }
+
+  /* after all channels, monitor sources refer to them */
+  for (i = count ; i > 0 ; i--)
+  {
+    channel_ptr = channels[i - 1];
+    mixer_capture_state(mixer_ptr, channel_ptr, i > inputs, capture_bit(fresh, channel_ptr->automation_slot));
+  }
+
+  for (i = inputs ; i < count ; i++)
+  {
+    output_channel_ptr = (struct output_channel *)channels[i];
+    routing.slot = channels[i]->automation_slot;
+    for (j = 0 ; j < inputs ; j++)
+    {
+      routing.input_slot = channels[j]->automation_slot;
+      routing.muted = g_slist_find(output_channel_ptr->muted_channels, channels[j]) != NULL;
+      routing.soloed = g_slist_find(output_channel_ptr->soloed_channels, channels[j]) != NULL;
+
+      if (!capture_bit(fresh, routing.slot) &&
+          !capture_bit(fresh, routing.input_slot) &&
+          capture_bit(output_channel_ptr->capture_muted, routing.input_slot) == routing.muted &&
+          capture_bit(output_channel_ptr->capture_soloed, routing.input_slot) == routing.soloed)
+      {
+        continue;
+      }
+
+      capture_set_bit(output_channel_ptr->capture_muted, routing.input_slot, routing.muted);
+      capture_set_bit(output_channel_ptr->capture_soloed, routing.input_slot, routing.soloed);
+      capture_write(capture_ptr, CAPTURE_ROUTING, &routing, sizeof(routing));
+    }
+  }
+
+  /* delayed already, replay does not delay again */
+  for (i = 0 ; i < inputs ; i++)
+  {
+    channel_ptr = channels[i];
+    capture_write_samples(capture_ptr, CAPTURE_INPUT, channel_ptr->automation_slot, false, channel_ptr->left_buffer_ptr, nframes);
+    if (channel_ptr->stereo)
+    {
+      capture_write_samples(capture_ptr, CAPTURE_INPUT, channel_ptr->automation_slot, true, channel_ptr->right_buffer_ptr, nframes);
+    }
+  }
+
+#if defined(HAVE_JACK_MIDI)
+  for (i = 0 ; i < event_count ; i++)
+  {
+    if (jack_midi_event_get(&in_event, midi_buffer, i) != 0)
+    {
+      continue;
+    }
+
+    memset(&midi, 0, sizeof(midi));
+    midi.time = in_event.time;
+    midi.size = in_event.size;
+    memcpy(midi.data, in_event.buffer, in_event.size < sizeof(midi.data) ? in_event.size : sizeof(midi.data));
+    capture_write(capture_ptr, CAPTURE_MIDI, &midi, sizeof(midi));
+  }
+#endif
+}
+
+/* record what the cycle produced */
+static void
+mixer_capture_end(
+  struct jack_mixer * mixer_ptr,
+  jack_nframes_t nframes)
+{
+  GSList * list_ptr;
+  struct channel * channel_ptr;
+
+  if (mixer_ptr->capture_rt_ptr == NULL || capture_failed(mixer_ptr->capture_rt_ptr))
+  {
+    return;
+  }
+
+  for (list_ptr = mixer_ptr->output_channels_list; list_ptr; list_ptr = g_slist_next(list_ptr))
+  {
+    channel_ptr = list_ptr->data;
+    if (channel_ptr->automation_slot == AUTOMATION_NO_SLOT ||
+        mixer_ptr->capture_channels[channel_ptr->automation_slot] != channel_ptr)
+    {
+      continue;
+    }
+
+    capture_write_samples(mixer_ptr->capture_rt_ptr, CAPTURE_OUTPUT, channel_ptr->automation_slot, false, channel_ptr->left_buffer_ptr, nframes);
+    if (channel_ptr->stereo)
+    {
+      capture_write_samples(mixer_ptr->capture_rt_ptr, CAPTURE_OUTPUT, channel_ptr->automation_slot, true, channel_ptr->right_buffer_ptr, nframes);
+    }
+  }
+}
+
+/* Shed optional work while the process callback takes too much of the
+ * period, restore it once load stays low. One level per step, with
+ * hysteresis in both load and time so that it does not flap. */
+static void
+mixer_govern(
+  struct jack_mixer * mixer_ptr,
+  jack_nframes_t nframes,
+  const struct timespec * start_ptr)
+{
+  struct timespec now;
+  float load;
+  float weight;
+  unsigned int level;
+  struct overload_transition transition;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  load = ((now.tv_sec - start_ptr->tv_sec) + (now.tv_nsec - start_ptr->tv_nsec) * 1e-9) *
+    mixer_ptr->sample_rate / nframes;
+
+  weight = (float)nframes / (mixer_ptr->sample_rate * GOVERNOR_AVERAGE_SECONDS);
+  if (weight > 1.0)
+  {
+    weight = 1.0;
+  }
+  mixer_ptr->governor_load += weight * (load - mixer_ptr->governor_load);
+
+  mixer_ptr->governor_high_frames = mixer_ptr->governor_load > GOVERNOR_HIGH_LOAD ? mixer_ptr->governor_high_frames + nframes : 0;
+  mixer_ptr->governor_low_frames = mixer_ptr->governor_load < GOVERNOR_LOW_LOAD ? mixer_ptr->governor_low_frames + nframes : 0;
+
+  level = mixer_ptr->shed_level;
+  if (level < MIXER_SHED_MAX &&
+      mixer_ptr->governor_high_frames >= GOVERNOR_SHED_SECONDS * mixer_ptr->sample_rate)
+  {
+    level++;
+  }
+  else if (level > MIXER_SHED_NONE &&
+           mixer_ptr->governor_low_frames >= GOVERNOR_RESTORE_SECONDS * mixer_ptr->sample_rate)
+  {
+    level--;
+  }
+  else
+  {
+    return;
+  }
+
+  __atomic_store_n(&mixer_ptr->shed_level, level, __ATOMIC_RELAXED);
+  mixer_ptr->governor_high_frames = 0;
+  mixer_ptr->governor_low_frames = 0;
+
+  transition.level = level;
+  transition.load = mixer_ptr->governor_load;
+  transition.frame_time = jack_last_frame_time(mixer_ptr->jack_client);
+  if (jack_ringbuffer_write(mixer_ptr->overload_ring, (const char *)&transition, sizeof(transition)) != sizeof(transition))
+  {
+    /* UI is not reading them, it still gets the current level */
+  }
+  mixer_ptr->cycle_events |= MIXER_EVENT_OVERLOAD;
+}
+
+/* solo or unsolo from the process callback, without allocating */
+static void
+channel_toggle_solo_rt(
+  struct channel * channel_ptr)
+{
+  GSList ** link_ptr_ptr;
+  GSList * node_ptr;
+
+  mixer_routing_changed(channel_ptr->mixer_ptr);
+
+  for (link_ptr_ptr = &channel_ptr->mixer_ptr->soloed_channels; *link_ptr_ptr; link_ptr_ptr = &(*link_ptr_ptr)->next)
+  {
+    if ((*link_ptr_ptr)->data == channel_ptr)
+    {
+      node_ptr = *link_ptr_ptr;
+      *link_ptr_ptr = node_ptr->next;
+      if (channel_ptr->solo_node_ptr == NULL)
+      {
+        node_ptr->next = NULL;
+        channel_ptr->solo_node_ptr = node_ptr;
+      }
+      else
+      {
+        mixer_release_node(channel_ptr->mixer_ptr, node_ptr);
+      }
+      STATE_STORE(channel_ptr, bool, solo, false);
+      return;
+    }
+  }
+
+  /* spare node is restocked by channel_unsolo() */
+  node_ptr = channel_ptr->solo_node_ptr;
+  if (node_ptr == NULL)
+  {
+    return;
+  }
+
+  channel_ptr->solo_node_ptr = NULL;
+  node_ptr->data = channel_ptr;
+  node_ptr->next = channel_ptr->mixer_ptr->soloed_channels;
+  channel_ptr->mixer_ptr->soloed_channels = node_ptr;
+  STATE_STORE(channel_ptr, bool, solo, true);
+}
+
+#define mixer_ptr ((struct jack_mixer *)context)
+
+static int
+process(
+  jack_nframes_t nframes,
+  void * context)
+{
+  jack_nframes_t i;
+  GSList *node_ptr;
+  struct channel * channel_ptr;
+  struct timespec start;
+#if defined(HAVE_JACK_MIDI)
+  jack_nframes_t event_count;
+  jack_midi_event_t in_event;
+  unsigned char* midi_out_buffer;
+  void * midi_buffer;
+  signed char byte;
+  unsigned int cc_channel_index;
+#endif
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  for (node_ptr = mixer_ptr->input_channels_list; node_ptr; node_ptr = g_slist_next(node_ptr))
+  {
+    channel_ptr = node_ptr->data;
+    update_channel_buffers(channel_ptr, nframes);
+    channel_delay_frames(channel_ptr, nframes);
+  }
+
+  // Fill output buffers with the input 
+  for (node_ptr = mixer_ptr->output_channels_list; node_ptr; node_ptr = g_slist_next(node_ptr))
+  {
+    if (((struct output_channel *)node_ptr->data)->shard_ptr != NULL)
+    {
+      continue;
+    }
+
+    channel_ptr = node_ptr->data;
+    update_channel_buffers(channel_ptr, nframes);
+  }
+
+#if defined(HAVE_JACK_MIDI)
+  midi_buffer = jack_port_get_buffer(mixer_ptr->port_midi_in, nframes);
+  event_count = jack_midi_get_event_count(midi_buffer);
+
+  for (i = 0 ; i < event_count; i++)
+  {
+    jack_midi_event_get(&in_event, midi_buffer, i);
+
+    if (in_event.size != 3 ||
+        (in_event.buffer[0] & 0xF0) != 0xB0 ||
+        in_event.buffer[1] > 127 ||
+        in_event.buffer[2] > 127)
+    {
+      continue;
+    }
+
+    assert(in_event.time < nframes);
+
+    LOG_DEBUG(
+      "%u: CC#%u -> %u",
+      (unsigned int)(in_event.buffer[0]),
+      (unsigned int)in_event.buffer[1],
+      (unsigned int)in_event.buffer[2]);
+
+    mixer_ptr->last_midi_channel = (unsigned int)in_event.buffer[1];
+    channel_ptr = mixer_ptr->midi_cc_map[in_event.buffer[1]];
+
+    /* if we have mapping for particular CC and MIDI scale is set for corresponding channel */
+    if (channel_ptr != NULL && channel_ptr->midi_scale != NULL)
+    {
+      if (channel_ptr->midi_cc_balance_index == (unsigned int)in_event.buffer[1])
+      {
+        byte = in_event.buffer[2];
+        if (byte == 0)
+        {
+          byte = 1;
+        }
+        byte -= 64;
+
+        if (channel_ptr->balance != channel_ptr->balance_new) {
+          channel_ptr->balance = channel_ptr->balance + channel_ptr->balance_idx *
+           (channel_ptr->balance_new - channel_ptr->balance) /
+           channel_ptr->num_volume_transition_steps;
+        }
+        channel_ptr->balance_idx = 0;
+        channel_ptr->balance_new = (float)byte / 63;
+        STATE_STORE(channel_ptr, float, balance, channel_ptr->balance_new);
+        LOG_DEBUG("\"%s\" balance -> %f", channel_ptr->name, channel_ptr->balance_new);
+      }
+      else if (channel_ptr->midi_cc_volume_index == in_event.buffer[1])
+      {
+        if (channel_ptr->volume_new != channel_ptr->volume) {
+          channel_ptr->volume = channel_ptr->volume + channel_ptr->volume_idx *
+           (channel_ptr->volume_new - channel_ptr->volume) /
+           channel_ptr->num_volume_transition_steps;
+        }
+        channel_ptr->volume_idx = 0;
+        channel_ptr->volume_new = db_to_value(scale_scale_to_db(channel_ptr->midi_scale,
+         (double)in_event.buffer[2] / 127));
+        STATE_STORE(channel_ptr, float, volume, channel_ptr->volume_new);
+        LOG_DEBUG("\"%s\" volume -> %f", channel_ptr->name, channel_ptr->volume_new);
+      }
+      else if (channel_ptr->midi_cc_mute_index == in_event.buffer[1])
+      {
+        if ((unsigned int)in_event.buffer[2] == 127) {
+          channel_ptr->out_mute = !channel_ptr->out_mute;
+          STATE_STORE(channel_ptr, bool, out_mute, channel_ptr->out_mute);
+        }
+        LOG_DEBUG("\"%s\" out_mute %d", channel_ptr->name, channel_ptr->out_mute);
+      }
+      else if (channel_ptr->midi_cc_solo_index == in_event.buffer[1])
+      {
+        if ((unsigned int)in_event.buffer[2] == 127) {
+          channel_toggle_solo_rt(channel_ptr);
+        }
+        LOG_DEBUG("\"%s\" solo %d", channel_ptr->name, channel_is_soloed(channel_ptr));
+      }
+      channel_ptr->midi_in_got_events = true;
+      mixer_ptr->cycle_events |= MIXER_EVENT_MIDI;
+      if (channel_ptr->midi_change_callback)
+        channel_ptr->midi_change_callback(channel_ptr->midi_change_callback_data);
+
+    }
+
+  }
+
+  midi_buffer = jack_port_get_buffer(mixer_ptr->port_midi_out, nframes);
+  jack_midi_clear_buffer(midi_buffer);
+
+  /* pending feedback is sent once the overload governor restores it */
+  for(i=0; i<nframes && mixer_ptr->shed_level < MIXER_SHED_MIDI_FEEDBACK; i++)
+  {
+    for (cc_channel_index=0; cc_channel_index<128; cc_channel_index++)
+    {
+      channel_ptr = mixer_ptr->midi_cc_map[cc_channel_index];
+      if (channel_ptr == NULL || channel_ptr->midi_scale == NULL)
+      {
+        continue;
+      }
+      if (channel_ptr->midi_out_has_events == false)
+      {
+        continue;
+      }
+      if (channel_ptr->midi_cc_balance_index == (unsigned int)cc_channel_index)
+      {
+        continue;
+      }
+      midi_out_buffer = jack_midi_event_reserve(midi_buffer, i, 3);
+      if (midi_out_buffer == NULL)
+      {
+        continue;
+      }
+      midi_out_buffer[0] = 0xB0; /* control change */
+      midi_out_buffer[1] = cc_channel_index;
+      midi_out_buffer[2] = (unsigned char)(127*scale_db_to_scale(channel_ptr->midi_scale, value_to_db(channel_ptr->volume_new)));
+
+      LOG_DEBUG(
+        "%u: CC#%u <- %u",
+        (unsigned int)(midi_out_buffer[0]),
+        (unsigned int)midi_out_buffer[1],
+        (unsigned int)midi_out_buffer[2]);
+
+      channel_ptr->midi_out_has_events = false;
+    }
+  }
+
+#endif
+
+  mixer_update_transport(mixer_ptr, nframes);
+#if defined(HAVE_SNDFILE)
+  mixer_play(mixer_ptr, nframes);
+#endif
+  mixer_capture_begin(mixer_ptr, nframes);
+  mixer_ptr->capture_offset = 0;
+  mix_scheduled(mixer_ptr, nframes);
+  mixer_capture_end(mixer_ptr, nframes);
+
+  mixer_govern(mixer_ptr, nframes, &start);
+
+  if (__atomic_exchange_n(&mixer_ptr->routing_changed, false, __ATOMIC_ACQ_REL))
+  {
+    mixer_ptr->cycle_events |= MIXER_EVENT_ROUTING;
+  }
+
+  mixer_signal_events(mixer_ptr);
+
+  __atomic_add_fetch(&mixer_ptr->process_cycles, 1, __ATOMIC_RELEASE);
+
+  return 0;
+}
+
+static int
+sample_rate_changed(
+  jack_nframes_t nframes,
+  void * context)
+{
+  GSList *node_ptr;
+  struct channel * channel_ptr;
+
+  LOG_NOTICE("Sample rate changed to %" PRIu32, nframes);
+
+  mixer_ptr->sample_rate = nframes;
+
+  /* ramps in progress finish early or late, the mix code copes with either */
+  for (node_ptr = mixer_ptr->input_channels_list; node_ptr; node_ptr = g_slist_next(node_ptr))
+  {
+    channel_ptr = node_ptr->data;
+    channel_ptr->num_volume_transition_steps = volume_transition_steps(channel_ptr);
+  }
+
+  for (node_ptr = mixer_ptr->output_channels_list; node_ptr; node_ptr = g_slist_next(node_ptr))
+  {
+    channel_ptr = node_ptr->data;
+    channel_ptr->num_volume_transition_steps = volume_transition_steps(channel_ptr);
+  }
+
+  /* delay lines are sized for the sample rate, set delays are in ms */
+  pthread_mutex_lock(&mixer_ptr->mutex);
+
+  for (node_ptr = mixer_ptr->input_channels_list; node_ptr; node_ptr = g_slist_next(node_ptr))
+  {
+    channel_ptr = node_ptr->data;
+    if (channel_ptr->delay_rate != 0)
+    {
+      channel_prepare_delay(channel_ptr);
+    }
+
+    if (!channel_ptr->delay_auto)
+    {
+      channel_use_set_delay(channel_ptr);
+    }
+  }
+
+  mixer_routing_changed(mixer_ptr);
+
+  pthread_mutex_unlock(&mixer_ptr->mutex);
+
+  return 0;
+}
+
+/* Channel buffers only grow, new ones are picked by the process callback at
+ * start of next cycle. JACK does not run process() with the new size before
+ * this callback returns. */
+static int
+buffer_size_changed(
+  jack_nframes_t nframes,
+  void * context)
+{
+  GSList *node_ptr;
+  int ret;
+
+  LOG_DEBUG("Buffer size changed to %" PRIu32, nframes);
+
+  pthread_mutex_lock(&mixer_ptr->mutex);
+
+  ret = 0;
+
+  if (nframes > mixer_ptr->buffers_size)
+  {
+    for (node_ptr = mixer_ptr->input_channels_list; node_ptr; node_ptr = g_slist_next(node_ptr))
+    {
+      if (!channel_replace_buffers(node_ptr->data, nframes))
+      {
+        ret = -1;
       }
+    }
 
-      float vol_l;
-      float vol_r;
-      if (mix_channel->stereo) {
-        if (bal > 0) {
-          vol_l = vol * (1 - bal);
-          vol_r = vol;
-        } else {
-          vol_l = vol;
-          vol_r = vol * (1 + bal);
-        }
-      } else {
-        vol_l = vol * (1 - bal);
-        vol_r = vol * (1 + bal);
+    for (node_ptr = mixer_ptr->output_channels_list; node_ptr; node_ptr = g_slist_next(node_ptr))
+    {
+      if (!channel_replace_buffers(node_ptr->data, nframes))
+      {
+        ret = -1;
       }
-      mix_channel->tmp_mixed_frames_left[i] *= vol_l;
-      mix_channel->tmp_mixed_frames_right[i] *= vol_r;
     }
 
-    frame_left = fabsf(mix_channel->tmp_mixed_frames_left[i]);
-    if (mix_channel->peak_left < frame_left)
-    {
-      mix_channel->peak_left = frame_left;
+    if (ret == 0)
+    {
+      mixer_ptr->buffers_size = nframes;
+    }
+    else
+    {
+      LOG_ERROR("Cannot allocate buffers for %" PRIu32 " frames", nframes);
+    }
+  }
+
+  pthread_mutex_unlock(&mixer_ptr->mutex);
+
+  return ret;
+}
+
+#if defined(HAVE_JACK_LATENCY)
+static void
+latency_changed(
+  jack_latency_callback_mode_t mode,
+  void * context)
+{
+  mixer_update_latencies(mixer_ptr, NULL, mode);
+}
+#endif
+
+#undef mixer_ptr
+
+/* open, activate and feed next shard client of active mixer */
+static bool
+mixer_open_shard(
+  struct jack_mixer * mixer_ptr)
+{
+  struct mixer_shard * shard_ptr;
+  char * name;
+  int ret;
+
+  shard_ptr = mixer_ptr->shards + mixer_ptr->shards_count;
+  shard_ptr->mixer_ptr = mixer_ptr;
+  shard_ptr->outputs_count = 0;
+
+  name = g_strdup_printf("%s-%u", jack_get_client_name(mixer_ptr->jack_client), mixer_ptr->shards_count + 1);
+  shard_ptr->jack_client = jack_client_open(name, 0, NULL);
+  g_free(name);
+  if (shard_ptr->jack_client == NULL)
+  {
+    LOG_ERROR("Cannot create JACK client for output channels shard.");
+    return false;
+  }
+
+  shard_ptr->port_sync = jack_port_register(shard_ptr->jack_client, "sync", JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput, 0);
+  if (shard_ptr->port_sync == NULL)
+  {
+    LOG_ERROR("Cannot create JACK sync port of shard");
+    goto close_jack;
+  }
+
+  ret = jack_set_process_callback(shard_ptr->jack_client, shard_process, shard_ptr);
+  if (ret != 0)
+  {
+    LOG_ERROR("Cannot set JACK process callback of shard");
+    goto close_jack;
+  }
+
+#if defined(HAVE_JACK_LATENCY)
+  ret = jack_set_latency_callback(shard_ptr->jack_client, shard_latency, shard_ptr);
+  if (ret != 0)
+  {
+    LOG_ERROR("Cannot set JACK latency callback of shard");
+    goto close_jack;
+  }
+#endif
+
+  ret = jack_activate(shard_ptr->jack_client);
+  if (ret != 0)
+  {
+    LOG_ERROR("Cannot activate JACK client of shard");
+    goto close_jack;
+  }
+
+  /* orders the shard after the mixer client */
+  ret = jack_connect(shard_ptr->jack_client, jack_port_name(mixer_ptr->port_shards_sync), jack_port_name(shard_ptr->port_sync));
+  if (ret != 0)
+  {
+    LOG_ERROR("Cannot connect JACK sync port of shard");
+    goto close_jack;
+  }
+
+  mixer_ptr->shards_count++;
+
+  return true;
+
+close_jack:
+  jack_client_close(shard_ptr->jack_client);
+  return false;
+}
+
+/* shard to put ports of a new output channel into, NULL for the mixer client */
+static struct mixer_shard *
+mixer_pick_shard(
+  struct jack_mixer * mixer_ptr,
+  bool system)
+{
+  struct mixer_shard * shard_ptr;
+  unsigned int i;
+
+  if (system || mixer_ptr->shards_count == 0)
+  {
+    return NULL;
+  }
+
+  shard_ptr = mixer_ptr->shards;
+  for (i = 1; i < mixer_ptr->shards_count; i++)
+  {
+    if (mixer_ptr->shards[i].outputs_count < shard_ptr->outputs_count)
+    {
+      shard_ptr = mixer_ptr->shards + i;
+    }
+  }
+
+  return shard_ptr;
+}
+
+jack_mixer_t
+create(
+  const char * jack_client_name_ptr,
+  bool stereo)
+{
+  return create_split(jack_client_name_ptr, stereo, 0);
+}
+
+jack_mixer_t
+create_split(
+  const char * jack_client_name_ptr,
+  bool stereo,
+  unsigned int shards)
+{
+  int ret;
+  struct jack_mixer * mixer_ptr;
+  int i;
+
+  if (shards > MIXER_SHARDS_MAX)
+  {
+    LOG_ERROR("Cannot split mixer into more than %u clients", MIXER_SHARDS_MAX);
+    goto exit;
+  }
+
+  kernels_init();
+  LOG_DEBUG("Using %s mix kernels", kernels_name());
+
+  mixer_ptr = malloc(sizeof(struct jack_mixer));
+  if (mixer_ptr == NULL)
+  {
+    goto exit;
+  }
+
+  ret = pthread_mutex_init(&mixer_ptr->mutex, NULL);
+  if (ret != 0)
+  {
+    goto exit_free;
+  }
+
+  mixer_ptr->input_channels_list = NULL;
+  mixer_ptr->output_channels_list = NULL;
+
+  mixer_ptr->soloed_channels = NULL;
+
+  mixer_ptr->last_midi_channel = -1;
+
+  mixer_ptr->state_ptr = NULL;
+
+  mixer_ptr->cycle_events = 0;
+  mixer_ptr->pending_events = 0;
+  mixer_ptr->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (mixer_ptr->event_fd == -1)
+  {
+    LOG_ERROR("Cannot create event fd");
+    goto exit_destroy_mutex;
+  }
+
+  for (i = 0 ; i < 128 ; i++)
+  {
+    mixer_ptr->midi_cc_map[i] = NULL;
+  }
+
+  mixer_ptr->channels_by_name = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  mixer_ptr->channels_by_port_name = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+  mixer_ptr->scheduled_pending = 0;
+  mixer_ptr->scheduled_count = 0;
+  /* room for cancel events too */
+  mixer_ptr->scheduled_ring = jack_ringbuffer_create(2 * SCHEDULED_EVENTS_MAX * sizeof(struct scheduled_event));
+  if (mixer_ptr->scheduled_ring == NULL)
+  {
+    goto exit_free_hash_tables;
+  }
+
+  mixer_ptr->released_ring = jack_ringbuffer_create((2 * SCHEDULED_EVENTS_MAX + AUTOMATION_RING_EVENTS) * sizeof(GSList *));
+  if (mixer_ptr->released_ring == NULL)
+  {
+    goto exit_free_scheduled_ring;
+  }
+
+  mixer_ptr->overload_ring = jack_ringbuffer_create(GOVERNOR_TRANSITIONS_MAX * sizeof(struct overload_transition));
+  if (mixer_ptr->overload_ring == NULL)
+  {
+    goto exit_free_released_ring;
+  }
+
+  jack_ringbuffer_mlock(mixer_ptr->scheduled_ring);
+  jack_ringbuffer_mlock(mixer_ptr->released_ring);
+  jack_ringbuffer_mlock(mixer_ptr->overload_ring);
+
+  memset(mixer_ptr->automation_slots, 0, sizeof(mixer_ptr->automation_slots));
+  mixer_ptr->automation_next_slot = 0;
+  mixer_ptr->automation_ptr = NULL;
+  mixer_ptr->automation_overruns = 0;
+  mixer_ptr->process_cycles = 0;
+  mixer_ptr->automation_rt_ptr = NULL;
+  mixer_ptr->capture_ptr = NULL;
+  mixer_ptr->capture_rt_ptr = NULL;
+  mixer_ptr->stopped_automations = NULL;
+  mixer_ptr->stopped_captures = NULL;
+  mixer_ptr->automation_snapshot = false;
+  mixer_ptr->automation_frame = 0;
+  mixer_ptr->transport_rolling = false;
+  mixer_ptr->transport_frame = 0;
+  mixer_ptr->transport_next_frame = 0;
+  mixer_ptr->shed_level = MIXER_SHED_NONE;
+  mixer_ptr->layout = KERNELS_LAYOUT_DEFAULT;
+  mixer_ptr->shards_count = 0;
+  mixer_ptr->port_shards_sync = NULL;
+  mixer_ptr->routing_changed = false;
+  mixer_ptr->governor_load = 0.0;
+  mixer_ptr->governor_high_frames = 0;
+  mixer_ptr->governor_low_frames = 0;
+
+  LOG_DEBUG("Initializing JACK");
+  mixer_ptr->jack_client = jack_client_open(jack_client_name_ptr, 0, NULL);
+  if (mixer_ptr->jack_client == NULL)
+  {
+    LOG_ERROR("Cannot create JACK client.");
+    LOG_NOTICE("Please make sure JACK daemon is running.");
+    goto exit_free_overload_ring;
+  }
+
+  LOG_DEBUG("JACK client created");
+
+  mixer_ptr->sample_rate = jack_get_sample_rate(mixer_ptr->jack_client);
+  mixer_ptr->buffers_size = jack_get_buffer_size(mixer_ptr->jack_client);
+
+  LOG_DEBUG("Sample rate: %" PRIu32, mixer_ptr->sample_rate);
+  LOG_DEBUG("Buffer size: %" PRIu32, mixer_ptr->buffers_size);
+
+  /* NULL when the pool is full, this mixer then mixes alone */
+  mixer_ptr->workers_slot_ptr = workers_attach(jack_client_real_time_priority(mixer_ptr->jack_client));
+
+#if defined(HAVE_JACK_MIDI)
+  mixer_ptr->port_midi_in = jack_port_register(mixer_ptr->jack_client, "midi in", JACK_DEFAULT_MIDI_TYPE, JackPortIsInput, 0);
+  if (mixer_ptr->port_midi_in == NULL)
+  {
+    LOG_ERROR("Cannot create JACK MIDI in port");
+    goto close_jack;
+  }
+
+  mixer_ptr->port_midi_out = jack_port_register(mixer_ptr->jack_client, "midi out", JACK_DEFAULT_MIDI_TYPE, JackPortIsOutput, 0);
+  if (mixer_ptr->port_midi_out == NULL)
+  {
+    LOG_ERROR("Cannot create JACK MIDI out port");
+    goto close_jack;
+  }
+
+#endif
+
+  if (shards > 0)
+  {
+    mixer_ptr->port_shards_sync = jack_port_register(mixer_ptr->jack_client, "shards sync", JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
+    if (mixer_ptr->port_shards_sync == NULL)
+    {
+      LOG_ERROR("Cannot create JACK shards sync port");
+      goto close_jack;
+    }
+  }
+
+  ret = jack_set_process_callback(mixer_ptr->jack_client, process, mixer_ptr);
+  if (ret != 0)
+  {
+    LOG_ERROR("Cannot set JACK process callback");
+    goto close_jack;
+  }
+
+  ret = jack_set_sample_rate_callback(mixer_ptr->jack_client, sample_rate_changed, mixer_ptr);
+  if (ret != 0)
+  {
+    LOG_ERROR("Cannot set JACK sample rate callback");
+    goto close_jack;
+  }
+
+  ret = jack_set_buffer_size_callback(mixer_ptr->jack_client, buffer_size_changed, mixer_ptr);
+  if (ret != 0)
+  {
+    LOG_ERROR("Cannot set JACK buffer size callback");
+    goto close_jack;
+  }
+
+#if defined(HAVE_JACK_LATENCY)
+  ret = jack_set_latency_callback(mixer_ptr->jack_client, latency_changed, mixer_ptr);
+  if (ret != 0)
+  {
+    LOG_ERROR("Cannot set JACK latency callback");
+    goto close_jack;
+  }
+#endif
+
+  ret = jack_activate(mixer_ptr->jack_client);
+  if (ret != 0)
+  {
+    LOG_ERROR("Cannot activate JACK client");
+    goto close_jack;
+  }
+
+  while (mixer_ptr->shards_count < shards)
+  {
+    if (!mixer_open_shard(mixer_ptr))
+    {
+      goto close_shards;
+    }
+  }
+
+  return mixer_ptr;
+
+close_shards:
+  while (mixer_ptr->shards_count > 0)
+  {
+    jack_client_close(mixer_ptr->shards[--mixer_ptr->shards_count].jack_client);
+  }
+
+close_jack:
+  jack_client_close(mixer_ptr->jack_client); /* this should clear all other resources we obtained through the client handle */
+  if (mixer_ptr->workers_slot_ptr != NULL)
+  {
+    workers_detach(mixer_ptr->workers_slot_ptr);
+  }
+
+exit_free_overload_ring:
+  jack_ringbuffer_free(mixer_ptr->overload_ring);
+
+exit_free_released_ring:
+  jack_ringbuffer_free(mixer_ptr->released_ring);
+
+exit_free_scheduled_ring:
+  jack_ringbuffer_free(mixer_ptr->scheduled_ring);
+
+exit_free_hash_tables:
+  g_hash_table_destroy(mixer_ptr->channels_by_name);
+  g_hash_table_destroy(mixer_ptr->channels_by_port_name);
+  close(mixer_ptr->event_fd);
 
-      if (frame_left > mix_channel->abspeak)
-      {
-        mix_channel->abspeak = frame_left;
-      }
-    }
+exit_destroy_mutex:
+  pthread_mutex_destroy(&mixer_ptr->mutex);
 
-    if (mix_channel->stereo)
-    {
-      frame_right = fabsf(mix_channel->tmp_mixed_frames_right[i]);
-      if (mix_channel->peak_right < frame_right)
-      {
-        mix_channel->peak_right = frame_right;
+exit_free:
+  free(mixer_ptr);
 
-        if (frame_right > mix_channel->abspeak)
-        {
-          mix_channel->abspeak = frame_right;
-        }
-      }
-    }
+exit:
+  return NULL;
+}
 
-    mix_channel->peak_frames++;
-    if (mix_channel->peak_frames >= PEAK_FRAMES_CHUNK)
-    {
-      mix_channel->meter_left = mix_channel->peak_left;
-      mix_channel->peak_left = 0.0;
+#define mixer_ctx_ptr ((struct jack_mixer *)mixer)
 
-      if (mix_channel->stereo)
-      {
-        mix_channel->meter_right = mix_channel->peak_right;
-        mix_channel->peak_right = 0.0;
-      }
+void
+destroy(
+  jack_mixer_t mixer)
+{
+  LOG_DEBUG("Uninitializing JACK");
 
-      mix_channel->peak_frames = 0;
-    }
-    mix_channel->volume_idx++;
-    if ((mix_channel->volume != mix_channel->volume_new) && (mix_channel->volume_idx == steps)) {
-      mix_channel->volume = mix_channel->volume_new;
-      mix_channel->volume_idx = 0;
-    }
-    mix_channel->balance_idx++;
-    if ((mix_channel->balance != mix_channel->balance_new) && (mix_channel->balance_idx == steps)) {
-      mix_channel->balance = mix_channel->balance_new;
-      mix_channel->balance_idx = 0;
-    }
+  assert(mixer_ctx_ptr->jack_client != NULL);
 
-    if (!mix_channel->out_mute) {
-        mix_channel->left_buffer_ptr[i] = mix_channel->tmp_mixed_frames_left[i];
-        mix_channel->right_buffer_ptr[i] = mix_channel->tmp_mixed_frames_right[i];
-    }
+  /* shards first, they read input channels of the mixer client */
+  while (mixer_ctx_ptr->shards_count > 0)
+  {
+    jack_client_close(mixer_ctx_ptr->shards[--mixer_ctx_ptr->shards_count].jack_client);
   }
-}
 
-static inline void
-calc_channel_frames(
-  struct channel *channel_ptr,
-  jack_nframes_t start,
-  jack_nframes_t end)
-{
-  jack_nframes_t i;
-  jack_default_audio_sample_t frame_left;
-  jack_default_audio_sample_t frame_right;
-  unsigned int steps = channel_ptr->num_volume_transition_steps;
-  for (i = start ; i < end ; i++)
+  jack_client_close(mixer_ctx_ptr->jack_client);
+
+  if (mixer_ctx_ptr->workers_slot_ptr != NULL)
   {
-    if (i-start >= MAX_BLOCK_SIZE)
-    {
-      fprintf(stderr, "i-start too high: %d - %d\n", i, start);
-    }
-    channel_ptr->prefader_frames_left[i-start] = channel_ptr->left_buffer_ptr[i];
-    if (channel_ptr->stereo)
-      channel_ptr->prefader_frames_right[i-start] = channel_ptr->right_buffer_ptr[i];
+    workers_detach(mixer_ctx_ptr->workers_slot_ptr);
+  }
 
-    if (!FLOAT_EXISTS(channel_ptr->left_buffer_ptr[i]))
-    {
-      channel_ptr->NaN_detected = true;
-      channel_ptr->frames_left[i-start] = NAN;
-      break;
-    }
-    float volume = channel_ptr->volume;
-    float volume_new = channel_ptr->volume_new;
-    float vol = volume;
-    float balance = channel_ptr->balance;
-    float balance_new = channel_ptr->balance_new;
-    float bal = balance;
-    if (channel_ptr->volume != channel_ptr->volume_new) {
-      vol = channel_ptr->volume_idx * (volume_new - volume) / steps + volume;
-    }
-    if (channel_ptr->balance != channel_ptr->balance_new) {
-      bal = channel_ptr->balance_idx * (balance_new - balance) / steps + balance;
-    }
-    float vol_l;
-    float vol_r;
-    if (channel_ptr->stereo) {
-      if (bal > 0) {
-        vol_l = vol * (1 - bal);
-        vol_r = vol;
-      } else {
-        vol_l = vol;
-        vol_r = vol * (1 + bal);
-      }
-    } else {
-      vol_l = vol * (1 - bal);
-      vol_r = vol * (1 + bal);
-    }
-    frame_left = channel_ptr->left_buffer_ptr[i] * vol_l;
-    if (channel_ptr->stereo)
-    {
-      if (!FLOAT_EXISTS(channel_ptr->right_buffer_ptr[i]))
-      {
-        channel_ptr->NaN_detected = true;
-        channel_ptr->frames_right[i-start] = NAN;
-        break;
-      }
+  if (mixer_ctx_ptr->automation_ptr != NULL)
+  {
+    automation_stop(mixer_ctx_ptr->automation_ptr);
+  }
 
-      frame_right = channel_ptr->right_buffer_ptr[i] * vol_r;
-    }
-    else
-    {
-      frame_right = channel_ptr->right_buffer_ptr[i] * vol_r;
-    }
-    channel_ptr->frames_left[i-start] = frame_left;
-    channel_ptr->frames_right[i-start] = frame_right;
+  if (mixer_ctx_ptr->capture_ptr != NULL)
+  {
+    capture_stop(mixer_ctx_ptr->capture_ptr);
+  }
 
-    if (channel_ptr->stereo)
-    {
-      frame_left = fabsf(frame_left);
-      frame_right = fabsf(frame_right);
+  /* process callback is gone, nothing can use these any more */
+  g_slist_free_full(mixer_ctx_ptr->stopped_automations, (GDestroyNotify)automation_stop);
+  g_slist_free_full(mixer_ctx_ptr->stopped_captures, (GDestroyNotify)capture_stop);
 
-      if (channel_ptr->peak_left < frame_left)
-      {
-        channel_ptr->peak_left = frame_left;
+  if (mixer_ctx_ptr->state_ptr != NULL)
+  {
+    state_close(mixer_ctx_ptr->state_ptr);
+  }
 
-        if (frame_left > channel_ptr->abspeak)
-        {
-          channel_ptr->abspeak = frame_left;
-        }
-      }
+  close(mixer_ctx_ptr->event_fd);
 
-      if (channel_ptr->peak_right < frame_right)
-      {
-        channel_ptr->peak_right = frame_right;
+  g_hash_table_destroy(mixer_ctx_ptr->channels_by_name);
+  g_hash_table_destroy(mixer_ctx_ptr->channels_by_port_name);
 
-        if (frame_right > channel_ptr->abspeak)
-        {
-          channel_ptr->abspeak = frame_right;
-        }
-      }
-    }
-    else
-    {
-      frame_left = (fabsf(frame_left) + fabsf(frame_right)) / 2;
+  /* process callback is gone, take back nodes of events it did not apply */
+  mixer_receive_scheduled(mixer_ctx_ptr);
+  while (mixer_ctx_ptr->scheduled_count > 0)
+  {
+    g_slist_free_1(mixer_ctx_ptr->scheduled_events[0].node_ptr);
+    mixer_drop_scheduled(mixer_ctx_ptr, 0);
+  }
+  mixer_free_released_nodes(mixer_ctx_ptr);
+  jack_ringbuffer_free(mixer_ctx_ptr->scheduled_ring);
+  jack_ringbuffer_free(mixer_ctx_ptr->released_ring);
+  jack_ringbuffer_free(mixer_ctx_ptr->overload_ring);
 
-      if (channel_ptr->peak_left < frame_left)
-      {
-        channel_ptr->peak_left = frame_left;
+  pthread_mutex_destroy(&mixer_ctx_ptr->mutex);
 
-        if (frame_left > channel_ptr->abspeak)
-        {
-          channel_ptr->abspeak = frame_left;
-        }
-      }
-    }
+  free(mixer_ctx_ptr);
+}
 
-    channel_ptr->peak_frames++;
-    if (channel_ptr->peak_frames >= PEAK_FRAMES_CHUNK)
-    {
-      channel_ptr->meter_left = channel_ptr->peak_left;
-      channel_ptr->peak_left = 0.0;
 
-      if (channel_ptr->stereo)
-      {
-        channel_ptr->meter_right = channel_ptr->peak_right;
-        channel_ptr->peak_right = 0.0;
-      }
+unsigned int
+get_channels_count(
+  jack_mixer_t mixer)
+{
+  return g_slist_length(mixer_ctx_ptr->input_channels_list);
+}
 
-      channel_ptr->peak_frames = 0;
-    }
-    channel_ptr->volume_idx++;
-    if ((channel_ptr->volume != channel_ptr->volume_new) &&
-     (channel_ptr->volume_idx == steps)) {
-      channel_ptr->volume = channel_ptr->volume_new;
-      channel_ptr->volume_idx = 0;
-    }
-    channel_ptr->balance_idx++;
-    if ((channel_ptr->balance != channel_ptr->balance_new) &&
-     (channel_ptr->balance_idx >= steps)) {
-      channel_ptr->balance = channel_ptr->balance_new;
-      channel_ptr->balance_idx = 0;
-     }
-  }
+const char*
+get_client_name(
+  jack_mixer_t mixer)
+{
+  return jack_get_client_name(mixer_ctx_ptr->jack_client);
 }
 
-static inline void
-mix(
-  struct jack_mixer * mixer_ptr,
-  jack_nframes_t start,         /* index of first sample to process */
-  jack_nframes_t end)           /* index of sample to stop processing before */
+int
+get_last_midi_channel(
+  jack_mixer_t mixer)
 {
-  GSList *node_ptr;
+  return mixer_ctx_ptr->last_midi_channel;
+}
+
+unsigned int
+set_last_midi_channel(
+  jack_mixer_t mixer,
+  int new_channel) {
+  mixer_ctx_ptr->last_midi_channel = new_channel;
+  return 0;
+}
+
+static void
+channel_state_store_all(
+  struct channel * channel_ptr,
+  bool output)
+{
+  struct state_record * record_ptr = channel_ptr->state_record_ptr;
+  struct mixer_state * state_ptr = channel_ptr->mixer_ptr->state_ptr;
   struct output_channel * output_channel_ptr;
-  struct channel *channel_ptr;
+  struct channel * input_ptr;
+  GSList *list_ptr;
+  unsigned int index;
 
-  for (node_ptr = mixer_ptr->input_channels_list; node_ptr; node_ptr = g_slist_next(node_ptr))
+  STATE_STORE(channel_ptr, float, volume, channel_ptr->volume_new);
+  STATE_STORE(channel_ptr, float, balance, channel_ptr->balance_new);
+  STATE_STORE(channel_ptr, bool, out_mute, channel_ptr->out_mute);
+  STATE_STORE(channel_ptr, int, midi_cc_volume, channel_ptr->midi_cc_volume_index);
+  STATE_STORE(channel_ptr, int, midi_cc_balance, channel_ptr->midi_cc_balance_index);
+  STATE_STORE(channel_ptr, int, midi_cc_mute, channel_ptr->midi_cc_mute_index);
+  STATE_STORE(channel_ptr, int, midi_cc_solo, channel_ptr->midi_cc_solo_index);
+
+  if (!output)
   {
-    channel_ptr = (struct channel*)node_ptr->data;
-    calc_channel_frames(channel_ptr, start, end);
+    STATE_STORE(channel_ptr, bool, solo, channel_is_soloed(channel_ptr));
+    return;
   }
 
-  for (node_ptr = mixer_ptr->output_channels_list; node_ptr; node_ptr = g_slist_next(node_ptr))
+  output_channel_ptr = (struct output_channel *)channel_ptr;
+  if (output_channel_ptr->prefader)
   {
-    output_channel_ptr = node_ptr->data;
-    channel_ptr = (struct channel*)output_channel_ptr;
+    __atomic_fetch_or(&record_ptr->flags, STATE_RECORD_PREFADER, __ATOMIC_RELEASE);
+  }
+  if (output_channel_ptr->double_precision)
+  {
+    __atomic_fetch_or(&record_ptr->flags, STATE_RECORD_DOUBLE_PRECISION, __ATOMIC_RELEASE);
+  }
 
-    if (output_channel_ptr->system)
+  for (list_ptr = channel_ptr->mixer_ptr->input_channels_list; list_ptr; list_ptr = g_slist_next(list_ptr))
+  {
+    input_ptr = list_ptr->data;
+    if (input_ptr->state_record_ptr == NULL)
     {
-      /* Don't bother mixing the channels if we are not connected */
-      if (channel_ptr->stereo)
-      {
-        if (jack_port_connected(channel_ptr->port_left) == 0 &&
-            jack_port_connected(channel_ptr->port_right) == 0)
-          continue;
-      } else {
-         if (jack_port_connected(channel_ptr->port_left) == 0)
-           continue;
-      }
+      continue;
     }
 
-    mix_one(output_channel_ptr, mixer_ptr->input_channels_list, start, end);
+    index = state_record_index(state_ptr, input_ptr->state_record_ptr);
+    state_store_mask_bit(record_ptr->muted_mask, index, output_channel_is_muted(output_channel_ptr, input_ptr));
+    state_store_mask_bit(record_ptr->soloed_mask, index, output_channel_is_solo(output_channel_ptr, input_ptr));
   }
 }
 
-static inline void
-update_channel_buffers(
+/* bind channel to a record of the state file, restoring the parameters
+ * left there by a previous process if the channel is found by name */
+static void
+channel_state_bind(
   struct channel * channel_ptr,
-  jack_nframes_t nframes)
+  bool output)
 {
-  channel_ptr->left_buffer_ptr = jack_port_get_buffer(channel_ptr->port_left, nframes);
-
-  if (channel_ptr->stereo)
-  {
-    channel_ptr->right_buffer_ptr = jack_port_get_buffer(channel_ptr->port_right, nframes);
-  }
-}
-
-#define mixer_ptr ((struct jack_mixer *)context)
-
-static int
-process(
-  jack_nframes_t nframes,
-  void * context)
-{
-  jack_nframes_t i;
-  GSList *node_ptr;
-  struct channel * channel_ptr;
-#if defined(HAVE_JACK_MIDI)
-  jack_nframes_t event_count;
-  jack_midi_event_t in_event;
-  unsigned char* midi_out_buffer;
-  void * midi_buffer;
-  signed char byte;
-  unsigned int cc_channel_index;
-#endif
-
-  for (node_ptr = mixer_ptr->input_channels_list; node_ptr; node_ptr = g_slist_next(node_ptr))
-  {
-    channel_ptr = node_ptr->data;
-    update_channel_buffers(channel_ptr, nframes);
-  }
+  struct mixer_state * state_ptr = channel_ptr->mixer_ptr->state_ptr;
+  struct state_record * record_ptr;
+  struct channel * other_ptr;
+  GSList *list_ptr;
+  uint32_t flags;
+  unsigned int index;
+  int cc_volume, cc_balance, cc_mute, cc_solo;
 
-  // Fill output buffers with the input 
-  for (node_ptr = mixer_ptr->output_channels_list; node_ptr; node_ptr = g_slist_next(node_ptr))
+  if (state_ptr == NULL)
   {
-    channel_ptr = node_ptr->data;
-    update_channel_buffers(channel_ptr, nframes);
+    return;
   }
 
-#if defined(HAVE_JACK_MIDI)
-  midi_buffer = jack_port_get_buffer(mixer_ptr->port_midi_in, nframes);
-  event_count = jack_midi_get_event_count(midi_buffer);
+  flags = (channel_ptr->stereo ? STATE_RECORD_STEREO : 0) | (output ? STATE_RECORD_OUTPUT : 0);
 
-  for (i = 0 ; i < event_count; i++)
+  record_ptr = state_record_reclaim(state_ptr, channel_ptr->name, flags);
+  if (record_ptr == NULL)
   {
-    jack_midi_event_get(&in_event, midi_buffer, i);
-
-    if (in_event.size != 3 ||
-        (in_event.buffer[0] & 0xF0) != 0xB0 ||
-        in_event.buffer[1] > 127 ||
-        in_event.buffer[2] > 127)
+    channel_ptr->state_record_ptr = state_record_claim(state_ptr, channel_ptr->name, flags);
+    if (channel_ptr->state_record_ptr != NULL)
     {
-      continue;
+      channel_state_store_all(channel_ptr, output);
     }
+    return;
+  }
 
-    assert(in_event.time < nframes);
+  LOG_NOTICE("Restoring state of channel \"%s\"", channel_ptr->name);
 
-    LOG_DEBUG(
-      "%u: CC#%u -> %u",
-      (unsigned int)(in_event.buffer[0]),
-      (unsigned int)in_event.buffer[1],
-      (unsigned int)in_event.buffer[2]);
+  channel_ptr->state_record_ptr = record_ptr;
+  channel_ptr->restored = true;
 
-    mixer_ptr->last_midi_channel = (unsigned int)in_event.buffer[1];
-    channel_ptr = mixer_ptr->midi_cc_map[in_event.buffer[1]];
+  channel_ptr->volume = channel_ptr->volume_new = state_load_float(&record_ptr->volume);
+  channel_ptr->volume_idx = 0;
+  channel_ptr->balance = channel_ptr->balance_new = state_load_float(&record_ptr->balance);
+  channel_ptr->balance_idx = 0;
+  channel_ptr->out_mute = __atomic_load_n(&record_ptr->out_mute, __ATOMIC_ACQUIRE) != 0;
+  channel_ptr->midi_out_has_events = true;
 
-    /* if we have mapping for particular CC and MIDI scale is set for corresponding channel */
-    if (channel_ptr != NULL && channel_ptr->midi_scale != NULL)
+  cc_volume = __atomic_load_n(&record_ptr->midi_cc_volume, __ATOMIC_ACQUIRE);
+  cc_balance = __atomic_load_n(&record_ptr->midi_cc_balance, __ATOMIC_ACQUIRE);
+  cc_mute = __atomic_load_n(&record_ptr->midi_cc_mute, __ATOMIC_ACQUIRE);
+  cc_solo = __atomic_load_n(&record_ptr->midi_cc_solo, __ATOMIC_ACQUIRE);
+
+  if (cc_volume != -1)
+  {
+    channel_set_volume_midi_cc(channel_ptr, cc_volume);
+  }
+  if (cc_balance != -1)
+  {
+    channel_set_balance_midi_cc(channel_ptr, cc_balance);
+  }
+  if (cc_mute != -1)
+  {
+    channel_set_mute_midi_cc(channel_ptr, cc_mute);
+  }
+  if (cc_solo != -1)
+  {
+    channel_set_solo_midi_cc(channel_ptr, cc_solo);
+  }
+
+  index = state_record_index(state_ptr, record_ptr);
+
+  if (!output)
+  {
+    if (__atomic_load_n(&record_ptr->solo, __ATOMIC_ACQUIRE))
     {
-      if (channel_ptr->midi_cc_balance_index == (unsigned int)in_event.buffer[1])
-      {
-        byte = in_event.buffer[2];
-        if (byte == 0)
-        {
-          byte = 1;
-        }
-        byte -= 64;
+      channel_solo(channel_ptr);
+    }
 
-        if (channel_ptr->balance != channel_ptr->balance_new) {
-          channel_ptr->balance = channel_ptr->balance + channel_ptr->balance_idx *
-           (channel_ptr->balance_new - channel_ptr->balance) /
-           channel_ptr->num_volume_transition_steps;
-        }
-        channel_ptr->balance_idx = 0;
-        channel_ptr->balance_new = (float)byte / 63;
-        LOG_DEBUG("\"%s\" balance -> %f", channel_ptr->name, channel_ptr->balance_new);
-      }
-      else if (channel_ptr->midi_cc_volume_index == in_event.buffer[1])
+    /* reconnect with buses restored before us */
+    for (list_ptr = channel_ptr->mixer_ptr->output_channels_list; list_ptr; list_ptr = g_slist_next(list_ptr))
+    {
+      other_ptr = list_ptr->data;
+      if (other_ptr->state_record_ptr == NULL)
       {
-        if (channel_ptr->volume_new != channel_ptr->volume) {
-          channel_ptr->volume = channel_ptr->volume + channel_ptr->volume_idx *
-           (channel_ptr->volume_new - channel_ptr->volume) /
-           channel_ptr->num_volume_transition_steps;
-        }
-        channel_ptr->volume_idx = 0;
-        channel_ptr->volume_new = db_to_value(scale_scale_to_db(channel_ptr->midi_scale,
-         (double)in_event.buffer[2] / 127));
-        LOG_DEBUG("\"%s\" volume -> %f", channel_ptr->name, channel_ptr->volume_new);
+        continue;
       }
-      else if (channel_ptr->midi_cc_mute_index == in_event.buffer[1])
+
+      if (state_load_mask_bit(other_ptr->state_record_ptr->muted_mask, index))
       {
-        if ((unsigned int)in_event.buffer[2] == 127) {
-          channel_ptr->out_mute = !channel_ptr->out_mute;
-        }
-        LOG_DEBUG("\"%s\" out_mute %d", channel_ptr->name, channel_ptr->out_mute);
+        output_channel_set_muted(other_ptr, channel_ptr, true);
       }
-      else if (channel_ptr->midi_cc_solo_index == in_event.buffer[1])
+      if (state_load_mask_bit(other_ptr->state_record_ptr->soloed_mask, index))
       {
-        if ((unsigned int)in_event.buffer[2] == 127) {
-          if (channel_is_soloed(channel_ptr)) {
-            channel_unsolo(channel_ptr);
-          } else {
-            channel_solo(channel_ptr);
-          }
-        }
-        LOG_DEBUG("\"%s\" solo %d", channel_ptr->name, channel_is_soloed(channel_ptr));
+        output_channel_set_solo(other_ptr, channel_ptr, true);
       }
-      channel_ptr->midi_in_got_events = true;
-      if (channel_ptr->midi_change_callback)
-        channel_ptr->midi_change_callback(channel_ptr->midi_change_callback_data);
-
     }
 
+    return;
   }
 
-  midi_buffer = jack_port_get_buffer(mixer_ptr->port_midi_out, nframes);
-  jack_midi_clear_buffer(midi_buffer);
+  ((struct output_channel *)channel_ptr)->prefader =
+    (__atomic_load_n(&record_ptr->flags, __ATOMIC_ACQUIRE) & STATE_RECORD_PREFADER) != 0;
+  ((struct output_channel *)channel_ptr)->double_precision =
+    (__atomic_load_n(&record_ptr->flags, __ATOMIC_ACQUIRE) & STATE_RECORD_DOUBLE_PRECISION) != 0;
 
-  for(i=0; i<nframes; i++)
+  /* reconnect with inputs restored before us */
+  for (list_ptr = channel_ptr->mixer_ptr->input_channels_list; list_ptr; list_ptr = g_slist_next(list_ptr))
   {
-    for (cc_channel_index=0; cc_channel_index<128; cc_channel_index++)
+    other_ptr = list_ptr->data;
+    if (other_ptr->state_record_ptr == NULL)
     {
-      channel_ptr = mixer_ptr->midi_cc_map[cc_channel_index];
-      if (channel_ptr == NULL || channel_ptr->midi_scale == NULL)
-      {
-        continue;
-      }
-      if (channel_ptr->midi_out_has_events == false)
-      {
-        continue;
-      }
-      if (channel_ptr->midi_cc_balance_index == (unsigned int)cc_channel_index)
-      {
-        continue;
-      }
-      midi_out_buffer = jack_midi_event_reserve(midi_buffer, i, 3);
-      if (midi_out_buffer == NULL)
-      {
-        continue;
-      }
-      midi_out_buffer[0] = 0xB0; /* control change */
-      midi_out_buffer[1] = cc_channel_index;
-      midi_out_buffer[2] = (unsigned char)(127*scale_db_to_scale(channel_ptr->midi_scale, value_to_db(channel_ptr->volume_new)));
-
-      LOG_DEBUG(
-        "%u: CC#%u <- %u",
-        (unsigned int)(midi_out_buffer[0]),
-        (unsigned int)midi_out_buffer[1],
-        (unsigned int)midi_out_buffer[2]);
+      continue;
+    }
 
-      channel_ptr->midi_out_has_events = false;
+    index = state_record_index(state_ptr, other_ptr->state_record_ptr);
+    if (state_load_mask_bit(record_ptr->muted_mask, index))
+    {
+      output_channel_set_muted(channel_ptr, other_ptr, true);
     }
+    if (state_load_mask_bit(record_ptr->soloed_mask, index))
+    {
+      output_channel_set_solo(channel_ptr, other_ptr, true);
+    }
+  }
+}
+
+jack_mixer_channel_t
+mixer_find_channel(
+  jack_mixer_t mixer,
+  const char * name)
+{
+  struct channel * channel_ptr;
+
+  channel_ptr = g_hash_table_lookup(mixer_ctx_ptr->channels_by_name, name);
+  if (channel_ptr == NULL)
+  {
+    channel_ptr = g_hash_table_lookup(mixer_ctx_ptr->channels_by_port_name, name);
+  }
+
+  return channel_ptr;
+}
+
+bool
+mixer_volumes_write_at(
+  jack_mixer_t mixer,
+  const jack_mixer_channel_t * channels,
+  const double * volumes,
+  unsigned int count,
+  uint32_t frame_time)
+{
+  return mixer_schedule_bulk(mixer_ctx_ptr, SCHEDULED_VOLUME, channels, volumes, count, frame_time);
+}
+
+bool
+mixer_balances_write_at(
+  jack_mixer_t mixer,
+  const jack_mixer_channel_t * channels,
+  const double * balances,
+  unsigned int count,
+  uint32_t frame_time)
+{
+  return mixer_schedule_bulk(mixer_ctx_ptr, SCHEDULED_BALANCE, channels, balances, count, frame_time);
+}
+
+bool
+mixer_out_mutes_write_at(
+  jack_mixer_t mixer,
+  const jack_mixer_channel_t * channels,
+  const double * out_mutes,
+  unsigned int count,
+  uint32_t frame_time)
+{
+  return mixer_schedule_bulk(mixer_ctx_ptr, SCHEDULED_OUT_MUTE, channels, out_mutes, count, frame_time);
+}
+
+uint32_t
+mixer_get_frame_time(
+  jack_mixer_t mixer)
+{
+  return jack_frame_time(mixer_ctx_ptr->jack_client);
+}
+
+int
+mixer_get_event_fd(
+  jack_mixer_t mixer)
+{
+  return mixer_ctx_ptr->event_fd;
+}
+
+unsigned int
+mixer_read_events(
+  jack_mixer_t mixer)
+{
+  uint64_t count;
+  unsigned int events;
+
+  /* drain first, the RT thread signals again only after pending is cleared */
+  if (read(mixer_ctx_ptr->event_fd, &count, sizeof(count)) != sizeof(count))
+  {
+    /* nothing to drain */
   }
 
+  events = __atomic_exchange_n(&mixer_ctx_ptr->pending_events, 0, __ATOMIC_ACQ_REL);
+
+#if defined(HAVE_JACK_LATENCY)
+  /* JACK calls the latency callbacks back, of shards too */
+  if (events & MIXER_EVENT_ROUTING)
+  {
+    jack_recompute_total_latencies(mixer_ctx_ptr->jack_client);
+  }
 #endif
 
-  mix(mixer_ptr, 0, nframes);
+  return events;
+}
 
-  return 0;
+unsigned int
+mixer_get_shed_level(
+  jack_mixer_t mixer)
+{
+  return __atomic_load_n(&mixer_ctx_ptr->shed_level, __ATOMIC_RELAXED);
 }
 
-#undef mixer_ptr
+bool
+mixer_read_overload_transition(
+  jack_mixer_t mixer,
+  unsigned int * level_ptr,
+  float * load_ptr,
+  uint32_t * frame_time_ptr)
+{
+  struct overload_transition transition;
 
-jack_mixer_t
-create(
-  const char * jack_client_name_ptr,
-  bool stereo)
+  if (jack_ringbuffer_read(mixer_ctx_ptr->overload_ring, (char *)&transition, sizeof(transition)) != sizeof(transition))
+  {
+    return false;
+  }
+
+  *level_ptr = transition.level;
+  *load_ptr = transition.load;
+  *frame_time_ptr = transition.frame_time;
+
+  return true;
+}
+
+static bool
+mixer_automation_slot_name(
+  void * context,
+  unsigned int slot,
+  char * name,
+  size_t size,
+  bool * output_ptr)
 {
-  int ret;
-  struct jack_mixer * mixer_ptr;
-  int i;
+  struct jack_mixer * mixer_ptr = context;
+  bool ret;
 
+  ret = false;
 
-  mixer_ptr = malloc(sizeof(struct jack_mixer));
-  if (mixer_ptr == NULL)
+  pthread_mutex_lock(&mixer_ptr->mutex);
+
+  if (slot < AUTOMATION_SLOTS && mixer_ptr->automation_slots[slot].channel_ptr != NULL)
   {
-    goto exit;
+    snprintf(name, size, "%s", mixer_ptr->automation_slots[slot].channel_ptr->name);
+    *output_ptr = mixer_ptr->automation_slots[slot].output;
+    ret = true;
   }
 
-  ret = pthread_mutex_init(&mixer_ptr->mutex, NULL);
-  if (ret != 0)
+  pthread_mutex_unlock(&mixer_ptr->mutex);
+
+  return ret;
+}
+
+static int
+mixer_automation_find_slot(
+  void * context,
+  const char * name,
+  bool output)
+{
+  struct jack_mixer * mixer_ptr = context;
+  unsigned int slot;
+  int ret;
+
+  ret = -1;
+
+  pthread_mutex_lock(&mixer_ptr->mutex);
+
+  for (slot = 0 ; slot < AUTOMATION_SLOTS ; slot++)
   {
-    goto exit_free;
+    if (mixer_ptr->automation_slots[slot].channel_ptr != NULL &&
+        mixer_ptr->automation_slots[slot].output == output &&
+        strcmp(mixer_ptr->automation_slots[slot].channel_ptr->name, name) == 0)
+    {
+      ret = slot;
+      break;
+    }
   }
 
-  mixer_ptr->input_channels_list = NULL;
-  mixer_ptr->output_channels_list = NULL;
+  pthread_mutex_unlock(&mixer_ptr->mutex);
 
-  mixer_ptr->soloed_channels = NULL;
+  return ret;
+}
 
-  mixer_ptr->last_midi_channel = -1;
+static void
+mixer_automation_collect(
+  void * context)
+{
+  struct jack_mixer * mixer_ptr = context;
+  unsigned int overruns;
 
-  for (i = 0 ; i < 128 ; i++)
+  pthread_mutex_lock(&mixer_ptr->mutex);
+  mixer_free_released_nodes(mixer_ptr);
+  pthread_mutex_unlock(&mixer_ptr->mutex);
+
+  overruns = __atomic_exchange_n(&mixer_ptr->automation_overruns, 0, __ATOMIC_RELAXED);
+  if (overruns != 0)
   {
-    mixer_ptr->midi_cc_map[i] = NULL;
+    LOG_ERROR("%u automation events were not recorded", overruns);
   }
+}
 
-  LOG_DEBUG("Initializing JACK");
-  mixer_ptr->jack_client = jack_client_open(jack_client_name_ptr, 0, NULL);
-  if (mixer_ptr->jack_client == NULL)
+static bool
+mixer_automation_start(
+  jack_mixer_t mixer,
+  const char * path,
+  bool record)
+{
+  struct automation_callbacks callbacks;
+  struct automation * automation_ptr;
+
+  if (mixer_ctx_ptr->automation_ptr != NULL)
   {
-    LOG_ERROR("Cannot create JACK client.");
-    LOG_NOTICE("Please make sure JACK daemon is running.");
-    goto exit_destroy_mutex;
+    LOG_ERROR("Automation is already running");
+    return false;
   }
 
-  LOG_DEBUG("JACK client created");
+  callbacks.context = mixer_ctx_ptr;
+  callbacks.get_slot_name = mixer_automation_slot_name;
+  callbacks.find_slot = mixer_automation_find_slot;
+  callbacks.collect = mixer_automation_collect;
 
-  LOG_DEBUG("Sample rate: %" PRIu32, jack_get_sample_rate(mixer_ptr->jack_client));
+  automation_ptr = automation_start(path, record, &callbacks);
+  if (automation_ptr == NULL)
+  {
+    return false;
+  }
 
+  __atomic_store_n(&mixer_ctx_ptr->automation_ptr, automation_ptr, __ATOMIC_RELEASE);
 
-#if defined(HAVE_JACK_MIDI)
-  mixer_ptr->port_midi_in = jack_port_register(mixer_ptr->jack_client, "midi in", JACK_DEFAULT_MIDI_TYPE, JackPortIsInput, 0);
-  if (mixer_ptr->port_midi_in == NULL)
+  return true;
+}
+
+bool
+mixer_automation_record(
+  jack_mixer_t mixer,
+  const char * path)
+{
+  return mixer_automation_start(mixer, path, true);
+}
+
+bool
+mixer_automation_play(
+  jack_mixer_t mixer,
+  const char * path)
+{
+  return mixer_automation_start(mixer, path, false);
+}
+
+void
+mixer_automation_stop(
+  jack_mixer_t mixer)
+{
+  struct automation * automation_ptr;
+
+  automation_ptr = __atomic_exchange_n(&mixer_ctx_ptr->automation_ptr, NULL, __ATOMIC_ACQ_REL);
+  if (automation_ptr == NULL)
   {
-    LOG_ERROR("Cannot create JACK MIDI in port");
-    goto close_jack;
+    return;
   }
 
-  mixer_ptr->port_midi_out = jack_port_register(mixer_ptr->jack_client, "midi out", JACK_DEFAULT_MIDI_TYPE, JackPortIsOutput, 0);
-  if (mixer_ptr->port_midi_out == NULL)
+  if (!mixer_wait_cycles(mixer_ctx_ptr))
   {
-    LOG_ERROR("Cannot create JACK MIDI out port");
-    goto close_jack;
+    LOG_WARNING("Process callback does not run, automation is freed when mixer is destroyed");
+    mixer_ctx_ptr->stopped_automations = g_slist_prepend(mixer_ctx_ptr->stopped_automations, automation_ptr);
+    return;
   }
 
-#endif
+  automation_stop(automation_ptr);
+}
 
-  ret = jack_set_process_callback(mixer_ptr->jack_client, process, mixer_ptr);
-  if (ret != 0)
+bool
+mixer_capture_start(
+  jack_mixer_t mixer,
+  const char * path)
+{
+  struct capture_callbacks callbacks;
+  struct capture * capture_ptr;
+
+  if (mixer_ctx_ptr->capture_ptr != NULL)
   {
-    LOG_ERROR("Cannot set JACK process callback");
-    goto close_jack;
+    LOG_ERROR("Capture is already running");
+    return false;
   }
 
-  ret = jack_activate(mixer_ptr->jack_client);
-  if (ret != 0)
+  /* output channels of shards are mixed after the cycle is captured */
+  if (mixer_ctx_ptr->shards_count > 0)
   {
-    LOG_ERROR("Cannot activate JACK client");
-    goto close_jack;
+    LOG_ERROR("Capture is not available when mixer is split into several clients");
+    return false;
   }
 
-  return mixer_ptr;
-
-close_jack:
-  jack_client_close(mixer_ptr->jack_client); /* this should clear all other resources we obtained through the client handle */
+  callbacks.context = mixer_ctx_ptr;
+  callbacks.get_slot_name = mixer_automation_slot_name;
 
-exit_destroy_mutex:
-  pthread_mutex_destroy(&mixer_ptr->mutex);
+  capture_ptr = capture_start(path, &callbacks);
+  if (capture_ptr == NULL)
+  {
+    return false;
+  }
 
-exit_free:
-  free(mixer_ptr);
+  __atomic_store_n(&mixer_ctx_ptr->capture_ptr, capture_ptr, __ATOMIC_RELEASE);
 
-exit:
-  return NULL;
+  return true;
 }
 
-#define mixer_ctx_ptr ((struct jack_mixer *)mixer)
-
 void
-destroy(
+mixer_capture_stop(
   jack_mixer_t mixer)
 {
-  LOG_DEBUG("Uninitializing JACK");
+  struct capture * capture_ptr;
 
-  assert(mixer_ctx_ptr->jack_client != NULL);
-
-  jack_client_close(mixer_ctx_ptr->jack_client);
+  capture_ptr = __atomic_exchange_n(&mixer_ctx_ptr->capture_ptr, NULL, __ATOMIC_ACQ_REL);
+  if (capture_ptr == NULL)
+  {
+    return;
+  }
 
-  pthread_mutex_destroy(&mixer_ctx_ptr->mutex);
+  if (!mixer_wait_cycles(mixer_ctx_ptr))
+  {
+    LOG_WARNING("Process callback does not run, capture is freed when mixer is destroyed");
+    mixer_ctx_ptr->stopped_captures = g_slist_prepend(mixer_ctx_ptr->stopped_captures, capture_ptr);
+    return;
+  }
 
-  free(mixer_ctx_ptr);
+  capture_stop(capture_ptr);
 }
 
+bool
+mixer_set_worker_threads(
+  unsigned int count,
+  bool pin)
+{
+  return workers_set_threads(count, pin);
+}
 
 unsigned int
-get_channels_count(
-  jack_mixer_t mixer)
+mixer_get_worker_threads(void)
 {
-  return g_slist_length(mixer_ctx_ptr->input_channels_list);
+  return workers_get_threads();
 }
 
-const char*
-get_client_name(
-  jack_mixer_t mixer)
+bool
+mixer_state_attach(
+  jack_mixer_t mixer,
+  const char * path)
 {
-  return jack_get_client_name(mixer_ctx_ptr->jack_client);
+  GSList *list_ptr;
+
+  if (mixer_ctx_ptr->state_ptr != NULL)
+  {
+    LOG_ERROR("State file already attached");
+    return false;
+  }
+
+  mixer_ctx_ptr->state_ptr = state_open(path);
+  if (mixer_ctx_ptr->state_ptr == NULL)
+  {
+    return false;
+  }
+
+  for (list_ptr = mixer_ctx_ptr->input_channels_list; list_ptr; list_ptr = g_slist_next(list_ptr))
+  {
+    channel_state_bind(list_ptr->data, false);
+  }
+
+  for (list_ptr = mixer_ctx_ptr->output_channels_list; list_ptr; list_ptr = g_slist_next(list_ptr))
+  {
+    channel_state_bind(list_ptr->data, true);
+  }
+
+  return true;
 }
 
-int
-get_last_midi_channel(
+void
+mixer_state_release_unclaimed(
   jack_mixer_t mixer)
 {
-  return mixer_ctx_ptr->last_midi_channel;
-}
-
-unsigned int
-set_last_midi_channel(
-  jack_mixer_t mixer,
-  int new_channel) {
-  mixer_ctx_ptr->last_midi_channel = new_channel;
-  return 0;
+  if (mixer_ctx_ptr->state_ptr != NULL)
+  {
+    state_release_unbound(mixer_ctx_ptr->state_ptr);
+  }
 }
 
-jack_mixer_channel_t
-add_channel(
+/* input channel fed by ports, or by player if not NULL; player is closed
+ * by remove_channel() once the channel is created */
+static struct channel *
+create_channel(
   jack_mixer_t mixer,
   const char * channel_name,
-  bool stereo)
+  bool stereo,
+  struct player * player_ptr)
 {
   struct channel * channel_ptr;
   char * port_name;
@@ -1312,7 +5211,12 @@ add_channel(
 
   channel_name_size = strlen(channel_name);
 
-  if (stereo)
+  if (player_ptr != NULL)
+  {
+    channel_ptr->port_left = NULL;
+    channel_ptr->port_right = NULL;
+  }
+  else if (stereo)
   {
     port_name = malloc(channel_name_size + 3);
     if (port_name == NULL)
@@ -1338,6 +5242,8 @@ add_channel(
     {
         goto fail_unregister_left_channel;
     }
+
+    free(port_name);
   }
   else
   {
@@ -1351,13 +5257,21 @@ add_channel(
   channel_ptr->stereo = stereo;
 
   channel_ptr->volume_transition_seconds = VOLUME_TRANSITION_SECONDS;
-  channel_ptr->num_volume_transition_steps =
-    channel_ptr->volume_transition_seconds *
-    jack_get_sample_rate(channel_ptr->mixer_ptr->jack_client) + 1;
+  channel_ptr->num_volume_transition_steps = volume_transition_steps(channel_ptr);
   channel_ptr->volume = 0.0;
   channel_ptr->volume_new = 0.0;
   channel_ptr->balance = 0.0;
   channel_ptr->balance_new = 0.0;
+  channel_ptr->agc_enabled = false;
+  channel_ptr->agc_target_db = -20.0;
+  channel_ptr->agc_max_gain_db = 12.0;
+  channel_ptr->agc_gate_db = -50.0;
+  channel_ptr->agc_energy = 0.0;
+  channel_ptr->agc_frames = 0;
+  channel_ptr->agc_level = 0.0;
+  channel_ptr->agc_gain = 1.0;
+  channel_ptr->agc_gain_new = 1.0;
+  channel_ptr->agc_gain_idx = 0;
   channel_ptr->meter_left = -1.0;
   channel_ptr->meter_right = -1.0;
   channel_ptr->abspeak = 0.0;
@@ -1367,12 +5281,22 @@ add_channel(
   channel_ptr->peak_right = 0.0;
   channel_ptr->peak_frames = 0;
 
-  channel_ptr->frames_left = calloc(MAX_BLOCK_SIZE, sizeof(jack_default_audio_sample_t));
-  channel_ptr->frames_right = calloc(MAX_BLOCK_SIZE, sizeof(jack_default_audio_sample_t));
-  channel_ptr->prefader_frames_left = calloc(MAX_BLOCK_SIZE, sizeof(jack_default_audio_sample_t));
-  channel_ptr->prefader_frames_right = calloc(MAX_BLOCK_SIZE, sizeof(jack_default_audio_sample_t));
+  channel_ptr->meter_subscribers = 0;
+  channel_ptr->clip_subscribers = 0;
+  channel_ptr->clip_count = 0;
+
+  channel_ptr->buffers_ptr = NULL;
+  channel_ptr->pending_buffers_ptr = NULL;
+  channel_ptr->retired_buffers_ptr = NULL;
 
   channel_ptr->NaN_detected = false;
+  channel_ptr->latency = 0;
+  channel_ptr->delay_ms = 0.0;
+  channel_ptr->delay_auto = false;
+  channel_ptr->delay_rate = 0;
+  channel_ptr->delay_ptr = NULL;
+  channel_ptr->pending_delay_ptr = NULL;
+  channel_ptr->retired_delay_ptr = NULL;
 
   channel_ptr->midi_cc_volume_index = -1;
   channel_ptr->midi_cc_balance_index = -1;
@@ -1384,9 +5308,22 @@ add_channel(
   channel_ptr->midi_out_has_events = false;
 
   channel_ptr->midi_scale = NULL;
+  channel_ptr->solo_node_ptr = g_slist_alloc();
 
-  channel_ptr->mixer_ptr->input_channels_list = g_slist_prepend(
-                  channel_ptr->mixer_ptr->input_channels_list, channel_ptr);
+  channel_ptr->state_record_ptr = NULL;
+  channel_ptr->restored = false;
+
+  channel_ptr->player_ptr = player_ptr;
+  if (!mixer_link_channel(channel_ptr, &channel_ptr->mixer_ptr->input_channels_list))
+  {
+    /* player is closed by the caller */
+    channel_ptr->player_ptr = NULL;
+    remove_channel(channel_ptr);
+    goto fail;
+  }
+  mixer_index_channel(channel_ptr);
+
+  channel_state_bind(channel_ptr, false);
 
   return channel_ptr;
 
@@ -1407,6 +5344,44 @@ fail:
   return NULL;
 }
 
+jack_mixer_channel_t
+add_channel(
+  jack_mixer_t mixer,
+  const char * channel_name,
+  bool stereo)
+{
+  return create_channel(mixer, channel_name, stereo, NULL);
+}
+
+jack_mixer_channel_t
+add_player_channel(
+  jack_mixer_t mixer,
+  const char * channel_name,
+  const char * path)
+{
+#if defined(HAVE_SNDFILE)
+  struct player * player_ptr;
+  struct channel * channel_ptr;
+
+  player_ptr = player_open(path, mixer_ctx_ptr->sample_rate);
+  if (player_ptr == NULL)
+  {
+    return NULL;
+  }
+
+  channel_ptr = create_channel(mixer, channel_name, player_is_stereo(player_ptr), player_ptr);
+  if (channel_ptr == NULL)
+  {
+    player_close(player_ptr);
+  }
+
+  return channel_ptr;
+#else
+  LOG_ERROR("Cannot play \"%s\", jack_mixer was built without libsndfile", path);
+  return NULL;
+#endif
+}
+
 static jack_mixer_output_channel_t
 create_output_channel(
   jack_mixer_t mixer,
@@ -1418,6 +5393,7 @@ create_output_channel(
   struct output_channel * output_channel_ptr;
   char * port_name;
   size_t channel_name_size;
+  jack_client_t * jack_client;
 
   output_channel_ptr = malloc(sizeof(struct output_channel));
   channel_ptr = (struct channel*)output_channel_ptr;
@@ -1427,6 +5403,8 @@ create_output_channel(
   }
 
   channel_ptr->mixer_ptr = mixer_ctx_ptr;
+  output_channel_ptr->shard_ptr = mixer_pick_shard(mixer_ctx_ptr, system);
+  jack_client = output_channel_ptr->shard_ptr != NULL ? output_channel_ptr->shard_ptr->jack_client : mixer_ctx_ptr->jack_client;
 
   channel_ptr->name = strdup(channel_name);
   if (channel_ptr->name == NULL)
@@ -1449,7 +5427,7 @@ create_output_channel(
     port_name[channel_name_size+1] = 'L';
     port_name[channel_name_size+2] = 0;
 
-    channel_ptr->port_left = jack_port_register(channel_ptr->mixer_ptr->jack_client, port_name, JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
+    channel_ptr->port_left = jack_port_register(jack_client, port_name, JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
     if (channel_ptr->port_left == NULL)
     {
         goto fail_free_port_name;
@@ -1457,15 +5435,17 @@ create_output_channel(
 
     port_name[channel_name_size+1] = 'R';
 
-    channel_ptr->port_right = jack_port_register(channel_ptr->mixer_ptr->jack_client, port_name, JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
+    channel_ptr->port_right = jack_port_register(jack_client, port_name, JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
     if (channel_ptr->port_right == NULL)
     {
         goto fail_unregister_left_channel;
     }
+
+    free(port_name);
   }
   else
   {
-    channel_ptr->port_left = jack_port_register(channel_ptr->mixer_ptr->jack_client, channel_name, JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
+    channel_ptr->port_left = jack_port_register(jack_client, channel_name, JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
     if (channel_ptr->port_left == NULL)
     {
         goto fail_free_channel_name;
@@ -1476,13 +5456,21 @@ create_output_channel(
   channel_ptr->out_mute = false;
 
   channel_ptr->volume_transition_seconds = VOLUME_TRANSITION_SECONDS;
-  channel_ptr->num_volume_transition_steps =
-    channel_ptr->volume_transition_seconds *
-    jack_get_sample_rate(channel_ptr->mixer_ptr->jack_client) + 1;
+  channel_ptr->num_volume_transition_steps = volume_transition_steps(channel_ptr);
   channel_ptr->volume = 0.0;
   channel_ptr->volume_new = 0.0;
   channel_ptr->balance = 0.0;
   channel_ptr->balance_new = 0.0;
+  channel_ptr->agc_enabled = false;
+  channel_ptr->agc_target_db = -20.0;
+  channel_ptr->agc_max_gain_db = 12.0;
+  channel_ptr->agc_gate_db = -50.0;
+  channel_ptr->agc_energy = 0.0;
+  channel_ptr->agc_frames = 0;
+  channel_ptr->agc_level = 0.0;
+  channel_ptr->agc_gain = 1.0;
+  channel_ptr->agc_gain_new = 1.0;
+  channel_ptr->agc_gain_idx = 0;
   channel_ptr->meter_left = -1.0;
   channel_ptr->meter_right = -1.0;
   channel_ptr->abspeak = 0.0;
@@ -1491,14 +5479,22 @@ create_output_channel(
   channel_ptr->peak_right = 0.0;
   channel_ptr->peak_frames = 0;
 
-  channel_ptr->tmp_mixed_frames_left = calloc(MAX_BLOCK_SIZE, sizeof(jack_default_audio_sample_t));
-  channel_ptr->tmp_mixed_frames_right = calloc(MAX_BLOCK_SIZE, sizeof(jack_default_audio_sample_t));
-  channel_ptr->frames_left = calloc(MAX_BLOCK_SIZE, sizeof(jack_default_audio_sample_t));
-  channel_ptr->frames_right = calloc(MAX_BLOCK_SIZE, sizeof(jack_default_audio_sample_t));
-  channel_ptr->prefader_frames_left = calloc(MAX_BLOCK_SIZE, sizeof(jack_default_audio_sample_t));
-  channel_ptr->prefader_frames_right = calloc(MAX_BLOCK_SIZE, sizeof(jack_default_audio_sample_t));
+  channel_ptr->meter_subscribers = 0;
+  channel_ptr->clip_subscribers = 0;
+  channel_ptr->clip_count = 0;
+
+  channel_ptr->buffers_ptr = NULL;
+  channel_ptr->pending_buffers_ptr = NULL;
+  channel_ptr->retired_buffers_ptr = NULL;
 
   channel_ptr->NaN_detected = false;
+  channel_ptr->latency = 0;
+  channel_ptr->delay_ms = 0.0;
+  channel_ptr->delay_auto = false;
+  channel_ptr->delay_rate = 0;
+  channel_ptr->delay_ptr = NULL;
+  channel_ptr->pending_delay_ptr = NULL;
+  channel_ptr->retired_delay_ptr = NULL;
 
   channel_ptr->midi_cc_volume_index = -1;
   channel_ptr->midi_cc_balance_index = -1;
@@ -1507,18 +5503,32 @@ create_output_channel(
 
   channel_ptr->midi_change_callback = NULL;
   channel_ptr->midi_change_callback_data = NULL;
+  channel_ptr->midi_out_has_events = false;
 
   channel_ptr->midi_scale = NULL;
+  channel_ptr->solo_node_ptr = g_slist_alloc();
+
+  channel_ptr->state_record_ptr = NULL;
+  channel_ptr->restored = false;
 
   output_channel_ptr->soloed_channels = NULL;
   output_channel_ptr->muted_channels = NULL;
   output_channel_ptr->system = system;
   output_channel_ptr->prefader = false;
+  output_channel_ptr->double_precision = false;
+  output_channel_ptr->monitor_source = NULL;
+  output_channel_ptr->monitor_bus = false;
+  output_channel_ptr->monitor_prefader = false;
+
+  if (output_channel_ptr->shard_ptr != NULL)
+  {
+    output_channel_ptr->shard_ptr->outputs_count++;
+  }
 
   return output_channel_ptr;
 
 fail_unregister_left_channel:
-  jack_port_unregister(channel_ptr->mixer_ptr->jack_client, channel_ptr->port_left);
+  jack_port_unregister(jack_client, channel_ptr->port_left);
 
 fail_free_port_name:
   free(port_name);
@@ -1550,8 +5560,13 @@ add_output_channel(
   }
   channel_ptr = (struct channel*)output_channel_ptr;
 
-  ((struct jack_mixer*)mixer)->output_channels_list = g_slist_prepend(
-                  ((struct jack_mixer*)mixer)->output_channels_list, channel_ptr);
+  if (!mixer_link_channel(channel_ptr, &((struct jack_mixer*)mixer)->output_channels_list))
+  {
+    remove_output_channel(output_channel_ptr);
+    return NULL;
+  }
+
+  channel_state_bind(channel_ptr, true);
 
   return output_channel_ptr;
 }
@@ -1562,15 +5577,43 @@ remove_output_channel(
 {
   struct output_channel *output_channel_ptr = output_channel;
   struct channel *channel_ptr = output_channel;
+  jack_client_t * jack_client;
+  GSList *list_ptr;
+  bool cancelled;
 
+  /* see remove_channel() */
+  pthread_mutex_lock(&channel_ptr->mixer_ptr->mutex);
   channel_ptr->mixer_ptr->output_channels_list = g_slist_remove(
                   channel_ptr->mixer_ptr->output_channels_list, channel_ptr);
+  for (list_ptr = channel_ptr->mixer_ptr->output_channels_list; list_ptr; list_ptr = g_slist_next(list_ptr))
+  {
+    if (((struct output_channel *)list_ptr->data)->monitor_source == channel_ptr)
+    {
+      ((struct output_channel *)list_ptr->data)->monitor_source = NULL;
+    }
+  }
+  pthread_mutex_unlock(&channel_ptr->mixer_ptr->mutex);
+
+  mixer_routing_changed(channel_ptr->mixer_ptr);
+  channel_unsolo(channel_ptr);
+  mixer_release_slot(channel_ptr);
+  cancelled = channel_cancel_scheduled(channel_ptr);
   free(channel_ptr->name);
 
-  jack_port_unregister(channel_ptr->mixer_ptr->jack_client, channel_ptr->port_left);
+  if (output_channel_ptr->shard_ptr != NULL)
+  {
+    jack_client = output_channel_ptr->shard_ptr->jack_client;
+    output_channel_ptr->shard_ptr->outputs_count--;
+  }
+  else
+  {
+    jack_client = channel_ptr->mixer_ptr->jack_client;
+  }
+
+  jack_port_unregister(jack_client, channel_ptr->port_left);
   if (channel_ptr->stereo)
   {
-    jack_port_unregister(channel_ptr->mixer_ptr->jack_client, channel_ptr->port_right);
+    jack_port_unregister(jack_client, channel_ptr->port_right);
   }
 
   if (channel_ptr->midi_cc_volume_index != -1)
@@ -1597,12 +5640,44 @@ remove_output_channel(
     channel_ptr->mixer_ptr->midi_cc_map[channel_ptr->midi_cc_solo_index] = NULL;
   }
 
+  if (channel_ptr->state_record_ptr != NULL)
+  {
+    state_record_release(channel_ptr->mixer_ptr->state_ptr, channel_ptr->state_record_ptr);
+  }
+
+  /* queued monitor events change these lists */
+  if (!cancelled)
+  {
+    return;
+  }
+
   g_slist_free(output_channel_ptr->soloed_channels);
   g_slist_free(output_channel_ptr->muted_channels);
+  g_slist_free_1(channel_ptr->solo_node_ptr);
+  channel_free_buffers(channel_ptr);
 
   free(channel_ptr);
 }
 
+static void
+output_channel_state_store_routing(
+  struct output_channel * output_channel_ptr,
+  struct channel * input_ptr,
+  bool value,
+  bool solo)
+{
+  struct state_record * record_ptr = output_channel_ptr->channel.state_record_ptr;
+  unsigned int index;
+
+  if (record_ptr == NULL || input_ptr->state_record_ptr == NULL)
+  {
+    return;
+  }
+
+  index = state_record_index(input_ptr->mixer_ptr->state_ptr, input_ptr->state_record_ptr);
+  state_store_mask_bit(solo ? record_ptr->soloed_mask : record_ptr->muted_mask, index, value);
+}
+
 void
 output_channel_set_solo(
   jack_mixer_output_channel_t output_channel,
@@ -1610,16 +5685,53 @@ output_channel_set_solo(
   bool solo_value)
 {
   struct output_channel *output_channel_ptr = output_channel;
+  struct jack_mixer * mixer_ptr = output_channel_ptr->channel.mixer_ptr;
 
-  if (solo_value) {
-    if (g_slist_find(output_channel_ptr->soloed_channels, channel) != NULL)
-      return;
+  pthread_mutex_lock(&mixer_ptr->mutex);
+  if ((g_slist_find(output_channel_ptr->soloed_channels, channel) != NULL) == solo_value)
+  {
+    pthread_mutex_unlock(&mixer_ptr->mutex);
+    return;
+  }
+  if (solo_value)
     output_channel_ptr->soloed_channels = g_slist_prepend(output_channel_ptr->soloed_channels, channel);
-  } else {
-    if (g_slist_find(output_channel_ptr->soloed_channels, channel) == NULL)
-      return;
+  else
     output_channel_ptr->soloed_channels = g_slist_remove(output_channel_ptr->soloed_channels, channel);
+  pthread_mutex_unlock(&mixer_ptr->mutex);
+
+  output_channel_state_store_routing(output_channel_ptr, channel, solo_value, true);
+  mixer_routing_changed(output_channel_ptr->channel.mixer_ptr);
+}
+
+/* the process callback records it, automation ring has single writer */
+static void
+output_channel_capture_muted(
+  struct output_channel * output_channel_ptr,
+  struct channel * input_ptr,
+  bool muted_value)
+{
+  struct automation * automation_ptr;
+  struct scheduled_event event;
+
+  automation_ptr = __atomic_load_n(&input_ptr->mixer_ptr->automation_ptr, __ATOMIC_ACQUIRE);
+  if (automation_ptr == NULL ||
+      !automation_is_recording(automation_ptr) ||
+      output_channel_ptr->channel.automation_slot == AUTOMATION_NO_SLOT ||
+      input_ptr->automation_slot == AUTOMATION_NO_SLOT)
+  {
+    return;
   }
+
+  event.frame_time = 0;
+  event.type = SCHEDULED_CAPTURE_SEND_MUTE;
+  event.channel_ptr = NULL;
+  event.input_ptr = NULL;
+  event.node_ptr = NULL;
+  event.slot = output_channel_ptr->channel.automation_slot;
+  event.input_slot = input_ptr->automation_slot;
+  event.value = muted_value ? 1.0 : 0.0;
+
+  mixer_schedule(input_ptr->mixer_ptr, &event);
 }
 
 void
@@ -1629,16 +5741,51 @@ output_channel_set_muted(
   bool muted_value)
 {
   struct output_channel *output_channel_ptr = output_channel;
+  struct jack_mixer * mixer_ptr = output_channel_ptr->channel.mixer_ptr;
 
-  if (muted_value) {
-    if (g_slist_find(output_channel_ptr->muted_channels, channel) != NULL)
-      return;
+  pthread_mutex_lock(&mixer_ptr->mutex);
+  if ((g_slist_find(output_channel_ptr->muted_channels, channel) != NULL) == muted_value)
+  {
+    pthread_mutex_unlock(&mixer_ptr->mutex);
+    return;
+  }
+  if (muted_value)
     output_channel_ptr->muted_channels = g_slist_prepend(output_channel_ptr->muted_channels, channel);
-  } else {
-    if (g_slist_find(output_channel_ptr->muted_channels, channel) == NULL)
-      return;
+  else
     output_channel_ptr->muted_channels = g_slist_remove(output_channel_ptr->muted_channels, channel);
+  pthread_mutex_unlock(&mixer_ptr->mutex);
+
+  output_channel_state_store_routing(output_channel_ptr, channel, muted_value, false);
+  output_channel_capture_muted(output_channel_ptr, channel, muted_value);
+  mixer_routing_changed(output_channel_ptr->channel.mixer_ptr);
+}
+
+bool
+output_channel_set_muted_at(
+  jack_mixer_output_channel_t output_channel,
+  jack_mixer_channel_t channel,
+  bool muted_value,
+  uint32_t frame_time)
+{
+  struct scheduled_event event;
+
+  event.frame_time = frame_time;
+  event.type = SCHEDULED_SEND_MUTE;
+  event.channel_ptr = output_channel;
+  event.input_ptr = channel;
+  event.node_ptr = muted_value ? g_slist_alloc() : NULL;
+  event.value = muted_value ? 1.0 : 0.0;
+
+  if (!mixer_schedule(event.channel_ptr->mixer_ptr, &event))
+  {
+    if (event.node_ptr != NULL)
+    {
+      g_slist_free_1(event.node_ptr);
+    }
+    return false;
   }
+
+  return true;
 }
 
 bool
@@ -1671,7 +5818,21 @@ output_channel_set_prefader(
   bool pfl_value)
 {
   struct output_channel *output_channel_ptr = output_channel;
+  struct state_record * record_ptr = output_channel_ptr->channel.state_record_ptr;
+
   output_channel_ptr->prefader = pfl_value;
+
+  if (record_ptr != NULL)
+  {
+    if (pfl_value)
+    {
+      __atomic_fetch_or(&record_ptr->flags, STATE_RECORD_PREFADER, __ATOMIC_RELEASE);
+    }
+    else
+    {
+      __atomic_fetch_and(&record_ptr->flags, ~STATE_RECORD_PREFADER, __ATOMIC_RELEASE);
+    }
+  }
 }
 
 bool
@@ -1681,3 +5842,62 @@ output_channel_is_prefader(
   struct output_channel *output_channel_ptr = output_channel;
   return output_channel_ptr->prefader;
 }
+
+void
+output_channel_set_double_precision(
+  jack_mixer_output_channel_t output_channel,
+  bool double_precision)
+{
+  struct output_channel *output_channel_ptr = output_channel;
+  struct state_record * record_ptr = output_channel_ptr->channel.state_record_ptr;
+
+  output_channel_ptr->double_precision = double_precision;
+
+  if (record_ptr != NULL)
+  {
+    if (double_precision)
+    {
+      __atomic_fetch_or(&record_ptr->flags, STATE_RECORD_DOUBLE_PRECISION, __ATOMIC_RELEASE);
+    }
+    else
+    {
+      __atomic_fetch_and(&record_ptr->flags, ~STATE_RECORD_DOUBLE_PRECISION, __ATOMIC_RELEASE);
+    }
+  }
+}
+
+bool
+output_channel_is_double_precision(
+  jack_mixer_output_channel_t output_channel)
+{
+  struct output_channel *output_channel_ptr = output_channel;
+  return output_channel_ptr->double_precision;
+}
+
+bool
+output_channel_set_monitor_source(
+  jack_mixer_output_channel_t output_channel,
+  jack_mixer_channel_t channel,
+  bool prefader)
+{
+  struct output_channel *output_channel_ptr = output_channel;
+  struct jack_mixer *mixer_ptr = output_channel_ptr->channel.mixer_ptr;
+  struct scheduled_event event;
+
+  if (channel == output_channel ||
+      (channel != NULL && ((struct channel *)channel)->mixer_ptr != mixer_ptr))
+  {
+    LOG_ERROR("Channel cannot be monitored by \"%s\"", output_channel_ptr->channel.name);
+    return false;
+  }
+
+  /* due already, so it is in effect for the whole next cycle */
+  event.frame_time = jack_last_frame_time(mixer_ptr->jack_client);
+  event.type = SCHEDULED_MONITOR;
+  event.channel_ptr = output_channel;
+  event.input_ptr = channel;
+  event.node_ptr = NULL;
+  event.value = prefader ? 1.0 : 0.0;
+
+  return mixer_schedule(mixer_ptr, &event);
+}
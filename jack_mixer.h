@@ -33,6 +33,8 @@
 %}
 #endif
 
+#include <stdint.h>
+
 typedef void * jack_mixer_t;
 typedef void * jack_mixer_channel_t;
 typedef void * jack_mixer_output_channel_t;
@@ -44,6 +46,17 @@ create(
   const char * jack_client_name_ptr,
   bool stereo);
 
+/* Like create(), with output channels other than system ones spread over
+ * shards extra JACK clients, named after the mixer client. JACK runs them
+ * after the mixer client, which processes input channels, and jackd2 runs
+ * them in parallel. Changes to output channels of shards take effect at
+ * cycle start instead of at their frame, and capture is not available. */
+jack_mixer_t
+create_split(
+  const char * jack_client_name_ptr,
+  bool stereo,
+  unsigned int shards);
+
 void
 destroy(
   jack_mixer_t mixer);
@@ -65,12 +78,134 @@ set_last_midi_channel(
   jack_mixer_t mixer,
   int new_channel);
 
+/* Find input channel by name, or by full JACK port name of one of its
+ * ports, NULL if there is no such channel */
+jack_mixer_channel_t
+mixer_find_channel(
+  jack_mixer_t mixer,
+  const char * name);
+
+#define MIXER_EVENT_METERS 0x01 /* new meter values were published */
+#define MIXER_EVENT_MIDI   0x02 /* channel parameters changed by MIDI */
+#define MIXER_EVENT_OVERLOAD 0x04 /* overload governor changed shed level */
+#define MIXER_EVENT_ROUTING 0x08 /* routing changed, port latencies are published again */
+
+/* Optional work the overload governor stops doing, cumulatively in this
+ * order, while the process callback takes too much of the period. Audio is
+ * not affected, meters freeze and MIDI feedback is delayed. */
+#define MIXER_SHED_NONE          0
+#define MIXER_SHED_INPUT_METERS  1
+#define MIXER_SHED_OUTPUT_METERS 2
+#define MIXER_SHED_MIDI_FEEDBACK 3
+#define MIXER_SHED_MAX MIXER_SHED_MIDI_FEEDBACK
+
+/* Current JACK frame time, to compute frame_time of *_at() calls */
+uint32_t
+mixer_get_frame_time(
+  jack_mixer_t mixer);
+
+/* File descriptor that becomes readable when there are events to read,
+ * for use with poll() or a main loop watch */
+int
+mixer_get_event_fd(
+  jack_mixer_t mixer);
+
+/* Returns MIXER_EVENT_* occurred since last call, and clears them. Port
+ * latencies follow routing changes only when events are read. */
+unsigned int
+mixer_read_events(
+  jack_mixer_t mixer);
+
+/* Current MIXER_SHED_* level */
+unsigned int
+mixer_get_shed_level(
+  jack_mixer_t mixer);
+
+/* Oldest shed level change not read yet, with the process callback load,
+ * as fraction of the period, that caused it. False if there is none. To
+ * be called when MIXER_EVENT_OVERLOAD is raised, until it returns false. */
+bool
+mixer_read_overload_transition(
+  jack_mixer_t mixer,
+  unsigned int * level_ptr,
+  float * load_ptr,
+  uint32_t * frame_time_ptr);
+
+/* Record volume, balance and mute changes into file at path, stamped with
+ * JACK transport frame, while transport rolls. Values at record start are
+ * recorded too. */
+bool
+mixer_automation_record(
+  jack_mixer_t mixer,
+  const char * path);
+
+/* Apply changes recorded by mixer_automation_record(), sample accurately
+ * while transport rolls. On transport relocation, values recorded before
+ * the new position are applied first. */
+bool
+mixer_automation_play(
+  jack_mixer_t mixer,
+  const char * path);
+
+/* Stop automation recording or playback, if any */
+void
+mixer_automation_stop(
+  jack_mixer_t mixer);
+
+/* Record input buffers, MIDI input, parameter changes and output buffers
+ * of every cycle into file at path, for bit exact offline replay with
+ * fuzz/replay. Capture ends early if the file cannot be written fast
+ * enough. */
+bool
+mixer_capture_start(
+  jack_mixer_t mixer,
+  const char * path);
+
+void
+mixer_capture_stop(
+  jack_mixer_t mixer);
+
+/* Share mixing of all mixers of the process with count worker threads, 0
+ * to mix in process callbacks only. Channels are mixed in parallel, output
+ * is bit identical. With pin, workers are bound to CPUs other than the
+ * first one. */
+bool
+mixer_set_worker_threads(
+  unsigned int count,
+  bool pin);
+
+unsigned int
+mixer_get_worker_threads(void);
+
+/* Mirror engine state into memory mapped file at path. Channels found there
+ * by name, left by a previous (crashed) process, get their state restored
+ * when they are added again. */
+bool
+mixer_state_attach(
+  jack_mixer_t mixer,
+  const char * path);
+
+/* Forget state of channels of the previous process that were not added
+ * again, to be called once the session is loaded. */
+void
+mixer_state_release_unclaimed(
+  jack_mixer_t mixer);
+
 jack_mixer_channel_t
 add_channel(
   jack_mixer_t mixer,
   const char * channel_name,
   bool stereo);
 
+/* Input channel playing an audio file instead of having ports, stereo if
+ * the file is. File must have the JACK sample rate; NULL on error or if
+ * built without libsndfile. */
+jack_mixer_channel_t
+add_player_channel(
+  jack_mixer_t mixer,
+  const char * channel_name,
+  const char * path);
+
 const char *
 channel_get_name(
   jack_mixer_channel_t channel);
@@ -88,6 +223,33 @@ channel_mono_meter_read(
   jack_mixer_channel_t channel,
   double * mono_ptr);
 
+/* Metering a channel is done only while someone looks at it. Each consumer
+ * subscribes to the MIXER_METER_* it reads and unsubscribes when done, the
+ * subscriptions are counted. Without MIXER_METER_PEAK subscribers meter
+ * and absolute peak values are not updated. */
+#define MIXER_METER_PEAK 0x01   /* meter and absolute peak */
+#define MIXER_METER_CLIP 0x02   /* count of clipped frames */
+
+void
+channel_meter_subscribe(
+  jack_mixer_channel_t channel,
+  unsigned int meters);
+
+void
+channel_meter_unsubscribe(
+  jack_mixer_channel_t channel,
+  unsigned int meters);
+
+/* Frames at or above full scale since last reset, counted while there are
+ * MIXER_METER_CLIP subscribers */
+unsigned int
+channel_clip_count_read(
+  jack_mixer_channel_t channel);
+
+void
+channel_clip_count_reset(
+  jack_mixer_channel_t channel);
+
 bool
 channel_is_stereo(
   jack_mixer_channel_t channel);
@@ -114,6 +276,56 @@ channel_balance_write(
   jack_mixer_channel_t channel,
   double balance);
 
+/* The *_at() functions schedule a change to be applied exactly at JACK
+ * frame_time, within the process cycle that contains it, or at start of
+ * next cycle if it is already past. They return false if too many events
+ * are pending. */
+
+bool
+channel_volume_write_at(
+  jack_mixer_channel_t channel,
+  double volume,
+  uint32_t frame_time);
+
+bool
+channel_balance_write_at(
+  jack_mixer_channel_t channel,
+  double balance,
+  uint32_t frame_time);
+
+bool
+channel_out_mute_write_at(
+  jack_mixer_channel_t channel,
+  bool out_mute,
+  uint32_t frame_time);
+
+/* *_at() for count channels of mixer at once, out mute values are nonzero
+ * to mute. Events are queued together: false and none is queued if they
+ * do not all fit, or if a channel is not one of mixer. */
+bool
+mixer_volumes_write_at(
+  jack_mixer_t mixer,
+  const jack_mixer_channel_t * channels,
+  const double * volumes,
+  unsigned int count,
+  uint32_t frame_time);
+
+bool
+mixer_balances_write_at(
+  jack_mixer_t mixer,
+  const jack_mixer_channel_t * channels,
+  const double * balances,
+  unsigned int count,
+  uint32_t frame_time);
+
+bool
+mixer_out_mutes_write_at(
+  jack_mixer_t mixer,
+  const jack_mixer_channel_t * channels,
+  const double * out_mutes,
+  unsigned int count,
+  uint32_t frame_time);
+
 double
 channel_balance_read(
   jack_mixer_channel_t channel);
@@ -209,6 +421,95 @@ bool
 channel_get_midi_in_got_events(
   jack_mixer_channel_t channel);
 
+/* true if channel parameters were restored from the state file */
+bool
+channel_is_restored(
+  jack_mixer_channel_t channel);
+
+/* Automatic gain, levels input to a short term RMS target level. Gain is
+ * limited to max_gain_db and held while input is below gate_db. */
+void
+channel_agc_enable(
+  jack_mixer_channel_t channel,
+  bool enabled);
+
+bool
+channel_is_agc_enabled(
+  jack_mixer_channel_t channel);
+
+void
+channel_agc_configure(
+  jack_mixer_channel_t channel,
+  double target_db,
+  double max_gain_db,
+  double gate_db);
+
+double
+channel_agc_target_read(
+  jack_mixer_channel_t channel);
+
+double
+channel_agc_max_gain_read(
+  jack_mixer_channel_t channel);
+
+double
+channel_agc_gate_read(
+  jack_mixer_channel_t channel);
+
+/* current automatic gain, in dB */
+double
+channel_agc_gain_read(
+  jack_mixer_channel_t channel);
+
+#define MIXER_DELAY_MAX_MS 500
+
+/* Delay of input channel before its fader, to align sources, from 0 to
+ * MIXER_DELAY_MAX_MS. False if out of range or if the delay line cannot be
+ * allocated. Not in effect while the delay follows port latencies. */
+bool
+channel_set_delay(
+  jack_mixer_channel_t channel,
+  float milliseconds);
+
+/* delay in effect, in ms */
+float
+channel_get_delay(
+  jack_mixer_channel_t channel);
+
+/* With JACK latency support, channels following port latencies are
+ * delayed to be aligned with the latest of them, once latencies are
+ * recomputed. */
+void
+channel_set_delay_auto(
+  jack_mixer_channel_t channel,
+  bool enabled);
+
+bool
+channel_is_delay_auto(
+  jack_mixer_channel_t channel);
+
+/* Start playing file of player channel from its start, or stop it, at
+ * JACK frame time; false if not a player channel or if too many events
+ * are pending. */
+bool
+channel_play_at(
+  jack_mixer_channel_t channel,
+  uint32_t frame_time);
+
+bool
+channel_stop_at(
+  jack_mixer_channel_t channel,
+  uint32_t frame_time);
+
+bool
+channel_is_player(
+  jack_mixer_channel_t channel);
+
+/* false once the end of file is played */
+bool
+channel_is_playing(
+  jack_mixer_channel_t channel);
+
 jack_mixer_scale_t
 scale_create();
 
@@ -232,6 +533,13 @@ scale_scale_to_db(
   jack_mixer_scale_t scale,
   double scale_value);
 
+/* Convert dBFS value to meter bar height in pixels, for meter of given height */
+unsigned int
+scale_db_to_pixels(
+  jack_mixer_scale_t scale,
+  double db,
+  unsigned int height);
+
 void
 scale_destroy(
   jack_mixer_scale_t scale);
@@ -259,6 +567,14 @@ output_channel_set_muted(
   jack_mixer_channel_t channel,
   bool muted_value);
 
+/* see channel_volume_write_at() */
+bool
+output_channel_set_muted_at(
+  jack_mixer_output_channel_t output_channel,
+  jack_mixer_channel_t channel,
+  bool muted_value,
+  uint32_t frame_time);
+
 bool
 output_channel_is_muted(
   jack_mixer_output_channel_t output_channel,
@@ -278,4 +594,29 @@ bool
 output_channel_is_prefader(
   jack_mixer_output_channel_t output_channel);
 
+/* Sum inputs of the output channel in double precision and round once,
+ * output then does not depend on the order channels were added in, as long
+ * as levels of N inputs are within 2^(29 - log2 N) of each other. Costs
+ * more than the float sum, see fuzz/bench. */
+void
+output_channel_set_double_precision(
+  jack_mixer_output_channel_t output_channel,
+  bool double_precision);
+
+bool
+output_channel_is_double_precision(
+  jack_mixer_output_channel_t output_channel);
+
+/* Output channel plays channel, of the same mixer, instead of its own
+ * routing, from the next cycle on; NULL restores that. An input channel is
+ * taken alone, before or after its fader, and not while muted. An output channel is mixed with
+ * its routing and, unless prefader, its fader and mute, which volume and
+ * balance of the output channel follow. Returns false if it cannot be
+ * scheduled. */
+bool
+output_channel_set_monitor_source(
+  jack_mixer_output_channel_t output_channel,
+  jack_mixer_channel_t channel,
+  bool prefader);
+
 #endif /* #ifndef JACK_MIXER_H__DAEB51D8_5861_40F2_92E4_24CA495A384D__INCLUDED */
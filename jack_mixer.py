@@ -26,6 +26,8 @@ import gobject
 import sys
 import os
 import signal
+import time
+from xml.parsers.expat import ExpatError
 
 try:
     import lash
@@ -105,14 +107,15 @@ class JackMixer(SerializedObject):
 
     _init_solo_channels = None
 
-    def __init__(self, name, lash_client):
-        self.mixer = jack_mixer_c.Mixer(name)
+    def __init__(self, name, lash_client, state_file=None, shards=0):
+        self.mixer = jack_mixer_c.Mixer(name, shards=shards)
         if not self.mixer:
             return
+        self.state_attached = bool(state_file)
+        if state_file:
+            self.mixer.state_attach(state_file)
         self.monitor_channel = self.mixer.add_output_channel("Monitor", True, True)
 
-        self.save = False
-
         if lash_client:
             # Send our client name to server
             lash_event = lash.lash_event_new_with_type(lash.LASH_Client_Name)
@@ -160,6 +163,10 @@ class JackMixer(SerializedObject):
         open = gtk.ImageMenuItem(gtk.STOCK_OPEN)
         mixer_menu.append(open)
         open.connect('activate', self.on_open_cb)
+        reload = gtk.ImageMenuItem(gtk.STOCK_REVERT_TO_SAVED)
+        reload.get_child().set_text_with_mnemonic('_Reload')
+        mixer_menu.append(reload)
+        reload.connect('activate', self.on_reload_cb)
         save = gtk.ImageMenuItem(gtk.STOCK_SAVE)
         mixer_menu.append(save)
         save.connect('activate', self.on_save_cb)
@@ -225,10 +232,13 @@ class JackMixer(SerializedObject):
         self.hbox_top.set_spacing(0)
         self.hbox_top.set_border_width(0)
         self.channels = []
+        self.channels_by_name = {}
         self.output_channels = []
 
         self.scrolled_window.set_policy(gtk.POLICY_AUTOMATIC, gtk.POLICY_AUTOMATIC)
         self.scrolled_window.add_with_viewport(self.hbox_inputs)
+        self.scrolled_window.get_hadjustment().connect('value-changed', self.on_inputs_scrolled)
+        self.hbox_inputs.connect('size-allocate', self.on_inputs_scrolled)
 
         self.hbox_outputs = gtk.HBox()
         self.hbox_outputs.set_spacing(0)
@@ -242,12 +252,14 @@ class JackMixer(SerializedObject):
         self.trayicon = TrayIcon(self)
         self.window.connect('delete-event', self.on_delete_event)
 
-        gobject.timeout_add(80, self.read_meters)
-        self.lash_client = lash_client
-
-        gobject.timeout_add(200, self.lash_check_events)
+        # the engine wakes us up only when meters or MIDI state changed
+        self.meters_refresh_time = 0
+        self.meters_refresh_source = None
+        gobject.io_add_watch(self.mixer.event_fd, gobject.IO_IN, self.on_mixer_events)
 
-        gobject.timeout_add(50, self.midi_events_check)
+        self.lash_client = lash_client
+        if self.lash_client:
+            gobject.timeout_add(200, self.lash_check_events)
 
 
     def on_delete_event(self, widget, event):
@@ -262,7 +274,7 @@ class JackMixer(SerializedObject):
     def sighandler(self, signum, frame):
         #print "Signal %d received" % signum
         if signum == signal.SIGUSR1:
-            self.save = True
+            gobject.idle_add(self.save_on_signal)
         elif signum == signal.SIGTERM:
             gtk.main_quit()
         elif signum == signal.SIGINT:
@@ -305,6 +317,21 @@ class JackMixer(SerializedObject):
                 f.close()
         dlg.destroy()
 
+    def on_reload_cb(self, *args):
+        if not self.current_filename:
+            return self.on_open_cb()
+        try:
+            with file(self.current_filename, 'r') as f:
+                self.reload_from_xml(f)
+        except (IOError, ExpatError, ValueError, RuntimeError), e:
+            err = gtk.MessageDialog(self.window,
+                        gtk.DIALOG_MODAL,
+                        gtk.MESSAGE_ERROR,
+                        gtk.BUTTONS_OK,
+                        "Failed reloading settings (%s)" % str(e))
+            err.run()
+            err.destroy()
+
     def on_save_cb(self, *args):
         if not self.current_filename:
             return self.on_save_as_cb()
@@ -377,6 +404,8 @@ class JackMixer(SerializedObject):
             if self.channels[i] is channel:
                 channel.unrealize()
                 del self.channels[i]
+                if self.channels_by_name.get(channel.channel_name) is channel:
+                    del self.channels_by_name[channel.channel_name]
                 self.hbox_inputs.remove(channel.parent)
                 break
         if len(self.channels) == 0:
@@ -411,7 +440,10 @@ class JackMixer(SerializedObject):
         if (container.get_label() == parameters['oldname']):
             container.set_label(parameters['newname'])
 
-    def on_channel_rename(self, oldname, newname):
+    def on_channel_rename(self, oldname, newname, channel=None):
+        if channel is not None and self.channels_by_name.get(oldname) is channel:
+            del self.channels_by_name[oldname]
+            self.channels_by_name[newname] = channel
         rename_parameters = { 'oldname' : oldname, 'newname' : newname }
         self.channel_edit_input_menu.foreach(self.rename_channels,
             rename_parameters)
@@ -432,6 +464,7 @@ class JackMixer(SerializedObject):
             channel.unrealize()
             self.hbox_inputs.remove(channel.parent)
         self.channels = []
+        self.channels_by_name = {}
         self.output_channels = []
         self.channel_edit_input_menu = gtk.Menu()
         self.channel_edit_input_menu_item.set_submenu(self.channel_edit_input_menu)
@@ -446,9 +479,10 @@ class JackMixer(SerializedObject):
         self.channel_remove_output_menu_item.set_submenu(self.channel_remove_output_menu)
         self.channel_remove_output_menu_item.set_sensitive(False)
 
-    def add_channel(self, name, stereo, volume_cc, balance_cc, mute_cc, solo_cc):
+    def add_channel(self, name, stereo, volume_cc, balance_cc, mute_cc, solo_cc, player_file=None):
         try:
             channel = InputChannel(self, name, stereo)
+            channel.player_file = player_file
             self.add_channel_precreated(channel)
         except Exception:
             err = gtk.MessageDialog(self.window,
@@ -489,6 +523,7 @@ class JackMixer(SerializedObject):
         self.channel_remove_input_menu_item.set_sensitive(True)
 
         self.channels.append(channel)
+        self.channels_by_name[channel.channel_name] = channel
 
         for outputchannel in self.output_channels:
             channel.add_control_group(outputchannel)
@@ -499,22 +534,75 @@ class JackMixer(SerializedObject):
         channel.post_fader_output_channel.volume = 0
         channel.post_fader_output_channel.set_solo(channel.channel, True)
 
-    def read_meters(self):
+    def on_inputs_scrolled(self, *args):
+        # strips scrolled out of the viewport are neither polled nor redrawn
+        adjustment = self.scrolled_window.get_hadjustment()
+        left = adjustment.get_value()
+        right = left + adjustment.get_page_size()
         for channel in self.channels:
-            channel.read_meter()
-        for channel in self.output_channels:
-            channel.read_meter()
+            allocation = channel.parent.get_allocation()
+            visible = allocation.x < right and allocation.x + allocation.width > left
+            if visible == channel.visible:
+                continue
+            channel.visible = visible
+            channel.set_metered(visible)
+            if visible:
+                channel.read_meter()
+
+    meters_refresh_interval = 1.0 / 60 # display rate
+
+    def on_mixer_events(self, fd, condition):
+        events = self.mixer.read_events()
+        if events & jack_mixer_c.EVENT_MIDI:
+            self.midi_events_check()
+        if events & jack_mixer_c.EVENT_OVERLOAD:
+            self.report_overload()
+        if events & jack_mixer_c.EVENT_METERS and not self.meters_refresh_source:
+            delay = self.meters_refresh_time + self.meters_refresh_interval - time.time()
+            if delay <= 0:
+                self.read_meters()
+            else:
+                self.meters_refresh_source = gobject.timeout_add(int(delay * 1000) + 1, self.read_meters)
         return True
 
+    shed_names = {
+        jack_mixer_c.SHED_NONE: 'nothing',
+        jack_mixer_c.SHED_INPUT_METERS: 'input meters',
+        jack_mixer_c.SHED_OUTPUT_METERS: 'input and output meters',
+        jack_mixer_c.SHED_MIDI_FEEDBACK: 'meters and MIDI feedback',
+    }
+
+    def report_overload(self):
+        for level, load, frame_time in self.mixer.read_overload_transitions():
+            sys.stderr.write('Engine load %d%% of period, shedding %s\n' %
+                             (load * 100, self.shed_names.get(level, level)))
+
+    def read_meters(self):
+        self.meters_refresh_source = None
+        self.meters_refresh_time = time.time()
+        # one call per meter scale and height converts all meters to pixels
+        groups = {}
+        for channel in self.channels + self.output_channels:
+            if channel.channel and channel.visible:
+                key = (channel.meter.scale, int(channel.meter.height))
+                groups.setdefault(key, []).append(channel)
+        for (scale, height), channels in groups.items():
+            pixels = jack_mixer_c.meters_to_pixels(scale.scale, height,
+                            [x.channel for x in channels])
+            for channel, channel_pixels in zip(channels, pixels):
+                channel.read_meter(channel_pixels)
+        return False
+
     def midi_events_check(self):
         for channel in self.channels + self.output_channels:
             channel.midi_events_check()
         return True
 
-    def add_output_channel(self, name, stereo, volume_cc, balance_cc, mute_cc, display_solo_buttons):
+    def add_output_channel(self, name, stereo, volume_cc, balance_cc, mute_cc, display_solo_buttons, double_precision=False):
         try:
             channel = OutputChannel(self, name, stereo)
             channel.display_solo_buttons = display_solo_buttons
+            channel.future_double_precision = double_precision
             self.add_output_channel_precreated(channel)
         except Exception:
             err = gtk.MessageDialog(self.window,
@@ -560,37 +648,14 @@ class JackMixer(SerializedObject):
             if channel.channel.name == self._monitored_channel.channel.name:
                 return
         self._monitored_channel = channel
-        if type(channel) is InputChannel:
-            # reset all solo/mute settings
-            for in_channel in self.channels:
-                self.monitor_channel.set_solo(in_channel.channel, False)
-                self.monitor_channel.set_muted(in_channel.channel, False)
-            self.monitor_channel.set_solo(channel.channel, True)
-            self.monitor_channel.prefader = True
-        else:
-            self.monitor_channel.prefader = False
-        self.update_monitor(channel)
+        # the engine follows its routing and fader, inputs are heard pre
+        # fader unless muted
+        self.monitor_channel.set_monitor_source(channel.channel,
+                                                type(channel) is InputChannel)
     monitored_channel = property(get_monitored_channel, set_monitored_channel)
 
-    def update_monitor(self, channel):
-        if self.monitored_channel is not channel:
-            return
-        self.monitor_channel.volume = channel.channel.volume
-        self.monitor_channel.balance = channel.channel.balance
-        self.monitor_channel.out_mute = channel.channel.out_mute
-        if type(self.monitored_channel) is OutputChannel:
-            # sync solo/muted channels
-            for input_channel in self.channels:
-                self.monitor_channel.set_solo(input_channel.channel,
-                                channel.channel.is_solo(input_channel.channel))
-                self.monitor_channel.set_muted(input_channel.channel,
-                                channel.channel.is_muted(input_channel.channel))
-
     def get_input_channel_by_name(self, name):
-        for input_channel in self.channels:
-            if input_channel.channel.name == name:
-                return input_channel
-        return None
+        return self.channels_by_name.get(name)
 
     def on_about(self, *args):
         about = gtk.AboutDialog()
@@ -618,20 +683,23 @@ Franklin Street, Fifth Floor, Boston, MA 02110-130159 USA''')
         about.run()
         about.destroy()
 
-    def lash_check_events(self):
-        if self.save:
-            self.save = False
-            if self.current_filename:
-                print "saving on SIGUSR1 request"
-                self.on_save_cb()
-                print "save done"
-            else:
-                print "not saving because filename is not known"
-            return True
+    def save_on_signal(self):
+        if self.current_filename:
+            print "saving on SIGUSR1 request"
+            self.on_save_cb()
+            print "save done"
+        else:
+            print "not saving because filename is not known"
+        return False
 
-        if not self.lash_client:
-            return True
+    def release_unclaimed_state(self):
+        '''Forget state file records of channels the session did not bring
+           back, once it is loaded'''
+        if self.state_attached:
+            self.mixer.state_release_unclaimed()
+            self.state_attached = False
 
+    def lash_check_events(self):
         while lash.lash_get_pending_event_count(self.lash_client):
             event = lash.lash_get_event(self.lash_client)
 
@@ -655,8 +723,9 @@ Franklin Street, Fifth Floor, Boston, MA 02110-130159 USA''')
                 print "jack_mixer: LASH ordered to restore data from directory %s" % directory
                 filename = directory + os.sep + "jack_mixer.xml"
                 f = file(filename, "r")
-                self.load_from_xml(f, silence_errors=True)
+                self.reload_from_xml(f, silence_errors=True)
                 f.close()
+                self.release_unclaimed_state()
                 lash.lash_send_event(self.lash_client, event)
             else:
                 print "jack_mixer: Got unhandled LASH event, type " + str(event_type)
@@ -700,6 +769,98 @@ Franklin Street, Fifth Floor, Boston, MA 02110-130159 USA''')
         del self.unserialized_channels
         self.window.show_all()
 
+    def find_menuitem(self, menu, label):
+        for item in menu.get_children():
+            if item.get_label() == label:
+                return item
+        return None
+
+    def match_channels(self, live_channels, new_channels):
+        '''Pair live channels with channels of a session, by name, and then
+           remaining ones in order when both are mono or both stereo, these
+           get renamed. Returns pairs, live channels to remove and session
+           channels to add.'''
+        new_by_name = dict([(x.channel_name, x) for x in new_channels])
+        pairs = []
+        unmatched = []
+        for channel in live_channels:
+            new_channel = new_by_name.get(channel.channel_name)
+            if new_channel is not None and new_channel.stereo == channel.stereo:
+                pairs.append((channel, new_channel))
+            else:
+                unmatched.append(channel)
+        paired = [x[1] for x in pairs]
+        added = [x for x in new_channels if x not in paired]
+        removed = []
+        for channel in unmatched:
+            for new_channel in added:
+                if new_channel.stereo == channel.stereo:
+                    pairs.append((channel, new_channel))
+                    added.remove(new_channel)
+                    break
+            else:
+                removed.append(channel)
+        return pairs, removed, added
+
+    def unused_channel_name(self, taken):
+        '''Channel name not in taken, nor its post fader output name, which
+           gets added to taken'''
+        i = 1
+        while True:
+            name = 'Renaming %u' % i
+            if name not in taken and name + ' Out' not in taken:
+                taken.add(name)
+                return name
+            i += 1
+
+    def reload_from_xml(self, file, silence_errors=False):
+        '''Apply session to the running mixer, only channels that are not
+           in the session anymore are removed and only new ones added,
+           others keep their ports, connections and meters'''
+        self.unserialized_channels = []
+        b = XmlSerialization()
+        try:
+            b.load(file)
+        except:
+            if silence_errors:
+                return
+            raise
+        s = Serializator()
+        s.unserialize(self, b)
+        new_inputs = [x for x in self.unserialized_channels if isinstance(x, InputChannel)]
+        new_outputs = [x for x in self.unserialized_channels if isinstance(x, OutputChannel)]
+        del self.unserialized_channels
+
+        input_pairs, removed_inputs, added_inputs = self.match_channels(self.channels, new_inputs)
+        output_pairs, removed_outputs, added_outputs = self.match_channels(self.output_channels, new_outputs)
+
+        for channel in removed_outputs:
+            self.on_remove_output_channel(
+                self.find_menuitem(self.channel_remove_output_menu, channel.channel_name), channel)
+        for channel in removed_inputs:
+            self.on_remove_input_channel(
+                self.find_menuitem(self.channel_remove_input_menu, channel.channel_name), channel)
+
+        # a channel may be renamed to the name of another one that is renamed
+        # later, so names get swapped through ones no channel has
+        renamed = [x for x in input_pairs + output_pairs if x[0].channel_name != x[1].channel_name]
+        taken = set([x.channel_name for x in self.channels + self.output_channels + new_inputs + new_outputs])
+        for channel, new_channel in renamed:
+            channel.channel_name = self.unused_channel_name(taken)
+
+        frame_time = self.mixer.frame_time
+        for channel, new_channel in input_pairs:
+            channel.reload_from(new_channel, frame_time)
+        for channel in added_inputs:
+            self.add_channel_precreated(channel)
+        for channel, new_channel in output_pairs:
+            channel.reload_from(new_channel, frame_time)
+        for channel in added_outputs:
+            self.add_output_channel_precreated(channel)
+
+        self._init_solo_channels = None
+        self.window.show_all()
+
     def serialize(self, object_backend):
         object_backend.add_property('geometry',
                         '%sx%s' % (self.window.allocation.width, self.window.allocation.height))
@@ -770,6 +931,14 @@ def main():
     parser = OptionParser(usage='usage: %prog [options] [jack_client_name]')
     parser.add_option('-c', '--config', dest='config',
                       help='use a non default configuration file')
+    parser.add_option('-s', '--state', dest='state',
+                      help='keep engine state in this file, and restore it from there on restart')
+    parser.add_option('--capture', dest='capture',
+                      help='capture engine input and output into this file, for offline replay')
+    parser.add_option('--workers', dest='workers', type='int', default=0,
+                      help='mix channels in parallel on this many extra threads')
+    parser.add_option('--shards', dest='shards', type='int', default=0,
+                      help='mix output channels in this many extra JACK clients, for jackd2 to run in parallel')
     # --no-lash here is not acted upon, it is specified for completeness when
     # --help is passed.
     parser.add_option('--no-lash', dest='nolash', action='store_true',
@@ -795,8 +964,11 @@ def main():
     if not name:
         name = "jack_mixer"
 
+    if options.workers > 0:
+        jack_mixer_c.set_worker_threads(options.workers, True)
+
     try:
-        mixer = JackMixer(name, lash_client)
+        mixer = JackMixer(name, lash_client, options.state, options.shards)
     except Exception, e:
         err = gtk.MessageDialog(None,
                             gtk.DIALOG_MODAL,
@@ -807,6 +979,19 @@ def main():
         err.destroy()
         sys.exit(1)
 
+    if options.capture:
+        try:
+            mixer.mixer.capture_start(options.capture)
+        except RuntimeError, e:
+            # mixer is usable without capture, keep running
+            err = gtk.MessageDialog(None,
+                                gtk.DIALOG_MODAL,
+                                gtk.MESSAGE_ERROR,
+                                gtk.BUTTONS_OK,
+                                "Capture to %s failed (%s)" % (options.capture, str(e)))
+            err.run()
+            err.destroy()
+
     if options.config:
         f = file(options.config)
         mixer.current_filename = options.config
@@ -823,6 +1008,10 @@ def main():
         mixer.window.set_default_size(60*(1+len(mixer.channels)+len(mixer.output_channels)), 300)
         f.close()
 
+    # under LASH the session comes with its restore event
+    if options.config or not mixer.lash_client:
+        mixer.release_unclaimed_state()
+
     mixer.main()
 
     mixer.cleanup()
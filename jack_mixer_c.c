@@ -24,9 +24,27 @@
 #include <stdbool.h>
 
 #include <structmember.h>
+#include <pythread.h>
 
 #include "jack_mixer.h"
 
+/* Engine calls that may wait on jackd, or on the process callback, run
+ * without the GIL: other Python threads go on meanwhile, and the process
+ * callback can take the GIL for MIDI change callbacks. Such calls add,
+ * remove and rename channels, which the engine does not expect from two
+ * threads at once, so they are serialized by engine_lock instead. Solo
+ * and mute changes take it too, removal of a channel changes the same
+ * lists. Nothing Python is touched between the two macros. */
+static PyThread_type_lock engine_lock;
+
+#define BEGIN_ENGINE_CALL \
+	Py_BEGIN_ALLOW_THREADS \
+	PyThread_acquire_lock(engine_lock, WAIT_LOCK);
+
+#define END_ENGINE_CALL \
+	PyThread_release_lock(engine_lock); \
+	Py_END_ALLOW_THREADS
+
 
 /** Scale Type **/
 
@@ -274,11 +292,13 @@ Channel_get_solo(ChannelObject *self, void *closure)
 static int
 Channel_set_solo(ChannelObject *self, PyObject *value, void *closure)
 {
+	BEGIN_ENGINE_CALL
 	if (value == Py_True) {
 		channel_solo(self->channel);
 	} else {
 		channel_unsolo(self->channel);
 	}
+	END_ENGINE_CALL
 	return 0;
 }
 
@@ -318,6 +338,23 @@ Channel_set_abspeak(ChannelObject *self, PyObject *value, void *closure)
 	return 0;
 }
 
+static PyObject*
+Channel_get_clip_count(ChannelObject *self, void *closure)
+{
+	return PyInt_FromLong(channel_clip_count_read(self->channel));
+}
+
+static int
+Channel_set_clip_count(ChannelObject *self, PyObject *value, void *closure)
+{
+	if (value != Py_None) {
+		fprintf(stderr, "clip_count can only be reset (set to None)\n");
+		return -1;
+	}
+	channel_clip_count_reset(self->channel);
+	return 0;
+}
+
 static int
 Channel_set_midi_scale(ChannelObject *self, PyObject *value, void *closure)
 {
@@ -383,7 +420,15 @@ Channel_get_name(ChannelObject *self, void *closure)
 static int
 Channel_set_name(ChannelObject *self, PyObject *value, void *closure)
 {
-	channel_rename(self->channel, PyString_AsString(value));
+	char *name;
+
+	name = PyString_AsString(value);
+	if (name == NULL) return -1;
+
+	BEGIN_ENGINE_CALL
+	channel_rename(self->channel, name);
+	END_ENGINE_CALL
+
 	return 0;
 }
 
@@ -493,6 +538,157 @@ Channel_get_midi_in_got_events(ChannelObject *self, void *closure)
 	return result;
 }
 
+static PyObject*
+Channel_get_agc(ChannelObject *self, void *closure)
+{
+	PyObject *result;
+
+	if (channel_is_agc_enabled(self->channel)) {
+		result = Py_True;
+	} else {
+		result = Py_False;
+	}
+	Py_INCREF(result);
+	return result;
+}
+
+static int
+Channel_set_agc(ChannelObject *self, PyObject *value, void *closure)
+{
+	channel_agc_enable(self->channel, value == Py_True);
+	return 0;
+}
+
+static PyObject*
+Channel_get_agc_target(ChannelObject *self, void *closure)
+{
+	return PyFloat_FromDouble(channel_agc_target_read(self->channel));
+}
+
+static int
+Channel_set_agc_target(ChannelObject *self, PyObject *value, void *closure)
+{
+	channel_agc_configure(self->channel, PyFloat_AsDouble(value),
+			channel_agc_max_gain_read(self->channel),
+			channel_agc_gate_read(self->channel));
+	return 0;
+}
+
+static PyObject*
+Channel_get_agc_max_gain(ChannelObject *self, void *closure)
+{
+	return PyFloat_FromDouble(channel_agc_max_gain_read(self->channel));
+}
+
+static int
+Channel_set_agc_max_gain(ChannelObject *self, PyObject *value, void *closure)
+{
+	channel_agc_configure(self->channel, channel_agc_target_read(self->channel),
+			PyFloat_AsDouble(value),
+			channel_agc_gate_read(self->channel));
+	return 0;
+}
+
+static PyObject*
+Channel_get_agc_gate(ChannelObject *self, void *closure)
+{
+	return PyFloat_FromDouble(channel_agc_gate_read(self->channel));
+}
+
+static int
+Channel_set_agc_gate(ChannelObject *self, PyObject *value, void *closure)
+{
+	channel_agc_configure(self->channel, channel_agc_target_read(self->channel),
+			channel_agc_max_gain_read(self->channel),
+			PyFloat_AsDouble(value));
+	return 0;
+}
+
+static PyObject*
+Channel_get_agc_gain(ChannelObject *self, void *closure)
+{
+	return PyFloat_FromDouble(channel_agc_gain_read(self->channel));
+}
+
+static PyObject*
+Channel_get_delay(ChannelObject *self, void *closure)
+{
+	return PyFloat_FromDouble(channel_get_delay(self->channel));
+}
+
+static int
+Channel_set_delay(ChannelObject *self, PyObject *value, void *closure)
+{
+	if (!channel_set_delay(self->channel, PyFloat_AsDouble(value))) {
+		PyErr_SetString(PyExc_RuntimeError, "value out of range");
+		return -1;
+	}
+	return 0;
+}
+
+static PyObject*
+Channel_get_delay_auto(ChannelObject *self, void *closure)
+{
+	PyObject *result;
+
+	if (channel_is_delay_auto(self->channel)) {
+		result = Py_True;
+	} else {
+		result = Py_False;
+	}
+	Py_INCREF(result);
+	return result;
+}
+
+static int
+Channel_set_delay_auto(ChannelObject *self, PyObject *value, void *closure)
+{
+	channel_set_delay_auto(self->channel, value == Py_True);
+	return 0;
+}
+
+static PyObject*
+Channel_get_is_player(ChannelObject *self, void *closure)
+{
+	PyObject *result;
+
+	if (channel_is_player(self->channel)) {
+		result = Py_True;
+	} else {
+		result = Py_False;
+	}
+	Py_INCREF(result);
+	return result;
+}
+
+static PyObject*
+Channel_get_playing(ChannelObject *self, void *closure)
+{
+	PyObject *result;
+
+	if (channel_is_playing(self->channel)) {
+		result = Py_True;
+	} else {
+		result = Py_False;
+	}
+	Py_INCREF(result);
+	return result;
+}
+
+static PyObject*
+Channel_get_restored(ChannelObject *self, void *closure)
+{
+	PyObject *result;
+
+	if (channel_is_restored(self->channel)) {
+		result = Py_True;
+	} else {
+		result = Py_False;
+	}
+	Py_INCREF(result);
+	return result;
+}
+
 static PyGetSetDef Channel_getseters[] = {
 	{"is_stereo",
 		(getter)Channel_get_is_stereo, NULL,
@@ -515,6 +711,9 @@ static PyGetSetDef Channel_getseters[] = {
 	{"abspeak",
 		(getter)Channel_get_abspeak, (setter)Channel_set_abspeak,
 		"balance", NULL},
+	{"clip_count",
+		(getter)Channel_get_clip_count, (setter)Channel_set_clip_count,
+		"Clipped frames since reset, counted while subscribed to METER_CLIP", NULL},
 	{"midi_scale",
 		NULL, (setter)Channel_set_midi_scale,
 		"midi scale", NULL},
@@ -545,6 +744,36 @@ static PyGetSetDef Channel_getseters[] = {
 	{"midi_in_got_events",
 		(getter)Channel_get_midi_in_got_events, NULL,
 		"Got new MIDI IN events", NULL},
+	{"restored",
+		(getter)Channel_get_restored, NULL,
+		"Restored from state file", NULL},
+	{"agc",
+		(getter)Channel_get_agc, (setter)Channel_set_agc,
+		"Automatic gain enabled", NULL},
+	{"agc_target",
+		(getter)Channel_get_agc_target, (setter)Channel_set_agc_target,
+		"Automatic gain target level, dBFS", NULL},
+	{"agc_max_gain",
+		(getter)Channel_get_agc_max_gain, (setter)Channel_set_agc_max_gain,
+		"Automatic gain maximum, dB", NULL},
+	{"agc_gate",
+		(getter)Channel_get_agc_gate, (setter)Channel_set_agc_gate,
+		"Automatic gain gate level, dBFS", NULL},
+	{"agc_gain",
+		(getter)Channel_get_agc_gain, NULL,
+		"Current automatic gain, dB", NULL},
+	{"delay",
+		(getter)Channel_get_delay, (setter)Channel_set_delay,
+		"Delay before fader in effect, ms", NULL},
+	{"delay_auto",
+		(getter)Channel_get_delay_auto, (setter)Channel_set_delay_auto,
+		"Delay follows port latencies", NULL},
+	{"is_player",
+		(getter)Channel_get_is_player, NULL,
+		"Channel plays a file instead of having ports", NULL},
+	{"playing",
+		(getter)Channel_get_playing, NULL,
+		"Player is playing its file", NULL},
 	{NULL}
 };
 
@@ -552,7 +781,9 @@ static PyObject*
 Channel_remove(ChannelObject *self, PyObject *args)
 {
 	if (! PyArg_ParseTuple(args, "")) return NULL;
+	BEGIN_ENGINE_CALL
 	remove_channel(self->channel);
+	END_ENGINE_CALL
 	Py_INCREF(Py_None);
 	return Py_None;
 }
@@ -566,9 +797,113 @@ Channel_autoset_midi_cc(ChannelObject *self, PyObject *args)
 	return Py_None;
 }
 
+static PyObject*
+Channel_meter_subscribe(ChannelObject *self, PyObject *args)
+{
+	unsigned int meters;
+
+	if (! PyArg_ParseTuple(args, "I", &meters)) return NULL;
+	channel_meter_subscribe(self->channel, meters);
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+static PyObject*
+Channel_meter_unsubscribe(ChannelObject *self, PyObject *args)
+{
+	unsigned int meters;
+
+	if (! PyArg_ParseTuple(args, "I", &meters)) return NULL;
+	channel_meter_unsubscribe(self->channel, meters);
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+static PyObject*
+Channel_scheduled_result(bool result)
+{
+	if (!result) {
+		PyErr_SetString(PyExc_RuntimeError, "too many scheduled events");
+		return NULL;
+	}
+
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+static PyObject*
+Channel_volume_write_at(ChannelObject *self, PyObject *args)
+{
+	double volume;
+	unsigned int frame_time;
+
+	if (! PyArg_ParseTuple(args, "dI", &volume, &frame_time)) return NULL;
+
+	return Channel_scheduled_result(channel_volume_write_at(self->channel, volume, frame_time));
+}
+
+static PyObject*
+Channel_balance_write_at(ChannelObject *self, PyObject *args)
+{
+	double balance;
+	unsigned int frame_time;
+
+	if (! PyArg_ParseTuple(args, "dI", &balance, &frame_time)) return NULL;
+
+	return Channel_scheduled_result(channel_balance_write_at(self->channel, balance, frame_time));
+}
+
+static PyObject*
+Channel_out_mute_write_at(ChannelObject *self, PyObject *args)
+{
+	unsigned char out_mute;
+	unsigned int frame_time;
+
+	if (! PyArg_ParseTuple(args, "bI", &out_mute, &frame_time)) return NULL;
+
+	return Channel_scheduled_result(channel_out_mute_write_at(self->channel, out_mute, frame_time));
+}
+
+static PyObject*
+Channel_play_at(ChannelObject *self, PyObject *args)
+{
+	unsigned int frame_time;
+
+	if (! PyArg_ParseTuple(args, "I", &frame_time)) return NULL;
+
+	if (!channel_is_player(self->channel)) {
+		PyErr_SetString(PyExc_RuntimeError, "not a player channel");
+		return NULL;
+	}
+
+	return Channel_scheduled_result(channel_play_at(self->channel, frame_time));
+}
+
+static PyObject*
+Channel_stop_at(ChannelObject *self, PyObject *args)
+{
+	unsigned int frame_time;
+
+	if (! PyArg_ParseTuple(args, "I", &frame_time)) return NULL;
+
+	if (!channel_is_player(self->channel)) {
+		PyErr_SetString(PyExc_RuntimeError, "not a player channel");
+		return NULL;
+	}
+
+	return Channel_scheduled_result(channel_stop_at(self->channel, frame_time));
+}
+
 static PyMethodDef channel_methods[] = {
 	{"remove", (PyCFunction)Channel_remove, METH_VARARGS, "Remove"},
 	{"autoset_midi_cc", (PyCFunction)Channel_autoset_midi_cc, METH_VARARGS, "Autoset MIDI CC"},
+	{"volume_write_at", (PyCFunction)Channel_volume_write_at, METH_VARARGS, "Set volume at JACK frame time"},
+	{"balance_write_at", (PyCFunction)Channel_balance_write_at, METH_VARARGS, "Set balance at JACK frame time"},
+	{"out_mute_write_at", (PyCFunction)Channel_out_mute_write_at, METH_VARARGS, "Set out mute at JACK frame time"},
+	{"play_at", (PyCFunction)Channel_play_at, METH_VARARGS, "Start playing file from its start at JACK frame time"},
+	{"stop_at", (PyCFunction)Channel_stop_at, METH_VARARGS, "Stop playing file at JACK frame time"},
+	{"meter_subscribe", (PyCFunction)Channel_meter_subscribe, METH_VARARGS, "Start metering, mask of METER_* constants"},
+	{"meter_unsubscribe", (PyCFunction)Channel_meter_unsubscribe, METH_VARARGS, "Stop metering, mask of METER_* constants"},
 	{NULL}
 };
 
@@ -659,10 +994,34 @@ OutputChannel_get_prefader(OutputChannelObject *self, void *closure)
 	return result;
 }
 
+static int
+OutputChannel_set_double_precision(OutputChannelObject *self, PyObject *value, void *closure)
+{
+	output_channel_set_double_precision(self->output_channel, value == Py_True);
+	return 0;
+}
+
+static PyObject*
+OutputChannel_get_double_precision(OutputChannelObject *self, void *closure)
+{
+	PyObject *result;
+
+	if (output_channel_is_double_precision(self->output_channel)) {
+		result = Py_True;
+	} else {
+		result = Py_False;
+	}
+	Py_INCREF(result);
+	return result;
+}
+
 static PyGetSetDef OutputChannel_getseters[] = {
 	{"prefader",
 		(getter)OutputChannel_get_prefader, (setter)OutputChannel_set_prefader,
 		"prefader", NULL},
+	{"double_precision",
+		(getter)OutputChannel_get_double_precision, (setter)OutputChannel_set_double_precision,
+		"Sum inputs in double precision", NULL},
 	{NULL}
 };
 
@@ -670,7 +1029,9 @@ static PyObject*
 OutputChannel_remove(OutputChannelObject *self, PyObject *args)
 {
 	if (! PyArg_ParseTuple(args, "")) return NULL;
+	BEGIN_ENGINE_CALL
 	remove_output_channel(self->output_channel);
+	END_ENGINE_CALL
 	Py_INCREF(Py_None);
 	return Py_None;
 }
@@ -683,9 +1044,11 @@ OutputChannel_set_solo(OutputChannelObject *self, PyObject *args)
 
 	if (! PyArg_ParseTuple(args, "Ob", &channel, &solo)) return NULL;
 
+	BEGIN_ENGINE_CALL
 	output_channel_set_solo(self->output_channel,
 			((ChannelObject*)channel)->channel,
 			solo);
+	END_ENGINE_CALL
 
 	Py_INCREF(Py_None);
 	return Py_None;
@@ -699,14 +1062,30 @@ OutputChannel_set_muted(OutputChannelObject *self, PyObject *args)
 
 	if (! PyArg_ParseTuple(args, "Ob", &channel, &muted)) return NULL;
 
+	BEGIN_ENGINE_CALL
 	output_channel_set_muted(self->output_channel,
 			((ChannelObject*)channel)->channel,
 			muted);
+	END_ENGINE_CALL
 
 	Py_INCREF(Py_None);
 	return Py_None;
 }
 
+static PyObject*
+OutputChannel_set_muted_at(OutputChannelObject *self, PyObject *args)
+{
+	PyObject *channel;
+	unsigned char muted;
+	unsigned int frame_time;
+
+	if (! PyArg_ParseTuple(args, "ObI", &channel, &muted, &frame_time)) return NULL;
+
+	return Channel_scheduled_result(output_channel_set_muted_at(self->output_channel,
+			((ChannelObject*)channel)->channel,
+			muted, frame_time));
+}
+
 static PyObject*
 OutputChannel_is_solo(OutputChannelObject *self, PyObject *args)
 {
@@ -745,12 +1124,40 @@ OutputChannel_is_muted(OutputChannelObject *self, PyObject *args)
 	return result;
 }
 
+static PyObject*
+OutputChannel_set_monitor_source(OutputChannelObject *self, PyObject *args)
+{
+	PyObject *channel;
+	unsigned char prefader = 0;
+	jack_mixer_channel_t source = NULL;
+
+	if (! PyArg_ParseTuple(args, "O|b", &channel, &prefader)) return NULL;
+
+	if (channel != Py_None) {
+		if (!PyObject_TypeCheck(channel, &ChannelType)) {
+			PyErr_SetString(PyExc_TypeError, "channel or None expected");
+			return NULL;
+		}
+		source = ((ChannelObject*)channel)->channel;
+	}
+
+	if (!output_channel_set_monitor_source(self->output_channel, source, prefader)) {
+		PyErr_SetString(PyExc_RuntimeError, "cannot monitor channel");
+		return NULL;
+	}
+
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
 static PyMethodDef output_channel_methods[] = {
 	{"remove", (PyCFunction)OutputChannel_remove, METH_VARARGS, "Remove"},
 	{"set_solo", (PyCFunction)OutputChannel_set_solo, METH_VARARGS, "Set a channel as solo"},
 	{"set_muted", (PyCFunction)OutputChannel_set_muted, METH_VARARGS, "Set a channel as muted"},
+	{"set_muted_at", (PyCFunction)OutputChannel_set_muted_at, METH_VARARGS, "Set a channel as muted at JACK frame time"},
 	{"is_solo", (PyCFunction)OutputChannel_is_solo, METH_VARARGS, "Is a channel set as solo"},
 	{"is_muted", (PyCFunction)OutputChannel_is_muted, METH_VARARGS, "Is a channel set as muted"},
+	{"set_monitor_source", (PyCFunction)OutputChannel_set_monitor_source, METH_VARARGS, "Play a channel, or None for own routing, from next cycle on"},
 	{NULL}
 };
 
@@ -819,8 +1226,13 @@ typedef struct {
 static void
 Mixer_dealloc(MixerObject *self)
 {
-	if (self->mixer)
-		destroy(self->mixer);
+	jack_mixer_t mixer = self->mixer;
+
+	if (mixer) {
+		BEGIN_ENGINE_CALL
+		destroy(mixer);
+		END_ENGINE_CALL
+	}
 	self->ob_type->tp_free((PyObject*)self);
 }
 
@@ -841,14 +1253,20 @@ Mixer_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
 static int
 Mixer_init(MixerObject *self, PyObject *args, PyObject *kwds)
 {
-	static char *kwlist[] = {"name", "stereo", NULL};
+	static char *kwlist[] = {"name", "stereo", "shards", NULL};
 	char *name;
 	int stereo = 1;
+	unsigned int shards = 0;
+	jack_mixer_t mixer;
 
-	if (!PyArg_ParseTupleAndKeywords(args, kwds, "s|b", kwlist, &name, &stereo))
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "s|bI", kwlist, &name, &stereo, &shards))
 		return -1;
 
-	self->mixer = create(name, (bool)stereo);
+	BEGIN_ENGINE_CALL
+	mixer = create_split(name, (bool)stereo, shards);
+	END_ENGINE_CALL
+
+	self->mixer = mixer;
 	if (self->mixer == NULL) {
 		PyErr_SetString(PyExc_RuntimeError,
 				"error creating mixer, probably jack is not running");
@@ -894,11 +1312,35 @@ Mixer_set_last_midi_channel(MixerObject *self, PyObject *value, void *closure)
 	return -1;
 }
 
+static PyObject*
+Mixer_get_frame_time(MixerObject *self, void *closure)
+{
+	return PyLong_FromUnsignedLong(mixer_get_frame_time(self->mixer));
+}
+
+static PyObject*
+Mixer_get_event_fd(MixerObject *self, void *closure)
+{
+	return PyInt_FromLong(mixer_get_event_fd(self->mixer));
+}
+
+static PyObject*
+Mixer_get_shed_level(MixerObject *self, void *closure)
+{
+	return PyInt_FromLong(mixer_get_shed_level(self->mixer));
+}
+
 static PyGetSetDef Mixer_getseters[] = {
 	{"channels_count", (getter)Mixer_get_channels_count, NULL,
 		"channels count", NULL},
 	{"last_midi_channel", (getter)Mixer_get_last_midi_channel, (setter)Mixer_set_last_midi_channel,
 		"last midi channel", NULL},
+	{"frame_time", (getter)Mixer_get_frame_time, NULL,
+		"current JACK frame time", NULL},
+	{"event_fd", (getter)Mixer_get_event_fd, NULL,
+		"file descriptor readable when there are events", NULL},
+	{"shed_level", (getter)Mixer_get_shed_level, NULL,
+		"optional work shed by overload governor, SHED_*", NULL},
 	{NULL}
 };
 
@@ -911,7 +1353,9 @@ Mixer_add_channel(MixerObject *self, PyObject *args)
 
 	if (! PyArg_ParseTuple(args, "si", &name, &stereo)) return NULL;
 
+	BEGIN_ENGINE_CALL
 	channel = add_channel(self->mixer, name, (bool)stereo);
+	END_ENGINE_CALL
 
 	if (channel == NULL) {
 		PyErr_SetString(PyExc_RuntimeError, "error adding channel");
@@ -922,36 +1366,520 @@ Mixer_add_channel(MixerObject *self, PyObject *args)
 }
 
 static PyObject*
-Mixer_add_output_channel(MixerObject *self, PyObject *args)
+Mixer_add_player_channel(MixerObject *self, PyObject *args)
 {
 	char *name;
-	int stereo = 1;
-	int system = 0;
-	jack_mixer_output_channel_t channel;
+	char *path;
+	jack_mixer_channel_t channel;
 
-	if (! PyArg_ParseTuple(args, "s|bb", &name, &stereo, &system)) return NULL;
+	if (! PyArg_ParseTuple(args, "ss", &name, &path)) return NULL;
 
-	channel = add_output_channel(self->mixer, name, (bool)stereo, (bool)system);
+	BEGIN_ENGINE_CALL
+	channel = add_player_channel(self->mixer, name, path);
+	END_ENGINE_CALL
 
-	return OutputChannel_New(channel);
+	if (channel == NULL) {
+		PyErr_SetString(PyExc_RuntimeError, "error adding player channel");
+		return NULL;
+	}
+
+	return Channel_New(channel);
+}
+
+static PyObject*
+Mixer_add_output_channel(MixerObject *self, PyObject *args)
+{
+	char *name;
+	int stereo = 1;
+	int system = 0;
+	jack_mixer_output_channel_t channel;
+
+	if (! PyArg_ParseTuple(args, "s|bb", &name, &stereo, &system)) return NULL;
+
+	BEGIN_ENGINE_CALL
+	channel = add_output_channel(self->mixer, name, (bool)stereo, (bool)system);
+	END_ENGINE_CALL
+
+	return OutputChannel_New(channel);
 }
 
 static PyObject*
 Mixer_destroy(MixerObject *self, PyObject *args)
 {
-	if (self->mixer) {
-		destroy(self->mixer);
+	jack_mixer_t mixer = self->mixer;
+
+	if (mixer) {
 		self->mixer = NULL;
+		BEGIN_ENGINE_CALL
+		destroy(mixer);
+		END_ENGINE_CALL
 	}
 	Py_INCREF(Py_None);
 	return Py_None;
 }
 
+static PyObject*
+Mixer_state_attach(MixerObject *self, PyObject *args)
+{
+	char *path;
+
+	if (! PyArg_ParseTuple(args, "s", &path)) return NULL;
+
+	if (!mixer_state_attach(self->mixer, path)) {
+		PyErr_SetString(PyExc_RuntimeError, "error attaching state file");
+		return NULL;
+	}
+
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+static PyObject*
+Mixer_state_release_unclaimed(MixerObject *self, PyObject *args)
+{
+	if (! PyArg_ParseTuple(args, "")) return NULL;
+
+	BEGIN_ENGINE_CALL
+	mixer_state_release_unclaimed(self->mixer);
+	END_ENGINE_CALL
+
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+static PyObject*
+Mixer_automation_record(MixerObject *self, PyObject *args)
+{
+	char *path;
+
+	if (! PyArg_ParseTuple(args, "s", &path)) return NULL;
+
+	if (!mixer_automation_record(self->mixer, path)) {
+		PyErr_SetString(PyExc_RuntimeError, "error starting automation recording");
+		return NULL;
+	}
+
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+static PyObject*
+Mixer_automation_play(MixerObject *self, PyObject *args)
+{
+	char *path;
+
+	if (! PyArg_ParseTuple(args, "s", &path)) return NULL;
+
+	if (!mixer_automation_play(self->mixer, path)) {
+		PyErr_SetString(PyExc_RuntimeError, "error starting automation playback");
+		return NULL;
+	}
+
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+static PyObject*
+Mixer_automation_stop(MixerObject *self, PyObject *args)
+{
+	if (! PyArg_ParseTuple(args, "")) return NULL;
+
+	/* waits for the process callback to let go of automation */
+	BEGIN_ENGINE_CALL
+	mixer_automation_stop(self->mixer);
+	END_ENGINE_CALL
+
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+static PyObject*
+Mixer_capture_start(MixerObject *self, PyObject *args)
+{
+	char *path;
+
+	if (! PyArg_ParseTuple(args, "s", &path)) return NULL;
+
+	if (!mixer_capture_start(self->mixer, path)) {
+		PyErr_SetString(PyExc_RuntimeError, "error starting capture");
+		return NULL;
+	}
+
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+static PyObject*
+Mixer_capture_stop(MixerObject *self, PyObject *args)
+{
+	if (! PyArg_ParseTuple(args, "")) return NULL;
+
+	BEGIN_ENGINE_CALL
+	mixer_capture_stop(self->mixer);
+	END_ENGINE_CALL
+
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+static PyObject*
+Mixer_find_channel(MixerObject *self, PyObject *args)
+{
+	char *name;
+	jack_mixer_channel_t channel;
+
+	if (! PyArg_ParseTuple(args, "s", &name)) return NULL;
+
+	/* channel index changes with channels added, removed and renamed */
+	BEGIN_ENGINE_CALL
+	channel = mixer_find_channel(self->mixer, name);
+	END_ENGINE_CALL
+	if (channel == NULL) {
+		Py_INCREF(Py_None);
+		return Py_None;
+	}
+
+	return Channel_New(channel);
+}
+
+static PyObject*
+Mixer_read_overload_transitions(MixerObject *self, PyObject *args)
+{
+	PyObject *list;
+	PyObject *item;
+	unsigned int level;
+	float load;
+	uint32_t frame_time;
+
+	if (! PyArg_ParseTuple(args, "")) return NULL;
+
+	list = PyList_New(0);
+	if (list == NULL) return NULL;
+
+	while (mixer_read_overload_transition(self->mixer, &level, &load, &frame_time)) {
+		item = Py_BuildValue("(idk)", level, (double)load, (unsigned long)frame_time);
+		if (item == NULL || PyList_Append(list, item) != 0) {
+			Py_XDECREF(item);
+			Py_DECREF(list);
+			return NULL;
+		}
+		Py_DECREF(item);
+	}
+
+	return list;
+}
+
+static PyObject*
+Mixer_read_events(MixerObject *self, PyObject *args)
+{
+	unsigned int events;
+
+	if (! PyArg_ParseTuple(args, "")) return NULL;
+
+	/* has JACK recompute latencies after routing changes */
+	BEGIN_ENGINE_CALL
+	events = mixer_read_events(self->mixer);
+	END_ENGINE_CALL
+
+	return PyInt_FromLong(events);
+}
+
+/* Bulk accessors read and write doubles in place, in a buffer of the
+ * caller such as array('d'), for a sequence of channels; polling many
+ * channels builds no Python objects then. */
+
+#define BULK_CHANNELS_MAX 512
+
+static PyObject *typecode_name; /* "typecode", of array objects */
+
+/* Doubles of object. view must be released with PyBuffer_Release() if
+ * view->obj is set; array('d') only has the old buffer interface. */
+static int
+bulk_get_values(PyObject *object, bool writable, Py_buffer *view, double **values_ptr, Py_ssize_t *count_ptr)
+{
+	void *buffer;
+	Py_ssize_t size;
+	PyObject *typecode;
+	bool doubles;
+
+	view->obj = NULL;
+
+	if (PyObject_CheckBuffer(object)) {
+		if (PyObject_GetBuffer(object, view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT | (writable ? PyBUF_WRITABLE : 0)) != 0)
+			return -1;
+		if (view->itemsize != sizeof(double) || (view->format != NULL && strcmp(view->format, "d") != 0)) {
+			PyBuffer_Release(view);
+			view->obj = NULL;
+			PyErr_SetString(PyExc_TypeError, "buffer must hold doubles");
+			return -1;
+		}
+		buffer = view->buf;
+		size = view->len;
+	} else {
+		/* no format with the old interface, arrays tell theirs */
+		typecode = PyObject_GetAttr(object, typecode_name);
+		if (typecode == NULL) {
+			PyErr_Clear();
+		} else {
+			doubles = PyString_Check(typecode) && strcmp(PyString_AS_STRING(typecode), "d") == 0;
+			Py_DECREF(typecode);
+			if (!doubles) {
+				PyErr_SetString(PyExc_TypeError, "buffer must hold doubles");
+				return -1;
+			}
+		}
+
+		if (writable) {
+			if (PyObject_AsWriteBuffer(object, &buffer, &size) != 0)
+				return -1;
+		} else {
+			if (PyObject_AsReadBuffer(object, (const void **)&buffer, &size) != 0)
+				return -1;
+		}
+	}
+
+	if (size % sizeof(double) != 0) {
+		if (view->obj != NULL) {
+			PyBuffer_Release(view);
+			view->obj = NULL;
+		}
+		PyErr_SetString(PyExc_TypeError, "buffer must hold doubles");
+		return -1;
+	}
+
+	*values_ptr = buffer;
+	*count_ptr = size / sizeof(double);
+	return 0;
+}
+
+/* channels of sequence into array, count of them or -1 on error */
+static Py_ssize_t
+bulk_get_channels(PyObject *channels, jack_mixer_channel_t *array)
+{
+	PyObject *sequence, *item;
+	Py_ssize_t i, count;
+
+	sequence = PySequence_Fast(channels, "channels must be a sequence");
+	if (sequence == NULL)
+		return -1;
+
+	count = PySequence_Fast_GET_SIZE(sequence);
+	if (count > BULK_CHANNELS_MAX) {
+		PyErr_Format(PyExc_ValueError, "at most %d channels at once", BULK_CHANNELS_MAX);
+		Py_DECREF(sequence);
+		return -1;
+	}
+
+	for (i = 0; i < count; i++) {
+		item = PySequence_Fast_GET_ITEM(sequence, i);
+		if (!PyObject_TypeCheck(item, &ChannelType)) {
+			PyErr_SetString(PyExc_TypeError, "channels must be Channel objects");
+			Py_DECREF(sequence);
+			return -1;
+		}
+		array[i] = ((ChannelObject*)item)->channel;
+	}
+
+	Py_DECREF(sequence);
+	return count;
+}
+
+/* fill buffer with per_channel values read by read for each channel */
+static PyObject*
+Mixer_bulk_read(PyObject *args, Py_ssize_t per_channel,
+		void (*read)(jack_mixer_channel_t channel, double *values))
+{
+	PyObject *channels, *buffer;
+	jack_mixer_channel_t array[BULK_CHANNELS_MAX];
+	Py_buffer view;
+	double *values;
+	Py_ssize_t i, count, size;
+
+	if (! PyArg_ParseTuple(args, "OO", &channels, &buffer)) return NULL;
+
+	count = bulk_get_channels(channels, array);
+	if (count < 0)
+		return NULL;
+
+	if (bulk_get_values(buffer, true, &view, &values, &size) != 0)
+		return NULL;
+
+	if (size < count * per_channel) {
+		PyErr_SetString(PyExc_ValueError, "buffer too small");
+	} else {
+		for (i = 0; i < count; i++)
+			read(array[i], values + i * per_channel);
+	}
+
+	if (view.obj != NULL)
+		PyBuffer_Release(&view);
+
+	if (PyErr_Occurred())
+		return NULL;
+
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+/* schedule values from buffer, one per channel, at frame time or now */
+static PyObject*
+Mixer_bulk_write(MixerObject *self, PyObject *args,
+		bool (*write)(jack_mixer_t mixer, const jack_mixer_channel_t *channels,
+			const double *values, unsigned int count, uint32_t frame_time))
+{
+	PyObject *channels, *buffer;
+	jack_mixer_channel_t array[BULK_CHANNELS_MAX];
+	Py_buffer view;
+	double *values;
+	Py_ssize_t count, size;
+	unsigned int frame_time;
+
+	frame_time = mixer_get_frame_time(self->mixer);
+	if (! PyArg_ParseTuple(args, "OO|I", &channels, &buffer, &frame_time)) return NULL;
+
+	count = bulk_get_channels(channels, array);
+	if (count < 0)
+		return NULL;
+
+	if (bulk_get_values(buffer, false, &view, &values, &size) != 0)
+		return NULL;
+
+	if (size < count) {
+		PyErr_SetString(PyExc_ValueError, "buffer too small");
+	} else if (!write(self->mixer, array, values, count, frame_time)) {
+		PyErr_SetString(PyExc_RuntimeError, "cannot schedule values");
+	}
+
+	if (view.obj != NULL)
+		PyBuffer_Release(&view);
+
+	if (PyErr_Occurred())
+		return NULL;
+
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+static void
+bulk_read_volume(jack_mixer_channel_t channel, double *values)
+{
+	values[0] = channel_volume_read(channel);
+}
+
+static void
+bulk_read_balance(jack_mixer_channel_t channel, double *values)
+{
+	values[0] = channel_balance_read(channel);
+}
+
+static void
+bulk_read_meter(jack_mixer_channel_t channel, double *values)
+{
+	if (channel_is_stereo(channel)) {
+		channel_stereo_meter_read(channel, values, values + 1);
+	} else {
+		channel_mono_meter_read(channel, values);
+		values[1] = values[0];
+	}
+}
+
+static void
+bulk_read_abspeak(jack_mixer_channel_t channel, double *values)
+{
+	values[0] = channel_abspeak_read(channel);
+}
+
+static void
+bulk_read_solo(jack_mixer_channel_t channel, double *values)
+{
+	values[0] = channel_is_soloed(channel) ? 1.0 : 0.0;
+}
+
+static void
+bulk_read_out_mute(jack_mixer_channel_t channel, double *values)
+{
+	values[0] = channel_is_out_muted(channel) ? 1.0 : 0.0;
+}
+
+static PyObject*
+Mixer_get_volumes(MixerObject *self, PyObject *args)
+{
+	return Mixer_bulk_read(args, 1, bulk_read_volume);
+}
+
+static PyObject*
+Mixer_get_balances(MixerObject *self, PyObject *args)
+{
+	return Mixer_bulk_read(args, 1, bulk_read_balance);
+}
+
+static PyObject*
+Mixer_get_meters(MixerObject *self, PyObject *args)
+{
+	return Mixer_bulk_read(args, 2, bulk_read_meter);
+}
+
+static PyObject*
+Mixer_get_abspeaks(MixerObject *self, PyObject *args)
+{
+	return Mixer_bulk_read(args, 1, bulk_read_abspeak);
+}
+
+static PyObject*
+Mixer_get_solos(MixerObject *self, PyObject *args)
+{
+	return Mixer_bulk_read(args, 1, bulk_read_solo);
+}
+
+static PyObject*
+Mixer_get_out_mutes(MixerObject *self, PyObject *args)
+{
+	return Mixer_bulk_read(args, 1, bulk_read_out_mute);
+}
+
+static PyObject*
+Mixer_set_volumes(MixerObject *self, PyObject *args)
+{
+	return Mixer_bulk_write(self, args, mixer_volumes_write_at);
+}
+
+static PyObject*
+Mixer_set_balances(MixerObject *self, PyObject *args)
+{
+	return Mixer_bulk_write(self, args, mixer_balances_write_at);
+}
+
+static PyObject*
+Mixer_set_out_mutes(MixerObject *self, PyObject *args)
+{
+	return Mixer_bulk_write(self, args, mixer_out_mutes_write_at);
+}
+
 static PyMethodDef Mixer_methods[] = {
 	{"add_channel", (PyCFunction)Mixer_add_channel, METH_VARARGS, "Add a new channel"},
+	{"add_player_channel", (PyCFunction)Mixer_add_player_channel, METH_VARARGS, "Add a new channel playing an audio file"},
 	{"add_output_channel", (PyCFunction)Mixer_add_output_channel, METH_VARARGS, "Add a new output channel"},
 	{"destroy", (PyCFunction)Mixer_destroy, METH_VARARGS, "Destroy JACK Mixer"},
 	{"client_name", (PyCFunction)Mixer_get_client_name, METH_VARARGS, "Get jack client name"},
+	{"state_attach", (PyCFunction)Mixer_state_attach, METH_VARARGS, "Mirror state into memory mapped file"},
+	{"state_release_unclaimed", (PyCFunction)Mixer_state_release_unclaimed, METH_VARARGS, "Forget state of channels not added again since attaching"},
+	{"find_channel", (PyCFunction)Mixer_find_channel, METH_VARARGS, "Find input channel by name or JACK port name"},
+	{"automation_record", (PyCFunction)Mixer_automation_record, METH_VARARGS, "Record automation to file, following JACK transport"},
+	{"automation_play", (PyCFunction)Mixer_automation_play, METH_VARARGS, "Play automation from file, following JACK transport"},
+	{"automation_stop", (PyCFunction)Mixer_automation_stop, METH_VARARGS, "Stop automation recording or playback"},
+	{"capture_start", (PyCFunction)Mixer_capture_start, METH_VARARGS, "Capture engine input and output to file, for offline replay"},
+	{"capture_stop", (PyCFunction)Mixer_capture_stop, METH_VARARGS, "Stop capture"},
+	{"read_events", (PyCFunction)Mixer_read_events, METH_VARARGS, "Read and clear pending events"},
+	{"read_overload_transitions", (PyCFunction)Mixer_read_overload_transitions, METH_VARARGS, "Read shed level changes, list of (level, load, frame time)"},
+	{"get_volumes", (PyCFunction)Mixer_get_volumes, METH_VARARGS, "Read volumes of channels, dB, into buffer of doubles"},
+	{"get_balances", (PyCFunction)Mixer_get_balances, METH_VARARGS, "Read balances of channels into buffer of doubles"},
+	{"get_meters", (PyCFunction)Mixer_get_meters, METH_VARARGS, "Read meters of channels, dBFS, left and right of each, into buffer of doubles"},
+	{"get_abspeaks", (PyCFunction)Mixer_get_abspeaks, METH_VARARGS, "Read absolute peaks of channels, dBFS, into buffer of doubles"},
+	{"get_solos", (PyCFunction)Mixer_get_solos, METH_VARARGS, "Read solo of channels, 1.0 or 0.0, into buffer of doubles"},
+	{"get_out_mutes", (PyCFunction)Mixer_get_out_mutes, METH_VARARGS, "Read out mute of channels, 1.0 or 0.0, into buffer of doubles"},
+	{"set_volumes", (PyCFunction)Mixer_set_volumes, METH_VARARGS, "Set volumes of channels, dB, from buffer of doubles, now or at JACK frame time"},
+	{"set_balances", (PyCFunction)Mixer_set_balances, METH_VARARGS, "Set balances of channels from buffer of doubles, now or at JACK frame time"},
+	{"set_out_mutes", (PyCFunction)Mixer_set_out_mutes, METH_VARARGS, "Set out mute of channels from buffer of doubles, nonzero mutes, now or at JACK frame time"},
 //	{"remove_channel", (PyCFunction)Mixer_remove_channel, METH_VARARGS, "Remove a channel"},
 	{NULL}
 };
@@ -999,7 +1927,92 @@ static PyTypeObject MixerType = {
 };
 
 
+static PyObject*
+meters_to_pixels(PyObject *self, PyObject *args)
+{
+	ScaleObject *scale;
+	unsigned int height;
+	PyObject *channels, *sequence, *result, *item;
+	Py_ssize_t i, count;
+	jack_mixer_channel_t channel;
+	double left, right;
+
+	if (! PyArg_ParseTuple(args, "O!IO", &ScaleType, &scale, &height, &channels)) return NULL;
+
+	sequence = PySequence_Fast(channels, "channels must be a sequence");
+	if (sequence == NULL)
+		return NULL;
+
+	count = PySequence_Fast_GET_SIZE(sequence);
+	result = PyList_New(count);
+	if (result == NULL) {
+		Py_DECREF(sequence);
+		return NULL;
+	}
+
+	for (i = 0; i < count; i++) {
+		item = PySequence_Fast_GET_ITEM(sequence, i);
+		if (!PyObject_TypeCheck(item, &ChannelType)) {
+			PyErr_SetString(PyExc_TypeError, "channels must be Channel objects");
+			Py_DECREF(result);
+			Py_DECREF(sequence);
+			return NULL;
+		}
+		channel = ((ChannelObject*)item)->channel;
+		if (channel_is_stereo(channel)) {
+			channel_stereo_meter_read(channel, &left, &right);
+			item = Py_BuildValue("(II)",
+					scale_db_to_pixels(scale->scale, left, height),
+					scale_db_to_pixels(scale->scale, right, height));
+		} else {
+			channel_mono_meter_read(channel, &left);
+			item = Py_BuildValue("(I)", scale_db_to_pixels(scale->scale, left, height));
+		}
+		PyList_SET_ITEM(result, i, item);
+	}
+
+	Py_DECREF(sequence);
+	return result;
+}
+
+static PyObject*
+set_worker_threads(PyObject *self, PyObject *args)
+{
+	unsigned int count;
+	int pin = 0;
+	bool ret;
+
+	if (! PyArg_ParseTuple(args, "I|i", &count, &pin)) return NULL;
+
+	/* joins running worker threads */
+	Py_BEGIN_ALLOW_THREADS
+	ret = mixer_set_worker_threads(count, pin);
+	Py_END_ALLOW_THREADS
+
+	if (!ret) {
+		PyErr_SetString(PyExc_RuntimeError, "error starting worker threads");
+		return NULL;
+	}
+
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+static PyObject*
+get_worker_threads(PyObject *self, PyObject *args)
+{
+	if (! PyArg_ParseTuple(args, "")) return NULL;
+
+	return PyInt_FromLong(mixer_get_worker_threads());
+}
+
 static PyMethodDef jack_mixer_methods[] = {
+	{"meters_to_pixels", meters_to_pixels, METH_VARARGS,
+		"Read meters of channels, as bar heights in pixels for meters of given scale and height"},
+	{"set_worker_threads", set_worker_threads, METH_VARARGS,
+		"Share mixing of all mixers with given count of threads, optionally pinned to CPUs"},
+	{"get_worker_threads", get_worker_threads, METH_VARARGS,
+		"Count of threads mixing is shared with"},
 	{NULL}  /* Sentinel */
 };
 
@@ -1018,6 +2031,17 @@ PyMODINIT_FUNC initjack_mixer_c(void)
 	if (PyType_Ready(&ScaleType) < 0)
 		return;
 
+	/* GIL is released around engine calls, and taken by MIDI change
+	 * callbacks from the process callback */
+	PyEval_InitThreads();
+	engine_lock = PyThread_allocate_lock();
+	if (engine_lock == NULL)
+		return;
+
+	typecode_name = PyString_InternFromString("typecode");
+	if (typecode_name == NULL)
+		return;
+
 	m = Py_InitModule3("jack_mixer_c", jack_mixer_methods, "Jack Mixer C Helper Module");
 
 	Py_INCREF(&MixerType);
@@ -1028,5 +2052,17 @@ PyMODINIT_FUNC initjack_mixer_c(void)
 	PyModule_AddObject(m, "OutputChannel", (PyObject*)&OutputChannelType);
 	Py_INCREF(&ScaleType);
 	PyModule_AddObject(m, "Scale", (PyObject*)&ScaleType);
+
+	PyModule_AddIntConstant(m, "EVENT_METERS", MIXER_EVENT_METERS);
+	PyModule_AddIntConstant(m, "EVENT_MIDI", MIXER_EVENT_MIDI);
+	PyModule_AddIntConstant(m, "EVENT_OVERLOAD", MIXER_EVENT_OVERLOAD);
+	PyModule_AddIntConstant(m, "EVENT_ROUTING", MIXER_EVENT_ROUTING);
+	PyModule_AddIntConstant(m, "DELAY_MAX_MS", MIXER_DELAY_MAX_MS);
+	PyModule_AddIntConstant(m, "SHED_NONE", MIXER_SHED_NONE);
+	PyModule_AddIntConstant(m, "SHED_INPUT_METERS", MIXER_SHED_INPUT_METERS);
+	PyModule_AddIntConstant(m, "SHED_OUTPUT_METERS", MIXER_SHED_OUTPUT_METERS);
+	PyModule_AddIntConstant(m, "SHED_MIDI_FEEDBACK", MIXER_SHED_MIDI_FEEDBACK);
+	PyModule_AddIntConstant(m, "METER_PEAK", MIXER_METER_PEAK);
+	PyModule_AddIntConstant(m, "METER_CLIP", MIXER_METER_CLIP);
 }
 
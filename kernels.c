@@ -0,0 +1,201 @@
+/* -*- Mode: C ; c-basic-offset: 2 -*- */
+/*****************************************************************************
+ *
+ *   This file is part of jack_mixer
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ *****************************************************************************/
+
+#include <stddef.h>
+
+#include "kernels.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KERNELS_X86
+#include <immintrin.h>
+#endif
+
+static void
+accumulate_scalar(
+  float * sum_ptr,
+  const float * frames_ptr,
+  unsigned int count)
+{
+  unsigned int i;
+
+  for (i = 0; i < count; i++)
+  {
+    sum_ptr[i] += frames_ptr[i];
+  }
+}
+
+static void
+accumulate_double_scalar(
+  double * sum_ptr,
+  const float * frames_ptr,
+  unsigned int count)
+{
+  unsigned int i;
+
+  for (i = 0; i < count; i++)
+  {
+    sum_ptr[i] += frames_ptr[i];
+  }
+}
+
+static void
+round_double_scalar(
+  float * frames_ptr,
+  const double * sum_ptr,
+  unsigned int count)
+{
+  unsigned int i;
+
+  for (i = 0; i < count; i++)
+  {
+    frames_ptr[i] = sum_ptr[i];
+  }
+}
+
+#ifdef KERNELS_X86
+
+__attribute__((target("avx2")))
+static void
+accumulate_avx2(
+  float * sum_ptr,
+  const float * frames_ptr,
+  unsigned int count)
+{
+  unsigned int i;
+
+  for (i = 0; i + 8 <= count; i += 8)
+  {
+    _mm256_storeu_ps(sum_ptr + i, _mm256_add_ps(_mm256_loadu_ps(sum_ptr + i), _mm256_loadu_ps(frames_ptr + i)));
+  }
+
+  accumulate_scalar(sum_ptr + i, frames_ptr + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void
+accumulate_double_avx2(
+  double * sum_ptr,
+  const float * frames_ptr,
+  unsigned int count)
+{
+  unsigned int i;
+
+  for (i = 0; i + 4 <= count; i += 4)
+  {
+    _mm256_storeu_pd(sum_ptr + i, _mm256_add_pd(_mm256_loadu_pd(sum_ptr + i), _mm256_cvtps_pd(_mm_loadu_ps(frames_ptr + i))));
+  }
+
+  accumulate_double_scalar(sum_ptr + i, frames_ptr + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void
+round_double_avx2(
+  float * frames_ptr,
+  const double * sum_ptr,
+  unsigned int count)
+{
+  unsigned int i;
+
+  for (i = 0; i + 4 <= count; i += 4)
+  {
+    _mm_storeu_ps(frames_ptr + i, _mm256_cvtpd_ps(_mm256_loadu_pd(sum_ptr + i)));
+  }
+
+  round_double_scalar(frames_ptr + i, sum_ptr + i, count - i);
+}
+
+#endif /* #ifdef KERNELS_X86 */
+
+struct kernels
+{
+  const char * name;
+  void (* accumulate)(float * sum_ptr, const float * frames_ptr, unsigned int count);
+  void (* accumulate_double)(double * sum_ptr, const float * frames_ptr, unsigned int count);
+  void (* round_double)(float * frames_ptr, const double * sum_ptr, unsigned int count);
+};
+
+static const struct kernels g_kernels_scalar =
+{
+  .name = "scalar",
+  .accumulate = accumulate_scalar,
+  .accumulate_double = accumulate_double_scalar,
+  .round_double = round_double_scalar,
+};
+
+#ifdef KERNELS_X86
+static const struct kernels g_kernels_avx2 =
+{
+  .name = "avx2",
+  .accumulate = accumulate_avx2,
+  .accumulate_double = accumulate_double_avx2,
+  .round_double = round_double_avx2,
+};
+#endif
+
+static const struct kernels * g_kernels_ptr = &g_kernels_scalar;
+
+void
+kernels_init(void)
+{
+#ifdef KERNELS_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+  {
+    g_kernels_ptr = &g_kernels_avx2;
+    return;
+  }
+#endif
+
+  g_kernels_ptr = &g_kernels_scalar;
+}
+
+const char *
+kernels_name(void)
+{
+  return g_kernels_ptr->name;
+}
+
+void
+kernel_accumulate(
+  float * sum_ptr,
+  const float * frames_ptr,
+  unsigned int count)
+{
+  g_kernels_ptr->accumulate(sum_ptr, frames_ptr, count);
+}
+
+void
+kernel_accumulate_double(
+  double * sum_ptr,
+  const float * frames_ptr,
+  unsigned int count)
+{
+  g_kernels_ptr->accumulate_double(sum_ptr, frames_ptr, count);
+}
+
+void
+kernel_round_double(
+  float * frames_ptr,
+  const double * sum_ptr,
+  unsigned int count)
+{
+  g_kernels_ptr->round_double(frames_ptr, sum_ptr, count);
+}
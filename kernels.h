@@ -0,0 +1,66 @@
+/* -*- Mode: C ; c-basic-offset: 2 -*- */
+/*****************************************************************************
+ *
+ *   This file is part of jack_mixer
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ *****************************************************************************/
+
+#ifndef KERNELS_H__3F9C1A72_64D8_4E0B_B5A1_D27E90C4F815__INCLUDED
+#define KERNELS_H__3F9C1A72_64D8_4E0B_B5A1_D27E90C4F815__INCLUDED
+
+/*
+ * Sample loops of the mix, with implementations picked for the CPU at run
+ * time. All implementations of a kernel give bit identical results.
+ */
+
+/* Layout of stereo frames inside the engine. Interleaved frames take the
+ * space of both planar arrays, left one first, so buffers are the same. */
+#define KERNELS_LAYOUT_PLANAR      0 /* left and right in separate arrays */
+#define KERNELS_LAYOUT_INTERLEAVED 1 /* left, right, left, ... in one array */
+
+/* faster one in fuzz/bench */
+#define KERNELS_LAYOUT_DEFAULT KERNELS_LAYOUT_PLANAR
+
+/* select implementations, to be called before any kernel is used */
+void
+kernels_init(void);
+
+/* name of the selected implementation, for benchmarks and logs */
+const char *
+kernels_name(void);
+
+/* sum_ptr[i] += frames_ptr[i] */
+void
+kernel_accumulate(
+  float * sum_ptr,
+  const float * frames_ptr,
+  unsigned int count);
+
+/* sum_ptr[i] += frames_ptr[i], in double precision */
+void
+kernel_accumulate_double(
+  double * sum_ptr,
+  const float * frames_ptr,
+  unsigned int count);
+
+/* frames_ptr[i] = sum_ptr[i], rounded to nearest */
+void
+kernel_round_double(
+  float * frames_ptr,
+  const double * sum_ptr,
+  unsigned int count);
+
+#endif /* #ifndef KERNELS_H__3F9C1A72_64D8_4E0B_B5A1_D27E90C4F815__INCLUDED */
@@ -17,6 +17,7 @@
 
 import gtk
 import cairo
+import math
 
 class MeterWidget(gtk.DrawingArea):
     def __init__(self, scale):
@@ -34,6 +35,7 @@ class MeterWidget(gtk.DrawingArea):
         self.width = 0
         self.height = 0
         self.cache_surface = None
+        self.cache_gradient = None
 
     def set_color(self, color):
         self.color_value = color
@@ -57,6 +59,8 @@ class MeterWidget(gtk.DrawingArea):
         self.height = float(allocation.height)
         self.font_size = 10
         self.cache_surface = None
+        self.cache_gradient = None
+        self.reset_pixels()
 
     def on_size_request(self, widget, requisition):
         #print "size-request, %u x %u" % (requisition.width, requisition.height)
@@ -66,6 +70,12 @@ class MeterWidget(gtk.DrawingArea):
     def invalidate_all(self):
         self.queue_draw_area(0, 0, int(self.width), int(self.height))
 
+    def invalidate_bar(self, old_value, new_value, x, width):
+        # only the band between old and new bar tops has changed
+        top = int(self.height * (1 - max(old_value, new_value)))
+        bottom = int(math.ceil(self.height * (1 - min(old_value, new_value))))
+        self.queue_draw_area(int(x), top, int(math.ceil(width)) + 1, bottom - top + 1)
+
     def draw_background(self, cairo_ctx):
         if not self.cache_surface:
             self.cache_surface = cairo.Surface.create_similar(
@@ -98,42 +108,43 @@ class MeterWidget(gtk.DrawingArea):
         if self.color_value is not None:
             cairo_ctx.set_source_color(self.color_value)
         else:
-            height = self.allocation.height
-            gradient = cairo.LinearGradient(1, 1, width-1, height-1)
-            gradient.add_color_stop_rgb(0, 1, 0, 0)
-            gradient.add_color_stop_rgb(0.2, 1, 1, 0)
-            gradient.add_color_stop_rgb(1, 0, 1, 0)
-            cairo_ctx.set_source(gradient)
+            if not self.cache_gradient:
+                height = self.allocation.height
+                self.cache_gradient = cairo.LinearGradient(1, 1, width-1, height-1)
+                self.cache_gradient.add_color_stop_rgb(0, 1, 0, 0)
+                self.cache_gradient.add_color_stop_rgb(0.2, 1, 1, 0)
+                self.cache_gradient.add_color_stop_rgb(1, 0, 1, 0)
+            cairo_ctx.set_source(self.cache_gradient)
         cairo_ctx.rectangle(x, self.height * (1 - value), width, self.height * value)
         cairo_ctx.fill()
 
     def set_scale(self, scale):
         self.scale = scale
         self.cache_surface = None
+        self.reset_pixels()
         self.invalidate_all()
 
 class MonoMeterWidget(MeterWidget):
     def __init__(self, scale):
         MeterWidget.__init__(self, scale)
         self.value = 0.0
-        self.raw_value = 0.0
+        self.pixels = 0
 
     def draw(self, cairo_ctx):
         self.draw_background(cairo_ctx)
         self.draw_value(cairo_ctx, self.value, self.width/4.0, self.width/2.0)
 
-    def set_value(self, value):
-        if value != self.raw_value:
-            self.raw_value = value
-            self.value = self.scale.db_to_scale(value)
-            self.invalidate_all()
-        if value == self.raw_value:
+    def reset_pixels(self):
+        # next set_pixels() redraws, even if pixel values did not change
+        self.pixels = -1
+
+    def set_pixels(self, pixels):
+        if pixels[0] == self.pixels or not self.height:
             return
-        self.raw_value = value
+        self.pixels = pixels[0]
         old_value = self.value
-        self.value = self.scale.db_to_scale(value)
-        if (abs(old_value-self.value) * self.height) > 1:
-            self.invalidate_all()
+        self.value = self.pixels / self.height
+        self.invalidate_bar(old_value, self.value, self.width/4.0, self.width/2.0)
 
 class StereoMeterWidget(MeterWidget):
     def __init__(self, scale):
@@ -141,22 +152,29 @@ class StereoMeterWidget(MeterWidget):
         self.left = 0.0
         self.right = 0.0
 
-        self.raw_left = 0.0
-        self.raw_right = 0.0
+        self.pixels_left = 0
+        self.pixels_right = 0
 
     def draw(self, cairo_ctx):
         self.draw_background(cairo_ctx)
         self.draw_value(cairo_ctx, self.left, self.width/5.0, self.width/5.0)
         self.draw_value(cairo_ctx, self.right, self.width/5.0 * 3.0, self.width/5.0)
 
-    def set_values(self, left, right):
-        if left == self.raw_left and right == self.raw_right:
+    def reset_pixels(self):
+        self.pixels_left = -1
+        self.pixels_right = -1
+
+    def set_pixels(self, pixels):
+        if not self.height:
             return
-        self.raw_left = left
-        self.raw_right = right
-        old_left = self.left
-        old_right = self.right
-        self.left = self.scale.db_to_scale(left)
-        self.right = self.scale.db_to_scale(right)
-        if (abs(old_left-self.left) * self.height) > 0.01 or (abs(old_right-self.right) * self.height) > 0.01:
-            self.invalidate_all()
+        left, right = pixels
+        if left != self.pixels_left:
+            self.pixels_left = left
+            old_left = self.left
+            self.left = left / self.height
+            self.invalidate_bar(old_left, self.left, self.width/5.0, self.width/5.0)
+        if right != self.pixels_right:
+            self.pixels_right = right
+            old_right = self.right
+            self.right = right / self.height
+            self.invalidate_bar(old_right, self.right, self.width/5.0 * 3.0, self.width/5.0)
@@ -0,0 +1,550 @@
+/* -*- Mode: C ; c-basic-offset: 2 -*- */
+/*****************************************************************************
+ *
+ *   This file is part of jack_mixer
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/mman.h>
+#include <sndfile.h>
+#include <jack/jack.h>
+#include <jack/ringbuffer.h>
+
+//#define LOG_LEVEL LOG_LEVEL_DEBUG
+#include "log.h"
+#include "player.h"
+
+#define PLAYER_MEMORY_SECONDS 10      /* files up to this long are kept in memory whole */
+#define PLAYER_HEAD_SECONDS 1         /* in memory of longer files, time the disk thread has to refill the ring */
+#define PLAYER_READAHEAD_PERIODS 16
+#define PLAYER_PERIOD_MAX 8192        /* largest JACK period, it may grow while the file is open */
+#define PLAYER_CHUNK_FRAMES 4096      /* read from file at once */
+
+/* Ring of the streamed part is filled for the cue it was last reset for.
+ * The process callback advances cue to have it reset and refilled from
+ * the end of the head, and reads it only while cued matches; the disk
+ * thread resets the ring only when they differ, so the two never touch
+ * the read side of the ring at the same time. */
+struct player
+{
+  SNDFILE * file_ptr;
+  unsigned int file_channels;
+  bool stereo;
+  jack_nframes_t frames;        /* of file */
+
+  jack_nframes_t head_frames;   /* start of file, in memory */
+  size_t head_size;
+  jack_default_audio_sample_t * head_left;
+  jack_default_audio_sample_t * head_right;
+
+  /* streamed part, rings are NULL when the whole file is in memory */
+  jack_ringbuffer_t * ring_left;
+  jack_ringbuffer_t * ring_right;
+  jack_nframes_t file_position; /* disk thread only */
+  float * chunk_ptr;            /* disk thread, frames as read from file */
+  jack_default_audio_sample_t * chunk_left;
+  jack_default_audio_sample_t * chunk_right;
+  pthread_t thread;
+  sem_t wake;
+  bool quit;
+  uint32_t cue;
+  uint32_t cued;
+
+  /* process callback only */
+  bool playing;                 /* read by other threads too */
+  jack_nframes_t position;
+  bool ring_used;               /* read since last cue */
+};
+
+/* split count frames of the chunk into left and right */
+static void
+player_split_chunk(
+  struct player * player_ptr,
+  jack_default_audio_sample_t * left_ptr,
+  jack_default_audio_sample_t * right_ptr,
+  unsigned int count)
+{
+  unsigned int i;
+
+  for (i = 0; i < count; i++)
+  {
+    left_ptr[i] = player_ptr->chunk_ptr[i * player_ptr->file_channels];
+    if (player_ptr->stereo)
+    {
+      right_ptr[i] = player_ptr->chunk_ptr[i * player_ptr->file_channels + 1];
+    }
+  }
+}
+
+/* read head of file into memory, false on error */
+static bool
+player_read_head(
+  struct player * player_ptr)
+{
+  jack_nframes_t done;
+  sf_count_t count;
+
+  for (done = 0; done < player_ptr->head_frames; done += count)
+  {
+    count = player_ptr->head_frames - done < PLAYER_CHUNK_FRAMES ? player_ptr->head_frames - done : PLAYER_CHUNK_FRAMES;
+    count = sf_readf_float(player_ptr->file_ptr, player_ptr->chunk_ptr, count);
+    if (count <= 0)
+    {
+      return false;
+    }
+
+    player_split_chunk(
+      player_ptr,
+      player_ptr->head_left + done,
+      player_ptr->stereo ? player_ptr->head_right + done : NULL,
+      count);
+  }
+
+  return true;
+}
+
+/* fill ring as far as it goes, for cue */
+static void
+player_fill(
+  struct player * player_ptr,
+  uint32_t cue)
+{
+  size_t space;
+  jack_nframes_t count;
+  sf_count_t read;
+
+  while (player_ptr->file_position < player_ptr->frames &&
+         __atomic_load_n(&player_ptr->cue, __ATOMIC_ACQUIRE) == cue)
+  {
+    /* right is written last, it has the least space */
+    space = jack_ringbuffer_write_space(player_ptr->stereo ? player_ptr->ring_right : player_ptr->ring_left);
+    count = space / sizeof(jack_default_audio_sample_t);
+    if (count > PLAYER_CHUNK_FRAMES)
+    {
+      count = PLAYER_CHUNK_FRAMES;
+    }
+    if (count > player_ptr->frames - player_ptr->file_position)
+    {
+      count = player_ptr->frames - player_ptr->file_position;
+    }
+    if (count == 0)
+    {
+      return;
+    }
+
+    read = sf_readf_float(player_ptr->file_ptr, player_ptr->chunk_ptr, count);
+    if (read <= 0)
+    {
+      LOG_ERROR("Cannot read file: %s", sf_strerror(player_ptr->file_ptr));
+      /* rest plays as silence */
+      player_ptr->file_position = player_ptr->frames;
+      return;
+    }
+
+    player_split_chunk(player_ptr, player_ptr->chunk_left, player_ptr->chunk_right, read);
+    jack_ringbuffer_write(player_ptr->ring_left, (const char *)player_ptr->chunk_left, read * sizeof(jack_default_audio_sample_t));
+    if (player_ptr->stereo)
+    {
+      jack_ringbuffer_write(player_ptr->ring_right, (const char *)player_ptr->chunk_right, read * sizeof(jack_default_audio_sample_t));
+    }
+
+    player_ptr->file_position += read;
+  }
+}
+
+static void *
+player_thread(
+  void * arg)
+{
+  struct player * player_ptr = arg;
+  uint32_t cue;
+
+  while (true)
+  {
+    sem_wait(&player_ptr->wake);
+    if (__atomic_load_n(&player_ptr->quit, __ATOMIC_ACQUIRE))
+    {
+      break;
+    }
+
+    cue = __atomic_load_n(&player_ptr->cue, __ATOMIC_ACQUIRE);
+    if (cue != __atomic_load_n(&player_ptr->cued, __ATOMIC_RELAXED))
+    {
+      /* process callback does not read the ring now */
+      jack_ringbuffer_reset(player_ptr->ring_left);
+      if (player_ptr->stereo)
+      {
+        jack_ringbuffer_reset(player_ptr->ring_right);
+      }
+
+      if (sf_seek(player_ptr->file_ptr, player_ptr->head_frames, SEEK_SET) < 0)
+      {
+        LOG_ERROR("Cannot seek in file: %s", sf_strerror(player_ptr->file_ptr));
+        player_ptr->file_position = player_ptr->frames;
+      }
+      else
+      {
+        player_ptr->file_position = player_ptr->head_frames;
+      }
+
+      __atomic_store_n(&player_ptr->cued, cue, __ATOMIC_RELEASE);
+    }
+
+    player_fill(player_ptr, cue);
+  }
+
+  return NULL;
+}
+
+/* have the ring refilled from the end of the head */
+static void
+player_cue(
+  struct player * player_ptr)
+{
+  player_ptr->ring_used = false;
+  __atomic_add_fetch(&player_ptr->cue, 1, __ATOMIC_RELEASE);
+  sem_post(&player_ptr->wake);
+}
+
+static jack_ringbuffer_t *
+player_ring_create(void)
+{
+  jack_ringbuffer_t * ring_ptr;
+
+  ring_ptr = jack_ringbuffer_create(PLAYER_READAHEAD_PERIODS * PLAYER_PERIOD_MAX * sizeof(jack_default_audio_sample_t));
+  if (ring_ptr != NULL)
+  {
+    jack_ringbuffer_mlock(ring_ptr);
+  }
+
+  return ring_ptr;
+}
+
+struct player *
+player_open(
+  const char * path,
+  jack_nframes_t sample_rate)
+{
+  struct player * player_ptr;
+  SF_INFO info;
+  unsigned int sides;
+
+  player_ptr = calloc(1, sizeof(struct player));
+  if (player_ptr == NULL)
+  {
+    goto fail;
+  }
+
+  memset(&info, 0, sizeof(info));
+  player_ptr->file_ptr = sf_open(path, SFM_READ, &info);
+  if (player_ptr->file_ptr == NULL)
+  {
+    LOG_ERROR("Cannot open \"%s\": %s", path, sf_strerror(NULL));
+    goto fail_free;
+  }
+
+  if (info.samplerate != (int)sample_rate)
+  {
+    LOG_ERROR("Sample rate of \"%s\" is %d, JACK runs at %u", path, info.samplerate, (unsigned int)sample_rate);
+    goto fail_close_file;
+  }
+
+  if (info.frames <= 0 || info.frames > UINT32_MAX)
+  {
+    LOG_ERROR("Cannot play \"%s\", it has %lld frames", path, (long long)info.frames);
+    goto fail_close_file;
+  }
+
+  if (info.channels > 2)
+  {
+    LOG_WARNING("\"%s\" has %d channels, first two are played", path, info.channels);
+  }
+
+  player_ptr->file_channels = info.channels;
+  player_ptr->stereo = info.channels > 1;
+  player_ptr->frames = info.frames;
+  sides = player_ptr->stereo ? 2 : 1;
+
+  player_ptr->head_frames = player_ptr->frames;
+  if (player_ptr->frames > PLAYER_MEMORY_SECONDS * sample_rate)
+  {
+    player_ptr->head_frames = PLAYER_HEAD_SECONDS * sample_rate;
+  }
+
+  player_ptr->chunk_ptr = malloc(PLAYER_CHUNK_FRAMES * (info.channels + sides) * sizeof(float));
+  if (player_ptr->chunk_ptr == NULL)
+  {
+    goto fail_close_file;
+  }
+  player_ptr->chunk_left = player_ptr->chunk_ptr + PLAYER_CHUNK_FRAMES * info.channels;
+  player_ptr->chunk_right = player_ptr->chunk_left + PLAYER_CHUNK_FRAMES;
+
+  player_ptr->head_size = sides * player_ptr->head_frames * sizeof(jack_default_audio_sample_t);
+  player_ptr->head_left = malloc(player_ptr->head_size);
+  if (player_ptr->head_left == NULL)
+  {
+    goto fail_free_chunk;
+  }
+  player_ptr->head_right = player_ptr->stereo ? player_ptr->head_left + player_ptr->head_frames : NULL;
+
+  if (!player_read_head(player_ptr))
+  {
+    LOG_ERROR("Cannot read \"%s\": %s", path, sf_strerror(player_ptr->file_ptr));
+    goto fail_free_head;
+  }
+
+  /* not paged out while waiting to be played */
+  if (mlock(player_ptr->head_left, player_ptr->head_size) != 0)
+  {
+    LOG_WARNING("Cannot lock \"%s\" in memory", path);
+  }
+
+  if (player_ptr->head_frames == player_ptr->frames)
+  {
+    /* whole file in memory, no disk thread */
+    sf_close(player_ptr->file_ptr);
+    player_ptr->file_ptr = NULL;
+    return player_ptr;
+  }
+
+  player_ptr->ring_left = player_ring_create();
+  if (player_ptr->ring_left == NULL)
+  {
+    goto fail_unlock_head;
+  }
+
+  if (player_ptr->stereo)
+  {
+    player_ptr->ring_right = player_ring_create();
+    if (player_ptr->ring_right == NULL)
+    {
+      goto fail_free_ring_left;
+    }
+  }
+
+  if (sem_init(&player_ptr->wake, 0, 0) != 0)
+  {
+    goto fail_free_ring_right;
+  }
+
+  /* disk thread fills the ring first thing */
+  player_ptr->cue = 0;
+  player_ptr->cued = 1;
+  sem_post(&player_ptr->wake);
+
+  if (pthread_create(&player_ptr->thread, NULL, player_thread, player_ptr) != 0)
+  {
+    LOG_ERROR("Cannot start disk thread of \"%s\"", path);
+    goto fail_destroy_wake;
+  }
+
+  return player_ptr;
+
+fail_destroy_wake:
+  sem_destroy(&player_ptr->wake);
+
+fail_free_ring_right:
+  if (player_ptr->ring_right != NULL)
+  {
+    jack_ringbuffer_free(player_ptr->ring_right);
+  }
+
+fail_free_ring_left:
+  jack_ringbuffer_free(player_ptr->ring_left);
+
+fail_unlock_head:
+  munlock(player_ptr->head_left, player_ptr->head_size);
+
+fail_free_head:
+  free(player_ptr->head_left);
+
+fail_free_chunk:
+  free(player_ptr->chunk_ptr);
+
+fail_close_file:
+  sf_close(player_ptr->file_ptr);
+
+fail_free:
+  free(player_ptr);
+
+fail:
+  return NULL;
+}
+
+void
+player_close(
+  struct player * player_ptr)
+{
+  if (player_ptr->ring_left != NULL)
+  {
+    __atomic_store_n(&player_ptr->quit, true, __ATOMIC_RELEASE);
+    sem_post(&player_ptr->wake);
+    pthread_join(player_ptr->thread, NULL);
+    sem_destroy(&player_ptr->wake);
+
+    jack_ringbuffer_free(player_ptr->ring_left);
+    if (player_ptr->ring_right != NULL)
+    {
+      jack_ringbuffer_free(player_ptr->ring_right);
+    }
+
+    sf_close(player_ptr->file_ptr);
+  }
+
+  munlock(player_ptr->head_left, player_ptr->head_size);
+  free(player_ptr->head_left);
+  free(player_ptr->chunk_ptr);
+  free(player_ptr);
+}
+
+bool
+player_is_stereo(
+  struct player * player_ptr)
+{
+  return player_ptr->stereo;
+}
+
+bool
+player_is_playing(
+  struct player * player_ptr)
+{
+  return __atomic_load_n(&player_ptr->playing, __ATOMIC_RELAXED);
+}
+
+void
+player_start(
+  struct player * player_ptr)
+{
+  if (player_ptr->ring_used)
+  {
+    player_cue(player_ptr);
+  }
+
+  player_ptr->position = 0;
+  __atomic_store_n(&player_ptr->playing, true, __ATOMIC_RELAXED);
+}
+
+void
+player_stop(
+  struct player * player_ptr)
+{
+  __atomic_store_n(&player_ptr->playing, false, __ATOMIC_RELAXED);
+
+  /* ready for next start */
+  if (player_ptr->ring_used)
+  {
+    player_cue(player_ptr);
+  }
+}
+
+void
+player_read(
+  struct player * player_ptr,
+  jack_default_audio_sample_t * left_ptr,
+  jack_default_audio_sample_t * right_ptr,
+  jack_nframes_t count)
+{
+  jack_nframes_t done;
+  jack_nframes_t frames;
+  size_t space;
+  bool read_ring;
+
+  read_ring = false;
+  done = 0;
+
+  while (done < count && player_ptr->playing)
+  {
+    if (player_ptr->position >= player_ptr->frames)
+    {
+      player_stop(player_ptr);
+      break;
+    }
+
+    frames = count - done;
+
+    if (player_ptr->position < player_ptr->head_frames)
+    {
+      if (frames > player_ptr->head_frames - player_ptr->position)
+      {
+        frames = player_ptr->head_frames - player_ptr->position;
+      }
+
+      memcpy(left_ptr + done, player_ptr->head_left + player_ptr->position, frames * sizeof(jack_default_audio_sample_t));
+      if (player_ptr->stereo)
+      {
+        memcpy(right_ptr + done, player_ptr->head_right + player_ptr->position, frames * sizeof(jack_default_audio_sample_t));
+      }
+    }
+    else
+    {
+      /* disk thread is behind, play on once it catches up */
+      if (__atomic_load_n(&player_ptr->cued, __ATOMIC_ACQUIRE) != player_ptr->cue)
+      {
+        break;
+      }
+
+      space = jack_ringbuffer_read_space(player_ptr->stereo ? player_ptr->ring_right : player_ptr->ring_left);
+      if (frames > space / sizeof(jack_default_audio_sample_t))
+      {
+        frames = space / sizeof(jack_default_audio_sample_t);
+      }
+      if (frames > player_ptr->frames - player_ptr->position)
+      {
+        frames = player_ptr->frames - player_ptr->position;
+      }
+      if (frames == 0)
+      {
+        break;
+      }
+
+      jack_ringbuffer_read(player_ptr->ring_left, (char *)(left_ptr + done), frames * sizeof(jack_default_audio_sample_t));
+      if (player_ptr->stereo)
+      {
+        jack_ringbuffer_read(player_ptr->ring_right, (char *)(right_ptr + done), frames * sizeof(jack_default_audio_sample_t));
+      }
+
+      player_ptr->ring_used = true;
+      read_ring = true;
+    }
+
+    player_ptr->position += frames;
+    done += frames;
+  }
+
+  if (player_ptr->playing && player_ptr->position >= player_ptr->frames)
+  {
+    player_stop(player_ptr);
+  }
+
+  memset(left_ptr + done, 0, (count - done) * sizeof(jack_default_audio_sample_t));
+  if (player_ptr->stereo)
+  {
+    memset(right_ptr + done, 0, (count - done) * sizeof(jack_default_audio_sample_t));
+  }
+
+  /* room for more */
+  if (read_ring && player_ptr->playing)
+  {
+    sem_post(&player_ptr->wake);
+  }
+}
@@ -0,0 +1,81 @@
+/* -*- Mode: C ; c-basic-offset: 2 -*- */
+/*****************************************************************************
+ *
+ *   This file is part of jack_mixer
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ *****************************************************************************/
+
+#ifndef PLAYER_H__8B31F0C6_27D4_4A9E_9C52_E6A1D3F7048B__INCLUDED
+#define PLAYER_H__8B31F0C6_27D4_4A9E_9C52_E6A1D3F7048B__INCLUDED
+
+#include <stdbool.h>
+#include <jack/jack.h>
+
+/*
+ * Audio file player feeding an input channel, files are read with
+ * libsndfile. The start of the file is decoded into locked memory when it
+ * is opened, so playing starts at once; short files are kept there
+ * whole. The rest of longer files is streamed by a disk thread through a
+ * lock free ring holding some periods of read-ahead, refilled from the
+ * start of the streamed part again once playing stops. The ring is sized
+ * for periods of up to 8192 frames, JACK does not allow longer ones.
+ */
+
+struct player;
+
+/* will sleep; NULL on error. File must have the sample rate given, first
+ * two channels of files with more are played. */
+struct player *
+player_open(
+  const char * path,
+  jack_nframes_t sample_rate);
+
+/* will sleep */
+void
+player_close(
+  struct player * player_ptr);
+
+bool
+player_is_stereo(
+  struct player * player_ptr);
+
+/* true from start until stopped or the end of file is played */
+bool
+player_is_playing(
+  struct player * player_ptr);
+
+/* will not sleep, to be called from the process callback only; plays from
+ * the start of the file */
+void
+player_start(
+  struct player * player_ptr);
+
+/* will not sleep, to be called from the process callback only */
+void
+player_stop(
+  struct player * player_ptr);
+
+/* Will not sleep, to be called from the process callback only. Next count
+ * frames, silence once stopped or while the disk thread is behind; right
+ * is not written for mono files. */
+void
+player_read(
+  struct player * player_ptr,
+  jack_default_audio_sample_t * left_ptr,
+  jack_default_audio_sample_t * right_ptr,
+  jack_nframes_t count);
+
+#endif /* #ifndef PLAYER_H__8B31F0C6_27D4_4A9E_9C52_E6A1D3F7048B__INCLUDED */
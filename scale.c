@@ -23,6 +23,7 @@
 #include <stddef.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <assert.h>
 
@@ -40,10 +41,25 @@ struct threshold
   double b;
 };
 
+#define SCALE_PIXELS_STEPS_PER_DB 20
+#define SCALE_PIXELS_TABLES 4     /* meters of different heights sharing scale */
+
+/* dBFS to pixels lookup table, for meters of given height */
+struct pixels_table
+{
+  unsigned int height;          /* 0 if unused */
+  unsigned int * pixels;
+};
+
 struct scale
 {
   struct list_head thresholds;
   double max_db;
+
+  struct pixels_table pixels_tables[SCALE_PIXELS_TABLES];
+  unsigned int pixels_tables_next;  /* to be replaced */
+  unsigned int pixels_table_size;
+  double pixels_min_db;
 };
 
 jack_mixer_scale_t
@@ -59,6 +75,9 @@ scale_create()
 
   INIT_LIST_HEAD(&scale_ptr->thresholds);
   scale_ptr->max_db = -INFINITY;
+  memset(scale_ptr->pixels_tables, 0, sizeof(scale_ptr->pixels_tables));
+  scale_ptr->pixels_tables_next = 0;
+  scale_ptr->pixels_table_size = 0;
 
   LOG_DEBUG("Scale %p created", scale_ptr);
 
@@ -67,10 +86,33 @@ scale_create()
 
 #define scale_ptr ((struct scale *)scale)
 
+static void
+scale_invalidate_pixels(
+  jack_mixer_scale_t scale)
+{
+  unsigned int i;
+
+  for (i = 0 ; i < SCALE_PIXELS_TABLES ; i++)
+  {
+    free(scale_ptr->pixels_tables[i].pixels);
+    scale_ptr->pixels_tables[i].pixels = NULL;
+    scale_ptr->pixels_tables[i].height = 0;
+  }
+}
+
 void
 scale_destroy(
   jack_mixer_scale_t scale)
 {
+  struct list_head * node_ptr;
+  struct list_head * next_ptr;
+
+  list_for_each_safe(node_ptr, next_ptr, &scale_ptr->thresholds)
+  {
+    free(list_entry(node_ptr, struct threshold, scale_siblings));
+  }
+
+  scale_invalidate_pixels(scale);
   free(scale_ptr);
 }
 
@@ -96,6 +138,7 @@ scale_add_threshold(
   threshold_ptr->scale = scale_value;
 
   list_add_tail(&threshold_ptr->scale_siblings, &scale_ptr->thresholds);
+  scale_invalidate_pixels(scale);
 
   if (db > scale_ptr->max_db)
   {
@@ -115,6 +158,8 @@ scale_calculate_coefficients(
   struct threshold * prev_ptr;
   struct list_head * node_ptr;
 
+  scale_invalidate_pixels(scale);
+
   prev_ptr = NULL;
 
   list_for_each(node_ptr, &scale_ptr->thresholds)
@@ -198,3 +243,99 @@ scale_scale_to_db(
 
   return scale_ptr->max_db;
 }
+
+static struct pixels_table *
+scale_build_pixels(
+  jack_mixer_scale_t scale,
+  unsigned int height)
+{
+  struct threshold * first_ptr;
+  struct pixels_table * table_ptr;
+  unsigned int i;
+
+  if (list_empty(&scale_ptr->thresholds))
+  {
+    return NULL;
+  }
+
+  first_ptr = list_entry(scale_ptr->thresholds.next, struct threshold, scale_siblings);
+  scale_ptr->pixels_min_db = first_ptr->db;
+  scale_ptr->pixels_table_size = (scale_ptr->max_db - first_ptr->db) * SCALE_PIXELS_STEPS_PER_DB + 1;
+
+  table_ptr = scale_ptr->pixels_tables + scale_ptr->pixels_tables_next;
+  free(table_ptr->pixels);
+  table_ptr->height = 0;
+
+  table_ptr->pixels = malloc(scale_ptr->pixels_table_size * sizeof(unsigned int));
+  if (table_ptr->pixels == NULL)
+  {
+    return NULL;
+  }
+
+  for (i = 0 ; i < scale_ptr->pixels_table_size ; i++)
+  {
+    table_ptr->pixels[i] = lrint(height * scale_db_to_scale(scale, first_ptr->db + (double)i / SCALE_PIXELS_STEPS_PER_DB));
+  }
+
+  table_ptr->height = height;
+  scale_ptr->pixels_tables_next = (scale_ptr->pixels_tables_next + 1) % SCALE_PIXELS_TABLES;
+
+  LOG_DEBUG("Scale %p pixel table for height %u, %u entries", scale_ptr, height, scale_ptr->pixels_table_size);
+
+  return table_ptr;
+}
+
+/* Convert dBFS value to bar height in pixels, for meter height pixels high;
+ * lookup tables are rebuilt when height or thresholds change */
+unsigned int
+scale_db_to_pixels(
+  jack_mixer_scale_t scale,
+  double db,
+  unsigned int height)
+{
+  struct pixels_table * table_ptr;
+  unsigned int index;
+
+  if (height == 0)
+  {
+    return 0;
+  }
+
+  table_ptr = NULL;
+  for (index = 0 ; index < SCALE_PIXELS_TABLES ; index++)
+  {
+    if (scale_ptr->pixels_tables[index].height == height)
+    {
+      table_ptr = scale_ptr->pixels_tables + index;
+      break;
+    }
+  }
+
+  if (table_ptr == NULL)
+  {
+    table_ptr = scale_build_pixels(scale, height);
+    if (table_ptr == NULL)
+    {
+      return 0;
+    }
+  }
+
+  /* also -inf and NaN */
+  if (!(db > scale_ptr->pixels_min_db))
+  {
+    return table_ptr->pixels[0];
+  }
+
+  if (db >= scale_ptr->max_db)
+  {
+    return height;
+  }
+
+  index = lrint((db - scale_ptr->pixels_min_db) * SCALE_PIXELS_STEPS_PER_DB);
+  if (index >= scale_ptr->pixels_table_size)
+  {
+    index = scale_ptr->pixels_table_size - 1;
+  }
+
+  return table_ptr->pixels[index];
+}
@@ -0,0 +1,271 @@
+/* -*- Mode: C ; c-basic-offset: 2 -*- */
+/*****************************************************************************
+ *
+ *   This file is part of jack_mixer
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//#define LOG_LEVEL LOG_LEVEL_DEBUG
+#include "log.h"
+#include "state.h"
+
+#define STATE_MAGIC "JMSTATE1"
+#define STATE_VERSION 1
+
+struct state_file
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size;
+  uint32_t records_count;
+  uint32_t reserved;
+  struct state_record records[STATE_MAX_RECORDS];
+};
+
+struct mixer_state
+{
+  int fd;
+  struct state_file * file_ptr;
+  bool bound[STATE_MAX_RECORDS]; /* records owned by channels of this process */
+};
+
+static bool
+state_file_valid(
+  struct state_file * file_ptr)
+{
+  return memcmp(file_ptr->magic, STATE_MAGIC, sizeof(file_ptr->magic)) == 0 &&
+    file_ptr->version == STATE_VERSION &&
+    file_ptr->record_size == sizeof(struct state_record) &&
+    file_ptr->records_count == STATE_MAX_RECORDS;
+}
+
+struct mixer_state *
+state_open(
+  const char * path)
+{
+  struct mixer_state * state_ptr;
+  struct stat st;
+
+  state_ptr = calloc(1, sizeof(struct mixer_state));
+  if (state_ptr == NULL)
+  {
+    goto fail;
+  }
+
+  state_ptr->fd = open(path, O_RDWR | O_CREAT, 0644);
+  if (state_ptr->fd == -1)
+  {
+    LOG_ERROR("Cannot open state file \"%s\"", path);
+    goto fail_free;
+  }
+
+  if (fstat(state_ptr->fd, &st) != 0)
+  {
+    goto fail_close;
+  }
+
+  if ((size_t)st.st_size != sizeof(struct state_file) &&
+      ftruncate(state_ptr->fd, sizeof(struct state_file)) != 0)
+  {
+    LOG_ERROR("Cannot resize state file \"%s\"", path);
+    goto fail_close;
+  }
+
+  state_ptr->file_ptr = mmap(NULL, sizeof(struct state_file), PROT_READ | PROT_WRITE, MAP_SHARED, state_ptr->fd, 0);
+  if (state_ptr->file_ptr == MAP_FAILED)
+  {
+    LOG_ERROR("Cannot map state file \"%s\"", path);
+    goto fail_close;
+  }
+
+  /* the RT thread stores into the mapping, keep it from faulting */
+  if (mlock(state_ptr->file_ptr, sizeof(struct state_file)) != 0)
+  {
+    LOG_WARNING("Cannot lock state file \"%s\" in memory", path);
+  }
+
+  if (!state_file_valid(state_ptr->file_ptr))
+  {
+    LOG_NOTICE("Initializing state file \"%s\"", path);
+    memset(state_ptr->file_ptr, 0, sizeof(struct state_file));
+    state_ptr->file_ptr->version = STATE_VERSION;
+    state_ptr->file_ptr->record_size = sizeof(struct state_record);
+    state_ptr->file_ptr->records_count = STATE_MAX_RECORDS;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(state_ptr->file_ptr->magic, STATE_MAGIC, sizeof(state_ptr->file_ptr->magic));
+  }
+
+  return state_ptr;
+
+fail_close:
+  close(state_ptr->fd);
+
+fail_free:
+  free(state_ptr);
+
+fail:
+  return NULL;
+}
+
+void
+state_close(
+  struct mixer_state * state_ptr)
+{
+  msync(state_ptr->file_ptr, sizeof(struct state_file), MS_ASYNC);
+  munmap(state_ptr->file_ptr, sizeof(struct state_file));
+  close(state_ptr->fd);
+  free(state_ptr);
+}
+
+struct state_record *
+state_record_reclaim(
+  struct mixer_state * state_ptr,
+  const char * name,
+  uint32_t flags)
+{
+  struct state_record * record_ptr;
+  unsigned int i;
+
+  for (i = 0 ; i < STATE_MAX_RECORDS ; i++)
+  {
+    record_ptr = state_ptr->file_ptr->records + i;
+
+    if (state_ptr->bound[i] || !__atomic_load_n(&record_ptr->in_use, __ATOMIC_ACQUIRE))
+    {
+      continue;
+    }
+
+    if ((record_ptr->flags & STATE_RECORD_OUTPUT) != (flags & STATE_RECORD_OUTPUT))
+    {
+      continue;
+    }
+
+    if (strncmp(record_ptr->name, name, STATE_NAME_MAX - 1) == 0)
+    {
+      LOG_DEBUG("State record %u reclaimed for \"%s\"", i, name);
+      state_ptr->bound[i] = true;
+      return record_ptr;
+    }
+  }
+
+  return NULL;
+}
+
+struct state_record *
+state_record_claim(
+  struct mixer_state * state_ptr,
+  const char * name,
+  uint32_t flags)
+{
+  struct state_record * record_ptr;
+  unsigned int i;
+
+  for (i = 0 ; i < STATE_MAX_RECORDS ; i++)
+  {
+    record_ptr = state_ptr->file_ptr->records + i;
+
+    if (state_ptr->bound[i] || __atomic_load_n(&record_ptr->in_use, __ATOMIC_ACQUIRE))
+    {
+      continue;
+    }
+
+    state_ptr->bound[i] = true;
+    memset(record_ptr, 0, sizeof(struct state_record));
+    record_ptr->flags = flags;
+    record_ptr->midi_cc_volume = -1;
+    record_ptr->midi_cc_balance = -1;
+    record_ptr->midi_cc_mute = -1;
+    record_ptr->midi_cc_solo = -1;
+    state_record_set_name(record_ptr, name);
+    __atomic_store_n(&record_ptr->in_use, 1, __ATOMIC_RELEASE);
+
+    LOG_DEBUG("State record %u claimed for \"%s\"", i, name);
+
+    return record_ptr;
+  }
+
+  LOG_WARNING("State file is full, \"%s\" will not be preserved", name);
+
+  return NULL;
+}
+
+void
+state_record_release(
+  struct mixer_state * state_ptr,
+  struct state_record * record_ptr)
+{
+  unsigned int index;
+  unsigned int i;
+
+  __atomic_store_n(&record_ptr->in_use, 0, __ATOMIC_RELEASE);
+
+  /* don't let a channel that later reuses this record inherit routing */
+  index = state_record_index(state_ptr, record_ptr);
+  state_ptr->bound[index] = false;
+  for (i = 0 ; i < STATE_MAX_RECORDS ; i++)
+  {
+    state_store_mask_bit(state_ptr->file_ptr->records[i].muted_mask, index, false);
+    state_store_mask_bit(state_ptr->file_ptr->records[i].soloed_mask, index, false);
+  }
+}
+
+void
+state_release_unbound(
+  struct mixer_state * state_ptr)
+{
+  struct state_record * record_ptr;
+  unsigned int i;
+
+  for (i = 0 ; i < STATE_MAX_RECORDS ; i++)
+  {
+    record_ptr = state_ptr->file_ptr->records + i;
+
+    if (state_ptr->bound[i] || !__atomic_load_n(&record_ptr->in_use, __ATOMIC_ACQUIRE))
+    {
+      continue;
+    }
+
+    LOG_DEBUG("State record %u of \"%.*s\" released, not reclaimed", i, STATE_NAME_MAX, record_ptr->name);
+    state_record_release(state_ptr, record_ptr);
+  }
+}
+
+unsigned int
+state_record_index(
+  struct mixer_state * state_ptr,
+  struct state_record * record_ptr)
+{
+  return record_ptr - state_ptr->file_ptr->records;
+}
+
+void
+state_record_set_name(
+  struct state_record * record_ptr,
+  const char * name)
+{
+  strncpy(record_ptr->name, name, STATE_NAME_MAX - 1);
+  record_ptr->name[STATE_NAME_MAX - 1] = 0;
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
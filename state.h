@@ -0,0 +1,169 @@
+/* -*- Mode: C ; c-basic-offset: 2 -*- */
+/*****************************************************************************
+ *
+ *   This file is part of jack_mixer
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ *****************************************************************************/
+
+#ifndef STATE_H__5C0B7E4A_2D61_4C3B_9E0F_7A1D8B52C6E3__INCLUDED
+#define STATE_H__5C0B7E4A_2D61_4C3B_9E0F_7A1D8B52C6E3__INCLUDED
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Engine state file. Every channel owns one fixed size record in a memory
+ * mapped file. Fields are written with release stores as the engine changes
+ * them (from the RT thread too, for MIDI), so a process restarted after a
+ * crash can map the same file and find the last state of each channel by
+ * name.
+ */
+
+#define STATE_MAX_RECORDS 256
+#define STATE_NAME_MAX 64
+#define STATE_MASK_WORDS (STATE_MAX_RECORDS / 32)
+
+#define STATE_RECORD_STEREO   0x01
+#define STATE_RECORD_OUTPUT   0x02
+#define STATE_RECORD_PREFADER 0x04
+#define STATE_RECORD_DOUBLE_PRECISION 0x08
+
+struct state_record
+{
+  uint32_t in_use;              /* stored last on claim, cleared first on release */
+  uint32_t flags;
+  char name[STATE_NAME_MAX];
+  float volume;                 /* linear, fader target */
+  float balance;
+  uint32_t out_mute;
+  uint32_t solo;
+  int32_t midi_cc_volume;
+  int32_t midi_cc_balance;
+  int32_t midi_cc_mute;
+  int32_t midi_cc_solo;
+  uint32_t muted_mask[STATE_MASK_WORDS];  /* output records: muted input record indexes */
+  uint32_t soloed_mask[STATE_MASK_WORDS]; /* output records: soloed input record indexes */
+};
+
+struct mixer_state;
+
+/* will sleep */
+struct mixer_state *
+state_open(
+  const char * path);
+
+/* will sleep */
+void
+state_close(
+  struct mixer_state * state_ptr);
+
+/* bind in-use record, left by a previous process, with matching name and
+ * kind, NULL if there is none */
+struct state_record *
+state_record_reclaim(
+  struct mixer_state * state_ptr,
+  const char * name,
+  uint32_t flags);
+
+/* claim a free record, NULL if the file is full */
+struct state_record *
+state_record_claim(
+  struct mixer_state * state_ptr,
+  const char * name,
+  uint32_t flags);
+
+void
+state_record_release(
+  struct mixer_state * state_ptr,
+  struct state_record * record_ptr);
+
+/* release in-use records left by a previous process that no channel of
+ * this one reclaimed */
+void
+state_release_unbound(
+  struct mixer_state * state_ptr);
+
+unsigned int
+state_record_index(
+  struct mixer_state * state_ptr,
+  struct state_record * record_ptr);
+
+void
+state_record_set_name(
+  struct state_record * record_ptr,
+  const char * name);
+
+/* will not sleep, safe to call from the RT thread */
+
+static inline void
+state_store_float(
+  float * field_ptr,
+  float value)
+{
+  __atomic_store(field_ptr, &value, __ATOMIC_RELEASE);
+}
+
+static inline void
+state_store_int(
+  int32_t * field_ptr,
+  int32_t value)
+{
+  __atomic_store_n(field_ptr, value, __ATOMIC_RELEASE);
+}
+
+static inline void
+state_store_bool(
+  uint32_t * field_ptr,
+  bool value)
+{
+  __atomic_store_n(field_ptr, value ? 1 : 0, __ATOMIC_RELEASE);
+}
+
+static inline void
+state_store_mask_bit(
+  uint32_t * mask,
+  unsigned int index,
+  bool value)
+{
+  if (value)
+  {
+    __atomic_fetch_or(&mask[index / 32], 1U << (index % 32), __ATOMIC_RELEASE);
+  }
+  else
+  {
+    __atomic_fetch_and(&mask[index / 32], ~(1U << (index % 32)), __ATOMIC_RELEASE);
+  }
+}
+
+static inline float
+state_load_float(
+  const float * field_ptr)
+{
+  float value;
+
+  __atomic_load(field_ptr, &value, __ATOMIC_ACQUIRE);
+  return value;
+}
+
+static inline bool
+state_load_mask_bit(
+  const uint32_t * mask,
+  unsigned int index)
+{
+  return (__atomic_load_n(&mask[index / 32], __ATOMIC_ACQUIRE) & (1U << (index % 32))) != 0;
+}
+
+#endif /* #ifndef STATE_H__5C0B7E4A_2D61_4C3B_9E0F_7A1D8B52C6E3__INCLUDED */
@@ -0,0 +1,379 @@
+/* -*- Mode: C ; c-basic-offset: 2 -*- */
+/*****************************************************************************
+ *
+ *   This file is part of jack_mixer
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+//#define LOG_LEVEL LOG_LEVEL_DEBUG
+#include "log.h"
+#include "workers.h"
+
+#define WORKERS_SPIN 20000      /* polls for a new batch before an idle worker sleeps */
+#define WORKERS_CLOSED 0xFFFFFFFFu /* next job index of a slot between batches */
+
+/* Batch of a slot. claim is batch sequence number in high half, index of
+ * next job to take in low half. Batch fields are written while claim is
+ * closed and published with it; a job is taken by advancing claim with
+ * compare and swap, which fails if the batch was closed meanwhile. The
+ * owner closes the batch once remaining drops to zero, all jobs are taken
+ * then. */
+struct workers_slot
+{
+  uint64_t claim;
+  void (* run)(void * context, unsigned int index);
+  void * context;
+  unsigned int count;
+  unsigned int remaining;       /* jobs not finished */
+  bool in_use;                  /* under mutex */
+} __attribute__((aligned(64)));
+
+struct workers
+{
+  pthread_mutex_t mutex;        /* serializes thread and slot changes */
+  pthread_t threads[WORKERS_THREADS_MAX];
+  unsigned int threads_count;
+  unsigned int active;          /* threads_count, for the process callbacks */
+  bool stop;
+  bool pin;
+  int priority;                 /* highest of attached mixers, -1 if none is real-time */
+  uint32_t generation;          /* futex, advanced when a batch is published */
+  unsigned int sleepers;
+  struct workers_slot slots[WORKERS_SLOTS_MAX];
+};
+
+static struct workers g_workers =
+{
+  .mutex = PTHREAD_MUTEX_INITIALIZER,
+  .priority = -1,
+};
+
+static inline void
+workers_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#endif
+}
+
+static void
+workers_wake(void)
+{
+  __atomic_add_fetch(&g_workers.generation, 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&g_workers.sleepers, __ATOMIC_SEQ_CST) > 0)
+  {
+    syscall(SYS_futex, &g_workers.generation, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+  }
+}
+
+/* take next job of slot batch, false if there is none */
+static bool
+workers_claim(
+  struct workers_slot * slot_ptr,
+  void (** run_ptr)(void * context, unsigned int index),
+  void ** context_ptr,
+  unsigned int * index_ptr)
+{
+  uint64_t claim;
+  uint32_t next;
+
+  claim = __atomic_load_n(&slot_ptr->claim, __ATOMIC_ACQUIRE);
+  do
+  {
+    next = (uint32_t)claim;
+    if (next == WORKERS_CLOSED ||
+        next >= __atomic_load_n(&slot_ptr->count, __ATOMIC_RELAXED))
+    {
+      return false;
+    }
+
+    *run_ptr = __atomic_load_n(&slot_ptr->run, __ATOMIC_RELAXED);
+    *context_ptr = __atomic_load_n(&slot_ptr->context, __ATOMIC_RELAXED);
+  }
+  while (!__atomic_compare_exchange_n(&slot_ptr->claim, &claim, claim + 1, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+  *index_ptr = next;
+  return true;
+}
+
+static void
+workers_apply_priority(
+  pthread_t thread)
+{
+  struct sched_param param;
+  int ret;
+
+  if (g_workers.priority < 0)
+  {
+    return;
+  }
+
+  memset(&param, 0, sizeof(param));
+  param.sched_priority = g_workers.priority;
+  ret = pthread_setschedparam(thread, SCHED_FIFO, &param);
+  if (ret != 0)
+  {
+    LOG_WARNING("Cannot set real-time priority %d of worker thread: %s", g_workers.priority, strerror(ret));
+  }
+}
+
+static void *
+workers_thread(
+  void * arg)
+{
+  unsigned int start = (uintptr_t)arg % WORKERS_SLOTS_MAX;
+  unsigned int i;
+  unsigned int spin;
+  uint32_t generation;
+  struct workers_slot * slot_ptr;
+  void (* run)(void * context, unsigned int index);
+  void * context;
+  unsigned int index;
+  bool found;
+
+  while (!__atomic_load_n(&g_workers.stop, __ATOMIC_ACQUIRE))
+  {
+    generation = __atomic_load_n(&g_workers.generation, __ATOMIC_SEQ_CST);
+
+    /* one job, then next slot, so busy mixers share workers */
+    found = false;
+    for (i = 0; i < WORKERS_SLOTS_MAX && !found; i++)
+    {
+      slot_ptr = g_workers.slots + (start + i) % WORKERS_SLOTS_MAX;
+      if (workers_claim(slot_ptr, &run, &context, &index))
+      {
+        run(context, index);
+        __atomic_sub_fetch(&slot_ptr->remaining, 1, __ATOMIC_RELEASE);
+        start = (start + i + 1) % WORKERS_SLOTS_MAX;
+        found = true;
+      }
+    }
+
+    if (found)
+    {
+      continue;
+    }
+
+    /* batches come in bursts, a few per cycle */
+    for (spin = 0; spin < WORKERS_SPIN; spin++)
+    {
+      if (__atomic_load_n(&g_workers.generation, __ATOMIC_RELAXED) != generation)
+      {
+        break;
+      }
+      workers_relax();
+    }
+
+    if (spin == WORKERS_SPIN)
+    {
+      __atomic_add_fetch(&g_workers.sleepers, 1, __ATOMIC_SEQ_CST);
+      if (!__atomic_load_n(&g_workers.stop, __ATOMIC_ACQUIRE))
+      {
+        syscall(SYS_futex, &g_workers.generation, FUTEX_WAIT_PRIVATE, generation, NULL, NULL, 0);
+      }
+      __atomic_sub_fetch(&g_workers.sleepers, 1, __ATOMIC_SEQ_CST);
+    }
+  }
+
+  return NULL;
+}
+
+static void
+workers_stop_threads(void)
+{
+  unsigned int i;
+
+  __atomic_store_n(&g_workers.active, 0, __ATOMIC_RELEASE);
+  __atomic_store_n(&g_workers.stop, true, __ATOMIC_RELEASE);
+  workers_wake();
+
+  for (i = 0; i < g_workers.threads_count; i++)
+  {
+    pthread_join(g_workers.threads[i], NULL);
+  }
+
+  g_workers.threads_count = 0;
+  g_workers.stop = false;
+}
+
+bool
+workers_set_threads(
+  unsigned int count,
+  bool pin)
+{
+  long cpus;
+  cpu_set_t cpu_set;
+  bool ret;
+
+  if (count > WORKERS_THREADS_MAX)
+  {
+    LOG_ERROR("Cannot have more than %u worker threads", WORKERS_THREADS_MAX);
+    return false;
+  }
+
+  pthread_mutex_lock(&g_workers.mutex);
+
+  workers_stop_threads();
+
+  g_workers.pin = pin;
+  cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  ret = true;
+
+  while (g_workers.threads_count < count)
+  {
+    if (pthread_create(g_workers.threads + g_workers.threads_count, NULL, workers_thread, (void *)(uintptr_t)g_workers.threads_count) != 0)
+    {
+      LOG_ERROR("Cannot start worker thread");
+      ret = false;
+      break;
+    }
+
+    workers_apply_priority(g_workers.threads[g_workers.threads_count]);
+
+    if (pin && cpus > 1)
+    {
+      CPU_ZERO(&cpu_set);
+      CPU_SET((g_workers.threads_count + 1) % cpus, &cpu_set);
+      if (pthread_setaffinity_np(g_workers.threads[g_workers.threads_count], sizeof(cpu_set), &cpu_set) != 0)
+      {
+        LOG_WARNING("Cannot pin worker thread to CPU %u", (unsigned int)((g_workers.threads_count + 1) % cpus));
+      }
+    }
+
+    g_workers.threads_count++;
+  }
+
+  __atomic_store_n(&g_workers.active, g_workers.threads_count, __ATOMIC_RELEASE);
+
+  pthread_mutex_unlock(&g_workers.mutex);
+
+  return ret;
+}
+
+unsigned int
+workers_get_threads(void)
+{
+  return __atomic_load_n(&g_workers.active, __ATOMIC_ACQUIRE);
+}
+
+struct workers_slot *
+workers_attach(
+  int priority)
+{
+  struct workers_slot * slot_ptr;
+  unsigned int i;
+
+  pthread_mutex_lock(&g_workers.mutex);
+
+  slot_ptr = NULL;
+  for (i = 0; i < WORKERS_SLOTS_MAX; i++)
+  {
+    if (!g_workers.slots[i].in_use)
+    {
+      slot_ptr = g_workers.slots + i;
+      slot_ptr->in_use = true;
+      __atomic_store_n(&slot_ptr->claim, (slot_ptr->claim & ~(uint64_t)UINT32_MAX) | WORKERS_CLOSED, __ATOMIC_RELEASE);
+      break;
+    }
+  }
+
+  if (priority > g_workers.priority)
+  {
+    g_workers.priority = priority;
+    for (i = 0; i < g_workers.threads_count; i++)
+    {
+      workers_apply_priority(g_workers.threads[i]);
+    }
+  }
+
+  pthread_mutex_unlock(&g_workers.mutex);
+
+  if (slot_ptr == NULL)
+  {
+    LOG_WARNING("All %u worker pool slots are in use, mixer will not use workers", WORKERS_SLOTS_MAX);
+  }
+
+  return slot_ptr;
+}
+
+void
+workers_detach(
+  struct workers_slot * slot_ptr)
+{
+  pthread_mutex_lock(&g_workers.mutex);
+  slot_ptr->in_use = false;
+  pthread_mutex_unlock(&g_workers.mutex);
+}
+
+bool
+workers_active(void)
+{
+  return __atomic_load_n(&g_workers.active, __ATOMIC_RELAXED) > 0;
+}
+
+void
+workers_run(
+  struct workers_slot * slot_ptr,
+  void (* run)(void * context, unsigned int index),
+  void * context,
+  unsigned int count)
+{
+  uint64_t sequence;
+  unsigned int index;
+
+  if (count == 0)
+  {
+    return;
+  }
+
+  /* batch is closed, nobody reads the fields now */
+  sequence = (__atomic_load_n(&slot_ptr->claim, __ATOMIC_RELAXED) >> 32) + 1;
+  __atomic_store_n(&slot_ptr->run, run, __ATOMIC_RELAXED);
+  __atomic_store_n(&slot_ptr->context, context, __ATOMIC_RELAXED);
+  __atomic_store_n(&slot_ptr->count, count, __ATOMIC_RELAXED);
+  __atomic_store_n(&slot_ptr->remaining, count, __ATOMIC_RELAXED);
+  __atomic_store_n(&slot_ptr->claim, sequence << 32, __ATOMIC_RELEASE);
+
+  if (count > 1)
+  {
+    workers_wake();
+  }
+
+  while (workers_claim(slot_ptr, &run, &context, &index))
+  {
+    run(context, index);
+    __atomic_sub_fetch(&slot_ptr->remaining, 1, __ATOMIC_RELEASE);
+  }
+
+  /* jobs taken by workers are running */
+  while (__atomic_load_n(&slot_ptr->remaining, __ATOMIC_ACQUIRE) > 0)
+  {
+    workers_relax();
+  }
+
+  __atomic_store_n(&slot_ptr->claim, (sequence << 32) | WORKERS_CLOSED, __ATOMIC_RELEASE);
+}
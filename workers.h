@@ -0,0 +1,77 @@
+/* -*- Mode: C ; c-basic-offset: 2 -*- */
+/*****************************************************************************
+ *
+ *   This file is part of jack_mixer
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ *****************************************************************************/
+
+#ifndef WORKERS_H__A4D27E63_1B9F_4C85_8E3A_5F60C9B21D74__INCLUDED
+#define WORKERS_H__A4D27E63_1B9F_4C85_8E3A_5F60C9B21D74__INCLUDED
+
+#include <stdbool.h>
+
+/*
+ * Process wide pool of worker threads, shared by all mixers of the
+ * process. A process callback hands out a batch of independent jobs through
+ * its slot and runs them too; idle workers take jobs from the batches of
+ * all slots in turn, one job at a time, so a mixer with many channels does
+ * not hold up the others. Jobs are claimed without locks and the process
+ * callback never waits for a worker to start, only for jobs already taken
+ * to finish.
+ */
+
+#define WORKERS_SLOTS_MAX 16    /* mixers using the pool at the same time */
+#define WORKERS_THREADS_MAX 64
+
+struct workers_slot;
+
+/* will sleep; stops or starts threads to have count of them, 0 stops all.
+ * With pin, thread n is bound to CPU n + 1, CPU 0 is left to JACK. */
+bool
+workers_set_threads(
+  unsigned int count,
+  bool pin);
+
+unsigned int
+workers_get_threads(void);
+
+/* will sleep; slot for a mixer, its process callback runs with given
+ * real-time priority (-1 if not real-time, workers are raised to the
+ * highest one). NULL if all slots are in use. */
+struct workers_slot *
+workers_attach(
+  int priority);
+
+/* will sleep, process callback must not use the slot anymore */
+void
+workers_detach(
+  struct workers_slot * slot_ptr);
+
+/* will not sleep; true when there are threads to share jobs with */
+bool
+workers_active(void);
+
+/* will not sleep, to be called from the process callback only; runs
+ * run(context, index) for index 0 to count - 1, some on this thread, and
+ * returns once all are done. Jobs must not depend on each other. */
+void
+workers_run(
+  struct workers_slot * slot_ptr,
+  void (* run)(void * context, unsigned int index),
+  void * context,
+  unsigned int count);
+
+#endif /* #ifndef WORKERS_H__A4D27E63_1B9F_4C85_8E3A_5F60C9B21D74__INCLUDED */